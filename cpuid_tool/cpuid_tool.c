@@ -51,13 +51,25 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <inttypes.h>
+#ifdef _WIN32
+#  include <direct.h>
+#  define mkdir(path) _mkdir(path)
+#else
+#  include <sys/stat.h>
+#  define mkdir(path) mkdir(path, 0777)
+#endif
 #include "libcpuid.h"
 
 /* Globals: */
 #define RAW_DATA_FILE_MAX 256
 #define OUT_FILE_MAX 256
 char raw_data_file[RAW_DATA_FILE_MAX] = "";
+char save_data_file[RAW_DATA_FILE_MAX] = "";
 char out_file[OUT_FILE_MAX] = "";
+char archive_file[RAW_DATA_FILE_MAX] = "";
+char** pack_files = NULL;
+int num_pack_files = 0;
 typedef enum {
 	NEED_CPUID_PRESENT,
 	NEED_ARCHITECTURE,
@@ -113,8 +125,14 @@ typedef enum {
 
 int need_input = 0,
     need_output = 0,
+    need_binary = 0,
+    need_delta = 0,
+    need_pack = 0,
+    need_unpack = 0,
     need_quiet = 0,
+    num_threads = 1,
     need_report = 0,
+    need_json = 0,
     need_clockreport = 0,
     need_timed_clockreport = 0,
     verbose_level = 0,
@@ -122,6 +140,7 @@ int need_input = 0,
     need_cpulist = 0,
     need_sgx = 0,
     need_hypervisor = 0,
+    need_cpuid_stats = 0,
     need_identify = 0;
 
 #define MAX_REQUESTS 64
@@ -196,14 +215,24 @@ static void usage(void)
 	printf("Usage: cpuid_tool [options]\n\n");
 	printf("Options:\n");
 	printf("  -h, --help       - Show this help\n");
-	printf("  --load=<file>    - Load raw CPUID data from file\n");
-	printf("  --save=<file>    - Acquire raw CPUID data and write it to file\n");
+	printf("  --load=<file>    - Load raw CPUID data from file (may be compressed with xz, gzip or zstd)\n");
+	printf("  --threads=<n>    - in conjunction to --load: parse large raw dumps with n threads (0: one per CPU)\n");
+	printf("  --save=<file>    - Acquire (or load) raw CPUID data and write it to file\n");
+	printf("  --binary         - in conjunction to --save: write the binary format\n");
+	printf("  --delta          - in conjunction to --save: write only the differences between logical CPUs\n");
+	printf("  --pack=<archive> <files...>\n");
+	printf("                   - Add raw CPUID dumps to an archive (created if needed), under their path\n");
+	printf("  --unpack=<archive>\n");
+	printf("                   - Write each raw CPUID dump of an archive to its (relative) path\n");
 	printf("  --report, --all  - Report all decoded CPU info (w/o clock)\n");
+	printf("  --json           - Report all decoded CPU info in JSON\n");
+	printf("  --ndjson         - same as --json, on a single line\n");
 	printf("  --clock          - in conjunction to --report: print CPU clock as well\n");
 	printf("  --clock-rdtsc    - same as --clock, but use RDTSC for clock detection\n");
 	printf("  --cpulist        - list all known CPUs\n");
 	printf("  --sgx            - list SGX leaf data, if SGX is supported.\n");
 	printf("  --hypervisor     - print hypervisor vendor if detected.\n");
+	printf("  --cpuid-stats    - print the number of CPUID instructions executed per leaf.\n");
 	printf("  --quiet          - disable warnings\n");
 	printf("  --outfile=<file> - redirect all output to this file, instead of stdout\n");
 	printf("  --verbose, -v    - be extra verbose (more keys increase verbosiness level)\n");
@@ -241,7 +270,7 @@ static int parse_cmdline(int argc, char** argv)
 	if (argc == 1) {
 		/* Default command line options */
 		need_output = 1;
-		strncpy(raw_data_file, "raw.txt", RAW_DATA_FILE_MAX);
+		strncpy(save_data_file, "raw.txt", RAW_DATA_FILE_MAX);
 		strncpy(out_file, "report.txt", OUT_FILE_MAX);
 		need_report = 1;
 		verbose_level = 1;
@@ -258,9 +287,6 @@ static int parse_cmdline(int argc, char** argv)
 			if (need_input) {
 				xerror("Too many `--load' options!");
 			}
-			if (need_output) {
-				xerror("Cannot have both `--load' and `--save' options!");
-			}
 			if (strlen(arg) <= 7) {
 				xerror("--load: bad file specification!");
 			}
@@ -268,18 +294,52 @@ static int parse_cmdline(int argc, char** argv)
 			strncpy(raw_data_file, arg + 7, RAW_DATA_FILE_MAX);
 			recog = 1;
 		}
+		if (!strncmp(arg, "--threads=", 10)) {
+			if (sscanf(arg + 10, "%d", &num_threads) != 1) {
+				xerror("--threads: bad number of threads!");
+			}
+			recog = 1;
+		}
 		if (!strncmp(arg, "--save=", 7)) {
 			if (need_output) {
 				xerror("Too many `--save' options!");
 			}
-			if (need_input) {
-				xerror("Cannot have both `--load' and `--save' options!");
-			}
 			if (strlen(arg) <= 7) {
 				xerror("--save: bad file specification!");
 			}
 			need_output = 1;
-			strncpy(raw_data_file, arg + 7, RAW_DATA_FILE_MAX);
+			strncpy(save_data_file, arg + 7, RAW_DATA_FILE_MAX);
+			recog = 1;
+		}
+		if (!strcmp(arg, "--binary")) {
+			need_binary = 1;
+			recog = 1;
+		}
+		if (!strcmp(arg, "--delta")) {
+			need_delta = 1;
+			recog = 1;
+		}
+		if (!strncmp(arg, "--pack=", 7) || !strncmp(arg, "--unpack=", 9)) {
+			if (need_pack || need_unpack) {
+				xerror("Too many `--pack' or `--unpack' options!");
+			}
+			if (strlen(strchr(arg, '=')) <= 1) {
+				xerror("--pack/--unpack: bad archive specification!");
+			}
+			if (arg[2] == 'p')
+				need_pack = 1;
+			else
+				need_unpack = 1;
+			strncpy(archive_file, strchr(arg, '=') + 1, RAW_DATA_FILE_MAX);
+			recog = 1;
+		}
+		if (arg[0] != '-') {
+			if (pack_files == NULL)
+				pack_files = (char**) malloc(argc * sizeof(char*));
+			if (pack_files == NULL) {
+				xerror("Out of memory!");
+			}
+			pack_files[num_pack_files++] = arg;
 			recog = 1;
 		}
 		if (!strncmp(arg, "--outfile=", 10)) {
@@ -293,6 +353,10 @@ static int parse_cmdline(int argc, char** argv)
 			need_report = 1;
 			recog = 1;
 		}
+		if (!strcmp(arg, "--json") || !strcmp(arg, "--ndjson")) {
+			need_json = !strcmp(arg, "--json") ? CPUID_JSON_PRETTY : -1;
+			recog = 1;
+		}
 		if (!strcmp(arg, "--clock")) {
 			need_clockreport = 1;
 			recog = 1;
@@ -328,6 +392,10 @@ static int parse_cmdline(int argc, char** argv)
 			need_identify = 1;
 			recog = 1;
 		}
+		if (!strcmp(arg, "--cpuid-stats")) {
+			need_cpuid_stats = 1;
+			recog = 1;
+		}
 		if (arg[0] == '-' && arg[1] == 'v') {
 			num_vs = 1;
 			while (arg[num_vs] == 'v')
@@ -353,6 +421,9 @@ static int parse_cmdline(int argc, char** argv)
 			return -1;
 		}
 	}
+	if ((num_pack_files > 0) && !need_pack) {
+		xerror("Raw dumps can be given only to `--pack'!");
+	}
 	return 1;
 }
 
@@ -361,11 +432,115 @@ static void close_out(void)
 	fclose(fout);
 }
 
+static int save_raw_data(struct cpu_raw_data_array_t* raw_array, const char* filename)
+{
+	if (need_binary)
+		return cpuid_serialize_all_raw_data_binary(raw_array, filename);
+	if (need_delta)
+		return cpuid_serialize_all_raw_data_delta(raw_array, filename);
+	return cpuid_serialize_all_raw_data(raw_array, filename);
+}
+
+/* Adds the raw dumps given on the command line to the archive, under their path */
+static int pack_archive(void)
+{
+	int i, r, errors = 0;
+	FILE *f;
+	struct cpu_raw_data_archive_t archive;
+	struct cpu_raw_data_array_t raw_array;
+
+	/* Append to the archive if it exists */
+	if ((f = fopen(archive_file, "rb")) != NULL)
+		fclose(f);
+	if (cpuid_open_raw_data_archive(&archive, f ? archive_file : NULL) < 0) {
+		if (!need_quiet)
+			fprintf(stderr, "Cannot open archive `%s'\nError: %s\n", archive_file, cpuid_error());
+		return -1;
+	}
+	for (i = 0; i < num_pack_files; i++) {
+		r = cpuid_deserialize_all_raw_data(&raw_array, pack_files[i]);
+		if (r >= 0) {
+			r = cpuid_add_to_raw_data_archive(&archive, pack_files[i], &raw_array);
+			cpuid_free_raw_data_array(&raw_array);
+		}
+		if (r < 0) {
+			if (!need_quiet)
+				fprintf(stderr, "Cannot add `%s' to the archive\nError: %s\n", pack_files[i], cpuid_error());
+			errors++;
+		}
+	}
+	if (verbose_level >= 1)
+		printf("Writing %u raw CPUID dumps to `%s'\n", archive.num_entries, archive_file);
+	if (cpuid_save_raw_data_archive(&archive, archive_file) < 0) {
+		if (!need_quiet)
+			fprintf(stderr, "Cannot write archive `%s'\nError: %s\n", archive_file, cpuid_error());
+		errors++;
+	}
+	cpuid_close_raw_data_archive(&archive);
+	return (errors > 0) ? -1 : 0;
+}
+
+/* Creates the missing parent directories of path */
+static void make_parent_dirs(char* path)
+{
+	char *p;
+
+	for (p = strchr(path + 1, '/'); p != NULL; p = strchr(p + 1, '/')) {
+		*p = '\0';
+		mkdir(path);
+		*p = '/';
+	}
+}
+
+/* Writes each raw dump of the archive to the path it was packed from */
+static int unpack_archive(void)
+{
+	int errors = 0;
+	uint32_t i;
+	const char* key;
+	char path[RAW_DATA_FILE_MAX];
+	struct cpu_raw_data_archive_t archive;
+	struct cpu_raw_data_array_t raw_array;
+
+	if (cpuid_open_raw_data_archive(&archive, archive_file) < 0) {
+		if (!need_quiet)
+			fprintf(stderr, "Cannot open archive `%s'\nError: %s\n", archive_file, cpuid_error());
+		return -1;
+	}
+	for (i = 0; i < archive.num_entries; i++) {
+		if (cpuid_get_archived_raw_data(&archive, i, &key, &raw_array) < 0) {
+			if (!need_quiet)
+				fprintf(stderr, "Cannot read entry %u of the archive\nError: %s\n", i, cpuid_error());
+			errors++;
+			continue;
+		}
+		/* Never write outside of the current directory */
+		if ((key[0] == '\0') || (key[0] == '/') || (key[0] == '\\') || strchr(key, ':') || strstr(key, "..") || (strlen(key) >= RAW_DATA_FILE_MAX)) {
+			if (!need_quiet)
+				fprintf(stderr, "Skipping entry `%s': not a relative path\n", key);
+			errors++;
+		} else {
+			strcpy(path, key);
+			make_parent_dirs(path);
+			if (verbose_level >= 1)
+				printf("Writing raw CPUID dump `%s'\n", path);
+			if (save_raw_data(&raw_array, path) < 0) {
+				if (!need_quiet)
+					fprintf(stderr, "Cannot write `%s'\nError: %s\n", path, cpuid_error());
+				errors++;
+			}
+		}
+		cpuid_free_raw_data_array(&raw_array);
+	}
+	cpuid_close_raw_data_archive(&archive);
+	return (errors > 0) ? -1 : 0;
+}
+
 static int check_need_raw_data(void)
 {
 	int i, j;
 
-	if (need_output || need_report || need_identify) return 1;
+	if (need_output || need_report || need_json || need_identify || need_cpuid_stats) return 1;
 	for (i = 0; i < num_requests; i++) {
 		for (j = 0; j < sz_match; j++)
 			if (requests[i] == matchtable[j].sw &&
@@ -672,6 +847,31 @@ static void print_hypervisor(struct cpu_raw_data_t* raw, struct cpu_id_t* data)
 		              "Refer to https://github.com/anrieff/libcpuid/issues/90#issuecomment-296568713\n");
 }
 
+static void print_cpuid_stats(void)
+{
+	int i, num_stats;
+	uint64_t total_count = 0, total_tsc_ticks = 0;
+	struct cpuid_leaf_stats_t* stats;
+
+	num_stats = cpuid_get_leaf_stats(NULL, 0);
+	stats = (struct cpuid_leaf_stats_t*) malloc(sizeof(struct cpuid_leaf_stats_t) * (num_stats > 0 ? num_stats : 1));
+	if (!stats) {
+		fprintf(stderr, "Cannot allocate memory for CPUID statistics\n");
+		return;
+	}
+	num_stats = cpuid_get_leaf_stats(stats, num_stats);
+	fprintf(fout, "CPUID statistics:\n");
+	fprintf(fout, "  %-10s  %10s  %14s  %10s\n", "leaf", "count", "TSC ticks", "average");
+	for (i = 0; i < num_stats; i++) {
+		fprintf(fout, "  0x%08" PRIx32 "  %10" PRIu64 "  %14" PRIu64 "  %10" PRIu64 "\n", stats[i].leaf,
+			stats[i].count, stats[i].tsc_ticks, stats[i].tsc_ticks / stats[i].count);
+		total_count     += stats[i].count;
+		total_tsc_ticks += stats[i].tsc_ticks;
+	}
+	fprintf(fout, "  %-10s  %10" PRIu64 "  %14" PRIu64 "\n", "total", total_count, total_tsc_ticks);
+	free(stats);
+}
+
 int main(int argc, char** argv)
 {
 	int parseres = parse_cmdline(argc, argv);
@@ -686,6 +886,7 @@ int main(int argc, char** argv)
 	struct system_id_t data = {
 		.num_cpu_types = 0
 	};
+	struct cpuid_buffer_t json = { NULL, 0, 0 };
 
 	if (parseres != 1)
 		return parseres;
@@ -713,14 +914,22 @@ int main(int argc, char** argv)
 	if (need_version)
 		fprintf(fout, "%s\n", cpuid_lib_version());
 
+	if (need_cpuid_stats)
+		cpuid_enable_leaf_stats(true);
+
+	if (need_pack)
+		return pack_archive();
+	if (need_unpack)
+		return unpack_archive();
+
 	if (need_input) {
 		/* We have a request to input raw CPUID data from file: */
 		if (!strcmp(raw_data_file, "-"))
 			/* Input from stdin */
-			readres = cpuid_deserialize_all_raw_data(&raw_array, "");
+			readres = cpuid_deserialize_all_raw_data_parallel(&raw_array, "", num_threads);
 		else
 			/* Input from file */
-			readres = cpuid_deserialize_all_raw_data(&raw_array, raw_data_file);
+			readres = cpuid_deserialize_all_raw_data_parallel(&raw_array, raw_data_file, num_threads);
 		if (readres < 0) {
 			if (!need_quiet) {
 				fprintf(stderr, "Cannot deserialize raw data from ");
@@ -735,7 +944,8 @@ int main(int argc, char** argv)
 		}
 	} else {
 		if (check_need_raw_data()) {
-			/* Try to obtain raw CPUID data from the CPU: */
+			/* Try to obtain raw CPUID data from the CPU, through the cpuid driver if it can be loaded: */
+			cpuid_load_driver();
 			readres = cpuid_get_all_raw_data(&raw_array);
 			if (readres < 0) {
 				if (!need_quiet) {
@@ -749,19 +959,19 @@ int main(int argc, char** argv)
 
 	/* Need to dump raw CPUID data to file: */
 	if (need_output) {
-		if (!strcmp(raw_data_file, "-"))
+		if (!strcmp(save_data_file, "-"))
 			/* Serialize to stdout */
-			writeres = cpuid_serialize_all_raw_data(&raw_array, "");
+			writeres = save_raw_data(&raw_array, "");
 		else
 			/* Serialize to file */
-			writeres = cpuid_serialize_all_raw_data(&raw_array, raw_data_file);
+			writeres = save_raw_data(&raw_array, save_data_file);
 		if (writeres < 0) {
 			if (!need_quiet) {
 				fprintf(stderr, "Cannot serialize raw data to ");
-				if (!strcmp(raw_data_file, "-"))
+				if (!strcmp(save_data_file, "-"))
 					fprintf(stderr, "stdout\n");
 				else
-					fprintf(stderr, "file `%s'\n", raw_data_file);
+					fprintf(stderr, "file `%s'\n", save_data_file);
 				/* Print the error message */
 				fprintf(stderr, "Error: %s\n", cpuid_error());
 			}
@@ -859,6 +1069,21 @@ int main(int argc, char** argv)
 			}
 		}
 	}
+	if (need_json) {
+		/* The report identified the CPU already */
+		if (!need_report && (cpu_identify_all(&raw_array, &data) < 0)) {
+			if (!need_quiet)
+				fprintf(stderr, "Error identifying the CPU: %s\n", cpuid_error());
+			return -1;
+		}
+		if (cpuid_serialize_system_id_json_buffer(&data, &json, (need_json > 0) ? CPUID_JSON_PRETTY : 0) < 0) {
+			if (!need_quiet)
+				fprintf(stderr, "Cannot write JSON: %s\n", cpuid_error());
+			return -1;
+		}
+		fwrite(json.data, 1, json.size, fout);
+		cpuid_free_buffer(&json);
+	}
 	/*
 	 * Check if we have any queries to process.
 	 * We have to handle the case when `--clock' or `--clock-rdtsc' options
@@ -904,6 +1129,9 @@ int main(int argc, char** argv)
 	if (need_hypervisor) {
 		print_hypervisor(&raw_array.raw[0], &data.cpu_types[0]);
 	}
+	if (need_cpuid_stats) {
+		print_cpuid_stats();
+	}
 
 	cpuid_free_raw_data_array(&raw_array);
 	cpuid_free_system_id(&data);
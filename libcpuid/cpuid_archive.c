@@ -0,0 +1,640 @@
+/*
+ * Copyright 2024  Veselin Georgiev,
+ * anrieffNOSPAM @ mgail_DOT.com (convert to gmail)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libcpuid.h"
+#include "libcpuid_util.h"
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+/* The raw data archive stores the raw CPUID data of many systems, each one under a key (e.g. its host name).
+   Its entries are sorted by key, so one of them is found with a binary search in the mapped file.
+   The logical CPUs with the same raw data (within a system or across systems) share their records,
+   which are in the format of the binary raw dumps.
+
+   Layout of the file (integers are little-endian, offsets are from the start of the file):
+   - header (ARCHIVE_HEADER_SIZE bytes):
+       0  magic                        10 header size (1 byte)       11 entry size (1 byte)
+       8  version (1 byte)             12 logical CPU size (1 byte)  13 record size (1 byte)
+       16 number of entries            20 number of logical CPUs     24 number of distinct CPUs
+       28 number of records            32 offset of the entries      36 offset of the logical CPUs
+       40 offset of the distinct CPUs  44 offset of the records      48 offset of the keys
+       52 size of the keys
+   - entries, sorted by key: key offset (in the keys), key length, flags, first logical CPU, number of logical CPUs
+   - logical CPUs: os_cpu, index of the distinct CPU
+   - distinct CPUs: index of their first record, they end where the next one starts
+   - records
+   - keys, each one followed by a NUL byte
+   The sizes in the header allow to add fields at the end of each item in later versions. */
+
+#define ARCHIVE_MAGIC         "\177LCPUAR\032"
+#define ARCHIVE_MAGIC_SIZE    8
+#define ARCHIVE_VERSION       1
+#define ARCHIVE_HEADER_SIZE   64
+#define ARCHIVE_ENTRY_SIZE    20
+#define ARCHIVE_CPU_SIZE      8
+#define ARCHIVE_DISTINCT_SIZE 4
+#define ARCHIVE_FLAG_AFFINITY 0x1 /* written from cpu_raw_data_array_t::with_affinity */
+
+enum _archive_section_t {
+	SECTION_ENTRIES,
+	SECTION_CPUS,
+	SECTION_DISTINCT,
+	SECTION_RECORDS,
+	SECTION_KEYS,
+	NUM_SECTIONS
+};
+
+static const uint32_t archive_item_sizes[NUM_SECTIONS] = {
+	ARCHIVE_ENTRY_SIZE, ARCHIVE_CPU_SIZE, ARCHIVE_DISTINCT_SIZE, BINARY_DUMP_RECORD_SIZE, 1
+};
+
+/* Open addressing hash table of item indexes, a slot contains the index + 1 (zero if the slot is free) */
+struct archive_htable_t {
+	uint32_t* slots;
+	uint32_t size; /* power of two */
+	uint32_t count;
+};
+
+struct archive_t {
+	/* the opened file, until the archive is modified */
+	struct mapped_file_t file;
+	bool is_writable;
+
+	/* the sections, in the file or in buffers */
+	const uint8_t* data[NUM_SECTIONS];
+	uint32_t item_size[NUM_SECTIONS];
+	uint32_t num_items[NUM_SECTIONS];
+	struct cpuid_buffer_t buffers[NUM_SECTIONS];
+
+	/* indexes of a writable archive */
+	struct archive_htable_t distinct_cpus; /* by hash of their records */
+	struct archive_htable_t keys;          /* entries, by hash of their key */
+	bool is_sorted;                        /* false when the last added entries are not sorted by key yet */
+};
+
+/* A key or the records of a logical CPU, looked up in the hash tables */
+struct archive_item_t {
+	const uint8_t* data;
+	uint32_t size;
+};
+
+typedef struct archive_item_t (*archive_item_fn)(const struct archive_t* archive, uint32_t index);
+
+/* FNV-1a */
+static uint32_t archive_hash(struct archive_item_t item)
+{
+	uint32_t i, hash = 2166136261U;
+
+	for (i = 0; i < item.size; i++)
+		hash = (hash ^ item.data[i]) * 16777619U;
+	return hash;
+}
+
+static const uint8_t* archive_get_item(const struct archive_t* archive, int section, uint32_t index)
+{
+	return archive->data[section] + (size_t) index * archive->item_size[section];
+}
+
+static struct archive_item_t archive_entry_key(const struct archive_t* archive, uint32_t entry)
+{
+	const uint8_t* item = archive_get_item(archive, SECTION_ENTRIES, entry);
+	struct archive_item_t key;
+
+	key.data = archive->data[SECTION_KEYS] + get_le32(item);
+	key.size = get_le32(item + 4);
+	return key;
+}
+
+/* Returns the index of the first record of a distinct CPU, and their number in num_records */
+static uint32_t archive_distinct_records(const struct archive_t* archive, uint32_t distinct, uint32_t* num_records)
+{
+	const uint32_t first = get_le32(archive_get_item(archive, SECTION_DISTINCT, distinct));
+	const uint32_t end   = (distinct + 1 < archive->num_items[SECTION_DISTINCT]) ?
+		get_le32(archive_get_item(archive, SECTION_DISTINCT, distinct + 1)) : archive->num_items[SECTION_RECORDS];
+
+	*num_records = end - first;
+	return first;
+}
+
+static struct archive_item_t archive_distinct_item(const struct archive_t* archive, uint32_t distinct)
+{
+	uint32_t num_records;
+	struct archive_item_t item;
+
+	item.data = archive_get_item(archive, SECTION_RECORDS, archive_distinct_records(archive, distinct, &num_records));
+	item.size = num_records * archive->item_size[SECTION_RECORDS];
+	return item;
+}
+
+static int archive_compare_items(struct archive_item_t a, struct archive_item_t b)
+{
+	const int r = memcmp(a.data, b.data, (a.size < b.size) ? a.size : b.size);
+	return (r != 0) ? r : (a.size > b.size) - (a.size < b.size);
+}
+
+/* Returns the slot of item, or the free slot where it can be inserted */
+static uint32_t* archive_htable_find(const struct archive_htable_t* table, const struct archive_t* archive, archive_item_fn get_item, struct archive_item_t item)
+{
+	uint32_t slot;
+	const uint32_t mask = table->size - 1;
+
+	for (slot = archive_hash(item) & mask; table->slots[slot] != 0; slot = (slot + 1) & mask)
+		if (!archive_compare_items(get_item(archive, table->slots[slot] - 1), item))
+			break;
+	return &table->slots[slot];
+}
+
+/* Fills the table with the count first items, its size is unchanged */
+static void archive_htable_fill(struct archive_htable_t* table, const struct archive_t* archive, archive_item_fn get_item, uint32_t count)
+{
+	uint32_t index;
+
+	memset(table->slots, 0, table->size * sizeof(uint32_t));
+	for (index = 0; index < count; index++)
+		*archive_htable_find(table, archive, get_item, get_item(archive, index)) = index + 1;
+	table->count = count;
+}
+
+/* Makes sure that one more item can be inserted, the table is kept at most half full */
+static bool archive_htable_reserve(struct archive_htable_t* table, const struct archive_t* archive, archive_item_fn get_item)
+{
+	uint32_t size;
+	uint32_t* slots;
+
+	if ((table->count + 1) * 2 <= table->size)
+		return true;
+	for (size = (table->size == 0) ? 1024 : table->size; (table->count + 1) * 2 > size; size *= 2);
+	if ((slots = cpuid_calloc(size, sizeof(uint32_t))) == NULL)
+		return false;
+	cpuid_free(table->slots);
+	table->slots = slots;
+	table->size  = size;
+	archive_htable_fill(table, archive, get_item, table->count);
+	return true;
+}
+
+/* Appends size bytes (zeroed) to a section of a writable archive, returns where they start (NULL if out of memory) */
+static uint8_t* archive_append(struct archive_t* archive, int section, size_t size)
+{
+	struct cpuid_buffer_t* buffer = &archive->buffers[section];
+	uint8_t* p;
+
+	if ((buffer->size + size > UINT32_MAX) || ((p = (uint8_t*) cpuid_buffer_reserve(buffer, size)) == NULL))
+		return NULL;
+	memset(p, 0, size);
+	buffer->size += size;
+	archive->data[section] = (const uint8_t*) buffer->data;
+	return p;
+}
+
+/* Copies the sections from the opened file to buffers, so the archive can be modified */
+static int archive_make_writable(struct archive_t* archive)
+{
+	int section;
+	uint32_t index;
+	uint8_t* copy;
+
+	if (archive->is_writable)
+		return ERR_OK;
+
+	/* Everything is allocated first, the archive stays usable if memory runs out */
+	archive->distinct_cpus.count = archive->num_items[SECTION_DISTINCT];
+	archive->keys.count          = archive->num_items[SECTION_ENTRIES];
+	if (!archive_htable_reserve(&archive->distinct_cpus, archive, archive_distinct_item) ||
+	    !archive_htable_reserve(&archive->keys, archive, archive_entry_key))
+		return ERR_NO_MEM;
+	for (section = 0; section < NUM_SECTIONS; section++)
+		if (cpuid_buffer_reserve(&archive->buffers[section], (size_t) archive->num_items[section] * archive_item_sizes[section]) == NULL)
+			return ERR_NO_MEM;
+
+	for (section = 0; section < NUM_SECTIONS; section++) {
+		copy = (uint8_t*) archive->buffers[section].data;
+		for (index = 0; index < archive->num_items[section]; index++)
+			memcpy(copy + (size_t) index * archive_item_sizes[section], archive_get_item(archive, section, index), archive_item_sizes[section]);
+		archive->buffers[section].size = (size_t) archive->num_items[section] * archive_item_sizes[section];
+		archive->data[section]         = (const uint8_t*) copy;
+		archive->item_size[section]    = archive_item_sizes[section];
+	}
+	unmap_file(&archive->file);
+	archive->is_writable = true;
+
+	/* The records of a newer version may be larger, they are hashed again */
+	archive_htable_fill(&archive->distinct_cpus, archive, archive_distinct_item, archive->num_items[SECTION_DISTINCT]);
+	archive_htable_fill(&archive->keys, archive, archive_entry_key, archive->num_items[SECTION_ENTRIES]);
+	return ERR_OK;
+}
+
+static void archive_swap_entries(struct archive_t* archive, uint32_t a, uint32_t b)
+{
+	uint8_t tmp[ARCHIVE_ENTRY_SIZE];
+	uint8_t* entries = (uint8_t*) archive->buffers[SECTION_ENTRIES].data;
+
+	memcpy(tmp, entries + a * ARCHIVE_ENTRY_SIZE, ARCHIVE_ENTRY_SIZE);
+	memcpy(entries + a * ARCHIVE_ENTRY_SIZE, entries + b * ARCHIVE_ENTRY_SIZE, ARCHIVE_ENTRY_SIZE);
+	memcpy(entries + b * ARCHIVE_ENTRY_SIZE, tmp, ARCHIVE_ENTRY_SIZE);
+}
+
+static void archive_sift_down(struct archive_t* archive, uint32_t root, uint32_t count)
+{
+	uint32_t child;
+
+	while ((child = 2 * root + 1) < count) {
+		if ((child + 1 < count) && (archive_compare_items(archive_entry_key(archive, child), archive_entry_key(archive, child + 1)) < 0))
+			child++;
+		if (archive_compare_items(archive_entry_key(archive, root), archive_entry_key(archive, child)) >= 0)
+			return;
+		archive_swap_entries(archive, root, child);
+		root = child;
+	}
+}
+
+/* Sorts the entries by key after additions in another order (heap sort, the entries are moved in place) */
+static void archive_sort(struct archive_t* archive)
+{
+	uint32_t i;
+	const uint32_t count = archive->num_items[SECTION_ENTRIES];
+
+	if (archive->is_sorted)
+		return;
+	for (i = count / 2; i-- > 0;)
+		archive_sift_down(archive, i, count);
+	for (i = count; i-- > 1;) {
+		archive_swap_entries(archive, 0, i);
+		archive_sift_down(archive, 0, i);
+	}
+	archive_htable_fill(&archive->keys, archive, archive_entry_key, count);
+	archive->is_sorted = true;
+}
+
+/* Checks an archive file, so that it can be read without any further check */
+static bool archive_check(struct archive_t* archive)
+{
+	int section;
+	uint32_t index, os_cpu, first_cpu, num_cpus, distinct, first_record, previous_record = 0;
+	const uint8_t* image = (const uint8_t*) archive->file.data;
+	const size_t size    = archive->file.size;
+	const uint8_t* item;
+	struct archive_item_t key, previous_key = { NULL, 0 };
+
+	if ((size < ARCHIVE_HEADER_SIZE) || memcmp(image, ARCHIVE_MAGIC, ARCHIVE_MAGIC_SIZE))
+		return false;
+	if (image[8] != ARCHIVE_VERSION) {
+		warnf("Unsupported version %u of raw data archive (supported: %u)\n", image[8], ARCHIVE_VERSION);
+		return false;
+	}
+	if (image[10] < ARCHIVE_HEADER_SIZE)
+		return false;
+	for (section = 0; section < NUM_SECTIONS; section++) {
+		archive->item_size[section] = (section == SECTION_DISTINCT) ? ARCHIVE_DISTINCT_SIZE : (section == SECTION_KEYS) ? 1 : image[11 + section - (section > SECTION_DISTINCT)];
+		archive->num_items[section] = get_le32(image + 16 + 4 * section + ((section == SECTION_KEYS) ? 20 : 0));
+		if ((archive->item_size[section] < archive_item_sizes[section]) || (get_le32(image + 32 + 4 * section) > size) ||
+		    ((size - get_le32(image + 32 + 4 * section)) / archive->item_size[section] < archive->num_items[section]))
+			return false;
+		archive->data[section] = image + get_le32(image + 32 + 4 * section);
+	}
+	if ((archive->num_items[SECTION_ENTRIES] > 0) &&
+	    ((archive->num_items[SECTION_KEYS] == 0) || (archive->data[SECTION_KEYS][archive->num_items[SECTION_KEYS] - 1] != '\0')))
+		return false;
+
+	for (index = 0; index < archive->num_items[SECTION_ENTRIES]; index++) {
+		item      = archive_get_item(archive, SECTION_ENTRIES, index);
+		first_cpu = get_le32(item + 12);
+		num_cpus  = get_le32(item + 16);
+		if ((get_le32(item) >= archive->num_items[SECTION_KEYS]) || (get_le32(item + 4) > archive->num_items[SECTION_KEYS] - 1 - get_le32(item)) ||
+		    (first_cpu > archive->num_items[SECTION_CPUS]) || (num_cpus > archive->num_items[SECTION_CPUS] - first_cpu) || (num_cpus > UINT16_MAX))
+			return false;
+		key = archive_entry_key(archive, index);
+		if ((key.data[key.size] != '\0') || (memchr(key.data, '\0', key.size) != NULL) ||
+		    ((index > 0) && (archive_compare_items(previous_key, key) >= 0)))
+			return false;
+		previous_key = key;
+	}
+	for (index = 0; index < archive->num_items[SECTION_CPUS]; index++) {
+		item     = archive_get_item(archive, SECTION_CPUS, index);
+		os_cpu   = get_le32(item);
+		distinct = get_le32(item + 4);
+		if ((distinct >= archive->num_items[SECTION_DISTINCT]) || (os_cpu > UINT16_MAX))
+			return false;
+	}
+	for (index = 0; index < archive->num_items[SECTION_DISTINCT]; index++) {
+		first_record = get_le32(archive_get_item(archive, SECTION_DISTINCT, index));
+		if ((first_record < previous_record) || (first_record > archive->num_items[SECTION_RECORDS]))
+			return false;
+		previous_record = first_record;
+	}
+	return true;
+}
+
+static void archive_t_destructor(struct archive_t* archive)
+{
+	int section;
+
+	unmap_file(&archive->file);
+	for (section = 0; section < NUM_SECTIONS; section++)
+		cpuid_free_buffer(&archive->buffers[section]);
+	cpuid_free(archive->distinct_cpus.slots);
+	cpuid_free(archive->keys.slots);
+	cpuid_free(archive);
+}
+
+int cpuid_open_raw_data_archive(struct cpu_raw_data_archive_t* archive, const char* filename)
+{
+	int r, section;
+	struct archive_t* internal;
+
+	if (archive == NULL)
+		return cpuid_set_error(ERR_HANDLE);
+	archive->num_entries = 0;
+	archive->internal    = NULL;
+	if ((internal = (struct archive_t*) cpuid_calloc(1, sizeof(struct archive_t))) == NULL)
+		return cpuid_set_error(ERR_NO_MEM);
+	internal->is_sorted = true;
+
+	if (filename == NULL) {
+		for (section = 0; section < NUM_SECTIONS; section++)
+			internal->item_size[section] = archive_item_sizes[section];
+		internal->is_writable = true;
+		archive->internal     = internal;
+		return cpuid_set_error(ERR_OK);
+	}
+
+	if ((r = map_file(filename, &internal->file)) != ERR_OK) {
+		cpuid_free(internal);
+		return cpuid_set_error(r);
+	}
+	if (!archive_check(internal)) {
+		archive_t_destructor(internal);
+		return cpuid_set_error(ERR_BADFMT);
+	}
+	debugf(2, "Opened raw data archive '%s': %u entries, %u logical CPUs, %u distinct\n", filename,
+		internal->num_items[SECTION_ENTRIES], internal->num_items[SECTION_CPUS], internal->num_items[SECTION_DISTINCT]);
+	archive->num_entries = internal->num_items[SECTION_ENTRIES];
+	archive->internal    = internal;
+	return cpuid_set_error(ERR_OK);
+}
+
+/* Adds the records of a logical CPU if they are not in the archive yet, returns the index of its distinct CPU */
+static int archive_add_distinct_cpu(struct archive_t* archive, const struct cpu_raw_data_t* raw, uint32_t* distinct)
+{
+	const uint32_t num_records = binary_dump_write_records(raw, NULL);
+	const size_t size          = (size_t) num_records * BINARY_DUMP_RECORD_SIZE;
+	struct cpuid_buffer_t* records = &archive->buffers[SECTION_RECORDS];
+	struct archive_item_t item;
+	uint32_t* slot;
+	uint8_t* p;
+
+	if (!archive_htable_reserve(&archive->distinct_cpus, archive, archive_distinct_item) ||
+	    ((p = (uint8_t*) cpuid_buffer_reserve(records, size)) == NULL))
+		return ERR_NO_MEM;
+	archive->data[SECTION_RECORDS] = (const uint8_t*) records->data;
+
+	/* The records are written after the end of the section, they are kept only if they are new */
+	binary_dump_write_records(raw, p);
+	item.data = p;
+	item.size = (uint32_t) size;
+	slot = archive_htable_find(&archive->distinct_cpus, archive, archive_distinct_item, item);
+	if (*slot != 0) {
+		*distinct = *slot - 1;
+		return ERR_OK;
+	}
+	if ((p = archive_append(archive, SECTION_DISTINCT, ARCHIVE_DISTINCT_SIZE)) == NULL)
+		return ERR_NO_MEM;
+	set_le32(p, archive->num_items[SECTION_RECORDS]);
+	records->size += size;
+	archive->num_items[SECTION_RECORDS] += num_records;
+	*distinct = archive->num_items[SECTION_DISTINCT]++;
+	*slot = *distinct + 1;
+	archive->distinct_cpus.count++;
+	return ERR_OK;
+}
+
+int cpuid_add_to_raw_data_archive(struct cpu_raw_data_archive_t* archive, const char* key, const struct cpu_raw_data_array_t* raw_array)
+{
+	int r;
+	logical_cpu_t logical_cpu;
+	uint32_t distinct;
+	uint8_t* p;
+	struct archive_item_t item;
+	struct archive_t* internal;
+
+	if ((archive == NULL) || (archive->internal == NULL) || (key == NULL) || (raw_array == NULL) || (raw_array->num_raw <= 0))
+		return cpuid_set_error(ERR_HANDLE);
+	internal = (struct archive_t*) archive->internal;
+	if ((r = archive_make_writable(internal)) != ERR_OK)
+		return cpuid_set_error(r);
+	if (!archive_htable_reserve(&internal->keys, internal, archive_entry_key))
+		return cpuid_set_error(ERR_NO_MEM);
+
+	item.data = (const uint8_t*) key;
+	item.size = (uint32_t) strlen(key);
+	if (*archive_htable_find(&internal->keys, internal, archive_entry_key, item) != 0) {
+		warnf("Key '%s' is already in the raw data archive\n", key);
+		return cpuid_set_error(ERR_REQUEST);
+	}
+
+	/* Logical CPUs are added first: if memory runs out, the entry is not added and they are unused */
+	if ((internal->num_items[SECTION_CPUS] > UINT32_MAX - (uint32_t) raw_array->num_raw) || (internal->num_items[SECTION_ENTRIES] == UINT32_MAX))
+		return cpuid_set_error(ERR_NO_MEM);
+	for (logical_cpu = 0; logical_cpu < raw_array->num_raw; logical_cpu++) {
+		if (((r = archive_add_distinct_cpu(internal, &raw_array->raw[logical_cpu], &distinct)) != ERR_OK) ||
+		    ((p = archive_append(internal, SECTION_CPUS, ARCHIVE_CPU_SIZE)) == NULL)) {
+			internal->buffers[SECTION_CPUS].size = (size_t) internal->num_items[SECTION_CPUS] * ARCHIVE_CPU_SIZE;
+			return cpuid_set_error((r != ERR_OK) ? r : ERR_NO_MEM);
+		}
+		set_le32(p,     (uint32_t) raw_array->raw[logical_cpu].os_cpu);
+		set_le32(p + 4, distinct);
+	}
+	if ((p = archive_append(internal, SECTION_KEYS, (size_t) item.size + 1)) == NULL) {
+		internal->buffers[SECTION_CPUS].size = (size_t) internal->num_items[SECTION_CPUS] * ARCHIVE_CPU_SIZE;
+		return cpuid_set_error(ERR_NO_MEM);
+	}
+	memcpy(p, key, item.size);
+	if ((p = archive_append(internal, SECTION_ENTRIES, ARCHIVE_ENTRY_SIZE)) == NULL) {
+		internal->buffers[SECTION_CPUS].size = (size_t) internal->num_items[SECTION_CPUS] * ARCHIVE_CPU_SIZE;
+		internal->buffers[SECTION_KEYS].size = internal->num_items[SECTION_KEYS];
+		return cpuid_set_error(ERR_NO_MEM);
+	}
+	set_le32(p,      internal->num_items[SECTION_KEYS]);
+	set_le32(p + 4,  item.size);
+	set_le32(p + 8,  raw_array->with_affinity ? ARCHIVE_FLAG_AFFINITY : 0);
+	set_le32(p + 12, internal->num_items[SECTION_CPUS]);
+	set_le32(p + 16, (uint32_t) raw_array->num_raw);
+	internal->num_items[SECTION_CPUS] += (uint32_t) raw_array->num_raw;
+	internal->num_items[SECTION_KEYS] += item.size + 1;
+
+	/* The entries stay sorted when the keys are added in order */
+	if ((internal->num_items[SECTION_ENTRIES] > 0) &&
+	    (archive_compare_items(archive_entry_key(internal, internal->num_items[SECTION_ENTRIES] - 1), item) > 0))
+		internal->is_sorted = false;
+	*archive_htable_find(&internal->keys, internal, archive_entry_key, item) = internal->num_items[SECTION_ENTRIES] + 1;
+	internal->keys.count++;
+	archive->num_entries = ++internal->num_items[SECTION_ENTRIES];
+	return cpuid_set_error(ERR_OK);
+}
+
+static int archive_read_entry(const struct archive_t* archive, uint32_t index, struct cpu_raw_data_array_t* raw_array)
+{
+	uint32_t i, distinct, first_record, num_records;
+	const uint8_t* entry = archive_get_item(archive, SECTION_ENTRIES, index);
+	const uint32_t first_cpu = get_le32(entry + 12);
+	const uint32_t num_cpus  = get_le32(entry + 16);
+	const uint8_t* cpu;
+
+	raw_array->with_affinity = (get_le32(entry + 8) & ARCHIVE_FLAG_AFFINITY) != 0;
+	raw_array->num_raw       = 0;
+	raw_array->raw           = NULL;
+	if (num_cpus == 0)
+		return ERR_OK;
+	/* Zeroed: each raw data gets its own table of leaves */
+	if ((raw_array->raw = (struct cpu_raw_data_t*) cpuid_calloc(num_cpus, sizeof(struct cpu_raw_data_t))) == NULL)
+		return ERR_NO_MEM;
+	raw_array->num_raw = (logical_cpu_t) num_cpus;
+	for (i = 0; i < num_cpus; i++) {
+		cpu          = archive_get_item(archive, SECTION_CPUS, first_cpu + i);
+		distinct     = get_le32(cpu + 4);
+		first_record = archive_distinct_records(archive, distinct, &num_records);
+		if (binary_dump_read_records(archive_get_item(archive, SECTION_RECORDS, first_record), num_records, archive->item_size[SECTION_RECORDS], &raw_array->raw[i]) != ERR_OK) {
+			cpuid_free_raw_data_array(raw_array);
+			return ERR_NO_MEM;
+		}
+		raw_array->raw[i].os_cpu = (logical_cpu_t) get_le32(cpu);
+	}
+	return ERR_OK;
+}
+
+int cpuid_find_in_raw_data_archive(struct cpu_raw_data_archive_t* archive, const char* key, struct cpu_raw_data_array_t* raw_array)
+{
+	int cmp;
+	uint32_t low, high, middle;
+	struct archive_item_t item;
+	struct archive_t* internal;
+
+	if ((archive == NULL) || (archive->internal == NULL) || (key == NULL) || (raw_array == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	internal = (struct archive_t*) archive->internal;
+	if (internal->is_writable)
+		archive_sort(internal);
+
+	item.data = (const uint8_t*) key;
+	item.size = (uint32_t) strlen(key);
+	for (low = 0, high = internal->num_items[SECTION_ENTRIES]; low < high;) {
+		middle = low + (high - low) / 2;
+		cmp    = archive_compare_items(item, archive_entry_key(internal, middle));
+		if (cmp == 0)
+			return cpuid_set_error(archive_read_entry(internal, middle, raw_array));
+		else if (cmp < 0)
+			high = middle;
+		else
+			low = middle + 1;
+	}
+	return cpuid_set_error(ERR_NOT_FOUND);
+}
+
+int cpuid_get_archived_raw_data(struct cpu_raw_data_archive_t* archive, uint32_t index, const char** key, struct cpu_raw_data_array_t* raw_array)
+{
+	struct archive_t* internal;
+
+	if ((archive == NULL) || (archive->internal == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	internal = (struct archive_t*) archive->internal;
+	if (index >= internal->num_items[SECTION_ENTRIES])
+		return cpuid_set_error(ERR_INVRANGE);
+	if (internal->is_writable)
+		archive_sort(internal);
+
+	if (key != NULL)
+		*key = (const char*) archive_entry_key(internal, index).data;
+	return cpuid_set_error((raw_array != NULL) ? archive_read_entry(internal, index, raw_array) : ERR_OK);
+}
+
+int cpuid_save_raw_data_archive(struct cpu_raw_data_archive_t* archive, const char* filename)
+{
+	int r, section;
+	size_t size;
+	uint32_t offsets[NUM_SECTIONS];
+	uint8_t header[ARCHIVE_HEADER_SIZE];
+	struct archive_t* internal;
+	FILE *f;
+
+	if ((archive == NULL) || (archive->internal == NULL) || (filename == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	internal = (struct archive_t*) archive->internal;
+	/* The file is not mapped anymore after this, so it can be overwritten */
+	if ((r = archive_make_writable(internal)) != ERR_OK)
+		return cpuid_set_error(r);
+	archive_sort(internal);
+
+	size = ARCHIVE_HEADER_SIZE;
+	for (section = 0; section < NUM_SECTIONS; section++) {
+		offsets[section] = (uint32_t) size;
+		size += internal->buffers[section].size;
+		if (size > UINT32_MAX)
+			return cpuid_set_error(ERR_NO_MEM);
+	}
+	memset(header, 0, ARCHIVE_HEADER_SIZE);
+	memcpy(header, ARCHIVE_MAGIC, ARCHIVE_MAGIC_SIZE);
+	header[8]  = ARCHIVE_VERSION;
+	header[10] = ARCHIVE_HEADER_SIZE;
+	header[11] = ARCHIVE_ENTRY_SIZE;
+	header[12] = ARCHIVE_CPU_SIZE;
+	header[13] = BINARY_DUMP_RECORD_SIZE;
+	for (section = 0; section < NUM_SECTIONS; section++) {
+		set_le32(header + 16 + 4 * section + ((section == SECTION_KEYS) ? 20 : 0), internal->num_items[section]);
+		set_le32(header + 32 + 4 * section, offsets[section]);
+	}
+
+	f = !strcmp(filename, "") ? stdout : fopen(filename, "wb");
+	if (!f)
+		return cpuid_set_error(ERR_OPEN);
+	debugf(1, "Writing raw data archive (%u entries, %lu bytes) to '%s'\n", internal->num_items[SECTION_ENTRIES],
+		(unsigned long) size, f == stdout ? "stdout" : filename);
+	r = ERR_OK;
+	if (fwrite(header, 1, ARCHIVE_HEADER_SIZE, f) != ARCHIVE_HEADER_SIZE)
+		r = ERR_OPEN;
+	for (section = 0; (section < NUM_SECTIONS) && (r == ERR_OK); section++)
+		if ((internal->buffers[section].size > 0) &&
+		    (fwrite(internal->buffers[section].data, 1, internal->buffers[section].size, f) != internal->buffers[section].size))
+			r = ERR_OPEN;
+	if (f != stdout) {
+		if (fclose(f) != 0)
+			r = ERR_OPEN;
+	}
+	else
+		fflush(f);
+	return cpuid_set_error(r);
+}
+
+void cpuid_close_raw_data_archive(struct cpu_raw_data_archive_t* archive)
+{
+	if ((archive == NULL) || (archive->internal == NULL))
+		return;
+	archive_t_destructor((struct archive_t*) archive->internal);
+	archive->num_entries = 0;
+	archive->internal    = NULL;
+}
@@ -0,0 +1,638 @@
+/*
+ * Copyright 2024  Veselin Georgiev,
+ * anrieffNOSPAM @ mgail_DOT.com (convert to gmail)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libcpuid.h"
+#include "libcpuid_util.h"
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+/* The identification cache stores the result of cpuid_get_all_raw_data() and cpu_identify_all()
+   in a file or in shared memory, so other processes can use it instead of executing CPUID on each logical CPU.
+   It is valid as long as its key is the same: boot ID, online logical CPUs and microcode revision. */
+
+#define CACHE_MAGIC          "LCPUIDC"
+#define CACHE_FORMAT_VERSION 3
+#define CACHE_KEY_LEN        4096
+
+/* Image layout (cache file or shared memory): header, then each section padded to 8 bytes
+   Everything is stored in the native byte order and structure layout, the structure sizes are checked when loading
+   The tables of leaves of all the raw data follow each other in the leaves section, cpu_raw_data_t::leaves is stored as NULL */
+struct cache_header_t {
+	char     magic[8];           /* written last in shared memory, when the image is complete */
+	uint32_t format_version;
+	uint32_t key_size;
+	char     library_version[16];
+	uint32_t raw_data_size;      /* sizeof(struct cpu_raw_data_t) */
+	uint32_t cpu_id_size;        /* sizeof(struct cpu_id_t) */
+	uint32_t topology_size;      /* sizeof(struct cpu_topology_t) */
+	uint32_t num_raw;
+	uint32_t with_affinity;
+	uint32_t num_cpu_types;
+	int32_t  total_instances[5]; /* L1 data, L1 instruction, L2, L3, L4 */
+	uint32_t num_leaves;         /* total length of the tables of leaves */
+	uint64_t payload_size;       /* everything after the header */
+	uint64_t checksum;           /* of the payload */
+};
+
+enum _cache_section_t {
+	SECTION_KEY,
+	SECTION_RAW,
+	SECTION_LEAVES,
+	SECTION_CPU_TYPES,
+	SECTION_TOPOLOGY,
+	NUM_SECTIONS
+};
+
+#define CACHE_PADDED_SIZE(__size) (((__size) + 7) & ~((uint64_t) 7))
+
+/* Computes the offset of each section from the start of the image, returns the image size */
+static uint64_t cache_sections(const struct cache_header_t* header, uint64_t offsets[NUM_SECTIONS])
+{
+	offsets[SECTION_KEY]       = sizeof(struct cache_header_t);
+	offsets[SECTION_RAW]       = offsets[SECTION_KEY]       + CACHE_PADDED_SIZE(header->key_size);
+	offsets[SECTION_LEAVES]    = offsets[SECTION_RAW]       + CACHE_PADDED_SIZE((uint64_t) header->num_raw * header->raw_data_size);
+	offsets[SECTION_CPU_TYPES] = offsets[SECTION_LEAVES]    + CACHE_PADDED_SIZE((uint64_t) header->num_leaves * sizeof(struct cpu_raw_leaf_t));
+	offsets[SECTION_TOPOLOGY]  = offsets[SECTION_CPU_TYPES] + CACHE_PADDED_SIZE((uint64_t) header->num_cpu_types * header->cpu_id_size);
+	return offsets[SECTION_TOPOLOGY] + CACHE_PADDED_SIZE((uint64_t) header->num_raw * header->topology_size);
+}
+
+static uint64_t cache_checksum(const uint8_t* data, size_t size)
+{
+	/* FNV-1a on 64-bit words, to detect corruption with a few cycles per word */
+	size_t i;
+	uint64_t word, hash = 0xcbf29ce484222325ULL;
+
+	for (i = 0; i + sizeof(word) <= size; i += sizeof(word)) {
+		memcpy(&word, data + i, sizeof(word));
+		hash = (hash ^ word) * 0x100000001b3ULL;
+	}
+	for (; i < size; i++)
+		hash = (hash ^ data[i]) * 0x100000001b3ULL;
+	return hash;
+}
+
+static void cache_header_t_constructor(struct cache_header_t* header, const char* key, logical_cpu_t num_raw, uint32_t num_leaves, bool with_affinity, const struct system_id_t* system)
+{
+	uint64_t offsets[NUM_SECTIONS];
+
+	memset(header, 0, sizeof(struct cache_header_t));
+	memcpy(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header->format_version     = CACHE_FORMAT_VERSION;
+	header->key_size           = (uint32_t) strlen(key);
+	strncpy(header->library_version, VERSION, sizeof(header->library_version) - 1);
+	header->raw_data_size      = sizeof(struct cpu_raw_data_t);
+	header->cpu_id_size        = sizeof(struct cpu_id_t);
+	header->topology_size      = sizeof(struct cpu_topology_t);
+	header->num_raw            = num_raw;
+	header->with_affinity      = with_affinity;
+	header->num_leaves         = num_leaves;
+	header->num_cpu_types      = system->num_cpu_types;
+	header->total_instances[0] = system->l1_data_total_instances;
+	header->total_instances[1] = system->l1_instruction_total_instances;
+	header->total_instances[2] = system->l2_total_instances;
+	header->total_instances[3] = system->l3_total_instances;
+	header->total_instances[4] = system->l4_total_instances;
+	header->payload_size       = cache_sections(header, offsets) - sizeof(struct cache_header_t);
+}
+
+/* Returns the topology of each logical CPU, and the CPU type it belongs to */
+static void cache_get_topology(struct cpu_raw_data_array_t* raw_array, struct system_id_t* system, struct cpu_topology_t* topology)
+{
+	logical_cpu_t i;
+	uint8_t cpu_type;
+	struct internal_topology_t internal;
+
+	for (i = 0; i < raw_array->num_raw; i++) {
+		topology[i].os_cpu   = raw_array->raw[i].os_cpu;
+		topology[i].cpu_type = 0;
+		if (raw_array->with_affinity)
+			for (cpu_type = 0; cpu_type < system->num_cpu_types; cpu_type++)
+				if (get_affinity_mask_bit(raw_array->raw[i].os_cpu, &system->cpu_types[cpu_type].affinity_mask)) {
+					topology[i].cpu_type = cpu_type;
+					break;
+				}
+		if (!cpu_ident_id(i, &raw_array->raw[i], &internal))
+			internal.package_id = internal.core_id = internal.smt_id = -1;
+		topology[i].apic_id    = internal.apic_id;
+		topology[i].package_id = internal.package_id;
+		topology[i].core_id    = internal.core_id;
+		topology[i].smt_id     = internal.smt_id;
+	}
+}
+
+/* Builds the image of the identified system, returns NULL if there is not enough memory */
+static uint8_t* cache_build_image(const char* key, struct cpu_raw_data_array_t* raw_array, struct system_id_t* system, size_t* image_size)
+{
+	uint8_t* image;
+	uint32_t num_leaves = 0;
+	uint64_t offsets[NUM_SECTIONS];
+	logical_cpu_t i;
+	struct cache_header_t header;
+	struct cpu_raw_data_t* raw;
+	struct cpu_raw_leaf_t* leaves;
+
+	for (i = 0; i < raw_array->num_raw; i++)
+		num_leaves += raw_array->raw[i].num_leaves;
+	cache_header_t_constructor(&header, key, raw_array->num_raw, num_leaves, raw_array->with_affinity, system);
+	*image_size = (size_t) cache_sections(&header, offsets);
+	if ((image = cpuid_calloc(1, *image_size)) == NULL)
+		return NULL;
+	memcpy(image + offsets[SECTION_KEY], key, header.key_size);
+	raw    = (struct cpu_raw_data_t*) (image + offsets[SECTION_RAW]);
+	leaves = (struct cpu_raw_leaf_t*) (image + offsets[SECTION_LEAVES]);
+	for (i = 0; i < raw_array->num_raw; i++) {
+		memcpy(&raw[i], &raw_array->raw[i], sizeof(struct cpu_raw_data_t));
+		raw[i].max_leaves = 0;
+		raw[i].leaves     = NULL;
+		if (raw[i].num_leaves > 0)
+			memcpy(leaves, raw_array->raw[i].leaves, raw[i].num_leaves * sizeof(struct cpu_raw_leaf_t));
+		leaves += raw[i].num_leaves;
+	}
+	memcpy(image + offsets[SECTION_CPU_TYPES], system->cpu_types, system->num_cpu_types * sizeof(struct cpu_id_t));
+	cache_get_topology(raw_array, system, (struct cpu_topology_t*) (image + offsets[SECTION_TOPOLOGY]));
+	header.checksum = cache_checksum(image + sizeof(struct cache_header_t), (size_t) header.payload_size);
+	memcpy(image, &header, sizeof(struct cache_header_t));
+	return image;
+}
+
+/* Checks that an image is complete, has the same format as this library, the same key and a valid checksum */
+static bool cache_check_image(const uint8_t* image, size_t image_size, const char* key, const char* name)
+{
+	struct cache_header_t expected;
+	const struct cache_header_t* header = (const struct cache_header_t*) image;
+	const struct system_id_t empty_system = { .num_cpu_types = 0 };
+	const struct cpu_raw_data_t* raw;
+	uint64_t offsets[NUM_SECTIONS], num_leaves = 0;
+	uint32_t i;
+
+	if (image_size < sizeof(struct cache_header_t))
+		return false;
+	cache_header_t_constructor(&expected, key, 0, 0, false, &empty_system);
+	if (memcmp(header->magic, expected.magic, sizeof(expected.magic)) ||
+	    (header->format_version != expected.format_version) ||
+	    strncmp(header->library_version, expected.library_version, sizeof(expected.library_version)) ||
+	    (header->raw_data_size != expected.raw_data_size) ||
+	    (header->cpu_id_size != expected.cpu_id_size) ||
+	    (header->topology_size != expected.topology_size) ||
+	    (header->key_size != expected.key_size) ||
+	    (header->num_raw == 0) || (header->num_raw > (logical_cpu_t) -1) ||
+	    (header->num_cpu_types == 0) || (header->num_cpu_types > UINT8_MAX) ||
+	    (cache_sections(header, offsets) != image_size) ||
+	    (header->payload_size != image_size - sizeof(struct cache_header_t))) {
+		debugf(2, "Identification cache '%s' has another format\n", name);
+		return false;
+	}
+	if (memcmp(image + offsets[SECTION_KEY], key, header->key_size)) {
+		debugf(2, "Identification cache '%s' is outdated\n", name);
+		return false;
+	}
+	if (cache_checksum(image + sizeof(struct cache_header_t), (size_t) header->payload_size) != header->checksum) {
+		warnf("Warning: identification cache '%s' is corrupted, ignoring it\n", name);
+		return false;
+	}
+	raw = (const struct cpu_raw_data_t*) (image + offsets[SECTION_RAW]);
+	for (i = 0; i < header->num_raw; i++)
+		num_leaves += raw[i].num_leaves;
+	if (num_leaves != header->num_leaves) {
+		warnf("Warning: identification cache '%s' is corrupted, ignoring it\n", name);
+		return false;
+	}
+	return true;
+}
+
+/* Makes the snapshot point to the sections of a valid image, which must be writable: the raw data are
+   linked to their tables of leaves, which they do not own (cpu_raw_data_t::max_leaves is zero) */
+static void cache_attach_image(struct cpu_snapshot_t* snapshot, uint8_t* image, size_t image_size, bool is_shared)
+{
+	uint64_t offsets[NUM_SECTIONS];
+	uint32_t i;
+	const struct cache_header_t* header = (const struct cache_header_t*) image;
+	struct cpu_raw_data_t* raw;
+	struct cpu_raw_leaf_t* leaves;
+
+	cache_sections(header, offsets);
+	raw    = (struct cpu_raw_data_t*) (image + offsets[SECTION_RAW]);
+	leaves = (struct cpu_raw_leaf_t*) (image + offsets[SECTION_LEAVES]);
+	for (i = 0; i < header->num_raw; i++) {
+		raw[i].max_leaves = 0;
+		raw[i].leaves     = (raw[i].num_leaves > 0) ? leaves : NULL;
+		leaves += raw[i].num_leaves;
+	}
+	snapshot->is_shared                             = is_shared;
+	snapshot->image                                 = image;
+	snapshot->image_size                            = image_size;
+	snapshot->num_raw                               = (logical_cpu_t) header->num_raw;
+	snapshot->raw                                   = (const struct cpu_raw_data_t*) (image + offsets[SECTION_RAW]);
+	snapshot->topology                              = (const struct cpu_topology_t*) (image + offsets[SECTION_TOPOLOGY]);
+	snapshot->system.num_cpu_types                  = (uint8_t) header->num_cpu_types;
+	snapshot->system.cpu_types                      = (struct cpu_id_t*) (image + offsets[SECTION_CPU_TYPES]);
+	snapshot->system.l1_data_total_instances        = header->total_instances[0];
+	snapshot->system.l1_instruction_total_instances = header->total_instances[1];
+	snapshot->system.l2_total_instances             = header->total_instances[2];
+	snapshot->system.l3_total_instances             = header->total_instances[3];
+	snapshot->system.l4_total_instances             = header->total_instances[4];
+}
+
+/* Copies the raw data and the identification out of a valid (writable) image */
+static bool cache_copy_image(uint8_t* image, struct cpu_raw_data_array_t* raw_array, struct system_id_t* system)
+{
+	logical_cpu_t i;
+	struct cpu_snapshot_t snapshot;
+
+	cache_attach_image(&snapshot, image, 0, false);
+	if (raw_array != NULL) {
+		if ((raw_array->raw = cpuid_calloc(snapshot.num_raw, sizeof(struct cpu_raw_data_t))) == NULL)
+			return false;
+		raw_array->num_raw       = snapshot.num_raw;
+		raw_array->with_affinity = ((const struct cache_header_t*) image)->with_affinity != 0;
+		for (i = 0; i < snapshot.num_raw; i++)
+			if (cpuid_copy_raw_data(&raw_array->raw[i], &snapshot.raw[i]) < 0) {
+				cpuid_free_raw_data_array(raw_array);
+				return false;
+			}
+	}
+	*system = snapshot.system;
+	if ((system->cpu_types = cpuid_malloc(system->num_cpu_types * sizeof(struct cpu_id_t))) == NULL) {
+		if (raw_array != NULL)
+			cpuid_free_raw_data_array(raw_array);
+		return false;
+	}
+	memcpy(system->cpu_types, snapshot.system.cpu_types, system->num_cpu_types * sizeof(struct cpu_id_t));
+	return true;
+}
+
+/* Identifies the system in the calling process */
+static int cache_identify(struct cpu_raw_data_array_t* raw_array, struct system_id_t* system)
+{
+	int r;
+
+	if ((r = cpuid_get_all_raw_data(raw_array)) < 0)
+		return r;
+	if ((r = cpu_identify_all(raw_array, system)) < 0)
+		cpuid_free_raw_data_array(raw_array);
+	return r;
+}
+
+#if defined linux || defined __linux__
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CACHE_FILE_NAME      "libcpuid.cache"
+#define SNAPSHOT_NAME        "/libcpuid"
+
+/* Reads the first line of a file, without the new line character */
+static bool read_first_line(const char* path, char* buffer, size_t buffer_len)
+{
+	FILE *f;
+	bool ret;
+
+	if ((f = fopen(path, "r")) == NULL)
+		return false;
+	ret = fgets(buffer, (int) buffer_len, f) != NULL;
+	fclose(f);
+	if (ret)
+		buffer[strcspn(buffer, "\n")] = '\0';
+	return ret;
+}
+
+/* Builds the path of a file in the sysfs CPU directory, returns false if it does not fit in path
+   LIBCPUID_SYSFS_CPU_DIR allows to use another directory than /sys/devices/system/cpu, for testing purposes */
+static bool get_sysfs_cpu_path(char* path, size_t path_len, const char* file_name)
+{
+	int len;
+	const char* sysfs_cpu_dir = cpuid_getenv_path("LIBCPUID_SYSFS_CPU_DIR");
+
+	len = snprintf(path, path_len, "%s/%s", (sysfs_cpu_dir != NULL) ? sysfs_cpu_dir : "/sys/devices/system/cpu", file_name);
+	return (len >= 0) && ((size_t) len < path_len);
+}
+
+/* Builds the key of the cache, returns false when the system cannot be identified safely (the cache is not used) */
+static bool cache_get_key(char* key, size_t key_len)
+{
+	char path[256], file_name[64], boot_id[64], online[CACHE_KEY_LEN / 2], microcode[32] = "unknown";
+
+	if (!read_first_line("/proc/sys/kernel/random/boot_id", boot_id, sizeof(boot_id)))
+		return false;
+	if (!get_sysfs_cpu_path(path, sizeof(path), "online") || !read_first_line(path, online, sizeof(online)))
+		return false;
+	/* A late microcode update is applied to all logical CPUs, the first online one is enough
+	   Virtual machines usually do not expose the microcode revision */
+	snprintf(file_name, sizeof(file_name), "cpu%d/microcode/version", atoi(online));
+	if (get_sysfs_cpu_path(path, sizeof(path), file_name))
+		read_first_line(path, microcode, sizeof(microcode));
+
+	snprintf(key, key_len, "boot_id=%s;online=%s;microcode=%s", boot_id, online, microcode);
+	debugf(2, "Identification cache key: %s\n", key);
+	return true;
+}
+
+/* Returns true when the raw data cover all the online logical CPUs. A process restricted to some of them
+   (e.g. by taskset or a cgroup cpuset) skips the others: its partial result must not be shared with other processes */
+static bool cache_is_complete(const struct cpu_raw_data_array_t* raw_array)
+{
+	char path[256];
+	FILE *f;
+	bool ret;
+	int32_t cpu, num_online = 0;
+	logical_cpu_t i;
+	cpu_affinity_mask_t online;
+
+	if (!raw_array->with_affinity || !get_sysfs_cpu_path(path, sizeof(path), "online") || ((f = fopen(path, "r")) == NULL))
+		return false;
+	ret = read_cpu_list(f, &online);
+	fclose(f);
+	if (!ret)
+		return false;
+	for (i = 0; i < raw_array->num_raw; i++)
+		if (!get_affinity_mask_bit(raw_array->raw[i].os_cpu, &online))
+			return false;
+	for (cpu = 0; cpu < (int32_t) (__MASK_SETSIZE * __MASK_NCPUBITS); cpu++)
+		num_online += get_affinity_mask_bit((logical_cpu_t) cpu, &online);
+	if (num_online != raw_array->num_raw)
+		debugf(2, "Only %u of the %i online logical CPUs are usable by this process\n", raw_array->num_raw, num_online);
+	return num_online == raw_array->num_raw;
+}
+
+/* Maps a cache file or a shared memory object, returns NULL if it cannot be trusted
+   The mapping is private and writable, so the raw data can be linked to their tables of leaves */
+static uint8_t* cache_map(int fd, size_t* size)
+{
+	struct stat st;
+	void* map;
+
+	/* Only trust a cache written by the current user or by root */
+	if ((fstat(fd, &st) < 0) || ((st.st_uid != geteuid()) && (st.st_uid != 0)) || (st.st_size <= 0))
+		return NULL;
+	*size = (size_t) st.st_size;
+	map = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	return (map == MAP_FAILED) ? NULL : (uint8_t*) map;
+}
+
+/* Loads the cache file, returns false if it does not exist, is corrupted or does not match the key */
+static bool cache_load(const char* path, const char* key, struct cpu_raw_data_array_t* raw_array, struct system_id_t* system)
+{
+	int fd;
+	bool ret = false;
+	size_t size;
+	uint8_t* map;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return false;
+	map = cache_map(fd, &size);
+	close(fd);
+	if (map == NULL)
+		return false;
+	if (cache_check_image(map, size, key, path) && cache_copy_image(map, raw_array, system)) {
+		debugf(2, "Identification loaded from cache '%s'\n", path);
+		ret = true;
+	}
+	munmap(map, size);
+	return ret;
+}
+
+static bool write_all(int fd, const void* data, size_t size)
+{
+	ssize_t written;
+	const uint8_t* ptr = (const uint8_t*) data;
+
+	while (size > 0) {
+		if ((written = write(fd, ptr, size)) <= 0)
+			return false;
+		ptr  += written;
+		size -= (size_t) written;
+	}
+	return true;
+}
+
+/* Writes the cache file: a temporary file is renamed, so concurrent readers and writers always see a complete file */
+static void cache_store(const char* path, const char* key, struct cpu_raw_data_array_t* raw_array, struct system_id_t* system)
+{
+	int fd;
+	bool ret;
+	char tmp_path[512];
+	size_t image_size;
+	uint8_t* image;
+
+	if ((image = cache_build_image(key, raw_array, system, &image_size)) == NULL)
+		return;
+	snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+	if ((fd = mkstemp(tmp_path)) < 0) {
+		debugf(2, "Cannot create identification cache '%s'\n", tmp_path);
+		cpuid_free(image);
+		return;
+	}
+	ret = (fchmod(fd, 0644) == 0) && write_all(fd, image, image_size);
+	ret = (close(fd) == 0) && ret;
+	if (ret)
+		ret = rename(tmp_path, path) == 0;
+	if (!ret) {
+		debugf(2, "Cannot write identification cache '%s'\n", path);
+		unlink(tmp_path);
+	}
+	else
+		debugf(2, "Identification stored in cache '%s'\n", path);
+	cpuid_free(image);
+}
+#endif /* defined linux || defined __linux__ */
+
+int cpu_identify_all_cached(struct cpu_raw_data_array_t* raw_array, struct system_id_t* system, const char* cache_dir)
+{
+	int r;
+	struct cpu_raw_data_array_t local_array;
+	struct cpu_raw_data_array_t* array = (raw_array != NULL) ? raw_array : &local_array;
+#if defined linux || defined __linux__
+	int len;
+	char path[256], key[CACHE_KEY_LEN];
+	bool use_cache;
+#endif /* defined linux || defined __linux__ */
+
+	if (system == NULL)
+		return cpuid_set_error(ERR_HANDLE);
+	if (cache_dir == NULL)
+		cache_dir = cpuid_getenv_path("LIBCPUID_CACHE_DIR");
+
+#if defined linux || defined __linux__
+	use_cache = (cache_dir != NULL) && (cache_dir[0] != '\0') && cache_get_key(key, sizeof(key));
+	if (use_cache) {
+		/* A truncated path would be another file */
+		len = snprintf(path, sizeof(path), "%s/%s", cache_dir, CACHE_FILE_NAME);
+		if ((len < 0) || ((size_t) len >= sizeof(path))) {
+			debugf(2, "Identification cache directory '%s' is too long\n", cache_dir);
+			return cpuid_set_error(ERR_OPEN);
+		}
+		if (cache_load(path, key, raw_array, system))
+			return cpuid_set_error(ERR_OK);
+	}
+#endif /* defined linux || defined __linux__ */
+
+	if ((r = cache_identify(array, system)) < 0)
+		return r;
+
+#if defined linux || defined __linux__
+	if (use_cache && cache_is_complete(array))
+		cache_store(path, key, array, system);
+#endif /* defined linux || defined __linux__ */
+	if (raw_array == NULL)
+		cpuid_free_raw_data_array(&local_array);
+	return cpuid_set_error(ERR_OK);
+}
+
+int cpuid_publish_shared_snapshot(const char* name)
+{
+#if defined linux || defined __linux__
+	int fd, r;
+	char key[CACHE_KEY_LEN];
+	size_t image_size;
+	uint8_t *image, *map;
+	struct cpu_raw_data_array_t raw_array;
+	struct system_id_t system;
+
+	if (name == NULL)
+		name = SNAPSHOT_NAME;
+	if (!cache_get_key(key, sizeof(key)))
+		return cpuid_set_error(ERR_NOT_IMP);
+	if ((r = cache_identify(&raw_array, &system)) < 0)
+		return r;
+	if (!cache_is_complete(&raw_array)) {
+		debugf(2, "Snapshot not published in shared memory '%s': some logical CPUs are not usable\n", name);
+		cpuid_free_raw_data_array(&raw_array);
+		cpuid_free_system_id(&system);
+		return cpuid_set_error(ERR_REQUEST);
+	}
+	image = cache_build_image(key, &raw_array, &system, &image_size);
+	cpuid_free_raw_data_array(&raw_array);
+	cpuid_free_system_id(&system);
+	if (image == NULL)
+		return cpuid_set_error(ERR_NO_MEM);
+
+	/* A new object replaces the previous one, so the processes which mapped it are not affected */
+	shm_unlink(name);
+	if ((fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644)) < 0) {
+		cpuid_free(image);
+		return cpuid_set_error(ERR_OPEN);
+	}
+	if ((ftruncate(fd, (off_t) image_size) < 0) ||
+	    ((map = mmap(NULL, image_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)) {
+		close(fd);
+		shm_unlink(name);
+		cpuid_free(image);
+		return cpuid_set_error(ERR_NO_MEM);
+	}
+	close(fd);
+
+	/* The magic is written last: until then, clients see an incomplete image and identify the system themselves */
+	memcpy(map + sizeof(((struct cache_header_t*) NULL)->magic), image + sizeof(((struct cache_header_t*) NULL)->magic),
+	       image_size - sizeof(((struct cache_header_t*) NULL)->magic));
+	__sync_synchronize();
+	memcpy(map, image, sizeof(((struct cache_header_t*) NULL)->magic));
+	munmap(map, image_size);
+	cpuid_free(image);
+	debugf(2, "Snapshot published in shared memory '%s'\n", name);
+	return cpuid_set_error(ERR_OK);
+#else
+	UNUSED(name);
+	return cpuid_set_error(ERR_NOT_IMP);
+#endif /* defined linux || defined __linux__ */
+}
+
+int cpuid_unpublish_shared_snapshot(const char* name)
+{
+#if defined linux || defined __linux__
+	if (shm_unlink((name != NULL) ? name : SNAPSHOT_NAME) < 0)
+		return cpuid_set_error(ERR_OPEN);
+	return cpuid_set_error(ERR_OK);
+#else
+	UNUSED(name);
+	return cpuid_set_error(ERR_NOT_IMP);
+#endif /* defined linux || defined __linux__ */
+}
+
+int cpuid_attach_shared_snapshot(struct cpu_snapshot_t* snapshot, const char* name)
+{
+	int r;
+	char key[CACHE_KEY_LEN] = "";
+	size_t image_size;
+	uint8_t* image;
+	struct cpu_raw_data_array_t raw_array;
+	struct system_id_t system;
+#if defined linux || defined __linux__
+	int fd;
+#endif /* defined linux || defined __linux__ */
+
+	if (snapshot == NULL)
+		return cpuid_set_error(ERR_HANDLE);
+
+#if defined linux || defined __linux__
+	if (name == NULL)
+		name = SNAPSHOT_NAME;
+	if (cache_get_key(key, sizeof(key)) && ((fd = shm_open(name, O_RDONLY, 0)) >= 0)) {
+		image = cache_map(fd, &image_size);
+		close(fd);
+		/* Any process of the same user may write the object, it is checked like a cache file */
+		if ((image != NULL) && cache_check_image(image, image_size, key, name)) {
+			cache_attach_image(snapshot, image, image_size, true);
+			mprotect(image, image_size, PROT_READ);
+			debugf(2, "Snapshot attached from shared memory '%s'\n", name);
+			return cpuid_set_error(ERR_OK);
+		}
+		if (image != NULL)
+			munmap(image, image_size);
+	}
+#else
+	UNUSED(name);
+#endif /* defined linux || defined __linux__ */
+
+	/* Fallback: the snapshot is identified by the calling process */
+	if ((r = cache_identify(&raw_array, &system)) < 0)
+		return r;
+	image = cache_build_image(key, &raw_array, &system, &image_size);
+	cpuid_free_raw_data_array(&raw_array);
+	cpuid_free_system_id(&system);
+	if (image == NULL)
+		return cpuid_set_error(ERR_NO_MEM);
+	cache_attach_image(snapshot, image, image_size, false);
+	return cpuid_set_error(ERR_OK);
+}
+
+void cpuid_detach_shared_snapshot(struct cpu_snapshot_t* snapshot)
+{
+	if ((snapshot == NULL) || (snapshot->image == NULL))
+		return;
+#if defined linux || defined __linux__
+	if (snapshot->is_shared)
+		munmap(snapshot->image, snapshot->image_size);
+	else
+#endif /* defined linux || defined __linux__ */
+		cpuid_free(snapshot->image);
+	snapshot->image   = NULL;
+	snapshot->num_raw = 0;
+	snapshot->system.num_cpu_types = 0;
+}
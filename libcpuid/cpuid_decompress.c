@@ -0,0 +1,236 @@
+/*
+ * Copyright 2024  Veselin Georgiev,
+ * anrieffNOSPAM @ mgail_DOT.com (convert to gmail)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "libcpuid.h"
+#include "libcpuid_util.h"
+#include "libcpuid_internal.h"
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+#ifdef HAVE_LZMA
+# include <lzma.h>
+#endif /* HAVE_LZMA */
+#ifdef HAVE_ZLIB
+# include <zlib.h>
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_ZSTD
+# include <zstd.h>
+#endif /* HAVE_ZSTD */
+
+/* Compressed raw dumps are decompressed in chunks of DECOMPRESS_CHUNK_SIZE bytes, which are passed to the
+   parser as they come: the decompressed dump is never held in memory as a whole (except binary dumps).
+   Each format is optional, it depends on the libraries found when libcpuid is built. */
+
+#define DECOMPRESS_CHUNK_SIZE   65536
+#define DECOMPRESS_MEMORY_LIMIT (128 << 20) /* enough for the largest dictionaries of xz -9 and zstd -19 */
+
+compression_t detect_compression(const void* data, size_t size)
+{
+	const uint8_t* p = data;
+
+	if ((size >= 6) && !memcmp(p, "\xFD" "7zXZ\0", 6))
+		return COMPRESSION_XZ;
+	if ((size >= 2) && (p[0] == 0x1F) && (p[1] == 0x8B))
+		return COMPRESSION_GZIP;
+	if ((size >= 4) && !memcmp(p, "\x28\xB5\x2F\xFD", 4))
+		return COMPRESSION_ZSTD;
+	return COMPRESSION_NONE;
+}
+
+const char* compression_str(compression_t compression)
+{
+	switch (compression) {
+		case COMPRESSION_XZ:   return "xz";
+		case COMPRESSION_GZIP: return "gzip";
+		case COMPRESSION_ZSTD: return "zstd";
+		default:               return "none";
+	}
+}
+
+#ifdef HAVE_LZMA
+/* liblzma does not need zeroed memory, and the dictionary is as large as the one used by the compressor (8 MB with xz -6) */
+static void* lzma_alloc(void* opaque, size_t count, size_t size)
+{
+	UNUSED(opaque);
+	return ((size != 0) && (count > SIZE_MAX / size)) ? NULL : cpuid_malloc(count * size);
+}
+
+static void lzma_free(void* opaque, void* ptr)
+{
+	UNUSED(opaque);
+	cpuid_free(ptr);
+}
+
+static int decompress_xz(const void* data, size_t size, uint8_t* chunk, decompress_consumer_t consume, void* arg)
+{
+	int r = ERR_OK;
+	lzma_ret ret;
+	lzma_stream stream = LZMA_STREAM_INIT;
+	const lzma_allocator allocator = { lzma_alloc, lzma_free, NULL };
+
+	stream.allocator = &allocator;
+	if (lzma_stream_decoder(&stream, DECOMPRESS_MEMORY_LIMIT, LZMA_CONCATENATED) != LZMA_OK)
+		return ERR_NO_MEM;
+	stream.next_in  = data;
+	stream.avail_in = size;
+	do {
+		stream.next_out  = chunk;
+		stream.avail_out = DECOMPRESS_CHUNK_SIZE;
+		ret = lzma_code(&stream, LZMA_FINISH);
+		if ((ret != LZMA_OK) && (ret != LZMA_STREAM_END)) {
+			debugf(2, "lzma_code() failed with error %d\n", (int) ret);
+			r = ((ret == LZMA_MEM_ERROR) || (ret == LZMA_MEMLIMIT_ERROR)) ? ERR_NO_MEM : ERR_BADFMT;
+			break;
+		}
+		if (!consume(arg, chunk, DECOMPRESS_CHUNK_SIZE - stream.avail_out))
+			break;
+	} while (ret != LZMA_STREAM_END);
+	lzma_end(&stream);
+	return r;
+}
+#endif /* HAVE_LZMA */
+
+#ifdef HAVE_ZLIB
+static voidpf zlib_alloc(voidpf opaque, uInt count, uInt size)
+{
+	UNUSED(opaque);
+	return cpuid_calloc(count, size);
+}
+
+static void zlib_free(voidpf opaque, voidpf ptr)
+{
+	UNUSED(opaque);
+	cpuid_free(ptr);
+}
+
+/* Concatenated gzip members are decompressed one after the other, like gzip -d does */
+static int decompress_gzip(const void* data, size_t size, uint8_t* chunk, decompress_consumer_t consume, void* arg)
+{
+	int r = ERR_OK;
+	int ret;
+	size_t left = size;
+	z_stream stream;
+
+	memset(&stream, 0, sizeof(stream));
+	stream.zalloc = zlib_alloc;
+	stream.zfree  = zlib_free;
+	if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+		return ERR_NO_MEM;
+	stream.next_in = (Bytef*) data;
+	for (;;) {
+		/* avail_in is 32-bit */
+		if (stream.avail_in == 0) {
+			stream.avail_in = (left > UINT_MAX) ? UINT_MAX : (uInt) left;
+			left -= stream.avail_in;
+		}
+		stream.next_out  = chunk;
+		stream.avail_out = DECOMPRESS_CHUNK_SIZE;
+		ret = inflate(&stream, Z_NO_FLUSH);
+		if ((ret != Z_OK) && (ret != Z_STREAM_END)) {
+			debugf(2, "inflate() failed with error %d\n", ret);
+			r = (ret == Z_MEM_ERROR) ? ERR_NO_MEM : ERR_BADFMT;
+			break;
+		}
+		if (!consume(arg, chunk, DECOMPRESS_CHUNK_SIZE - stream.avail_out))
+			break;
+		if (ret == Z_STREAM_END) {
+			if ((stream.avail_in == 0) && (left == 0))
+				break;
+			inflateReset(&stream);
+		}
+	}
+	inflateEnd(&stream);
+	return r;
+}
+#endif /* HAVE_ZLIB */
+
+#ifdef HAVE_ZSTD
+static int decompress_zstd(const void* data, size_t size, uint8_t* chunk, decompress_consumer_t consume, void* arg)
+{
+	int r = ERR_OK;
+	size_t ret = 0;
+	ZSTD_DCtx* stream;
+	ZSTD_inBuffer in = { data, size, 0 };
+	ZSTD_outBuffer out;
+
+	/* The allocation functions of libzstd can only be replaced with its static linking API */
+	if ((stream = ZSTD_createDCtx()) == NULL)
+		return ERR_NO_MEM;
+	ZSTD_DCtx_setParameter(stream, ZSTD_d_windowLogMax, 27);
+	do {
+		out.dst  = chunk;
+		out.size = DECOMPRESS_CHUNK_SIZE;
+		out.pos  = 0;
+		ret = ZSTD_decompressStream(stream, &out, &in);
+		if (ZSTD_isError(ret)) {
+			debugf(2, "ZSTD_decompressStream() failed: %s\n", ZSTD_getErrorName(ret));
+			r = ERR_BADFMT;
+			break;
+		}
+		if (!consume(arg, chunk, out.pos)) {
+			ret = 0;
+			break;
+		}
+	} while ((in.pos < in.size) || (out.pos == out.size));
+	/* A non-zero hint means that the last frame is incomplete */
+	if ((r == ERR_OK) && (ret != 0))
+		r = ERR_BADFMT;
+	ZSTD_freeDCtx(stream);
+	return r;
+}
+#endif /* HAVE_ZSTD */
+
+int decompress(compression_t compression, const void* data, size_t size, decompress_consumer_t consume, void* arg)
+{
+	int r;
+	uint8_t* chunk;
+	int (*decompress_format)(const void*, size_t, uint8_t*, decompress_consumer_t, void*) = NULL;
+
+	switch (compression) {
+#ifdef HAVE_LZMA
+		case COMPRESSION_XZ:   decompress_format = decompress_xz;   break;
+#endif /* HAVE_LZMA */
+#ifdef HAVE_ZLIB
+		case COMPRESSION_GZIP: decompress_format = decompress_gzip; break;
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_ZSTD
+		case COMPRESSION_ZSTD: decompress_format = decompress_zstd; break;
+#endif /* HAVE_ZSTD */
+		default: break;
+	}
+	if (decompress_format == NULL) {
+		warnf("Warning: libcpuid is built without %s support\n", compression_str(compression));
+		return ERR_NOT_IMP;
+	}
+	if ((chunk = cpuid_malloc(DECOMPRESS_CHUNK_SIZE)) == NULL)
+		return ERR_NO_MEM;
+	r = decompress_format(data, size, chunk, consume, arg);
+	cpuid_free(chunk);
+	return r;
+}
@@ -0,0 +1,198 @@
+/*
+ * Copyright 2024  Veselin Georgiev,
+ * anrieffNOSPAM @ mgail_DOT.com (convert to gmail)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <string.h>
+#include "libcpuid.h"
+#include "libcpuid_util.h"
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+/* The set operations work on 128-bit vectors when the target always has them (SSE2 on x86-64, NEON on AArch64),
+   otherwise on 64-bit words. A set is CPU_FEATURE_SET_WORDS words, i.e. 3 vectors: there is no tail to handle. */
+#if (CPU_FEATURE_SET_WORDS % 2) == 0
+#  if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    include <emmintrin.h>
+#    define FEATURE_SET_SSE2
+#  elif defined(__ARM_NEON) && defined(__aarch64__)
+#    include <arm_neon.h>
+#    define FEATURE_SET_NEON
+#  endif
+#endif
+
+#if defined(FEATURE_SET_SSE2)
+#  define VECTOR_OP(__result, __a, __b, __op) \
+	_mm_storeu_si128((__m128i*) (__result), __op(_mm_loadu_si128((const __m128i*) (__a)), _mm_loadu_si128((const __m128i*) (__b))))
+#  define VECTOR_AND(__result, __a, __b)     VECTOR_OP(__result, __a, __b, _mm_and_si128)
+#  define VECTOR_OR(__result, __a, __b)      VECTOR_OP(__result, __a, __b, _mm_or_si128)
+/* _mm_andnot_si128(x, y) is ~x & y */
+#  define VECTOR_ANDNOT(__result, __a, __b)  \
+	_mm_storeu_si128((__m128i*) (__result), _mm_andnot_si128(_mm_loadu_si128((const __m128i*) (__b)), _mm_loadu_si128((const __m128i*) (__a))))
+#elif defined(FEATURE_SET_NEON)
+#  define VECTOR_AND(__result, __a, __b)     vst1q_u64((__result), vandq_u64(vld1q_u64(__a), vld1q_u64(__b)))
+#  define VECTOR_OR(__result, __a, __b)      vst1q_u64((__result), vorrq_u64(vld1q_u64(__a), vld1q_u64(__b)))
+/* vbicq_u64(x, y) is x & ~y */
+#  define VECTOR_ANDNOT(__result, __a, __b)  vst1q_u64((__result), vbicq_u64(vld1q_u64(__a), vld1q_u64(__b)))
+#endif
+
+static int popcount64(uint64_t x)
+{
+#if defined(__GNUC__) && (defined(__POPCNT__) || defined(__aarch64__))
+	return __builtin_popcountll(x);
+#else
+	/* Without a POPCNT instruction, __builtin_popcountll() is a library call */
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return (int) ((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+/* Index of the lowest set bit, x must not be zero */
+static int lowest_bit64(uint64_t x)
+{
+#if defined(__GNUC__)
+	return __builtin_ctzll(x);
+#else
+	return popcount64((x & (~x + 1)) - 1);
+#endif
+}
+
+void cpu_feature_set_clear(cpu_feature_set_t* set)
+{
+	memset(set->bits, 0, sizeof(set->bits));
+}
+
+int cpu_feature_set_add(cpu_feature_set_t* set, cpu_feature_t feature)
+{
+	if ((feature < 0) || (feature >= NUM_CPU_FEATURES))
+		return cpuid_set_error(ERR_INVRANGE);
+	set->bits[feature / 64] |= 1ULL << (feature % 64);
+	return cpuid_set_error(ERR_OK);
+}
+
+void cpu_feature_set_from_flags(cpu_feature_set_t* set, const uint8_t* flags)
+{
+	int word, bit;
+	uint64_t bits;
+
+	for (word = 0; word < CPU_FEATURE_SET_WORDS; word++) {
+		bits = 0;
+		for (bit = 0; bit < 64; bit++)
+			bits |= (uint64_t) (flags[word * 64 + bit] != 0) << bit;
+		set->bits[word] = bits;
+	}
+}
+
+bool cpu_feature_set_is_subset(const cpu_feature_set_t* subset, const cpu_feature_set_t* set)
+{
+	int word;
+#if defined(FEATURE_SET_SSE2)
+	__m128i missing = _mm_setzero_si128();
+
+	for (word = 0; word < CPU_FEATURE_SET_WORDS; word += 2)
+		missing = _mm_or_si128(missing, _mm_andnot_si128(_mm_loadu_si128((const __m128i*) &set->bits[word]), _mm_loadu_si128((const __m128i*) &subset->bits[word])));
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(missing, _mm_setzero_si128())) == 0xffff;
+#elif defined(FEATURE_SET_NEON)
+	uint64x2_t missing = vdupq_n_u64(0);
+
+	for (word = 0; word < CPU_FEATURE_SET_WORDS; word += 2)
+		missing = vorrq_u64(missing, vbicq_u64(vld1q_u64(&subset->bits[word]), vld1q_u64(&set->bits[word])));
+	return (vgetq_lane_u64(missing, 0) | vgetq_lane_u64(missing, 1)) == 0;
+#else
+	uint64_t missing = 0;
+
+	for (word = 0; word < CPU_FEATURE_SET_WORDS; word++)
+		missing |= subset->bits[word] & ~set->bits[word];
+	return missing == 0;
+#endif
+}
+
+void cpu_feature_set_intersection(cpu_feature_set_t* result, const cpu_feature_set_t* a, const cpu_feature_set_t* b)
+{
+	int word;
+
+#if defined(VECTOR_AND)
+	for (word = 0; word < CPU_FEATURE_SET_WORDS; word += 2)
+		VECTOR_AND(&result->bits[word], &a->bits[word], &b->bits[word]);
+#else
+	for (word = 0; word < CPU_FEATURE_SET_WORDS; word++)
+		result->bits[word] = a->bits[word] & b->bits[word];
+#endif
+}
+
+void cpu_feature_set_union(cpu_feature_set_t* result, const cpu_feature_set_t* a, const cpu_feature_set_t* b)
+{
+	int word;
+
+#if defined(VECTOR_OR)
+	for (word = 0; word < CPU_FEATURE_SET_WORDS; word += 2)
+		VECTOR_OR(&result->bits[word], &a->bits[word], &b->bits[word]);
+#else
+	for (word = 0; word < CPU_FEATURE_SET_WORDS; word++)
+		result->bits[word] = a->bits[word] | b->bits[word];
+#endif
+}
+
+void cpu_feature_set_difference(cpu_feature_set_t* result, const cpu_feature_set_t* a, const cpu_feature_set_t* b)
+{
+	int word;
+
+#if defined(VECTOR_ANDNOT)
+	for (word = 0; word < CPU_FEATURE_SET_WORDS; word += 2)
+		VECTOR_ANDNOT(&result->bits[word], &a->bits[word], &b->bits[word]);
+#else
+	for (word = 0; word < CPU_FEATURE_SET_WORDS; word++)
+		result->bits[word] = a->bits[word] & ~b->bits[word];
+#endif
+}
+
+int cpu_feature_set_count(const cpu_feature_set_t* set)
+{
+	int word, count = 0;
+
+	for (word = 0; word < CPU_FEATURE_SET_WORDS; word++)
+		count += popcount64(set->bits[word]);
+	return count;
+}
+
+int cpu_feature_set_next(const cpu_feature_set_t* set, int feature)
+{
+	int word;
+	uint64_t bits;
+
+	feature = (feature < 0) ? 0 : feature + 1;
+	word    = feature / 64;
+	if (word >= CPU_FEATURE_SET_WORDS)
+		return -1;
+	/* In the word of the previous feature, only the bits above it */
+	bits = set->bits[word] & (~0ULL << (feature % 64));
+	while (bits == 0) {
+		if (++word >= CPU_FEATURE_SET_WORDS)
+			return -1;
+		bits = set->bits[word];
+	}
+	return word * 64 + lowest_bit64(bits);
+}
@@ -0,0 +1,408 @@
+/*
+ * Copyright 2024  Veselin Georgiev,
+ * anrieffNOSPAM @ mgail_DOT.com (convert to gmail)
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libcpuid.h"
+#include "libcpuid_util.h"
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+/* The JSON emitter writes system_id_t and cpu_id_t as they are decoded, without building a document in memory.
+   The output follows libcpuid.schema.json; without CPUID_JSON_PRETTY, it is a single line (an NDJSON record).
+   Strings are escaped so the output is always valid UTF-8: a byte which does not belong to a UTF-8 sequence
+   is written as \u00XX (i.e. read as Latin-1), since the brand string comes from the CPU. */
+
+#define JSON_FLUSH_SIZE 65536 /* output written to a file or a file descriptor is flushed in blocks of this size */
+#define JSON_MAX_DEPTH  16
+
+struct json_writer_t {
+	struct cpuid_buffer_t* buffer; /* output, or block written to file or fd */
+	FILE* file;
+	int fd;
+	bool pretty;
+	int depth;
+	uint32_t has_members;          /* bit n is set when the object or array at depth n is not empty */
+	int error;
+};
+
+static void json_flush(struct json_writer_t* w, bool force)
+{
+	if ((w->error != ERR_OK) || ((w->file == NULL) && (w->fd < 0)) || (!force && (w->buffer->size < JSON_FLUSH_SIZE)))
+		return;
+	if (w->file != NULL) {
+		if (fwrite(w->buffer->data, 1, w->buffer->size, w->file) != w->buffer->size)
+			w->error = ERR_OPEN;
+	}
+	else
+		w->error = write_fd(w->fd, w->buffer->data, w->buffer->size);
+	w->buffer->size = 0;
+}
+
+/* Returns where size bytes can be written, NULL after an error */
+static char* json_reserve(struct json_writer_t* w, size_t size)
+{
+	char* p;
+
+	if (w->error != ERR_OK)
+		return NULL;
+	if ((p = cpuid_buffer_reserve(w->buffer, size)) == NULL)
+		w->error = ERR_NO_MEM;
+	return p;
+}
+
+static void json_commit(struct json_writer_t* w, const char* end)
+{
+	w->buffer->size = (size_t) (end - w->buffer->data);
+}
+
+static void json_raw(struct json_writer_t* w, const char* str, size_t len)
+{
+	char* p;
+
+	if ((p = json_reserve(w, len)) != NULL) {
+		memcpy(p, str, len);
+		json_commit(w, p + len);
+	}
+}
+
+/* Returns the length of the UTF-8 sequence starting at s, 0 if it is invalid */
+static int utf8_sequence_length(const unsigned char* s)
+{
+	int i, length;
+
+	if ((*s >= 0xC2) && (*s <= 0xDF))
+		length = 2;
+	else if ((*s >= 0xE0) && (*s <= 0xEF))
+		length = 3;
+	else if ((*s >= 0xF0) && (*s <= 0xF4))
+		length = 4;
+	else
+		return 0;
+	for (i = 1; i < length; i++)
+		if ((s[i] & 0xC0) != 0x80)
+			return 0;
+	/* Reject the overlong forms, the UTF-16 surrogates (U+D800 to U+DFFF) and the code points above U+10FFFF */
+	if (((s[0] == 0xE0) && (s[1] < 0xA0)) ||
+	    ((s[0] == 0xED) && (s[1] > 0x9F)) ||
+	    ((s[0] == 0xF0) && (s[1] < 0x90)) ||
+	    ((s[0] == 0xF4) && (s[1] > 0x8F)))
+		return 0;
+	return length;
+}
+
+static void json_string_value(struct json_writer_t* w, const char* str)
+{
+	static const char hex_digits[] = "0123456789abcdef";
+	const unsigned char* s;
+	char* p;
+	int length;
+
+	/* Each byte takes at most 6 characters (\u00XX) */
+	if ((p = json_reserve(w, strlen(str) * 6 + 2)) == NULL)
+		return;
+	*p++ = '"';
+	for (s = (const unsigned char*) str; *s != '\0'; s++) {
+		if ((*s == '"') || (*s == '\\')) {
+			*p++ = '\\';
+			*p++ = (char) *s;
+		}
+		else if ((*s >= 0x80) && ((length = utf8_sequence_length(s)) > 0)) {
+			memcpy(p, s, length);
+			p += length;
+			s += length - 1;
+		}
+		else if ((*s < 0x20) || (*s >= 0x80)) {
+			memcpy(p, "\\u00", 4);
+			p[4] = hex_digits[*s >> 4];
+			p[5] = hex_digits[*s & 0xF];
+			p += 6;
+		}
+		else
+			*p++ = (char) *s;
+	}
+	*p++ = '"';
+	json_commit(w, p);
+}
+
+static void json_newline(struct json_writer_t* w, int depth)
+{
+	char* p;
+
+	if (w->pretty && ((p = json_reserve(w, 1 + 2 * depth)) != NULL)) {
+		*p = '\n';
+		memset(p + 1, ' ', 2 * depth);
+		json_commit(w, p + 1 + 2 * depth);
+	}
+}
+
+/* Starts a member of the current object (with a key) or array (key is NULL) */
+static void json_member(struct json_writer_t* w, const char* key)
+{
+	json_flush(w, false);
+	if (w->depth > 0) {
+		if (w->has_members & (1U << w->depth))
+			json_raw(w, ",", 1);
+		w->has_members |= 1U << w->depth;
+		json_newline(w, w->depth);
+	}
+	if (key != NULL) {
+		json_string_value(w, key);
+		json_raw(w, ": ", w->pretty ? 2 : 1);
+	}
+}
+
+static void json_begin(struct json_writer_t* w, const char* key, char open)
+{
+	json_member(w, key);
+	json_raw(w, &open, 1);
+	if (++w->depth >= JSON_MAX_DEPTH)
+		w->error = ERR_REQUEST;
+	w->has_members &= ~(1U << w->depth);
+}
+
+static void json_end(struct json_writer_t* w, char close)
+{
+	if (w->has_members & (1U << w->depth))
+		json_newline(w, w->depth - 1);
+	w->depth--;
+	json_raw(w, &close, 1);
+}
+
+static void json_int(struct json_writer_t* w, const char* key, int64_t value)
+{
+	char str[24];
+
+	json_member(w, key);
+	snprintf(str, sizeof(str), "%lld", (long long) value);
+	json_raw(w, str, strlen(str));
+}
+
+static void json_bool(struct json_writer_t* w, const char* key, bool value)
+{
+	json_member(w, key);
+	json_raw(w, value ? "true" : "false", value ? 4 : 5);
+}
+
+static void json_string(struct json_writer_t* w, const char* key, const char* value)
+{
+	json_member(w, key);
+	json_string_value(w, value);
+}
+
+/* 64-bit masks are written as hexadecimal strings, they do not fit in the doubles of most JSON parsers */
+static void json_hex64(struct json_writer_t* w, const char* key, uint64_t value)
+{
+	char str[24];
+
+	snprintf(str, sizeof(str), "0x%016llx", (unsigned long long) value);
+	json_string(w, key, str);
+}
+
+/* Same format as affinity_mask_str(), with a 0x prefix */
+static void json_affinity_mask(struct json_writer_t* w, const char* key, const cpu_affinity_mask_t* mask)
+{
+	static const char hex_digits[] = "0123456789ABCDEF";
+	int i, last;
+	char* p;
+
+	for (last = __MASK_SETSIZE - 1; (last >= 4) && (mask->__bits[last] == 0x00); last--);
+	json_member(w, key);
+	if ((p = json_reserve(w, 2 * (size_t) last + 6)) == NULL)
+		return;
+	memcpy(p, "\"0x", 3);
+	p += 3;
+	for (i = last; i >= 0; i--) {
+		*p++ = hex_digits[mask->__bits[i] >> 4];
+		*p++ = hex_digits[mask->__bits[i] & 0xF];
+	}
+	*p++ = '"';
+	json_commit(w, p);
+}
+
+static void json_cache(struct json_writer_t* w, const char* key, int32_t size, int32_t assoc, int32_t cacheline, int32_t instances)
+{
+	json_begin(w, key, '{');
+	json_int(w, "size_kb", size);
+	json_int(w, "assoc", assoc);
+	json_int(w, "cacheline", cacheline);
+	json_int(w, "instances", instances);
+	json_end(w, '}');
+}
+
+static void json_cpu_id(struct json_writer_t* w, const char* key, const struct cpu_id_t* id)
+{
+	int i;
+
+	json_begin(w, key, '{');
+	json_string(w, "architecture",  cpu_architecture_str(id->architecture));
+	json_string(w, "feature_level", cpu_feature_level_str(id->feature_level));
+	json_string(w, "purpose",       cpu_purpose_str(id->purpose));
+	json_int(w,    "vendor_id",     id->vendor);
+	json_string(w, "vendor_str",    id->vendor_str);
+	json_string(w, "brand_str",     id->brand_str);
+	if (id->architecture == ARCHITECTURE_X86) {
+		json_begin(w, "x86", '{');
+		json_int(w,  "family",                 id->x86.family);
+		json_int(w,  "model",                  id->x86.model);
+		json_int(w,  "stepping",               id->x86.stepping);
+		json_int(w,  "ext_family",             id->x86.ext_family);
+		json_int(w,  "ext_model",              id->x86.ext_model);
+		json_int(w,  "sse_size",               id->x86.sse_size);
+		json_bool(w, "sse_size_authoritative", id->detection_hints[CPU_HINT_SSE_SIZE_AUTH] != 0);
+		if (id->x86.sgx.present) {
+			json_begin(w, "sgx", '{');
+			json_int(w,   "max_enclave_32bit", id->x86.sgx.max_enclave_32bit);
+			json_int(w,   "max_enclave_64bit", id->x86.sgx.max_enclave_64bit);
+			json_bool(w,  "sgx1",              id->x86.sgx.flags[INTEL_SGX1] != 0);
+			json_bool(w,  "sgx2",              id->x86.sgx.flags[INTEL_SGX2] != 0);
+			json_int(w,   "misc_select",       id->x86.sgx.misc_select);
+			json_hex64(w, "secs_attributes",   id->x86.sgx.secs_attributes);
+			json_hex64(w, "secs_xfrm",         id->x86.sgx.secs_xfrm);
+			json_int(w,   "num_epc_sections",  id->x86.sgx.num_epc_sections);
+			json_end(w, '}');
+		}
+		json_end(w, '}');
+	}
+	else if (id->architecture == ARCHITECTURE_ARM) {
+		json_begin(w, "arm", '{');
+		json_int(w, "implementer", id->arm.implementer);
+		json_int(w, "variant",     id->arm.variant);
+		json_int(w, "part_num",    id->arm.part_num);
+		json_int(w, "revision",    id->arm.revision);
+		json_end(w, '}');
+	}
+	json_int(w, "num_cores",          id->num_cores);
+	json_int(w, "num_logical_cpus",   id->num_logical_cpus);
+	json_int(w, "total_logical_cpus", id->total_logical_cpus);
+	json_affinity_mask(w, "affinity_mask", &id->affinity_mask);
+	json_begin(w, "caches", '{');
+	json_cache(w, "l1_data",        id->l1_data_cache,        id->l1_data_assoc,        id->l1_data_cacheline,        id->l1_data_instances);
+	json_cache(w, "l1_instruction", id->l1_instruction_cache, id->l1_instruction_assoc, id->l1_instruction_cacheline, id->l1_instruction_instances);
+	json_cache(w, "l2",             id->l2_cache,             id->l2_assoc,             id->l2_cacheline,             id->l2_instances);
+	json_cache(w, "l3",             id->l3_cache,             id->l3_assoc,             id->l3_cacheline,             id->l3_instances);
+	json_cache(w, "l4",             id->l4_cache,             id->l4_assoc,             id->l4_cacheline,             id->l4_instances);
+	json_end(w, '}');
+	json_string(w, "codename",        id->cpu_codename);
+	json_string(w, "technology_node", id->technology_node);
+	json_begin(w, "features", '[');
+	for (i = 0; i < NUM_CPU_FEATURES; i++)
+		if (id->flags[i])
+			json_string(w, NULL, cpu_feature_str(i));
+	json_end(w, ']');
+	json_end(w, '}');
+}
+
+static void json_system_id(struct json_writer_t* w, const struct system_id_t* system)
+{
+	uint8_t cpu_type_index;
+
+	json_begin(w, NULL, '{');
+	json_string(w, "library_version", cpuid_lib_version());
+	json_int(w, "num_cpu_types", system->num_cpu_types);
+	json_begin(w, "total_instances", '{');
+	json_int(w, "l1_data",        system->l1_data_total_instances);
+	json_int(w, "l1_instruction", system->l1_instruction_total_instances);
+	json_int(w, "l2",             system->l2_total_instances);
+	json_int(w, "l3",             system->l3_total_instances);
+	json_int(w, "l4",             system->l4_total_instances);
+	json_end(w, '}');
+	json_begin(w, "cpu_types", '[');
+	for (cpu_type_index = 0; cpu_type_index < system->num_cpu_types; cpu_type_index++)
+		json_cpu_id(w, NULL, &system->cpu_types[cpu_type_index]);
+	json_end(w, ']');
+	json_end(w, '}');
+}
+
+/* Writes system (or id if system is NULL) to buffer, or through a block buffer to file or fd */
+static int cpuid_serialize_json_internal(const struct system_id_t* system, const struct cpu_id_t* id, int flags,
+                                         struct cpuid_buffer_t* buffer, FILE* file, int fd)
+{
+	struct cpuid_buffer_t block = { NULL, 0, 0 };
+	const size_t initial_size = (buffer != NULL) ? buffer->size : 0;
+	struct json_writer_t w;
+
+	memset(&w, 0, sizeof(w));
+	w.buffer = (buffer != NULL) ? buffer : &block;
+	w.file   = file;
+	w.fd     = fd;
+	w.pretty = (flags & CPUID_JSON_PRETTY) != 0;
+	w.error  = ERR_OK;
+
+	if (system != NULL)
+		json_system_id(&w, system);
+	else
+		json_cpu_id(&w, NULL, id);
+	json_raw(&w, "\n", 1);
+	json_flush(&w, true);
+	cpuid_free_buffer(&block);
+	if ((buffer != NULL) && (w.error != ERR_OK))
+		buffer->size = initial_size;
+	return w.error;
+}
+
+int cpuid_serialize_system_id_json(const struct system_id_t* system, const char* filename, int flags)
+{
+	int r;
+	FILE *f;
+
+	if ((system == NULL) || (filename == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	f = !strcmp(filename, "") ? stdout : fopen(filename, "wt");
+	if (!f)
+		return cpuid_set_error(ERR_OPEN);
+	debugf(1, "Writing JSON description of %u CPU types to '%s'\n", system->num_cpu_types, f == stdout ? "stdout" : filename);
+	r = cpuid_serialize_json_internal(system, NULL, flags, NULL, f, -1);
+	if (f != stdout) {
+		if ((fclose(f) != 0) && (r == ERR_OK))
+			r = ERR_OPEN;
+	}
+	else
+		fflush(f);
+	return cpuid_set_error(r);
+}
+
+int cpuid_serialize_system_id_json_fd(const struct system_id_t* system, int fd, int flags)
+{
+	if ((system == NULL) || (fd < 0))
+		return cpuid_set_error(ERR_HANDLE);
+	return cpuid_set_error(cpuid_serialize_json_internal(system, NULL, flags, NULL, NULL, fd));
+}
+
+int cpuid_serialize_system_id_json_buffer(const struct system_id_t* system, struct cpuid_buffer_t* buffer, int flags)
+{
+	if ((system == NULL) || (buffer == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	return cpuid_set_error(cpuid_serialize_json_internal(system, NULL, flags, buffer, NULL, -1));
+}
+
+int cpuid_serialize_cpu_id_json_buffer(const struct cpu_id_t* id, struct cpuid_buffer_t* buffer, int flags)
+{
+	if ((id == NULL) || (buffer == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	return cpuid_set_error(cpuid_serialize_json_internal(NULL, id, flags, buffer, NULL, -1));
+}
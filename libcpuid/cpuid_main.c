@@ -31,14 +31,13 @@
 #include "recog_intel.h"
 #include "asm-bits.h"
 #include "libcpuid_util.h"
-#if defined(PLATFORM_ARM) || defined(PLATFORM_AARCH64)
-# include "libcpuid_arm_driver.h"
-# include "rdcpuid.h"
-#endif /* ARM */
+#include "libcpuid_arm_driver.h"
+#include "rdcpuid.h"
 #ifdef HAVE_CONFIG_H
 # include "config.h"
 #endif /* HAVE_CONFIG_H */
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -232,27 +231,56 @@ static int get_total_cpus(void)
 #if defined linux || defined __linux__
 #include <sched.h>
 
-INTERNAL_SCOPE cpu_set_t saved_affinity;
+/* cpu_set_t is limited to CPU_SETSIZE (1024) logical CPUs, so the sets are sized for all the logical CPU numbers of cpu_affinity_mask_t
+   They are not allocated, as the affinity is saved and changed for each logical CPU */
+#define CPU_AFFINITY_SET_SIZE (__MASK_SETSIZE)
+INTERNAL_SCOPE unsigned long saved_affinity[CPU_AFFINITY_SET_SIZE / sizeof(unsigned long)];
+INTERNAL_SCOPE bool is_affinity_saved = false;
 
 static bool save_cpu_affinity(void)
 {
-	return sched_getaffinity(0, sizeof(saved_affinity), &saved_affinity) == 0;
+	is_affinity_saved = sched_getaffinity(0, CPU_AFFINITY_SET_SIZE, (cpu_set_t*) saved_affinity) == 0;
+	return is_affinity_saved;
 }
 
 static bool restore_cpu_affinity(void)
 {
-	return sched_setaffinity(0, sizeof(saved_affinity), &saved_affinity) == 0;
+	if (!is_affinity_saved)
+		return false;
+
+	is_affinity_saved = false;
+	return sched_setaffinity(0, CPU_AFFINITY_SET_SIZE, (cpu_set_t*) saved_affinity) == 0;
 }
 #define PRESERVE_CPU_AFFINITY
 
 static bool set_cpu_affinity(logical_cpu_t logical_cpu)
 {
-	cpu_set_t cpuset;
-	CPU_ZERO(&cpuset);
-	CPU_SET(logical_cpu, &cpuset);
-	return sched_setaffinity(0, sizeof(cpuset), &cpuset) == 0;
+	unsigned long cpuset[CPU_AFFINITY_SET_SIZE / sizeof(unsigned long)];
+	const size_t size = CPU_ALLOC_SIZE(logical_cpu + 1);
+
+	CPU_ZERO_S(size, (cpu_set_t*) cpuset);
+	CPU_SET_S(logical_cpu, size, (cpu_set_t*) cpuset);
+	return sched_setaffinity(0, size, (cpu_set_t*) cpuset) == 0;
 }
 #define SET_CPU_AFFINITY
+
+/* Reads the online logical CPUs, which have holes when some of them are offline (e.g. "0-3,8-11")
+   LIBCPUID_SYSFS_CPU_DIR allows to use another directory than /sys/devices/system/cpu, for testing purposes */
+static bool get_online_cpu_mask(cpu_affinity_mask_t* online_mask)
+{
+	bool ret;
+	char path[256];
+	FILE *f;
+	const char* sysfs_cpu_dir = cpuid_getenv_path("LIBCPUID_SYSFS_CPU_DIR");
+
+	snprintf(path, sizeof(path), "%s/online", sysfs_cpu_dir ? sysfs_cpu_dir : "/sys/devices/system/cpu");
+	if ((f = fopen(path, "r")) == NULL)
+		return false;
+	ret = read_cpu_list(f, online_mask);
+	fclose(f);
+	return ret;
+}
+#define GET_ONLINE_CPU_MASK
 #endif /* defined linux || defined __linux__ */
 
 #if defined sun || defined __sun
@@ -463,6 +491,14 @@ static bool set_cpu_affinity(logical_cpu_t logical_cpu)
 }
 #endif /* SET_CPU_AFFINITY */
 
+#ifndef GET_ONLINE_CPU_MASK
+static bool get_online_cpu_mask(cpu_affinity_mask_t* online_mask)
+{
+	UNUSED(online_mask);
+	return false;
+}
+#endif /* GET_ONLINE_CPU_MASK */
+
 int cpuid_set_error(cpu_error_t err)
 {
 	_libcpuid_errno = (int) err;
@@ -479,6 +515,218 @@ static void raw_data_t_constructor(struct cpu_raw_data_t* raw)
 	memset(raw, 0, sizeof(struct cpu_raw_data_t));
 }
 
+/* Size of the part of cpu_raw_data_t which is stored inline, before its table of leaves */
+#define RAW_DATA_FIXED_SIZE offsetof(struct cpu_raw_data_t, num_leaves)
+
+/* Empties raw data, but keeps its table of leaves allocated to be reused
+   The table is owned when max_leaves is not zero, otherwise it points to memory owned by something else (e.g. a snapshot) */
+static void raw_data_clear(struct cpu_raw_data_t* raw)
+{
+	struct cpu_raw_leaf_t* leaves = (raw->max_leaves > 0) ? raw->leaves : NULL;
+	const uint32_t max_leaves = raw->max_leaves;
+
+	raw_data_t_constructor(raw);
+	raw->leaves     = leaves;
+	raw->max_leaves = max_leaves;
+}
+
+/* Allocates at least n entries in raw->leaves, without changing num_leaves
+   The first allocation has the requested length, then the table grows geometrically, so leaves can be added one by one */
+static bool raw_data_reserve_leaves(struct cpu_raw_data_t* raw, uint32_t n)
+{
+	uint32_t max_leaves = (raw->max_leaves < 16) ? 16 : raw->max_leaves;
+	struct cpu_raw_leaf_t* tmp;
+
+	if (n <= raw->max_leaves)
+		return true;
+	if (n > (uint32_t) (SIZE_MAX / 2 / sizeof(struct cpu_raw_leaf_t)))
+		return false;
+	if (raw->max_leaves == 0)
+		max_leaves = (n < 16) ? 16 : n;
+	while (max_leaves < n)
+		max_leaves *= 2;
+	tmp = cpuid_realloc((raw->max_leaves > 0) ? raw->leaves : NULL, sizeof(struct cpu_raw_leaf_t) * max_leaves);
+	if (tmp == NULL)
+		return false;
+	/* A table which is not owned is copied */
+	if ((raw->max_leaves == 0) && (raw->num_leaves > 0))
+		memcpy(tmp, raw->leaves, sizeof(struct cpu_raw_leaf_t) * raw->num_leaves);
+	raw->leaves     = tmp;
+	raw->max_leaves = max_leaves;
+	return true;
+}
+
+/* Arrays of cpu_raw_data_t which hold a copy of some x86 leaves: consecutive leaves from leaf
+   (subleaf 0), or the subleaves of leaf when subleaves is true */
+struct raw_data_array_t {
+	size_t offset;
+	uint32_t count;
+	uint32_t leaf;
+	bool subleaves;
+};
+
+#define RAW_DATA_ARRAY(__field, __count, __leaf, __subleaves) { offsetof(struct cpu_raw_data_t, __field), __count, __leaf, __subleaves }
+static const struct raw_data_array_t raw_data_arrays[] = {
+	RAW_DATA_ARRAY(basic_cpuid,     MAX_CPUID_LEVEL,          0x00000000,              false),
+	RAW_DATA_ARRAY(ext_cpuid,       MAX_EXT_CPUID_LEVEL,      ADDRESS_EXT_CPUID_START, false),
+	RAW_DATA_ARRAY(intel_fn4,       MAX_INTELFN4_LEVEL,       0x00000004,              true),
+	RAW_DATA_ARRAY(intel_fn11,      MAX_INTELFN11_LEVEL,      0x0000000B,              true),
+	RAW_DATA_ARRAY(intel_fn12h,     MAX_INTELFN12H_LEVEL,     0x00000012,              true),
+	RAW_DATA_ARRAY(intel_fn14h,     MAX_INTELFN14H_LEVEL,     0x00000014,              true),
+	RAW_DATA_ARRAY(amd_fn8000001dh, MAX_AMDFN8000001DH_LEVEL, 0x8000001D,              true),
+	RAW_DATA_ARRAY(amd_fn80000026h, MAX_AMDFN80000026H_LEVEL, 0x80000026,              true),
+};
+#undef RAW_DATA_ARRAY
+
+/* Returns true if a leaf and subleaf fit in an array of cpu_raw_data_t, at index */
+static bool raw_data_array_index(const struct raw_data_array_t* array, uint32_t leaf, uint32_t subleaf, uint32_t* index)
+{
+	if (array->subleaves) {
+		*index = subleaf;
+		return (leaf == array->leaf) && (subleaf < array->count);
+	}
+	*index = leaf - array->leaf;
+	return (subleaf == 0) && (leaf >= array->leaf) && (leaf - array->leaf < array->count);
+}
+
+/* Returns the entry of an array of cpu_raw_data_t where a leaf and subleaf fit, NULL if it does not fit */
+static uint32_t* raw_data_array_entry(const struct raw_data_array_t* array, struct cpu_raw_data_t* raw, uint32_t leaf, uint32_t subleaf)
+{
+	uint32_t index;
+
+	if (!raw_data_array_index(array, leaf, subleaf, &index))
+		return NULL;
+	return (uint32_t*) ((uint8_t*) raw + array->offset) + index * NUM_REGS;
+}
+
+/* Leaf and subleaf of the element index of an array of cpu_raw_data_t */
+static void raw_data_array_leaf(const struct raw_data_array_t* array, uint32_t index, uint32_t* leaf, uint32_t* subleaf)
+{
+	*leaf    = array->subleaves ? array->leaf : array->leaf + index;
+	*subleaf = array->subleaves ? index : 0;
+}
+
+/* Returns the position of a leaf and subleaf in raw->leaves (binary search), or where it should be inserted */
+static uint32_t raw_data_leaf_position(const struct cpu_raw_data_t* raw, uint32_t leaf, uint32_t subleaf, bool* found)
+{
+	uint32_t first = 0, last = raw->num_leaves, middle;
+	const uint64_t key = ((uint64_t) leaf << 32) | subleaf;
+	const struct cpu_raw_leaf_t* entry;
+
+	while (first < last) {
+		middle = first + (last - first) / 2;
+		entry  = &raw->leaves[middle];
+		if ((((uint64_t) entry->leaf << 32) | entry->subleaf) < key)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+	*found = (first < raw->num_leaves) && (raw->leaves[first].leaf == leaf) && (raw->leaves[first].subleaf == subleaf);
+	return first;
+}
+
+/* Adds the leaves of the arrays of cpu_raw_data_t to its empty table of leaves (raw data filled by the caller)
+   Leaf 4 subleaf 0 is taken from basic_cpuid[4], like cpuid_get_raw_leaf() reads it */
+static bool raw_data_import_arrays(struct cpu_raw_data_t* raw)
+{
+	int i;
+	bool found;
+	uint32_t index, leaf, subleaf, position;
+	const uint32_t* regs;
+
+	for (i = 0; i < (int) COUNT_OF(raw_data_arrays); i++)
+		for (index = 0; index < raw_data_arrays[i].count; index++) {
+			regs = (const uint32_t*) ((const uint8_t*) raw + raw_data_arrays[i].offset) + index * NUM_REGS;
+			if (!(regs[EAX] | regs[EBX] | regs[ECX] | regs[EDX]))
+				continue;
+			raw_data_array_leaf(&raw_data_arrays[i], index, &leaf, &subleaf);
+			position = raw_data_leaf_position(raw, leaf, subleaf, &found);
+			if (found)
+				continue;
+			if (!raw_data_reserve_leaves(raw, raw->num_leaves + 1))
+				return false;
+			memmove(&raw->leaves[position + 1], &raw->leaves[position], (raw->num_leaves - position) * sizeof(struct cpu_raw_leaf_t));
+			raw->leaves[position].leaf    = leaf;
+			raw->leaves[position].subleaf = subleaf;
+			memcpy(raw->leaves[position].regs, regs, sizeof(raw->leaves[position].regs));
+			raw->num_leaves++;
+		}
+	return true;
+}
+
+static const uint32_t raw_data_zero_leaf[NUM_REGS] = { 0, 0, 0, 0 };
+
+const uint32_t* cpuid_get_raw_leaf(const struct cpu_raw_data_t* raw, uint32_t leaf, uint32_t subleaf)
+{
+	int i;
+	bool found;
+	uint32_t position;
+	const uint32_t* regs;
+
+	if (raw->num_leaves == 0) {
+		for (i = 0; i < (int) COUNT_OF(raw_data_arrays); i++)
+			if ((regs = raw_data_array_entry(&raw_data_arrays[i], (struct cpu_raw_data_t*) raw, leaf, subleaf)) != NULL)
+				return regs;
+		return raw_data_zero_leaf;
+	}
+	position = raw_data_leaf_position(raw, leaf, subleaf, &found);
+	return found ? raw->leaves[position].regs : raw_data_zero_leaf;
+}
+
+int cpuid_set_raw_leaf(struct cpu_raw_data_t* raw, uint32_t leaf, uint32_t subleaf, const uint32_t* regs)
+{
+	int i;
+	bool found;
+	uint32_t position;
+	uint32_t* entry;
+	const bool is_zero = !(regs[EAX] | regs[EBX] | regs[ECX] | regs[EDX]);
+
+	if ((raw->num_leaves == 0) && !raw_data_import_arrays(raw))
+		return cpuid_set_error(ERR_NO_MEM);
+	/* The table is also copied here when it is not owned */
+	if (!raw_data_reserve_leaves(raw, raw->num_leaves + (is_zero ? 0 : 1)))
+		return cpuid_set_error(ERR_NO_MEM);
+	position = raw_data_leaf_position(raw, leaf, subleaf, &found);
+	if (!found && !is_zero) {
+		memmove(&raw->leaves[position + 1], &raw->leaves[position], (raw->num_leaves - position) * sizeof(struct cpu_raw_leaf_t));
+		raw->leaves[position].leaf    = leaf;
+		raw->leaves[position].subleaf = subleaf;
+		raw->num_leaves++;
+	}
+	else if (found && is_zero) {
+		raw->num_leaves--;
+		memmove(&raw->leaves[position], &raw->leaves[position + 1], (raw->num_leaves - position) * sizeof(struct cpu_raw_leaf_t));
+	}
+	if (!is_zero)
+		memcpy(raw->leaves[position].regs, regs, sizeof(raw->leaves[position].regs));
+
+	for (i = 0; i < (int) COUNT_OF(raw_data_arrays); i++)
+		if ((entry = raw_data_array_entry(&raw_data_arrays[i], raw, leaf, subleaf)) != NULL)
+			memcpy(entry, regs, NUM_REGS * sizeof(uint32_t));
+	return cpuid_set_error(ERR_OK);
+}
+
+int cpuid_copy_raw_data(struct cpu_raw_data_t* dst, const struct cpu_raw_data_t* src)
+{
+	struct cpu_raw_leaf_t* leaves;
+	uint32_t max_leaves;
+
+	if (dst == src)
+		return cpuid_set_error(ERR_OK);
+	raw_data_clear(dst);
+	leaves     = dst->leaves;
+	max_leaves = dst->max_leaves;
+	memcpy(dst, src, RAW_DATA_FIXED_SIZE);
+	dst->leaves     = leaves;
+	dst->max_leaves = max_leaves;
+	if (!raw_data_reserve_leaves(dst, src->num_leaves))
+		return cpuid_set_error(ERR_NO_MEM);
+	if (src->num_leaves > 0)
+		memcpy(dst->leaves, src->leaves, sizeof(struct cpu_raw_leaf_t) * src->num_leaves);
+	dst->num_leaves = src->num_leaves;
+	return cpuid_set_error(ERR_OK);
+}
+
 static void cpu_id_t_constructor(struct cpu_id_t* id)
 {
 	memset(id, 0, sizeof(struct cpu_id_t));
@@ -530,13 +778,22 @@ static void topology_t_constructor(struct internal_topology_t* topology, logical
 static void core_instances_t_constructor(struct internal_core_instances_t* data)
 {
 	data->instances = 0;
-	memset(data->htable, 0, sizeof(data->htable));
 }
 
 static void cache_instances_t_constructor(struct internal_cache_instances_t* data)
 {
 	memset(data->instances, 0, sizeof(data->instances));
-	memset(data->htable,    0, sizeof(data->htable));
+}
+
+static void id_table_t_constructor(struct internal_id_table_t* table)
+{
+	uint32_t i;
+
+	table->num_ids   = 0;
+	table->num_slots = ID_TABLE_INLINE_SLOTS;
+	table->slots     = table->inline_slots;
+	for (i = 0; i < ID_TABLE_INLINE_SLOTS; i++)
+		table->inline_slots[i].set = -1;
 }
 
 static void type_info_array_t_constructor(struct internal_type_info_array_t* data)
@@ -564,391 +821,1762 @@ static int16_t cpuid_find_index_system_id(struct system_id_t* system, cpu_purpos
 	return -1;
 }
 
-static void cpuid_grow_raw_data_array(struct cpu_raw_data_array_t* raw_array, logical_cpu_t n)
+/* Allocates at least n items in raw_array, without changing num_raw
+   capacity is the number of allocated items, it grows geometrically so items can be added one by one */
+static bool cpuid_reserve_raw_data_array(struct cpu_raw_data_array_t* raw_array, uint32_t n, uint32_t* capacity)
+{
+	uint32_t new_capacity = n;
+	struct cpu_raw_data_t *tmp;
+
+	if (n <= *capacity) return true;
+	if (2 * *capacity > new_capacity)
+		new_capacity = 2 * *capacity;
+	debugf(3, "Allocating %u items in cpu_raw_data_array_t\n", new_capacity);
+	tmp = cpuid_realloc(raw_array->raw, sizeof(struct cpu_raw_data_t) * new_capacity);
+	if (tmp == NULL) { /* Memory allocation failure */
+		cpuid_set_error(ERR_NO_MEM);
+		return false;
+	}
+	raw_array->raw = tmp;
+	*capacity      = new_capacity;
+	return true;
+}
+
+/* Grows raw_array to n items, capacity is optional (see cpuid_reserve_raw_data_array()) */
+static void cpuid_grow_raw_data_array(struct cpu_raw_data_array_t* raw_array, logical_cpu_t n, uint32_t* capacity)
 {
 	logical_cpu_t i;
-	struct cpu_raw_data_t *tmp = NULL;
+	uint32_t exact_capacity = raw_array->num_raw;
 
-	if ((n <= 0) || (n < raw_array->num_raw)) return;
+	if ((n <= 0) || (n <= raw_array->num_raw)) return;
 	debugf(3, "Growing cpu_raw_data_array_t from %u to %u items\n", raw_array->num_raw, n);
-	tmp = realloc(raw_array->raw, sizeof(struct cpu_raw_data_t) * n);
+	if (!cpuid_reserve_raw_data_array(raw_array, n, (capacity != NULL) ? capacity : &exact_capacity))
+		return;
+
+	for (i = raw_array->num_raw; i < n; i++) {
+		raw_data_t_constructor(&raw_array->raw[i]);
+		raw_array->raw[i].os_cpu = (logical_cpu_t) i;
+	}
+	raw_array->num_raw = n;
+}
+
+/* Releases the items allocated by cpuid_grow_raw_data_array() above num_raw */
+static void cpuid_shrink_raw_data_array(struct cpu_raw_data_array_t* raw_array, uint32_t capacity)
+{
+	struct cpu_raw_data_t *tmp;
+
+	if (capacity <= raw_array->num_raw) return;
+	if (raw_array->num_raw == 0) {
+		cpuid_free(raw_array->raw);
+		raw_array->raw = NULL;
+		return;
+	}
+	if ((tmp = cpuid_realloc(raw_array->raw, sizeof(struct cpu_raw_data_t) * raw_array->num_raw)) != NULL)
+		raw_array->raw = tmp;
+}
+
+/* A logical CPU uses a new template when it has more differences than this with all the existing ones */
+#define MAX_RAW_DATA_DELTAS 32
+/* The words of raw data are the ones of cpu_raw_data_t before its table of leaves, then the registers of each leaf */
+#define RAW_DATA_WORDS      (RAW_DATA_FIXED_SIZE / sizeof(uint32_t))
+
+static void cpu_raw_data_compact_t_constructor(struct cpu_raw_data_compact_t* data, bool with_affinity)
+{
+	memset(data, 0, sizeof(struct cpu_raw_data_compact_t));
+#ifdef SET_CPU_AFFINITY
+	data->with_affinity = with_affinity;
+#else
+	UNUSED(with_affinity);
+#endif
+}
+
+static uint32_t raw_data_num_words(const struct cpu_raw_data_t* raw)
+{
+	return (uint32_t) RAW_DATA_WORDS + raw->num_leaves * NUM_REGS;
+}
+
+static uint32_t raw_data_word(const struct cpu_raw_data_t* raw, uint32_t word)
+{
+	uint32_t value;
+
+	if (word >= RAW_DATA_WORDS)
+		return raw->leaves[(word - RAW_DATA_WORDS) / NUM_REGS].regs[(word - RAW_DATA_WORDS) % NUM_REGS];
+	memcpy(&value, (const uint8_t*) raw + word * sizeof(uint32_t), sizeof(uint32_t));
+	return value;
+}
+
+static void raw_data_set_word(struct cpu_raw_data_t* raw, uint32_t word, uint32_t value)
+{
+	if (word >= RAW_DATA_WORDS)
+		raw->leaves[(word - RAW_DATA_WORDS) / NUM_REGS].regs[(word - RAW_DATA_WORDS) % NUM_REGS] = value;
+	else
+		memcpy((uint8_t*) raw + word * sizeof(uint32_t), &value, sizeof(uint32_t));
+}
+
+/* Returns true if two raw data have the same leaves and subleaves in their table (their registers may differ) */
+static bool raw_data_same_leaves(const struct cpu_raw_data_t* raw1, const struct cpu_raw_data_t* raw2)
+{
+	uint32_t i;
+
+	if (raw1->num_leaves != raw2->num_leaves)
+		return false;
+	for (i = 0; i < raw1->num_leaves; i++)
+		if ((raw1->leaves[i].leaf != raw2->leaves[i].leaf) || (raw1->leaves[i].subleaf != raw2->leaves[i].subleaf))
+			return false;
+	return true;
+}
+
+/* Returns the number of words which differ between two raw data with the same leaves, or max_deltas + 1 if there are more */
+static uint32_t count_raw_data_deltas(const struct cpu_raw_data_t* template_raw, const struct cpu_raw_data_t* raw, uint32_t max_deltas)
+{
+	uint32_t word, num_deltas = 0;
+	const uint32_t num_words = raw_data_num_words(raw);
+
+	for (word = 0; (word < num_words) && (num_deltas <= max_deltas); word++)
+		if (raw_data_word(template_raw, word) != raw_data_word(raw, word))
+			num_deltas++;
+	return num_deltas;
+}
+
+/* Makes room for one more logical CPU and n_deltas more differences in compact raw data */
+static bool grow_raw_data_compact(struct cpu_raw_data_compact_t* data, uint32_t n_deltas)
+{
+	uint16_t* tmp_index;
+	uint32_t* tmp_first;
+	struct cpu_raw_data_delta_t* tmp_deltas;
+	logical_cpu_t max_raw = data->max_raw;
+	uint32_t max_deltas = data->max_deltas;
+
+	if (data->num_raw >= data->max_raw) {
+		max_raw = (data->max_raw == 0) ? 16 : (data->max_raw >= (logical_cpu_t) -1 / 2) ? (logical_cpu_t) -1 : data->max_raw * 2;
+		debugf(3, "Growing cpu_raw_data_compact_t from %u to %u logical CPUs\n", data->max_raw, max_raw);
+		if ((tmp_index = cpuid_realloc(data->template_index, sizeof(uint16_t) * max_raw)) == NULL)
+			return false;
+		data->template_index = tmp_index;
+		if ((tmp_first = cpuid_realloc(data->first_delta, sizeof(uint32_t) * (max_raw + 1))) == NULL)
+			return false;
+		data->first_delta = tmp_first;
+		data->max_raw     = max_raw;
+	}
+	if (data->num_deltas + n_deltas > data->max_deltas) {
+		for (max_deltas = (data->max_deltas == 0) ? 64 : data->max_deltas; max_deltas < data->num_deltas + n_deltas; max_deltas *= 2);
+		debugf(3, "Growing cpu_raw_data_compact_t from %u to %u differences\n", data->max_deltas, max_deltas);
+		if ((tmp_deltas = cpuid_realloc(data->deltas, sizeof(struct cpu_raw_data_delta_t) * max_deltas)) == NULL)
+			return false;
+		data->deltas     = tmp_deltas;
+		data->max_deltas = max_deltas;
+	}
+	return true;
+}
+
+/* Appends the raw data of the next logical CPU to compact raw data */
+static int cpuid_compact_append(struct cpu_raw_data_compact_t* data, const struct cpu_raw_data_t* raw)
+{
+	uint16_t i, template_index = 0;
+	uint32_t word, num_deltas;
+	struct cpu_raw_data_t* tmp;
+	const struct cpu_raw_data_t* template_raw;
+
+	if (data->num_raw == (logical_cpu_t) -1)
+		return cpuid_set_error(ERR_INVCNB);
+
+	/* Look for a template: the one of the previous logical CPU matches most of the time
+	   The words of a difference are 16-bit, a logical CPU with more words is its own template */
+	for (i = 0; (i < data->num_templates) && (raw_data_num_words(raw) <= UINT16_MAX + 1); i++) {
+		template_index = (data->num_raw > 0) ? (data->template_index[data->num_raw - 1] + i) % data->num_templates : i;
+		if (raw_data_same_leaves(&data->templates[template_index], raw) &&
+		    (count_raw_data_deltas(&data->templates[template_index], raw, MAX_RAW_DATA_DELTAS) <= MAX_RAW_DATA_DELTAS))
+			break;
+	}
+	if ((i >= data->num_templates) || (raw_data_num_words(raw) > UINT16_MAX + 1)) {
+		debugf(3, "Adding template #%u for logical CPU %u in cpu_raw_data_compact_t\n", data->num_templates, data->num_raw);
+		if ((data->num_templates == UINT16_MAX) ||
+		    ((tmp = cpuid_realloc(data->templates, sizeof(struct cpu_raw_data_t) * (data->num_templates + 1))) == NULL))
+			return cpuid_set_error(ERR_NO_MEM);
+		data->templates = tmp;
+		template_index  = data->num_templates++;
+		raw_data_t_constructor(&data->templates[template_index]);
+		if (cpuid_copy_raw_data(&data->templates[template_index], raw) != ERR_OK)
+			return cpuid_set_error(ERR_NO_MEM);
+	}
+	template_raw = &data->templates[template_index];
+	num_deltas   = count_raw_data_deltas(template_raw, raw, raw_data_num_words(raw));
+
+	/* Store the differences with the template */
+	if (!grow_raw_data_compact(data, num_deltas))
+		return cpuid_set_error(ERR_NO_MEM);
+	data->template_index[data->num_raw] = template_index;
+	data->first_delta[data->num_raw]    = data->num_deltas;
+	for (word = 0; word < raw_data_num_words(raw); word++)
+		if (raw_data_word(template_raw, word) != raw_data_word(raw, word)) {
+			data->deltas[data->num_deltas].word  = (uint16_t) word;
+			data->deltas[data->num_deltas].value = raw_data_word(raw, word);
+			data->num_deltas++;
+		}
+	data->num_raw++;
+	data->first_delta[data->num_raw] = data->num_deltas;
+	return cpuid_set_error(ERR_OK);
+}
+
+/* Copies the raw data of a logical CPU from compact raw data to raw, which is initialized (its table of leaves is reused) */
+static int compact_raw_data_get(const struct cpu_raw_data_compact_t* data, logical_cpu_t logical_cpu, struct cpu_raw_data_t* raw)
+{
+	uint32_t i;
+
+	if (cpuid_copy_raw_data(raw, &data->templates[data->template_index[logical_cpu]]) != ERR_OK)
+		return ERR_NO_MEM;
+	for (i = data->first_delta[logical_cpu]; i < data->first_delta[logical_cpu + 1]; i++)
+		raw_data_set_word(raw, data->deltas[i].word, data->deltas[i].value);
+	return ERR_OK;
+}
+
+static void cpuid_grow_system_id(struct system_id_t* system, uint8_t n)
+{
+	uint8_t i;
+	struct cpu_id_t *tmp = NULL;
+
+	if ((n <= 0) || (n < system->num_cpu_types)) return;
+	debugf(3, "Growing system_id_t from %u to %u items\n", system->num_cpu_types, n);
+	tmp = cpuid_realloc(system->cpu_types, sizeof(struct cpu_id_t) * n);
 	if (tmp == NULL) { /* Memory allocation failure */
 		cpuid_set_error(ERR_NO_MEM);
 		return;
 	}
-
-	for (i = raw_array->num_raw; i < n; i++)
-		raw_data_t_constructor(&tmp[i]);
-	raw_array->num_raw = n;
-	raw_array->raw     = tmp;
+
+	for (i = system->num_cpu_types; i < n; i++)
+		cpu_id_t_constructor(&tmp[i]);
+	system->num_cpu_types = n;
+	system->cpu_types     = tmp;
+}
+
+static void cpuid_grow_type_info(struct internal_type_info_array_t* type_info, uint8_t n)
+{
+	uint8_t i;
+	struct internal_type_info_t *tmp = NULL;
+
+	if ((n <= 0) || (n < type_info->num)) return;
+	debugf(3, "Growing internal_type_info_t from %u to %u items\n", type_info->num, n);
+	tmp = cpuid_realloc(type_info->data, sizeof(struct internal_type_info_t) * n);
+	if (tmp == NULL) { /* Memory allocation failure */
+		cpuid_set_error(ERR_NO_MEM);
+		return;
+	}
+
+	for (i = type_info->num; i < n; i++) {
+		core_instances_t_constructor(&tmp[i].core_instances);
+		cache_instances_t_constructor(&tmp[i].cache_instances);
+	}
+	type_info->num  = n;
+	type_info->data = tmp;
+}
+
+static void cpuid_free_type_info(struct internal_type_info_array_t* type_info)
+{
+	if (type_info->num <= 0) return;
+	cpuid_free(type_info->data);
+	type_info->num = 0;
+}
+
+static void cpuid_free_id_table(struct internal_id_table_t* table)
+{
+	if (table->slots != table->inline_slots)
+		cpuid_free(table->slots);
+	table->slots = NULL;
+}
+
+static cpu_architecture_t cpuid_architecture_identify(const struct cpu_raw_data_t* raw)
+{
+	const uint32_t* fn0 = cpuid_get_raw_leaf(raw, 0, 0);
+
+	if (fn0[EAX] != 0x0 || fn0[EBX] != 0x0 || fn0[ECX] != 0x0 || fn0[EDX] != 0x0)
+		return ARCHITECTURE_X86;
+	else if (raw->arm_midr != 0x0)
+		return ARCHITECTURE_ARM;
+
+	return ARCHITECTURE_UNKNOWN;
+}
+
+/* Where the deserializer stores the raw data of each logical CPU, for an array or for compact raw data */
+struct raw_data_output_t {
+	struct cpu_raw_data_array_t* raw_array;
+	struct cpu_raw_data_compact_t* compact;
+	uint32_t capacity;             /* raw array: number of allocated items */
+	struct cpu_raw_data_t current; /* compact: raw data of the logical CPU being read */
+	int32_t current_cpu;           /* compact: logical CPU being read, -1 if none */
+	int error;
+};
+
+/* Appends the logical CPU being read to compact raw data (with empty logical CPUs for the missing ones) */
+static void raw_data_output_flush(struct raw_data_output_t* output)
+{
+	struct cpu_raw_data_t empty;
+
+	if ((output->compact == NULL) || (output->current_cpu < 0))
+		return;
+	raw_data_t_constructor(&empty);
+	while ((output->error == ERR_OK) && (output->compact->num_raw < output->current_cpu)) {
+		empty.os_cpu = output->compact->num_raw;
+		output->error = cpuid_compact_append(output->compact, &empty);
+	}
+	if (output->error == ERR_OK)
+		output->error = cpuid_compact_append(output->compact, &output->current);
+	output->current_cpu = -1;
+}
+
+/* Returns where the raw data of a logical CPU must be written */
+static struct cpu_raw_data_t* raw_data_output_select(struct raw_data_output_t* output, logical_cpu_t logical_cpu, bool with_affinity)
+{
+	struct cpu_raw_data_t* raw;
+
+	if (output->raw_array != NULL) {
+		cpuid_grow_raw_data_array(output->raw_array, logical_cpu + 1, &output->capacity);
+		output->raw_array->with_affinity = with_affinity;
+		raw = &output->raw_array->raw[logical_cpu];
+		/* The logical CPUs usually have the same leaves: the table is allocated once, like the previous one */
+		if ((logical_cpu > 0) && (raw->max_leaves == 0) && (raw->num_leaves == 0))
+			raw_data_reserve_leaves(raw, output->raw_array->raw[logical_cpu - 1].num_leaves);
+		return raw;
+	}
+	output->compact->with_affinity = with_affinity;
+	if (output->current_cpu != (int32_t) logical_cpu) {
+		raw_data_output_flush(output);
+		if (logical_cpu < output->compact->num_raw)
+			warnf("Warning: logical CPU %u is not in ascending order, it is ignored in compact raw data\n", logical_cpu);
+		else
+			output->current_cpu = logical_cpu;
+		raw_data_clear(&output->current);
+		output->current.os_cpu = logical_cpu;
+	}
+	return &output->current;
+}
+
+/* Copies the raw data of a logical CPU already read (before current_cpu) to raw, except os_cpu
+   Returns false if there is no such logical CPU */
+static bool raw_data_output_copy(const struct raw_data_output_t* output, uint32_t logical_cpu, logical_cpu_t current_cpu, struct cpu_raw_data_t* raw)
+{
+	const logical_cpu_t os_cpu = raw->os_cpu;
+
+	if (logical_cpu >= current_cpu)
+		return false;
+	if (output->raw_array != NULL) {
+		if (cpuid_copy_raw_data(raw, &output->raw_array->raw[logical_cpu]) != ERR_OK)
+			return false;
+	}
+	else if ((logical_cpu >= output->compact->num_raw) || (compact_raw_data_get(output->compact, (logical_cpu_t) logical_cpu, raw) != ERR_OK))
+		return false;
+	raw->os_cpu = os_cpu;
+	return true;
+}
+
+/* Releases the raw data of the logical CPU being read */
+static void raw_data_output_end(struct raw_data_output_t* output)
+{
+	cpuid_free_raw_data(&output->current);
+}
+
+static logical_cpu_t raw_data_output_num_cpus(const struct raw_data_output_t* output)
+{
+	if (output->raw_array != NULL)
+		return output->raw_array->num_raw;
+	return output->compact->num_raw + ((output->current_cpu >= 0) ? 1 : 0);
+}
+
+/* Binary raw dumps, all integers are little-endian:
+   - header: magic (8 bytes), format version (16-bit), sizes of the header, of an index entry and of a record
+     (8-bit each), reserved (3 bytes), flags, number of logical CPUs, number of records, offset of the index,
+     offset of the records (32-bit each), reserved (4 bytes), version of the library (NUL-terminated)
+   - index: for each logical CPU, its OS number and its first record (32-bit each)
+   - records: for each logical CPU, the non-zero fields of cpu_raw_data_t, then the leaves which do not fit in them
+     (sparse leaves): type, index (subleaf for sparse leaves),
+     leaf (sparse leaves only) and the 4 words of data (32-bit each, 64-bit registers are split in low and high words)
+   Readers use the sizes from the header, so a later version can append new items to each part. */
+#define BINARY_DUMP_MAGIC        "\177LCPUID\032"
+#define BINARY_DUMP_MAGIC_SIZE   8
+#define BINARY_DUMP_VERSION      1
+#define BINARY_DUMP_HEADER_SIZE  64
+#define BINARY_DUMP_INDEX_SIZE   8
+#define BINARY_DUMP_FLAG_ARRAY   0x1 /* written from cpu_raw_data_array_t::with_affinity */
+#define BINARY_RECORD_SPARSE     0   /* record type of the leaves which do not fit in the arrays of cpu_raw_data_t */
+/* BINARY_DUMP_RECORD_SIZE is in libcpuid_internal.h, the records are also used by raw dump archives */
+
+typedef enum {
+	FIELD_X86_REGS, /* uint32_t[NUM_REGS] */
+	FIELD_AARCH32,  /* uint32_t */
+	FIELD_AARCH64,  /* uint64_t */
+} raw_data_field_kind_t;
+
+/* Fields of cpu_raw_data_t, with their name in text raw dumps and their record type in binary raw dumps
+   The record types are part of the binary format, they must never change */
+struct raw_data_field_t {
+	uint32_t type;
+	raw_data_field_kind_t kind;
+	size_t offset;
+	uint32_t count;
+	const char* name;
+	size_t name_len;
+	bool indexed; /* false for single registers, written without index in text raw dumps */
+};
+
+#define RAW_DATA_FIELD(__type, __kind, __field, __count) { __type, __kind, offsetof(struct cpu_raw_data_t, __field), __count, #__field, sizeof(#__field) - 1, true }
+#define RAW_DATA_REG(__type, __field) { __type, FIELD_AARCH64, offsetof(struct cpu_raw_data_t, __field), 1, #__field, sizeof(#__field) - 1, false }
+static const struct raw_data_field_t raw_data_fields[] = {
+	RAW_DATA_FIELD( 1, FIELD_X86_REGS, basic_cpuid,      MAX_CPUID_LEVEL),
+	RAW_DATA_FIELD( 2, FIELD_X86_REGS, ext_cpuid,        MAX_EXT_CPUID_LEVEL),
+	RAW_DATA_FIELD( 3, FIELD_X86_REGS, intel_fn4,        MAX_INTELFN4_LEVEL),
+	RAW_DATA_FIELD( 4, FIELD_X86_REGS, intel_fn11,       MAX_INTELFN11_LEVEL),
+	RAW_DATA_FIELD( 5, FIELD_X86_REGS, intel_fn12h,      MAX_INTELFN12H_LEVEL),
+	RAW_DATA_FIELD( 6, FIELD_X86_REGS, intel_fn14h,      MAX_INTELFN14H_LEVEL),
+	RAW_DATA_FIELD( 7, FIELD_X86_REGS, amd_fn8000001dh,  MAX_AMDFN8000001DH_LEVEL),
+	RAW_DATA_FIELD( 8, FIELD_X86_REGS, amd_fn80000026h,  MAX_AMDFN80000026H_LEVEL),
+	RAW_DATA_REG(16, arm_midr),
+	RAW_DATA_REG(17, arm_mpidr),
+	RAW_DATA_REG(18, arm_revidr),
+	RAW_DATA_FIELD(19, FIELD_AARCH32,  arm_id_afr,       MAX_ARM_ID_AFR_REGS),
+	RAW_DATA_FIELD(20, FIELD_AARCH32,  arm_id_dfr,       MAX_ARM_ID_DFR_REGS),
+	RAW_DATA_FIELD(21, FIELD_AARCH32,  arm_id_isar,      MAX_ARM_ID_ISAR_REGS),
+	RAW_DATA_FIELD(22, FIELD_AARCH32,  arm_id_mmfr,      MAX_ARM_ID_MMFR_REGS),
+	RAW_DATA_FIELD(23, FIELD_AARCH32,  arm_id_pfr,       MAX_ARM_ID_PFR_REGS),
+	RAW_DATA_FIELD(24, FIELD_AARCH64,  arm_id_aa64afr,   MAX_ARM_ID_AA64AFR_REGS),
+	RAW_DATA_FIELD(25, FIELD_AARCH64,  arm_id_aa64dfr,   MAX_ARM_ID_AA64DFR_REGS),
+	RAW_DATA_FIELD(26, FIELD_AARCH64,  arm_id_aa64fpfr,  MAX_ARM_ID_AA64FPFR_REGS),
+	RAW_DATA_FIELD(27, FIELD_AARCH64,  arm_id_aa64isar,  MAX_ARM_ID_AA64ISAR_REGS),
+	RAW_DATA_FIELD(28, FIELD_AARCH64,  arm_id_aa64mmfr,  MAX_ARM_ID_AA64MMFR_REGS),
+	RAW_DATA_FIELD(29, FIELD_AARCH64,  arm_id_aa64pfr,   MAX_ARM_ID_AA64PFR_REGS),
+	RAW_DATA_FIELD(30, FIELD_AARCH64,  arm_id_aa64smfr,  MAX_ARM_ID_AA64SMFR_REGS),
+	RAW_DATA_FIELD(31, FIELD_AARCH64,  arm_id_aa64zfr,   MAX_ARM_ID_AA64ZFR_REGS),
+};
+#undef RAW_DATA_FIELD
+#undef RAW_DATA_REG
+
+/* Returns the leaf and subleaf of element index of an x86 field */
+static void raw_data_field_leaf(const struct raw_data_field_t* field, uint32_t index, uint32_t* leaf, uint32_t* subleaf)
+{
+	int i;
+
+	for (i = 0; (i < (int) COUNT_OF(raw_data_arrays) - 1) && (raw_data_arrays[i].offset != field->offset); i++);
+	raw_data_array_leaf(&raw_data_arrays[i], index, leaf, subleaf);
+}
+
+/* Reads element index of a field as 4 words (64-bit registers are split in low and high words),
+   returns false if they are all zero. x86 leaves are read with cpuid_get_raw_leaf(). */
+static bool raw_data_field_get(const struct cpu_raw_data_t* raw, const struct raw_data_field_t* field, uint32_t index, uint32_t* words)
+{
+	uint32_t leaf, subleaf;
+	uint64_t aarch64_reg;
+	const uint8_t* p = (const uint8_t*) raw + field->offset;
+
+	memset(words, 0, NUM_REGS * sizeof(uint32_t));
+	switch (field->kind) {
+		case FIELD_X86_REGS:
+			raw_data_field_leaf(field, index, &leaf, &subleaf);
+			memcpy(words, cpuid_get_raw_leaf(raw, leaf, subleaf), NUM_REGS * sizeof(uint32_t));
+			break;
+		case FIELD_AARCH32:
+			memcpy(&words[0], p + index * sizeof(uint32_t), sizeof(uint32_t));
+			break;
+		case FIELD_AARCH64:
+			memcpy(&aarch64_reg, p + index * sizeof(uint64_t), sizeof(uint64_t));
+			words[0] = (uint32_t) aarch64_reg;
+			words[1] = (uint32_t) (aarch64_reg >> 32);
+			break;
+	}
+	return (words[0] | words[1] | words[2] | words[3]) != 0;
+}
+
+/* Writes element index of a field, x86 leaves are written with cpuid_set_raw_leaf()
+   Returns false if out of memory */
+static bool raw_data_field_set(struct cpu_raw_data_t* raw, const struct raw_data_field_t* field, uint32_t index, const uint32_t* words)
+{
+	uint32_t leaf, subleaf;
+	uint64_t aarch64_reg;
+	uint8_t* p = (uint8_t*) raw + field->offset;
+
+	switch (field->kind) {
+		case FIELD_X86_REGS:
+			raw_data_field_leaf(field, index, &leaf, &subleaf);
+			return cpuid_set_raw_leaf(raw, leaf, subleaf, words) == ERR_OK;
+		case FIELD_AARCH32:
+			memcpy(p + index * sizeof(uint32_t), &words[0], sizeof(uint32_t));
+			break;
+		case FIELD_AARCH64:
+			aarch64_reg = ((uint64_t) words[1] << 32) | words[0];
+			memcpy(p + index * sizeof(uint64_t), &aarch64_reg, sizeof(uint64_t));
+			break;
+	}
+	return true;
+}
+
+/* Returns true if a leaf of the table of raw data does not fit in the arrays of cpu_raw_data_t */
+static bool raw_data_is_sparse_leaf(const struct cpu_raw_leaf_t* entry)
+{
+	int i;
+	uint32_t index;
+
+	for (i = 0; i < (int) COUNT_OF(raw_data_arrays); i++)
+		if (raw_data_array_index(&raw_data_arrays[i], entry->leaf, entry->subleaf, &index))
+			return false;
+	return true;
+}
+
+static void binary_record_write(uint8_t* record, uint32_t type, uint32_t index, uint32_t leaf, const uint32_t* words)
+{
+	int i;
+
+	set_le32(record,     type);
+	set_le32(record + 4, index);
+	set_le32(record + 8, leaf);
+	for (i = 0; i < NUM_REGS; i++)
+		set_le32(record + 12 + 4 * i, words[i]);
+}
+
+uint32_t binary_dump_write_records(const struct cpu_raw_data_t* raw, uint8_t* records)
+{
+	int i;
+	uint32_t index, leaf, num_records = 0;
+	uint32_t words[NUM_REGS];
+
+	for (i = 0; i < (int) COUNT_OF(raw_data_fields); i++)
+		for (index = 0; index < raw_data_fields[i].count; index++)
+			if (raw_data_field_get(raw, &raw_data_fields[i], index, words)) {
+				if (records != NULL)
+					binary_record_write(records + num_records * BINARY_DUMP_RECORD_SIZE, raw_data_fields[i].type, index, 0, words);
+				num_records++;
+			}
+	for (leaf = 0; leaf < raw->num_leaves; leaf++) {
+		if (!raw_data_is_sparse_leaf(&raw->leaves[leaf]))
+			continue;
+		if (records != NULL)
+			binary_record_write(records + num_records * BINARY_DUMP_RECORD_SIZE, BINARY_RECORD_SPARSE,
+				raw->leaves[leaf].subleaf, raw->leaves[leaf].leaf, raw->leaves[leaf].regs);
+		num_records++;
+	}
+	return num_records;
+}
+
+/* Builds the binary raw dump of single_raw or raw_array in an allocated buffer */
+static uint8_t* binary_dump_build(const struct cpu_raw_data_t* single_raw, const struct cpu_raw_data_array_t* raw_array, size_t* size)
+{
+	logical_cpu_t logical_cpu;
+	const bool use_raw_array = (raw_array != NULL);
+	const logical_cpu_t num_cpus = use_raw_array ? raw_array->num_raw : 1;
+	const uint32_t records_offset = BINARY_DUMP_HEADER_SIZE + num_cpus * BINARY_DUMP_INDEX_SIZE;
+	uint32_t num_records = 0;
+	uint8_t *image, *index;
+	const struct cpu_raw_data_t* raw;
+
+	for (logical_cpu = 0; logical_cpu < num_cpus; logical_cpu++)
+		num_records += binary_dump_write_records(use_raw_array ? &raw_array->raw[logical_cpu] : single_raw, NULL);
+	*size = (size_t) records_offset + (size_t) num_records * BINARY_DUMP_RECORD_SIZE;
+	if ((image = cpuid_calloc(1, *size)) == NULL)
+		return NULL;
+
+	memcpy(image, BINARY_DUMP_MAGIC, BINARY_DUMP_MAGIC_SIZE);
+	image[8]  = BINARY_DUMP_VERSION;
+	image[10] = BINARY_DUMP_HEADER_SIZE;
+	image[11] = BINARY_DUMP_INDEX_SIZE;
+	image[12] = BINARY_DUMP_RECORD_SIZE;
+	set_le32(image + 16, (use_raw_array && raw_array->with_affinity) ? BINARY_DUMP_FLAG_ARRAY : 0);
+	set_le32(image + 20, num_cpus);
+	set_le32(image + 24, num_records);
+	set_le32(image + 28, BINARY_DUMP_HEADER_SIZE);
+	set_le32(image + 32, records_offset);
+	strncpy((char*) image + 40, VERSION, BINARY_DUMP_HEADER_SIZE - 40 - 1);
+
+	num_records = 0;
+	for (logical_cpu = 0; logical_cpu < num_cpus; logical_cpu++) {
+		raw   = use_raw_array ? &raw_array->raw[logical_cpu] : single_raw;
+		index = image + BINARY_DUMP_HEADER_SIZE + logical_cpu * BINARY_DUMP_INDEX_SIZE;
+		set_le32(index,     use_raw_array ? raw->os_cpu : 0);
+		set_le32(index + 4, num_records);
+		num_records += binary_dump_write_records(raw, image + records_offset + (size_t) num_records * BINARY_DUMP_RECORD_SIZE);
+	}
+	return image;
+}
+
+static int cpuid_serialize_binary_internal(struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array, const char* filename)
+{
+	int r = ERR_OK;
+	size_t size;
+	uint8_t* image;
+	FILE *f;
+
+	if ((image = binary_dump_build(single_raw, raw_array, &size)) == NULL)
+		return cpuid_set_error(ERR_NO_MEM);
+	f = !strcmp(filename, "") ? stdout : fopen(filename, "wb");
+	if (!f) {
+		cpuid_free(image);
+		return cpuid_set_error(ERR_OPEN);
+	}
+	debugf(1, "Writing binary raw CPUID dump (%lu bytes) to '%s'\n", (unsigned long) size, f == stdout ? "stdout" : filename);
+	if (fwrite(image, 1, size, f) != size)
+		r = ERR_OPEN;
+	if (f != stdout)
+		fclose(f);
+	else
+		fflush(f);
+	cpuid_free(image);
+	return cpuid_set_error(r);
+}
+
+/* A binary raw dump in memory, checked by binary_dump_open() */
+struct binary_dump_t {
+	const uint8_t* image;
+	uint32_t flags;
+	logical_cpu_t num_cpus;
+	uint32_t num_records;
+	const uint8_t* index;
+	uint32_t index_size;
+	const uint8_t* records;
+	uint32_t record_size;
+};
+
+static bool is_binary_dump(const void* image, size_t size)
+{
+	return (size >= BINARY_DUMP_MAGIC_SIZE) && !memcmp(image, BINARY_DUMP_MAGIC, BINARY_DUMP_MAGIC_SIZE);
+}
+
+/* Returns the first record of a logical CPU, the one after the last CPU is num_records */
+static uint32_t binary_dump_first_record(const struct binary_dump_t* dump, logical_cpu_t logical_cpu)
+{
+	if (logical_cpu >= dump->num_cpus)
+		return dump->num_records;
+	return get_le32(dump->index + (size_t) logical_cpu * dump->index_size + 4);
+}
+
+static int binary_dump_open(struct binary_dump_t* dump, const void* image, size_t size)
+{
+	logical_cpu_t logical_cpu;
+	uint32_t header_size, num_cpus, index_offset, records_offset;
+	const uint8_t* header = image;
+
+	if (!is_binary_dump(image, size) || (size < BINARY_DUMP_HEADER_SIZE))
+		return ERR_BADFMT;
+	if ((header[8] | (header[9] << 8)) != BINARY_DUMP_VERSION) {
+		debugf(1, "Unsupported binary raw dump version %u\n", header[8] | (header[9] << 8));
+		return ERR_BADFMT;
+	}
+	header_size       = header[10];
+	dump->index_size  = header[11];
+	dump->record_size = header[12];
+	dump->flags       = get_le32(header + 16);
+	num_cpus          = get_le32(header + 20);
+	dump->num_records = get_le32(header + 24);
+	index_offset      = get_le32(header + 28);
+	records_offset    = get_le32(header + 32);
+	if ((header_size < BINARY_DUMP_HEADER_SIZE) || (dump->index_size < BINARY_DUMP_INDEX_SIZE) || (dump->record_size < BINARY_DUMP_RECORD_SIZE) ||
+	    (num_cpus == 0) || (num_cpus > UINT16_MAX) ||
+	    ((uint64_t) index_offset + (uint64_t) num_cpus * dump->index_size > size) ||
+	    ((uint64_t) records_offset + (uint64_t) dump->num_records * dump->record_size > size))
+		return ERR_BADFMT;
+	dump->image    = image;
+	dump->num_cpus = (logical_cpu_t) num_cpus;
+	dump->index    = header + index_offset;
+	dump->records  = header + records_offset;
+
+	/* The records of each logical CPU must follow the ones of the previous logical CPU */
+	for (logical_cpu = 0; logical_cpu < dump->num_cpus; logical_cpu++)
+		if (binary_dump_first_record(dump, logical_cpu) > binary_dump_first_record(dump, logical_cpu + 1))
+			return ERR_BADFMT;
+	return ERR_OK;
+}
+
+int binary_dump_read_records(const uint8_t* records, uint32_t num_records, uint32_t record_size, struct cpu_raw_data_t* raw)
+{
+	int i;
+	uint32_t record, type, index;
+	uint32_t words[NUM_REGS];
+	const uint8_t* p;
+
+	raw_data_clear(raw);
+	if (!raw_data_reserve_leaves(raw, num_records))
+		return ERR_NO_MEM;
+	for (record = 0; record < num_records; record++) {
+		p     = records + (size_t) record * record_size;
+		type  = get_le32(p);
+		index = get_le32(p + 4);
+		for (i = 0; i < NUM_REGS; i++)
+			words[i] = get_le32(p + 12 + 4 * i);
+		if (type == BINARY_RECORD_SPARSE) {
+			if (cpuid_set_raw_leaf(raw, get_le32(p + 8), index, words) != ERR_OK)
+				return ERR_NO_MEM;
+			continue;
+		}
+		for (i = 0; (i < (int) COUNT_OF(raw_data_fields)) && (raw_data_fields[i].type != type); i++);
+		if ((i < (int) COUNT_OF(raw_data_fields)) && (index < raw_data_fields[i].count)) {
+			if (!raw_data_field_set(raw, &raw_data_fields[i], index, words))
+				return ERR_NO_MEM;
+		}
+		else
+			debugf(2, "Binary raw data: record type %u index %u ignored\n", type, index);
+	}
+	return ERR_OK;
+}
+
+/* Decodes the raw data of a logical CPU from a binary raw dump, raw is initialized (its table of leaves is reused) */
+static int binary_dump_get(const struct binary_dump_t* dump, logical_cpu_t logical_cpu, struct cpu_raw_data_t* raw)
+{
+	int r;
+	const uint32_t first_record = binary_dump_first_record(dump, logical_cpu);
+
+	r = binary_dump_read_records(dump->records + (size_t) first_record * dump->record_size,
+		binary_dump_first_record(dump, logical_cpu + 1) - first_record, dump->record_size, raw);
+	raw->os_cpu = (logical_cpu_t) get_le32(dump->index + (size_t) logical_cpu * dump->index_size);
+	return r;
+}
+
+static int cpuid_deserialize_binary_internal(struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array, struct cpu_raw_data_compact_t* compact, const void* image, size_t size)
+{
+	int r;
+	logical_cpu_t logical_cpu;
+	struct binary_dump_t dump;
+	struct raw_data_output_t output = { .raw_array = raw_array, .compact = compact, .capacity = 0, .current_cpu = -1, .error = ERR_OK };
+
+	if ((r = binary_dump_open(&dump, image, size)) != ERR_OK)
+		return cpuid_set_error(r);
+
+	if (single_raw != NULL)
+		return cpuid_set_error(binary_dump_get(&dump, 0, single_raw));
+	if (raw_array != NULL) {
+		cpu_raw_data_array_t_constructor(raw_array, false);
+		if (!cpuid_reserve_raw_data_array(raw_array, dump.num_cpus, &output.capacity))
+			return cpuid_set_error(ERR_NO_MEM);
+	}
+	if (compact != NULL)
+		cpu_raw_data_compact_t_constructor(compact, false);
+	raw_data_t_constructor(&output.current);
+	for (logical_cpu = 0; (logical_cpu < dump.num_cpus) && (output.error == ERR_OK); logical_cpu++)
+		output.error = binary_dump_get(&dump, logical_cpu, raw_data_output_select(&output, logical_cpu, (dump.flags & BINARY_DUMP_FLAG_ARRAY) != 0));
+	if (raw_array != NULL) {
+		cpuid_shrink_raw_data_array(raw_array, output.capacity);
+		if (output.error != ERR_OK) {
+			cpuid_free_raw_data_array(raw_array);
+			return cpuid_set_error(output.error);
+		}
+	}
+	if (compact != NULL) {
+		raw_data_output_flush(&output);
+		raw_data_output_end(&output);
+		if (output.error != ERR_OK) {
+			cpuid_free_raw_data_compact(compact);
+			return cpuid_set_error(output.error);
+		}
+	}
+	return cpuid_set_error(ERR_OK);
+}
+
+/* Upper bound of the length of a line of a text raw dump, the version line excepted */
+#define TEXT_DUMP_MAX_LINE 80
+
+static char* write_str(char* p, const char* str, size_t len)
+{
+	memcpy(p, str, len);
+	return p + len;
+}
+
+/* Same as printf("%0<digits>x"), digits must be even: two digits are written per byte */
+static char* write_hex(char* p, uint64_t value, int digits)
+{
+	static const char hex_pairs[] =
+		"000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+		"202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+		"404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+		"606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+		"808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+		"a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+		"c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+		"e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+	int i;
+
+	for (i = digits - 2; i >= 0; i -= 2, value >>= 8)
+		memcpy(p + i, hex_pairs + 2 * (value & 0xff), 2);
+	return p + digits;
+}
+
+/* Same as printf("%u") */
+static char* write_dec(char* p, uint32_t value)
+{
+	int n = 0;
+	char digits[10];
+
+	do {
+		digits[n++] = (char) ('0' + value % 10);
+		value /= 10;
+	} while (value > 0);
+	while (n > 0)
+		*p++ = digits[--n];
+	return p;
+}
+
+static char* write_x86_regs(char* p, const uint32_t* regs)
+{
+	int i;
+
+	for (i = 0; i < NUM_REGS; i++) {
+		p = write_hex(p, regs[i], 8);
+		*p++ = (i < NUM_REGS - 1) ? ' ' : '\n';
+	}
+	return p;
+}
+
+/* Delta text raw dumps: a logical CPU can start with "same_as_cpu=<n>", after its header and os_cpu,
+   then only the registers which differ from those of logical CPU <n> are written.
+   Only logical CPUs written in full are referred to, so each block can be read against a single other one. */
+#define SAME_AS_CPU_KEY "same_as_cpu="
+#define MAX_DELTA_REFERENCES 64 /* number of logical CPUs written in full which are compared to the next ones */
+
+static bool text_dump_uses_field(const struct raw_data_field_t* field, cpu_architecture_t architecture)
+{
+	return (field->kind == FIELD_X86_REGS) ? (architecture == ARCHITECTURE_X86) : (architecture == ARCHITECTURE_ARM);
+}
+
+/* Returns the number of lines needed to write raw in a delta text raw dump which refers to reference,
+   or UINT32_MAX if it cannot refer to it (different leaves) or needs more than max_lines */
+static uint32_t text_dump_count_deltas(const struct cpu_raw_data_t* raw, const struct cpu_raw_data_t* reference, cpu_architecture_t architecture, uint32_t max_lines)
+{
+	uint32_t i, index, num_lines = 0;
+	uint32_t words[NUM_REGS], ref_words[NUM_REGS];
+	const struct raw_data_field_t* field;
+
+	/* The sparse leaves are written after the arrays, a reference must have the same ones */
+	if (architecture == ARCHITECTURE_X86) {
+		if (!raw_data_same_leaves(raw, reference))
+			return UINT32_MAX;
+		for (i = 0; i < raw->num_leaves; i++)
+			if (raw_data_is_sparse_leaf(&raw->leaves[i]) && memcmp(raw->leaves[i].regs, reference->leaves[i].regs, sizeof(raw->leaves[i].regs)) &&
+			    (++num_lines > max_lines))
+				return UINT32_MAX;
+	}
+	for (field = raw_data_fields; field < raw_data_fields + COUNT_OF(raw_data_fields); field++) {
+		if (!text_dump_uses_field(field, architecture))
+			continue;
+		for (index = 0; index < field->count; index++) {
+			raw_data_field_get(raw, field, index, words);
+			raw_data_field_get(reference, field, index, ref_words);
+			if (memcmp(words, ref_words, sizeof(words)) && (++num_lines > max_lines))
+				return UINT32_MAX;
+		}
+	}
+	return num_lines;
+}
+
+/* Writes the lines of the registers of a logical CPU in a text raw dump, only those which differ from reference if not NULL
+   Returns false if out of memory */
+static bool text_dump_write_regs(struct cpuid_buffer_t* buffer, const struct cpu_raw_data_t* raw, const struct cpu_raw_data_t* reference, cpu_architecture_t architecture)
+{
+	uint32_t i, index, num_lines = (architecture == ARCHITECTURE_X86) ? raw->num_leaves : 0;
+	uint32_t words[NUM_REGS], ref_words[NUM_REGS];
+	char* p;
+	const struct raw_data_field_t* field;
+
+	for (field = raw_data_fields; field < raw_data_fields + COUNT_OF(raw_data_fields); field++)
+		if (text_dump_uses_field(field, architecture))
+			num_lines += field->count;
+	if ((p = cpuid_buffer_reserve(buffer, (size_t) num_lines * TEXT_DUMP_MAX_LINE)) == NULL)
+		return false;
+
+	for (field = raw_data_fields; field < raw_data_fields + COUNT_OF(raw_data_fields); field++) {
+		if (!text_dump_uses_field(field, architecture))
+			continue;
+		for (index = 0; index < field->count; index++) {
+			raw_data_field_get(raw, field, index, words);
+			if (reference != NULL) {
+				raw_data_field_get(reference, field, index, ref_words);
+				if (!memcmp(words, ref_words, sizeof(words)))
+					continue;
+			}
+			p = write_str(p, field->name, field->name_len);
+			switch (field->kind) {
+				case FIELD_X86_REGS:
+					*p++ = '[';
+					p = write_dec(p, index);
+					p = write_str(p, "]=", 2);
+					p = write_x86_regs(p, words);
+					break;
+				case FIELD_AARCH32:
+					p = write_dec(p, index);
+					*p++ = '=';
+					p = write_hex(p, words[0], 8);
+					*p++ = '\n';
+					break;
+				case FIELD_AARCH64:
+					if (field->indexed)
+						p = write_dec(p, index);
+					*p++ = '=';
+					p = write_hex(p, ((uint64_t) words[1] << 32) | words[0], 16);
+					*p++ = '\n';
+					break;
+			}
+		}
+	}
+	if (architecture == ARCHITECTURE_X86) {
+		for (i = 0; i < raw->num_leaves; i++) {
+			if (!raw_data_is_sparse_leaf(&raw->leaves[i]) ||
+			    ((reference != NULL) && !memcmp(raw->leaves[i].regs, reference->leaves[i].regs, sizeof(raw->leaves[i].regs))))
+				continue;
+			p = write_str(p, "sparse_cpuid[", 13);
+			p = write_hex(p, raw->leaves[i].leaf, 8);
+			p = write_str(p, "][", 2);
+			p = write_dec(p, raw->leaves[i].subleaf);
+			p = write_str(p, "]=", 2);
+			p = write_x86_regs(p, raw->leaves[i].regs);
+		}
+	}
+	buffer->size = (size_t) (p - buffer->data);
+	return true;
+}
+
+/* Returns the logical CPU written in full which raw can refer to with the fewest lines, -1 if none saves enough lines
+   references are the candidates, the last one used is tried first */
+static int32_t text_dump_find_reference(const struct cpu_raw_data_array_t* raw_array, const struct cpu_raw_data_t* raw, cpu_architecture_t architecture,
+                                        const logical_cpu_t* references, int num_references, int* last_reference)
+{
+	int i, candidate, best = -1;
+	uint32_t num_lines, best_lines = 0;
+	const struct raw_data_field_t* field;
+
+	/* A reference must save at least half of the lines */
+	for (field = raw_data_fields; field < raw_data_fields + COUNT_OF(raw_data_fields); field++)
+		if (text_dump_uses_field(field, architecture))
+			best_lines += field->count;
+	best_lines /= 2;
+
+	for (i = 0; (i < num_references) && (best_lines > 0); i++) {
+		candidate = (*last_reference + i) % num_references;
+		num_lines = text_dump_count_deltas(raw, &raw_array->raw[references[candidate]], architecture, best_lines - 1);
+		if (num_lines < best_lines) {
+			best       = candidate;
+			best_lines = num_lines;
+		}
+	}
+	if (best < 0)
+		return -1;
+	*last_reference = best;
+	return references[best];
+}
+
+/* Writes the content of buffer to file, or to fd if file is NULL, then empties it
+   Nothing is done without file and fd: the dump stays in buffer */
+static int text_dump_flush(struct cpuid_buffer_t* buffer, FILE* file, int fd)
+{
+	int r;
+
+	if ((file == NULL) && (fd < 0))
+		return ERR_OK;
+	if (file != NULL)
+		r = (fwrite(buffer->data, 1, buffer->size, file) == buffer->size) ? ERR_OK : ERR_OPEN;
+	else
+		r = write_fd(fd, buffer->data, buffer->size);
+	buffer->size = 0;
+	return r;
+}
+
+/* Appends the text raw dump of single_raw or raw_array to buffer, as a delta text raw dump if delta is true
+   With file or fd, buffer only holds one logical CPU at a time: each one is written at once */
+static int text_dump_write(const struct cpu_raw_data_t* single_raw, const struct cpu_raw_data_array_t* raw_array, bool delta,
+                           struct cpuid_buffer_t* buffer, FILE* file, int fd)
+{
+	const bool use_raw_array = (raw_array != NULL);
+	int r = ERR_OK, num_references = 0, last_reference = 0;
+	int32_t reference_cpu;
+	logical_cpu_t logical_cpu;
+	logical_cpu_t references[MAX_DELTA_REFERENCES];
+	char* p;
+	const struct cpu_raw_data_t* raw = use_raw_array ? ((raw_array->num_raw > 0) ? raw_array->raw : NULL) : single_raw;
+	const cpu_architecture_t architecture = (raw != NULL) ? cpuid_architecture_identify(raw) : ARCHITECTURE_UNKNOWN;
+
+	if ((p = cpuid_buffer_reserve(buffer, sizeof("version=") + sizeof(VERSION))) == NULL)
+		return ERR_NO_MEM;
+	p = write_str(p, "version=", 8);
+	p = write_str(p, VERSION, sizeof(VERSION) - 1);
+	*p++ = '\n';
+	buffer->size = (size_t) (p - buffer->data);
+	if (!use_raw_array)
+		return text_dump_write_regs(buffer, single_raw, NULL, architecture) ? text_dump_flush(buffer, file, fd) : ERR_NO_MEM;
+
+	for (logical_cpu = 0; (logical_cpu < raw_array->num_raw) && (r == ERR_OK); logical_cpu++) {
+		debugf(2, "Writing raw dump for logical CPU %i\n", logical_cpu);
+		raw = &raw_array->raw[logical_cpu];
+		reference_cpu = delta ? text_dump_find_reference(raw_array, raw, architecture, references, num_references, &last_reference) : -1;
+		if ((p = cpuid_buffer_reserve(buffer, 3 * TEXT_DUMP_MAX_LINE)) == NULL)
+			return ERR_NO_MEM;
+		p = write_str(p, "\n_________________ Logical CPU #", 32);
+		p = write_dec(p, logical_cpu);
+		p = write_str(p, " _________________\n", 19);
+		/* Only written when some logical CPUs are offline */
+		if (raw->os_cpu != logical_cpu) {
+			p = write_str(p, "os_cpu=", 7);
+			p = write_dec(p, raw->os_cpu);
+			*p++ = '\n';
+		}
+		if (reference_cpu >= 0) {
+			p = write_str(p, SAME_AS_CPU_KEY, sizeof(SAME_AS_CPU_KEY) - 1);
+			p = write_dec(p, (uint32_t) reference_cpu);
+			*p++ = '\n';
+		}
+		else if (delta && (num_references < MAX_DELTA_REFERENCES))
+			references[num_references++] = logical_cpu;
+		buffer->size = (size_t) (p - buffer->data);
+		if (!text_dump_write_regs(buffer, raw, (reference_cpu >= 0) ? &raw_array->raw[reference_cpu] : NULL, architecture))
+			r = ERR_NO_MEM;
+		else
+			r = text_dump_flush(buffer, file, fd);
+	}
+	return (raw_array->num_raw > 0) ? r : text_dump_flush(buffer, file, fd);
+}
+
+/* Writes the text raw dump of single_raw or raw_array to a file, or to a file descriptor if filename is NULL */
+static int cpuid_serialize_raw_data_internal(struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array, bool delta, const char* filename, int fd)
+{
+	int r;
+	struct cpuid_buffer_t block = { .data = NULL, .size = 0, .capacity = 0 };
+	FILE *f;
+
+	/* Each logical CPU is formatted in memory, then written at once */
+	if (filename == NULL) {
+		debugf(1, "Writing raw CPUID dump to file descriptor %i\n", fd);
+		r = text_dump_write(single_raw, raw_array, delta, &block, NULL, fd);
+	}
+	else {
+		f = !strcmp(filename, "") ? stdout : fopen(filename, "wt");
+		if (f) {
+			debugf(1, "Writing raw CPUID dump to '%s'\n", f == stdout ? "stdout" : filename);
+			r = text_dump_write(single_raw, raw_array, delta, &block, f, -1);
+			if (f != stdout) {
+				if ((fclose(f) != 0) && (r == ERR_OK))
+					r = ERR_OPEN;
+			}
+			else
+				fflush(f);
+		}
+		else
+			r = ERR_OPEN;
+	}
+	cpuid_free_buffer(&block);
+	return cpuid_set_error(r);
+}
+
+/* Parsers of the text raw dumps: on success, they advance *p after what they read */
+static const char* skip_spaces(const char* p)
+{
+	while ((*p == ' ') || (*p == '\t'))
+		p++;
+	return p;
+}
+
+static bool parse_hex64(const char** p, uint64_t* value)
+{
+	int digit;
+	const char* q = skip_spaces(*p);
+
+	if ((q[0] == '0') && ((q[1] == 'x') || (q[1] == 'X')))
+		q += 2;
+	for (*value = 0, *p = q; ; q++) {
+		if ((*q >= '0') && (*q <= '9'))      digit = *q - '0';
+		else if ((*q >= 'a') && (*q <= 'f')) digit = *q - 'a' + 10;
+		else if ((*q >= 'A') && (*q <= 'F')) digit = *q - 'A' + 10;
+		else break;
+		*value = (*value << 4) | (uint64_t) digit;
+	}
+	if (q == *p)
+		return false;
+	*p = q;
+	return true;
+}
+
+static bool parse_hex32(const char** p, uint32_t* value)
+{
+	uint64_t value64;
+
+	if (!parse_hex64(p, &value64))
+		return false;
+	*value = (uint32_t) value64;
+	return true;
+}
+
+static bool parse_dec(const char** p, uint32_t* value)
+{
+	const char* q = skip_spaces(*p);
+
+	for (*value = 0, *p = q; (*q >= '0') && (*q <= '9'); q++)
+		*value = *value * 10 + (uint32_t) (*q - '0');
+	if (q == *p)
+		return false;
+	*p = q;
+	return true;
+}
+
+static bool parse_char(const char** p, char c)
+{
+	if (**p != c)
+		return false;
+	(*p)++;
+	return true;
+}
+
+/* Parses EAX, EBX, ECX and EDX, separated by separator (spaces are always allowed) */
+static bool parse_x86_regs(const char** p, char separator, uint32_t* regs)
+{
+	int i;
+
+	for (i = 0; i < NUM_REGS; i++)
+		if (((i > 0) && (separator != ' ') && !parse_char(p, separator)) || !parse_hex32(p, &regs[i]))
+			return false;
+	return true;
+}
+
+/* Returns the field of cpu_raw_data_t named key (key_len characters), NULL if none
+   *hint is the index of the previous field found, lines of the same field usually follow each other */
+static const struct raw_data_field_t* raw_data_field_find(const char* key, size_t key_len, int* hint)
+{
+	int i;
+
+	if ((*hint >= 0) && (raw_data_fields[*hint].name_len == key_len) && !memcmp(raw_data_fields[*hint].name, key, key_len))
+		return &raw_data_fields[*hint];
+	for (i = 0; i < (int) COUNT_OF(raw_data_fields); i++)
+		if ((raw_data_fields[i].name_len == key_len) && !memcmp(raw_data_fields[i].name, key, key_len)) {
+			*hint = i;
+			return &raw_data_fields[i];
+		}
+	return NULL;
+}
+
+#define SPARSE_CPUID_KEY "sparse_cpuid"
+#define OS_CPU_KEY       "os_cpu"
+#define KEY_IS(__key)    ((key_len == sizeof(__key) - 1) && !memcmp(line, __key, key_len))
+/* Parses a line of a libcpuid raw dump, like "basic_cpuid[0]=...", "sparse_cpuid[...][...]=...", "os_cpu=..." or "arm_id_isar0=..."
+   Returns false if the line is not understood, no_mem is set if the table of leaves cannot grow */
+static bool parse_raw_data_line(const char* line, struct cpu_raw_data_t* raw, int* hint, bool* no_mem)
+{
+	size_t key_len, name_len;
+	uint32_t index, leaf, subleaf;
+	uint32_t words[NUM_REGS] = { 0 };
+	uint64_t aarch64_reg;
+	const char *p, *q;
+	const struct raw_data_field_t* field;
+
+	for (p = line; ((*p >= 'a') && (*p <= 'z')) || ((*p >= '0') && (*p <= '9')) || (*p == '_'); p++);
+	key_len = (size_t) (p - line);
+
+	/* x86 leaves: key[index]=eax ebx ecx edx */
+	if (parse_char(&p, '[')) {
+		if (KEY_IS(SPARSE_CPUID_KEY)) {
+			if (!parse_hex32(&p, &leaf) || !parse_char(&p, ']') || !parse_char(&p, '[') || !parse_dec(&p, &subleaf) ||
+			    !parse_char(&p, ']') || !parse_char(&p, '=') || !parse_x86_regs(&p, ' ', words))
+				return false;
+			*no_mem = (cpuid_set_raw_leaf(raw, leaf, subleaf, words) != ERR_OK);
+			return true;
+		}
+		field = raw_data_field_find(line, key_len, hint);
+		if ((field == NULL) || (field->kind != FIELD_X86_REGS) || !parse_dec(&p, &index) || (index >= field->count) ||
+		    !parse_char(&p, ']') || !parse_char(&p, '=') || !parse_x86_regs(&p, ' ', words))
+			return false;
+		*no_mem = !raw_data_field_set(raw, field, index, words);
+		return true;
+	}
+	if (!parse_char(&p, '='))
+		return false;
+	if (KEY_IS(OS_CPU_KEY)) {
+		if (!parse_dec(&p, &index))
+			return false;
+		raw->os_cpu = (logical_cpu_t) index;
+		return true;
+	}
+
+	/* ARM registers: key=value, or key<index>=value for arrays */
+	for (name_len = key_len; (name_len > 0) && (line[name_len - 1] >= '0') && (line[name_len - 1] <= '9'); name_len--);
+	for (index = 0, q = line + name_len; q < line + key_len; q++)
+		index = index * 10 + (uint32_t) (*q - '0');
+	field = raw_data_field_find(line, name_len, hint);
+	if ((field == NULL) || (field->kind == FIELD_X86_REGS) || (index >= field->count) || !parse_hex64(&p, &aarch64_reg))
+		return false;
+	words[0] = (uint32_t) aarch64_reg;
+	words[1] = (uint32_t) (aarch64_reg >> 32);
+	raw_data_field_set(raw, field, index, words);
+	return true;
+}
+#undef KEY_IS
+#undef OS_CPU_KEY
+#undef SPARSE_CPUID_KEY
+
+/* Parses "CPUID <leaf>: <eax>-<ebx>-<ecx>-<edx> [SL <subleaf>]" from an AIDA64 raw dump (some dumps have spaces instead of ':')
+   Returns the number of values read, like sscanf() */
+static int parse_aida64_line(const char* line, uint32_t* leaf, uint32_t* regs, uint32_t* subleaf)
+{
+	const char* p = line;
+
+	if (strncmp(p, "CPUID", 5))
+		return 0;
+	p += 5;
+	if (!parse_hex32(&p, leaf))
+		return 0;
+	parse_char(&p, ':');
+	if (!parse_x86_regs(&p, '-', regs))
+		return 1;
+	p = skip_spaces(p);
+	if (!parse_char(&p, '[') || !parse_char(&p, 'S') || !parse_char(&p, 'L') || !parse_hex32(&p, subleaf))
+		return 5;
+	return 6;
+}
+
+#define LOGICAL_CPU_HEADER  "_________________ Logical CPU #"
+#define TEXT_DUMP_LINE_SIZE 100 /* longer lines are truncated */
+#define TEXT_DUMP_DELIMITER "--------------------------------------------------------------------------------" /* test results follow */
+
+/* Parser of the text raw dumps (libcpuid, AIDA64 or InstLatx64 format), which is fed line by line
+   InstLatx64 dumps are AIDA64 dumps, sometimes without any header: the logical CPUs are then separated by empty lines */
+struct text_parser_t {
+	struct cpu_raw_data_t* raw_ptr;
+	struct raw_data_output_t output;
+	const char* name; /* only used in warnings */
+	int cur_line;
+	int hint;
+	bool use_raw_array;
+	bool is_header;
+	bool is_libcpuid_dump;
+	bool is_aida64_dump;
+	bool is_instlatx64_dump;
+	bool next_cpu;
+	logical_cpu_t logical_cpu;
+	logical_cpu_t logical_cpu_offset;
+};
+
+static void text_parser_begin(struct text_parser_t* parser, struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array,
+                              struct cpu_raw_data_compact_t* compact, const char* name)
+{
+	if (raw_array != NULL)
+		cpu_raw_data_array_t_constructor(raw_array, false);
+	if (compact != NULL)
+		cpu_raw_data_compact_t_constructor(compact, false);
+	parser->raw_ptr            = single_raw;
+	parser->output.raw_array   = raw_array;
+	parser->output.compact     = compact;
+	parser->output.capacity    = 0;
+	raw_data_t_constructor(&parser->output.current);
+	parser->output.current_cpu = -1;
+	parser->output.error       = ERR_OK;
+	parser->name               = name;
+	parser->cur_line           = 0;
+	parser->hint               = -1;
+	parser->use_raw_array      = (raw_array != NULL) || (compact != NULL);
+	parser->is_header          = true;
+	parser->is_libcpuid_dump   = true;
+	parser->is_aida64_dump     = false;
+	parser->is_instlatx64_dump = false;
+	parser->next_cpu           = false;
+	parser->logical_cpu        = 0;
+	parser->logical_cpu_offset = 0;
+}
+
+/* Parses a line of len characters (LF or CRLF line ending included or not) and stores data in cpu_raw_data_t
+   Returns false at the end of the raw dump (test results follow) */
+static bool text_parser_line(struct text_parser_t* parser, const char* text, size_t len)
+{
+	int assigned = 0;
+	bool no_mem = false;
+	uint32_t addr, subleaf, value;
+	uint32_t regs[NUM_REGS];
+	char line[TEXT_DUMP_LINE_SIZE];
+	const char* p;
+	const char* name = parser->name;
+
+	if ((len > 0) && (text[len - 1] == '\n'))
+		len--;
+	if ((len > 0) && (text[len - 1] == '\r'))
+		len--;
+	if (len >= sizeof(line))
+		len = sizeof(line) - 1;
+	memcpy(line, text, len);
+	line[len] = '\0';
+	if (line[0] == '\0') { // Skip empty lines
+		parser->next_cpu = parser->is_instlatx64_dump;
+		return true;
+	}
+	if (!strcmp(line, TEXT_DUMP_DELIMITER)) // Skip test results
+		return false;
+	parser->cur_line++;
+	if (parser->is_header) {
+		if (!strncmp(line, "version=", 8)) {
+			debugf(2, "Recognized version '%s' from raw dump\n", line + 8);
+			parser->is_libcpuid_dump = true;
+			parser->is_aida64_dump = false;
+			return true;
+		}
+		else if (!strncmp(line, "basic_cpuid[", 12)) {
+			debugf(2, "Parsing raw dump for a single CPU dump\n");
+			parser->is_header = false;
+			parser->is_libcpuid_dump = true;
+			parser->is_aida64_dump = false;
+			if (parser->use_raw_array)
+				parser->raw_ptr = raw_data_output_select(&parser->output, 0, false);
+		}
+		else if (!strcmp(line, "------[ Versions ]------") ||
+		         !strcmp(line, "------[ Logical CPU #0 ]------") ||
+		         !strcmp(line, "------[ CPUID Registers / Logical CPU #0 ]------") ||
+		         !strcmp(line, "CPUID Registers (CPU #1):") ||
+		         strstr(line, "CPU#000 AffMask: 0x")) {
+			debugf(2, "Recognized AIDA64 raw dump\n");
+			parser->is_header = false;
+			parser->is_libcpuid_dump = false;
+			parser->is_aida64_dump = true;
+		}
+		else if (parse_aida64_line(line, &addr, regs, &subleaf) >= 5) {
+			debugf(2, "Recognized InstLatx64 raw dump without logical CPU headers\n");
+			parser->is_header = false;
+			parser->is_libcpuid_dump = false;
+			parser->is_aida64_dump = true;
+			parser->is_instlatx64_dump = true;
+			if (parser->use_raw_array)
+				parser->raw_ptr = raw_data_output_select(&parser->output, 0, true);
+		}
+	}
+
+	if (parser->is_libcpuid_dump) {
+		p = line + sizeof(LOGICAL_CPU_HEADER) - 1;
+		if (parser->use_raw_array && !strncmp(line, LOGICAL_CPU_HEADER, sizeof(LOGICAL_CPU_HEADER) - 1) && parse_dec(&p, &value)) {
+			parser->logical_cpu = (logical_cpu_t) value;
+			debugf(2, "Parsing raw dump for logical CPU %i\n", parser->logical_cpu);
+			parser->is_header = false;
+			parser->raw_ptr = raw_data_output_select(&parser->output, parser->logical_cpu, true);
+		}
+		else if (!strncmp(line, SAME_AS_CPU_KEY, sizeof(SAME_AS_CPU_KEY) - 1)) {
+			p = line + sizeof(SAME_AS_CPU_KEY) - 1;
+			if (!parse_dec(&p, &value) || (parser->use_raw_array && !raw_data_output_copy(&parser->output, value, parser->logical_cpu, parser->raw_ptr)))
+				warnf("Warning: file '%s', line %d: '%s' does not refer to a previous logical CPU!\n", name, parser->cur_line, line);
+		}
+		else if (!parse_raw_data_line(line, parser->raw_ptr, &parser->hint, &no_mem)) {
+			warnf("Warning: file '%s', line %d: '%s' not understood!\n", name, parser->cur_line, line);
+		}
+		else if (no_mem) {
+			parser->output.error = ERR_NO_MEM;
+		}
+	}
+	else if (parser->is_aida64_dump) {
+		if (parser->use_raw_array && ((line[0] == '-') || !strncmp(line, "CPU#", 4) || !strncmp(line, "CPUID Registers", 15)) &&
+		                             ((sscanf(line, "------[ Logical CPU #%" SCNu16 " ]------", &parser->logical_cpu) >= 1) ||
+		                              (sscanf(line, "------[ CPUID Registers / Logical CPU #%" SCNu16 " ]------", &parser->logical_cpu) >= 1) ||
+		                              (sscanf(line, "CPUID Registers (CPU #%" SCNu16, &parser->logical_cpu) >= 1) ||
+		                              (sscanf(line, "CPU#%" SCNu16 " AffMask: 0x%*x", &parser->logical_cpu) >= 1))) {
+			/* Some raw dumps start core count from 1, we need to start from 0 */
+			if ((raw_data_output_num_cpus(&parser->output) == 0) && (parser->logical_cpu >= 1))
+				parser->logical_cpu_offset = parser->logical_cpu;
+			parser->logical_cpu -= parser->logical_cpu_offset;
+			debugf(2, "Parsing AIDA64 raw dump for logical CPU %i\n", parser->logical_cpu);
+			parser->raw_ptr = raw_data_output_select(&parser->output, parser->logical_cpu, true);
+			return true;
+		}
+		subleaf = 0;
+		assigned = parse_aida64_line(line, &addr, regs, &subleaf);
+		debugf(3, "raw line %d: %i items assigned for string '%s'\n", parser->cur_line, assigned, line);
+		if (parser->next_cpu && (assigned >= 5)) {
+			/* First leaf after an empty line in an InstLatx64 dump without headers */
+			parser->logical_cpu++;
+			debugf(2, "Parsing InstLatx64 raw dump for logical CPU %i\n", parser->logical_cpu);
+			if (parser->use_raw_array)
+				parser->raw_ptr = raw_data_output_select(&parser->output, parser->logical_cpu, true);
+			parser->next_cpu = false;
+		}
+		/* Without [SL xx], the subleaf is unknown: the line is stored as subleaf 0, the last one is kept */
+		if ((assigned >= 5) && (cpuid_set_raw_leaf(parser->raw_ptr, addr, subleaf, regs) != ERR_OK))
+			parser->output.error = ERR_NO_MEM;
+	}
+	return true;
 }
 
-static void cpuid_grow_system_id(struct system_id_t* system, uint8_t n)
+static int text_parser_end(struct text_parser_t* parser)
 {
-	uint8_t i;
-	struct cpu_id_t *tmp = NULL;
+	struct raw_data_output_t* output = &parser->output;
 
-	if ((n <= 0) || (n < system->num_cpu_types)) return;
-	debugf(3, "Growing system_id_t from %u to %u items\n", system->num_cpu_types, n);
-	tmp = realloc(system->cpu_types, sizeof(struct cpu_id_t) * n);
-	if (tmp == NULL) { /* Memory allocation failure */
-		cpuid_set_error(ERR_NO_MEM);
-		return;
+	if (output->raw_array != NULL) {
+		cpuid_shrink_raw_data_array(output->raw_array, output->capacity);
+		if (output->error != ERR_OK) {
+			cpuid_free_raw_data_array(output->raw_array);
+			return cpuid_set_error(output->error);
+		}
 	}
-
-	for (i = system->num_cpu_types; i < n; i++)
-		cpu_id_t_constructor(&tmp[i]);
-	system->num_cpu_types = n;
-	system->cpu_types     = tmp;
+	if (output->compact != NULL) {
+		raw_data_output_flush(output);
+		raw_data_output_end(output);
+		if (output->error != ERR_OK) {
+			cpuid_free_raw_data_compact(output->compact);
+			return cpuid_set_error(output->error);
+		}
+	}
+	if (output->error != ERR_OK)
+		return cpuid_set_error(output->error);
+	return cpuid_set_error((parser->use_raw_array && (raw_data_output_num_cpus(output) == 0)) ? ERR_BADFMT : ERR_OK);
 }
 
-static void cpuid_grow_type_info(struct internal_type_info_array_t* type_info, uint8_t n)
+/* Parses a text raw dump of size bytes, name is only used in warnings */
+static int cpuid_deserialize_text_internal(struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array, struct cpu_raw_data_compact_t* compact,
+                                           const char* text, size_t size, const char* name)
 {
-	uint8_t i;
-	struct internal_type_info_t *tmp = NULL;
+	const char *p, *next;
+	const char* end = text + size;
+	struct text_parser_t parser;
+
+	text_parser_begin(&parser, single_raw, raw_array, compact, name);
+	for (p = text; p < end; p = next) {
+		next = memchr(p, '\n', (size_t) (end - p));
+		next = (next != NULL) ? next + 1 : end;
+		if (!text_parser_line(&parser, p, (size_t) (next - p)))
+			break;
+	}
+	return text_parser_end(&parser);
+}
 
-	if ((n <= 0) || (n < type_info->num)) return;
-	debugf(3, "Growing internal_type_info_t from %u to %u items\n", type_info->num, n);
-	tmp = realloc(type_info->data, sizeof(struct internal_type_info_t) * n);
-	if (tmp == NULL) { /* Memory allocation failure */
-		cpuid_set_error(ERR_NO_MEM);
-		return;
+/* Decompressed raw dump: text dumps are parsed chunk by chunk, binary dumps are parsed once fully decompressed */
+struct decompressed_dump_t {
+	struct cpu_raw_data_t* single_raw;
+	struct cpu_raw_data_array_t* raw_array;
+	struct cpu_raw_data_compact_t* compact;
+	const char* name;
+	bool started;
+	bool is_binary;
+	bool is_complete; /* the end of the text dump is reached (test results follow) */
+	struct cpuid_buffer_t binary;
+	struct text_parser_t parser;
+	char partial_line[TEXT_DUMP_LINE_SIZE + 2]; /* start of a line split between two chunks (with room for CRLF) */
+	size_t partial_len;
+	int error;
+};
+
+static bool decompressed_dump_consume(void* arg, const void* chunk, size_t size)
+{
+	bool has_eol;
+	size_t len;
+	const char *p, *next;
+	const char* end = (const char*) chunk + size;
+	struct decompressed_dump_t* dump = arg;
+
+	if (size == 0)
+		return true;
+	if (!dump->started) {
+		dump->started   = true;
+		dump->is_binary = (*(const char*) chunk == BINARY_DUMP_MAGIC[0]);
+		if (!dump->is_binary)
+			text_parser_begin(&dump->parser, dump->single_raw, dump->raw_array, dump->compact, dump->name);
+	}
+	if (dump->is_binary) {
+		if (cpuid_buffer_reserve(&dump->binary, size) == NULL) {
+			dump->error = ERR_NO_MEM;
+			return false;
+		}
+		memcpy(dump->binary.data + dump->binary.size, chunk, size);
+		dump->binary.size += size;
+		return true;
 	}
 
-	for (i = type_info->num; i < n; i++) {
-		core_instances_t_constructor(&tmp[i].core_instances);
-		cache_instances_t_constructor(&tmp[i].cache_instances);
+	for (p = chunk; p < end; p = next) {
+		next    = memchr(p, '\n', (size_t) (end - p));
+		has_eol = (next != NULL);
+		next    = has_eol ? next + 1 : end;
+		len     = (size_t) (next - p);
+		if ((dump->partial_len == 0) && has_eol) {
+			dump->is_complete = !text_parser_line(&dump->parser, p, len);
+			if (dump->is_complete)
+				return false;
+			continue;
+		}
+		/* Line split between two chunks: only its start is kept, since long lines are truncated anyway */
+		if (len > sizeof(dump->partial_line) - dump->partial_len)
+			len = sizeof(dump->partial_line) - dump->partial_len;
+		memcpy(dump->partial_line + dump->partial_len, p, len);
+		dump->partial_len += len;
+		if (has_eol) {
+			len = dump->partial_len;
+			dump->partial_len = 0;
+			dump->is_complete = !text_parser_line(&dump->parser, dump->partial_line, len);
+			if (dump->is_complete)
+				return false;
+		}
 	}
-	type_info->num  = n;
-	type_info->data = tmp;
+	return true;
 }
 
-static void cpuid_free_type_info(struct internal_type_info_array_t* type_info)
+/* Parses a compressed raw dump of size bytes, which is decompressed in chunks */
+static int cpuid_deserialize_compressed_internal(struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array, struct cpu_raw_data_compact_t* compact,
+                                                 compression_t compression, const void* data, size_t size, const char* name)
 {
-	if (type_info->num <= 0) return;
-	free(type_info->data);
-	type_info->num = 0;
+	int r, r_parser;
+	struct decompressed_dump_t dump;
+
+	dump.single_raw  = single_raw;
+	dump.raw_array   = raw_array;
+	dump.compact     = compact;
+	dump.name        = name;
+	dump.started     = false;
+	dump.is_binary   = false;
+	dump.is_complete = false;
+	dump.partial_len = 0;
+	dump.error       = ERR_OK;
+	memset(&dump.binary, 0, sizeof(dump.binary));
+
+	r = decompress(compression, data, size, decompressed_dump_consume, &dump);
+	if (r == ERR_OK)
+		r = dump.error;
+	if (dump.is_binary) {
+		debugf(2, "Decompressed %llu bytes of binary raw dump\n", (unsigned long long) dump.binary.size);
+		if (r == ERR_OK)
+			r = cpuid_deserialize_binary_internal(single_raw, raw_array, compact, dump.binary.data, dump.binary.size);
+		cpuid_free_buffer(&dump.binary);
+		return cpuid_set_error(r);
+	}
+	if (r == ERR_NOT_IMP)
+		return cpuid_set_error(r);
+
+	if (!dump.started)
+		text_parser_begin(&dump.parser, single_raw, raw_array, compact, name);
+	if (!dump.is_complete && (dump.partial_len > 0))
+		text_parser_line(&dump.parser, dump.partial_line, dump.partial_len);
+	r_parser = text_parser_end(&dump.parser);
+	if (r == ERR_OK)
+		return r_parser;
+	/* Corrupted or truncated data */
+	if (raw_array != NULL)
+		cpuid_free_raw_data_array(raw_array);
+	if ((compact != NULL) && (r_parser != ERR_NO_MEM))
+		cpuid_free_raw_data_compact(compact);
+	return cpuid_set_error(r);
 }
 
-static cpu_architecture_t cpuid_architecture_identify(struct cpu_raw_data_t* raw)
+/* Parses a raw dump in memory, binary raw dumps start with a byte which is never in text dumps */
+static int cpuid_deserialize_buffer_internal(struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array, struct cpu_raw_data_compact_t* compact,
+                                             const void* data, size_t size, const char* name)
 {
-	if (raw->basic_cpuid[0][EAX] != 0x0 || raw->basic_cpuid[0][EBX] != 0x0 || raw->basic_cpuid[0][ECX] != 0x0 || raw->basic_cpuid[0][EDX] != 0x0)
-		return ARCHITECTURE_X86;
-	else if (raw->arm_midr != 0x0)
-		return ARCHITECTURE_ARM;
+	compression_t compression;
 
-	return ARCHITECTURE_UNKNOWN;
+	if ((data == NULL) && (size > 0))
+		return cpuid_set_error(ERR_HANDLE);
+	if ((size > 0) && (*(const char*) data == BINARY_DUMP_MAGIC[0])) {
+		debugf(1, "Opening binary raw dump from '%s'\n", name);
+		return cpuid_deserialize_binary_internal(single_raw, raw_array, compact, data, size);
+	}
+	if ((compression = detect_compression(data, size)) != COMPRESSION_NONE) {
+		debugf(1, "Opening %s compressed raw dump from '%s'\n", compression_str(compression), name);
+		return cpuid_deserialize_compressed_internal(single_raw, raw_array, compact, compression, data, size, name);
+	}
+	debugf(1, "Opening raw dump from '%s'\n", name);
+	return cpuid_deserialize_text_internal(single_raw, raw_array, compact, data, size, name);
 }
 
-static int cpuid_serialize_raw_data_internal(struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array, const char* filename)
+static int cpuid_deserialize_raw_data_internal(struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array, struct cpu_raw_data_compact_t* compact, const char* filename)
 {
-	int i;
-	bool end_loop = false;
-	const bool use_raw_array = (raw_array != NULL) && raw_array->num_raw > 0;
-	logical_cpu_t logical_cpu = 0;
-	struct cpu_raw_data_t* raw_ptr = use_raw_array ? &raw_array->raw[0] : single_raw;
-	const cpu_architecture_t architecture = cpuid_architecture_identify(raw_ptr);
-	FILE *f;
-
-	/* Open file descriptor */
-	f = !strcmp(filename, "") ? stdout : fopen(filename, "wt");
-	if (!f)
-		return cpuid_set_error(ERR_OPEN);
-	debugf(1, "Writing raw CPUID dump to '%s'\n", f == stdout ? "stdout" : filename);
-
-	/* Write raw data to output file */
-	fprintf(f, "version=%s\n", VERSION);
-	while (!end_loop) {
-		if (use_raw_array) {
-			debugf(2, "Writing raw dump for logical CPU %i\n", logical_cpu);
-			fprintf(f, "\n_________________ Logical CPU #%" PRIi16 " _________________\n", logical_cpu);
-			raw_ptr = &raw_array->raw[logical_cpu];
-		}
-		switch (architecture) {
-			case ARCHITECTURE_X86:
-				for (i = 0; i < MAX_CPUID_LEVEL; i++)
-					fprintf(f, "basic_cpuid[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
-						raw_ptr->basic_cpuid[i][EAX], raw_ptr->basic_cpuid[i][EBX],
-						raw_ptr->basic_cpuid[i][ECX], raw_ptr->basic_cpuid[i][EDX]);
-				for (i = 0; i < MAX_EXT_CPUID_LEVEL; i++)
-					fprintf(f, "ext_cpuid[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
-						raw_ptr->ext_cpuid[i][EAX], raw_ptr->ext_cpuid[i][EBX],
-						raw_ptr->ext_cpuid[i][ECX], raw_ptr->ext_cpuid[i][EDX]);
-				for (i = 0; i < MAX_INTELFN4_LEVEL; i++)
-					fprintf(f, "intel_fn4[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
-						raw_ptr->intel_fn4[i][EAX], raw_ptr->intel_fn4[i][EBX],
-						raw_ptr->intel_fn4[i][ECX], raw_ptr->intel_fn4[i][EDX]);
-				for (i = 0; i < MAX_INTELFN11_LEVEL; i++)
-					fprintf(f, "intel_fn11[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
-						raw_ptr->intel_fn11[i][EAX], raw_ptr->intel_fn11[i][EBX],
-						raw_ptr->intel_fn11[i][ECX], raw_ptr->intel_fn11[i][EDX]);
-				for (i = 0; i < MAX_INTELFN12H_LEVEL; i++)
-					fprintf(f, "intel_fn12h[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
-						raw_ptr->intel_fn12h[i][EAX], raw_ptr->intel_fn12h[i][EBX],
-						raw_ptr->intel_fn12h[i][ECX], raw_ptr->intel_fn12h[i][EDX]);
-				for (i = 0; i < MAX_INTELFN14H_LEVEL; i++)
-					fprintf(f, "intel_fn14h[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
-						raw_ptr->intel_fn14h[i][EAX], raw_ptr->intel_fn14h[i][EBX],
-						raw_ptr->intel_fn14h[i][ECX], raw_ptr->intel_fn14h[i][EDX]);
-				for (i = 0; i < MAX_AMDFN8000001DH_LEVEL; i++)
-					fprintf(f, "amd_fn8000001dh[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
-						raw_ptr->amd_fn8000001dh[i][EAX], raw_ptr->amd_fn8000001dh[i][EBX],
-						raw_ptr->amd_fn8000001dh[i][ECX], raw_ptr->amd_fn8000001dh[i][EDX]);
-				for (i = 0; i < MAX_AMDFN80000026H_LEVEL; i++)
-					fprintf(f, "amd_fn80000026h[%d]=%08" PRIx32 " %08" PRIx32 " %08" PRIx32 " %08" PRIx32 "\n", i,
-						raw_ptr->amd_fn80000026h[i][EAX], raw_ptr->amd_fn80000026h[i][EBX],
-						raw_ptr->amd_fn80000026h[i][ECX], raw_ptr->amd_fn80000026h[i][EDX]);
-				break;
-			case ARCHITECTURE_ARM:
-				fprintf(f, "arm_midr=%016" PRIx64 "\n", raw_ptr->arm_midr);
-				fprintf(f, "arm_mpidr=%016" PRIx64 "\n", raw_ptr->arm_mpidr);
-				fprintf(f, "arm_revidr=%016" PRIx64 "\n", raw_ptr->arm_revidr);
-				for (i = 0; i < MAX_ARM_ID_AFR_REGS; i++)
-					fprintf(f, "arm_id_afr%d=%08" PRIx32 "\n", i, raw_ptr->arm_id_afr[i]);
-				for (i = 0; i < MAX_ARM_ID_DFR_REGS; i++)
-					fprintf(f, "arm_id_dfr%d=%08" PRIx32 "\n", i, raw_ptr->arm_id_dfr[i]);
-				for (i = 0; i < MAX_ARM_ID_ISAR_REGS; i++)
-					fprintf(f, "arm_id_isar%d=%08" PRIx32 "\n", i, raw_ptr->arm_id_isar[i]);
-				for (i = 0; i < MAX_ARM_ID_MMFR_REGS; i++)
-					fprintf(f, "arm_id_mmfr%d=%08" PRIx32 "\n", i, raw_ptr->arm_id_mmfr[i]);
-				for (i = 0; i < MAX_ARM_ID_PFR_REGS; i++)
-					fprintf(f, "arm_id_pfr%d=%08" PRIx32 "\n", i, raw_ptr->arm_id_pfr[i]);
-				for (i = 0; i < MAX_ARM_ID_AA64AFR_REGS; i++)
-					fprintf(f, "arm_id_aa64afr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64afr[i]);
-				for (i = 0; i < MAX_ARM_ID_AA64DFR_REGS; i++)
-					fprintf(f, "arm_id_aa64dfr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64dfr[i]);
-				for (i = 0; i < MAX_ARM_ID_AA64FPFR_REGS; i++)
-					fprintf(f, "arm_id_aa64fpfr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64fpfr[i]);
-				for (i = 0; i < MAX_ARM_ID_AA64ISAR_REGS; i++)
-					fprintf(f, "arm_id_aa64isar%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64isar[i]);
-				for (i = 0; i < MAX_ARM_ID_AA64MMFR_REGS; i++)
-					fprintf(f, "arm_id_aa64mmfr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64mmfr[i]);
-				for (i = 0; i < MAX_ARM_ID_AA64PFR_REGS; i++)
-					fprintf(f, "arm_id_aa64pfr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64pfr[i]);
-				for (i = 0; i < MAX_ARM_ID_AA64SMFR_REGS; i++)
-					fprintf(f, "arm_id_aa64smfr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64smfr[i]);
-				for (i = 0; i < MAX_ARM_ID_AA64ZFR_REGS; i++)
-					fprintf(f, "arm_id_aa64zfr%d=%016" PRIx64 "\n", i, raw_ptr->arm_id_aa64zfr[i]);
-				break;
-			default:
-				break;
-		}
-
-		logical_cpu++;
-		end_loop = ((use_raw_array && (logical_cpu >= raw_array->num_raw)) || !use_raw_array);
-	}
+	int r;
+	struct mapped_file_t file;
 
-	/* Close file descriptor */
-	if (strcmp(filename, ""))
-		fclose(f);
-	return cpuid_set_error(ERR_OK);
+	if ((r = map_file(filename, &file)) != ERR_OK)
+		return cpuid_set_error(r);
+	r = cpuid_deserialize_buffer_internal(single_raw, raw_array, compact, file.data, file.size, !strcmp(filename, "") ? "stdin" : filename);
+	unmap_file(&file);
+	return r;
 }
 
-#define RAW_ASSIGN_LINE_X86(__line) __line[EAX] = eax ; __line[EBX] = ebx ; __line[ECX] = ecx ; __line[EDX] = edx
-#define RAW_ASSIGN_LINE_AARCH32(__line) __line = aarch32_reg
-#define RAW_ASSIGN_LINE_AARCH64(__line) __line = aarch64_reg
-static int cpuid_deserialize_raw_data_internal(struct cpu_raw_data_t* single_raw, struct cpu_raw_data_array_t* raw_array, const char* filename)
+/* Parallel parsing of libcpuid text raw dumps: the dump is split at the logical CPU headers, then contiguous
+   ranges of logical CPUs are parsed concurrently, each one directly into its item of the array. Logical CPUs
+   which refer to a previous one (same_as_cpu=) are parsed afterwards, in ascending order. */
+#define PARALLEL_MIN_CPUS_PER_THREAD 16 /* fewer logical CPUs are not worth a thread */
+
+/* Lines of a logical CPU, after its header */
+struct text_dump_block_t {
+	const char* start;
+	const char* end;
+	int header_line; /* only used in warnings */
+	logical_cpu_t logical_cpu;
+	bool is_delta;
+};
+
+struct text_dump_slice_t {
+	struct cpu_raw_data_array_t* raw_array;
+	const struct text_dump_block_t* blocks;
+	uint32_t first;
+	uint32_t last;
+	const char* name;
+	int error;
+};
+
+/* Splits a libcpuid text raw dump in blocks (allocated in *blocks), with logical CPUs in ascending order
+   Returns the number of blocks, zero if the raw dump must be parsed sequentially */
+static uint32_t text_dump_split(const char* text, size_t size, struct text_dump_block_t** blocks)
 {
-	int i;
 	int cur_line = 0;
-	int assigned = 0;
-	int subleaf = 0;
-	bool is_header = true;
-	bool is_libcpuid_dump = true;
-	bool is_aida64_dump = false;
-	const bool use_raw_array = (raw_array != NULL);
-	logical_cpu_t logical_cpu = 0, logical_cpu_offset = 0;
-	uint32_t addr, eax, ebx, ecx, edx, aarch32_reg;
-	uint64_t aarch64_reg;
-	char version[8] = "";
-	char line[100];
-	struct cpu_raw_data_t* raw_ptr = single_raw;
-	FILE *f;
-
-	/* Open file descriptor */
-	f = !strcmp(filename, "") ? stdin : fopen(filename, "rt");
-	if (!f)
-		return cpuid_set_error(ERR_OPEN);
-	debugf(1, "Opening raw dump from '%s'\n", f == stdin ? "stdin" : filename);
-
-	if (use_raw_array)
-		cpu_raw_data_array_t_constructor(raw_array, false);
-
-	/* Parse file and store data in cpu_raw_data_t */
-	while (fgets(line, sizeof(line), f) != NULL) {
-		i = -1;
-		line[strcspn(line, "\n")] = '\0';
-		if (line[0] == '\0') // Skip empty lines
+	uint32_t value, num_blocks = 0, capacity = 0;
+	size_t len;
+	char header[TEXT_DUMP_LINE_SIZE];
+	const char *p, *q, *next;
+	const char* end = text + size;
+	struct text_dump_block_t *tmp, *list = NULL;
+
+	for (p = text; p < end; p = next) {
+		next = memchr(p, '\n', (size_t) (end - p));
+		len  = (size_t) (((next != NULL) ? next : end) - p);
+		next = (next != NULL) ? next + 1 : end;
+		if ((len > 0) && (p[len - 1] == '\r'))
+			len--;
+		if (len == 0)
 			continue;
-		if (!strcmp(line, "--------------------------------------------------------------------------------")) // Skip test results
+		if ((len == sizeof(TEXT_DUMP_DELIMITER) - 1) && !memcmp(p, TEXT_DUMP_DELIMITER, len))
 			break;
 		cur_line++;
-		if (is_header) {
-			if (sscanf(line, "version=%s", version) >= 1) {
-				debugf(2, "Recognized version '%s' from raw dump\n", version);
-				is_libcpuid_dump = true;
-				is_aida64_dump = false;
-				continue;
-			}
-			else if (sscanf(line, "basic_cpuid[%d]=%" SCNx32 "%" SCNx32 "%" SCNx32 "%" SCNx32, &i, &eax, &ebx, &ecx, &edx) >= 5) {
-				debugf(2, "Parsing raw dump for a single CPU dump\n");
-				is_header = false;
-				is_libcpuid_dump = true;
-				is_aida64_dump = false;
-				if (use_raw_array) {
-					cpuid_grow_raw_data_array(raw_array, 1);
-					raw_ptr = &raw_array->raw[0];
-					raw_array->with_affinity = false;
-				}
-			}
-			else if (!strcmp(line, "------[ Versions ]------") ||
-			         !strcmp(line, "------[ Logical CPU #0 ]------") ||
-			         !strcmp(line, "------[ CPUID Registers / Logical CPU #0 ]------") ||
-			         !strcmp(line, "CPUID Registers (CPU #1):") ||
-			         strstr(line, "CPU#000 AffMask: 0x")) {
-				debugf(2, "Recognized AIDA64 raw dump\n");
-				is_header = false;
-				is_libcpuid_dump = false;
-				is_aida64_dump = true;
-			}
-		}
-
-		if (is_libcpuid_dump) {
-			if (use_raw_array && (sscanf(line, "_________________ Logical CPU #%" SCNu16 " _________________", &logical_cpu) >= 1)) {
-				debugf(2, "Parsing raw dump for logical CPU %i\n", logical_cpu);
-				is_header = false;
-				cpuid_grow_raw_data_array(raw_array, logical_cpu + 1);
-				raw_ptr = &raw_array->raw[logical_cpu];
-				raw_array->with_affinity = true;
-			}
-			else if ((sscanf(line, "basic_cpuid[%d]=%" SCNx32 "%" SCNx32 "%" SCNx32 "%" SCNx32, &i, &eax, &ebx, &ecx, &edx) >= 5) && (i >= 0) && (i < MAX_CPUID_LEVEL)) {
-				RAW_ASSIGN_LINE_X86(raw_ptr->basic_cpuid[i]);
-			}
-			else if ((sscanf(line, "ext_cpuid[%d]=%" SCNx32 "%" SCNx32 "%" SCNx32 "%" SCNx32, &i, &eax, &ebx, &ecx, &edx) >= 5) && (i >= 0) && (i < MAX_EXT_CPUID_LEVEL)) {
-				RAW_ASSIGN_LINE_X86(raw_ptr->ext_cpuid[i]);
-			}
-			else if ((sscanf(line, "intel_fn4[%d]=%" SCNx32 "%" SCNx32 "%" SCNx32 "%" SCNx32, &i, &eax, &ebx, &ecx, &edx) >= 5) && (i >= 0) && (i < MAX_INTELFN4_LEVEL)) {
-				RAW_ASSIGN_LINE_X86(raw_ptr->intel_fn4[i]);
-			}
-			else if ((sscanf(line, "intel_fn11[%d]=%" SCNx32 "%" SCNx32 "%" SCNx32 "%" SCNx32, &i, &eax, &ebx, &ecx, &edx) >= 5) && (i >= 0) && (i < MAX_INTELFN11_LEVEL)) {
-				RAW_ASSIGN_LINE_X86(raw_ptr->intel_fn11[i]);
-			}
-			else if ((sscanf(line, "intel_fn12h[%d]=%" SCNx32 "%" SCNx32 "%" SCNx32 "%" SCNx32, &i, &eax, &ebx, &ecx, &edx) >= 5) && (i >= 0) && (i < MAX_INTELFN12H_LEVEL)) {
-				RAW_ASSIGN_LINE_X86(raw_ptr->intel_fn12h[i]);
-			}
-			else if ((sscanf(line, "intel_fn14h[%d]=%" SCNx32 "%" SCNx32 "%" SCNx32 "%" SCNx32, &i, &eax, &ebx, &ecx, &edx) >= 5) && (i >= 0) && (i < MAX_INTELFN14H_LEVEL)) {
-				RAW_ASSIGN_LINE_X86(raw_ptr->intel_fn14h[i]);
-			}
-			else if ((sscanf(line, "amd_fn8000001dh[%d]=%" SCNx32 "%" SCNx32 "%" SCNx32 "%" SCNx32, &i, &eax, &ebx, &ecx, &edx) >= 5) && (i >= 0) && (i < MAX_AMDFN8000001DH_LEVEL)) {
-				RAW_ASSIGN_LINE_X86(raw_ptr->amd_fn8000001dh[i]);
-			}
-			else if ((sscanf(line, "amd_fn80000026h[%d]=%" SCNx32 "%" SCNx32 "%" SCNx32 "%" SCNx32, &i, &eax, &ebx, &ecx, &edx) >= 5) && (i >= 0) && (i < MAX_AMDFN80000026H_LEVEL)) {
-				RAW_ASSIGN_LINE_X86(raw_ptr->amd_fn80000026h[i]);
-			}
-			else if ((sscanf(line, "arm_midr=%" SCNx64, &aarch64_reg) >= 1)) {
-				RAW_ASSIGN_LINE_AARCH64(raw_ptr->arm_midr);
-			}
-			else if ((sscanf(line, "arm_mpidr=%" SCNx64, &aarch64_reg) >= 1)) {
-				RAW_ASSIGN_LINE_AARCH64(raw_ptr->arm_mpidr);
-			}
-			else if ((sscanf(line, "arm_revidr=%" SCNx64, &aarch64_reg) >= 1)) {
-				RAW_ASSIGN_LINE_AARCH64(raw_ptr->arm_revidr);
-			}
-			else if ((sscanf(line, "arm_id_afr%d=%" SCNx32, &i, &aarch32_reg) >= 2)) {
-				RAW_ASSIGN_LINE_AARCH32(raw_ptr->arm_id_afr[i]);
-			}
-			else if ((sscanf(line, "arm_id_dfr%d=%" SCNx32, &i, &aarch32_reg) >= 2)) {
-				RAW_ASSIGN_LINE_AARCH32(raw_ptr->arm_id_dfr[i]);
-			}
-			else if ((sscanf(line, "arm_id_isar%d=%" SCNx32, &i, &aarch32_reg) >= 2)) {
-				RAW_ASSIGN_LINE_AARCH32(raw_ptr->arm_id_isar[i]);
-			}
-			else if ((sscanf(line, "arm_id_mmfr%d=%" SCNx32, &i, &aarch32_reg) >= 2)) {
-				RAW_ASSIGN_LINE_AARCH32(raw_ptr->arm_id_mmfr[i]);
-			}
-			else if ((sscanf(line, "arm_id_pfr%d=%" SCNx32, &i, &aarch32_reg) >= 2)) {
-				RAW_ASSIGN_LINE_AARCH32(raw_ptr->arm_id_pfr[i]);
-			}
-			else if ((sscanf(line, "arm_id_aa64afr%d=%" SCNx64, &i, &aarch64_reg) >= 2)) {
-				RAW_ASSIGN_LINE_AARCH64(raw_ptr->arm_id_aa64afr[i]);
-			}
-			else if ((sscanf(line, "arm_id_aa64dfr%d=%" SCNx64, &i, &aarch64_reg) >= 2)) {
-				RAW_ASSIGN_LINE_AARCH64(raw_ptr->arm_id_aa64dfr[i]);
-			}
-			else if ((sscanf(line, "arm_id_aa64fpfr%d=%" SCNx64, &i, &aarch64_reg) >= 2)) {
-				RAW_ASSIGN_LINE_AARCH64(raw_ptr->arm_id_aa64fpfr[i]);
-			}
-			else if ((sscanf(line, "arm_id_aa64isar%d=%" SCNx64, &i, &aarch64_reg) >= 2)) {
-				RAW_ASSIGN_LINE_AARCH64(raw_ptr->arm_id_aa64isar[i]);
-			}
-			else if ((sscanf(line, "arm_id_aa64mmfr%d=%" SCNx64, &i, &aarch64_reg) >= 2)) {
-				RAW_ASSIGN_LINE_AARCH64(raw_ptr->arm_id_aa64mmfr[i]);
-			}
-			else if ((sscanf(line, "arm_id_aa64pfr%d=%" SCNx64, &i, &aarch64_reg) >= 2)) {
-				RAW_ASSIGN_LINE_AARCH64(raw_ptr->arm_id_aa64pfr[i]);
-			}
-			else if ((sscanf(line, "arm_id_aa64smfr%d=%" SCNx64, &i, &aarch64_reg) >= 2)) {
-				RAW_ASSIGN_LINE_AARCH64(raw_ptr->arm_id_aa64smfr[i]);
-			}
-			else if ((sscanf(line, "arm_id_aa64zfr%d=%" SCNx64, &i, &aarch64_reg) >= 2)) {
-				RAW_ASSIGN_LINE_AARCH64(raw_ptr->arm_id_aa64zfr[i]);
-			}
-			else if (line[0] != '\0') {
-				warnf("Warning: file '%s', line %d: '%s' not understood!\n", filename, cur_line, line);
+		if ((len > sizeof(LOGICAL_CPU_HEADER) - 1) && !memcmp(p, LOGICAL_CPU_HEADER, sizeof(LOGICAL_CPU_HEADER) - 1)) {
+			/* parse_dec() needs a NUL-terminated string */
+			if (len >= sizeof(header))
+				len = sizeof(header) - 1;
+			memcpy(header, p, len);
+			header[len] = '\0';
+			q = header + sizeof(LOGICAL_CPU_HEADER) - 1;
+			if (!parse_dec(&q, &value) || (value >= UINT16_MAX) || ((num_blocks > 0) && (value <= list[num_blocks - 1].logical_cpu)))
+				goto sequential;
+			if (num_blocks >= capacity) {
+				capacity = (capacity > 0) ? 2 * capacity : 64;
+				if ((tmp = cpuid_realloc(list, sizeof(struct text_dump_block_t) * capacity)) == NULL)
+					goto sequential;
+				list = tmp;
 			}
+			if (num_blocks > 0)
+				list[num_blocks - 1].end = p;
+			list[num_blocks].start       = next;
+			list[num_blocks].end         = end;
+			list[num_blocks].header_line = cur_line;
+			list[num_blocks].logical_cpu = (logical_cpu_t) value;
+			list[num_blocks].is_delta    = false;
+			num_blocks++;
 		}
-		else if (is_aida64_dump) {
-			if (use_raw_array && ((sscanf(line, "------[ Logical CPU #%" SCNu16 " ]------", &logical_cpu) >= 1) ||
-			                      (sscanf(line, "------[ CPUID Registers / Logical CPU #%" SCNu16 " ]------", &logical_cpu) >= 1) ||
-			                      (sscanf(line, "CPUID Registers (CPU #%" SCNu16, &logical_cpu) >= 1) ||
-			                      (sscanf(line, "CPU#%" SCNu16 " AffMask: 0x%*x", &logical_cpu) >= 1))) {
-				/* Some raw dumps start core count from 1, we need to start from 0 */
-				if ((raw_array->num_raw == 0) && (logical_cpu >= 1))
-					logical_cpu_offset = logical_cpu;
-				logical_cpu -= logical_cpu_offset;
-				debugf(2, "Parsing AIDA64 raw dump for logical CPU %i\n", logical_cpu);
-				cpuid_grow_raw_data_array(raw_array, logical_cpu + 1);
-				raw_ptr = &raw_array->raw[logical_cpu];
-				raw_array->with_affinity = true;
-				continue;
-			}
-			subleaf = 0;
-			assigned = sscanf(line, "CPUID %" SCNx32 ": %" SCNx32 "-%" SCNx32 "-%" SCNx32 "-%" SCNx32 " [SL %02i]", &addr, &eax, &ebx, &ecx, &edx, &subleaf);
-			if (assigned == 1)
-				assigned = sscanf(line, "CPUID %" SCNx32 "  	 %" SCNx32 "-%" SCNx32 "-%" SCNx32 "-%" SCNx32 " [SL %02i]", &addr, &eax, &ebx, &ecx, &edx, &subleaf);
-			debugf(3, "raw line %d: %i items assigned for string '%s'\n", cur_line, assigned, line);
-			if ((assigned >= 5) && (subleaf == 0)) {
-				if (addr < MAX_CPUID_LEVEL) {
-					i = (int) addr;
-					RAW_ASSIGN_LINE_X86(raw_ptr->basic_cpuid[i]);
-				}
-				else if ((addr >= ADDRESS_EXT_CPUID_START) && (addr < ADDRESS_EXT_CPUID_END)) {
-					i = (int) addr - ADDRESS_EXT_CPUID_START;
-					RAW_ASSIGN_LINE_X86(raw_ptr->ext_cpuid[i]);
-				}
-			}
-			if (assigned >= 6) {
-				i = subleaf;
-				switch (addr) {
-					case 0x00000004: RAW_ASSIGN_LINE_X86(raw_ptr->intel_fn4[i]);       break;
-					case 0x0000000B: RAW_ASSIGN_LINE_X86(raw_ptr->intel_fn11[i]);      break;
-					case 0x00000012: RAW_ASSIGN_LINE_X86(raw_ptr->intel_fn12h[i]);     break;
-					case 0x00000014: RAW_ASSIGN_LINE_X86(raw_ptr->intel_fn14h[i]);     break;
-					case 0x8000001D: RAW_ASSIGN_LINE_X86(raw_ptr->amd_fn8000001dh[i]); break;
-					case 0x80000026: RAW_ASSIGN_LINE_X86(raw_ptr->amd_fn80000026h[i]); break;
-					default: break;
-				}
-			}
+		else if (num_blocks == 0) {
+			/* Only the version may come before the first logical CPU */
+			if ((len < 8) || memcmp(p, "version=", 8))
+				goto sequential;
 		}
+		else if ((len >= sizeof(SAME_AS_CPU_KEY) - 1) && !memcmp(p, SAME_AS_CPU_KEY, sizeof(SAME_AS_CPU_KEY) - 1))
+			list[num_blocks - 1].is_delta = true;
+	}
+	if ((num_blocks > 0) && (p < end))
+		list[num_blocks - 1].end = p;
+	*blocks = list;
+	return num_blocks;
+
+sequential:
+	cpuid_free(list);
+	*blocks = NULL;
+	return 0;
+}
+
+/* Feeds the lines of a block to a parser which writes to the raw data of its logical CPU */
+static void text_parser_block(struct text_parser_t* parser, const struct text_dump_block_t* block)
+{
+	const char *p, *next;
+
+	parser->is_header = false;
+	parser->cur_line  = block->header_line;
+	for (p = block->start; p < block->end; p = next) {
+		next = memchr(p, '\n', (size_t) (block->end - p));
+		next = (next != NULL) ? next + 1 : block->end;
+		text_parser_line(parser, p, (size_t) (next - p));
 	}
+}
 
-	/* Close file descriptor */
-	if (strcmp(filename, ""))
-		fclose(f);
-	return cpuid_set_error((use_raw_array && (raw_array->num_raw == 0)) ? ERR_BADFMT : ERR_OK);
+static void text_dump_parse_slice(void* arg)
+{
+	struct text_dump_slice_t* slice = (struct text_dump_slice_t*) arg;
+	struct text_parser_t parser;
+	uint32_t i;
+
+	for (i = slice->first; i < slice->last; i++) {
+		if (slice->blocks[i].is_delta)
+			continue;
+		text_parser_begin(&parser, &slice->raw_array->raw[slice->blocks[i].logical_cpu], NULL, NULL, slice->name);
+		text_parser_block(&parser, &slice->blocks[i]);
+		if (parser.output.error != ERR_OK)
+			slice->error = parser.output.error;
+	}
+}
+
+/* Parses a raw dump in memory with num_threads threads, or sequentially if it is not a libcpuid text raw dump
+   The result is the same as with cpuid_deserialize_buffer_internal() */
+static int cpuid_deserialize_parallel_internal(struct cpu_raw_data_array_t* raw_array, const void* data, size_t size, const char* name, int num_threads)
+{
+#ifdef HAVE_PARALLEL_TASKS
+	int i;
+	uint32_t b, num_blocks = 0, num_full_blocks = 0;
+	size_t total, target;
+	struct text_parser_t parser;
+	struct text_dump_block_t* blocks = NULL;
+	struct text_dump_slice_t* slices = NULL;
+	struct parallel_task_t* tasks = NULL;
+
+	if (num_threads <= 0)
+		num_threads = cpuid_get_total_cpus();
+	if ((num_threads > 1) && (data != NULL) && (size > 0) && (*(const char*) data != BINARY_DUMP_MAGIC[0]) &&
+	    (detect_compression(data, size) == COMPRESSION_NONE))
+		num_blocks = text_dump_split(data, size, &blocks);
+	/* Delta raw dumps mostly have logical CPUs with references, which are parsed sequentially anyway */
+	for (b = 0; b < num_blocks; b++)
+		if (!blocks[b].is_delta)
+			num_full_blocks++;
+	if ((uint32_t) num_threads > num_full_blocks / PARALLEL_MIN_CPUS_PER_THREAD)
+		num_threads = (int) (num_full_blocks / PARALLEL_MIN_CPUS_PER_THREAD);
+	if (num_threads <= 1) {
+		cpuid_free(blocks);
+		return cpuid_deserialize_buffer_internal(NULL, raw_array, NULL, data, size, name);
+	}
+
+	cpu_raw_data_array_t_constructor(raw_array, false);
+	cpuid_grow_raw_data_array(raw_array, (logical_cpu_t) (blocks[num_blocks - 1].logical_cpu + 1), NULL);
+	slices = cpuid_calloc(num_threads, sizeof(struct text_dump_slice_t));
+	tasks  = cpuid_calloc(num_threads, sizeof(struct parallel_task_t));
+	if ((raw_array->raw == NULL) || (slices == NULL) || (tasks == NULL)) {
+		cpuid_free(blocks);
+		cpuid_free(slices);
+		cpuid_free(tasks);
+		cpuid_free_raw_data_array(raw_array);
+		return cpuid_set_error(ERR_NO_MEM);
+	}
+	raw_array->with_affinity = true;
+
+	/* Each thread parses a contiguous range of logical CPUs, with about the same number of bytes */
+	debugf(1, "Opening raw dump from '%s' with %i threads\n", name, num_threads);
+	total = (size_t) (blocks[num_blocks - 1].end - blocks[0].start);
+	for (b = 0, i = 0; i < num_threads; i++) {
+		target = (i == num_threads - 1) ? total : total / num_threads * (i + 1);
+		slices[i].raw_array = raw_array;
+		slices[i].blocks    = blocks;
+		slices[i].name      = name;
+		slices[i].first     = b;
+		while ((b < num_blocks) && ((size_t) (blocks[b].start - blocks[0].start) < target))
+			b++;
+		slices[i].last      = b;
+		tasks[i].run        = text_dump_parse_slice;
+		tasks[i].arg        = &slices[i];
+	}
+	run_parallel_tasks(tasks, num_threads);
+
+	/* Logical CPUs with references need the previous ones */
+	text_parser_begin(&parser, NULL, NULL, NULL, name);
+	parser.use_raw_array      = true;
+	parser.output.raw_array   = raw_array;
+	parser.output.capacity    = raw_array->num_raw;
+	for (b = 0; b < num_blocks; b++) {
+		if (!blocks[b].is_delta)
+			continue;
+		parser.logical_cpu = blocks[b].logical_cpu;
+		parser.raw_ptr     = &raw_array->raw[blocks[b].logical_cpu];
+		text_parser_block(&parser, &blocks[b]);
+	}
+	for (i = 0; i < num_threads; i++)
+		if (slices[i].error != ERR_OK)
+			parser.output.error = slices[i].error;
+	cpuid_free(blocks);
+	cpuid_free(slices);
+	cpuid_free(tasks);
+	if (parser.output.error != ERR_OK) {
+		cpuid_free_raw_data_array(raw_array);
+		return cpuid_set_error(parser.output.error);
+	}
+	return cpuid_set_error(ERR_OK);
+#else
+	UNUSED(num_threads);
+	return cpuid_deserialize_buffer_internal(NULL, raw_array, NULL, data, size, name);
+#endif /* HAVE_PARALLEL_TASKS */
 }
-#undef RAW_ASSIGN_LINE_X86
-#undef RAW_ASSIGN_LINE_ARM
 
 static void load_features_common(struct cpu_raw_data_t* raw, struct cpu_id_t* data)
 {
@@ -1027,20 +2655,20 @@ static void load_features_common(struct cpu_raw_data_t* raw, struct cpu_id_t* da
 	const struct feature_map_t matchtable_edx87[] = {
 		{  8, CPU_FEATURE_CONSTANT_TSC },
 	};
-	if (raw->basic_cpuid[0][EAX] >= 1) {
-		match_features(matchtable_edx1, COUNT_OF(matchtable_edx1), raw->basic_cpuid[1][EDX], data);
-		match_features(matchtable_ecx1, COUNT_OF(matchtable_ecx1), raw->basic_cpuid[1][ECX], data);
+	if (cpuid_get_raw_leaf(raw, 0, 0)[EAX] >= 1) {
+		match_features(matchtable_edx1, COUNT_OF(matchtable_edx1), cpuid_get_raw_leaf(raw, 1, 0)[EDX], data);
+		match_features(matchtable_ecx1, COUNT_OF(matchtable_ecx1), cpuid_get_raw_leaf(raw, 1, 0)[ECX], data);
 	}
-	if (raw->basic_cpuid[0][EAX] >= 7) {
-		match_features(matchtable_ebx7, COUNT_OF(matchtable_ebx7), raw->basic_cpuid[7][EBX], data);
-		match_features(matchtable_ecx7, COUNT_OF(matchtable_ecx7), raw->basic_cpuid[7][ECX], data);
+	if (cpuid_get_raw_leaf(raw, 0, 0)[EAX] >= 7) {
+		match_features(matchtable_ebx7, COUNT_OF(matchtable_ebx7), cpuid_get_raw_leaf(raw, 7, 0)[EBX], data);
+		match_features(matchtable_ecx7, COUNT_OF(matchtable_ecx7), cpuid_get_raw_leaf(raw, 7, 0)[ECX], data);
 	}
-	if (raw->ext_cpuid[0][EAX] >= 0x80000001) {
-		match_features(matchtable_edx81, COUNT_OF(matchtable_edx81), raw->ext_cpuid[1][EDX], data);
-		match_features(matchtable_ecx81, COUNT_OF(matchtable_ecx81), raw->ext_cpuid[1][ECX], data);
+	if (cpuid_get_raw_leaf(raw, 0x80000000, 0)[EAX] >= 0x80000001) {
+		match_features(matchtable_edx81, COUNT_OF(matchtable_edx81), cpuid_get_raw_leaf(raw, 0x80000001, 0)[EDX], data);
+		match_features(matchtable_ecx81, COUNT_OF(matchtable_ecx81), cpuid_get_raw_leaf(raw, 0x80000001, 0)[ECX], data);
 	}
-	if (raw->ext_cpuid[0][EAX] >= 0x80000007) {
-		match_features(matchtable_edx87, COUNT_OF(matchtable_edx87), raw->ext_cpuid[7][EDX], data);
+	if (cpuid_get_raw_leaf(raw, 0x80000000, 0)[EAX] >= 0x80000007) {
+		match_features(matchtable_edx87, COUNT_OF(matchtable_edx87), cpuid_get_raw_leaf(raw, 0x80000007, 0)[EDX], data);
 	}
 	if (data->flags[CPU_FEATURE_SSE]) {
 		/* apply guesswork to check if the SSE unit width is 128 bit */
@@ -1096,33 +2724,35 @@ static cpu_vendor_t cpuid_vendor_identify(const uint32_t *raw_vendor, char *vend
 static int cpuid_basic_identify(struct cpu_raw_data_t* raw, struct cpu_id_t* data)
 {
 	int i, j, basic, xmodel, xfamily, ext;
+	uint32_t signature;
 	char brandstr[64] = {0};
-	data->vendor = cpuid_vendor_identify(raw->basic_cpuid[0], data->vendor_str);
+	data->vendor = cpuid_vendor_identify(cpuid_get_raw_leaf(raw, 0, 0), data->vendor_str);
 
 	if (data->vendor == VENDOR_UNKNOWN)
 		return cpuid_set_error(ERR_CPU_UNKN);
 
-	basic = raw->basic_cpuid[0][EAX];
+	basic = cpuid_get_raw_leaf(raw, 0, 0)[EAX];
 	if (basic >= 1) {
-		data->x86.family = (raw->basic_cpuid[1][EAX] >> 8) & 0xf;
-		data->x86.model = (raw->basic_cpuid[1][EAX] >> 4) & 0xf;
-		data->x86.stepping = raw->basic_cpuid[1][EAX] & 0xf;
-		xmodel = (raw->basic_cpuid[1][EAX] >> 16) & 0xf;
-		xfamily = (raw->basic_cpuid[1][EAX] >> 20) & 0xff;
+		signature = cpuid_get_raw_leaf(raw, 1, 0)[EAX];
+		data->x86.family = (signature >> 8) & 0xf;
+		data->x86.model = (signature >> 4) & 0xf;
+		data->x86.stepping = signature & 0xf;
+		xmodel = (signature >> 16) & 0xf;
+		xfamily = (signature >> 20) & 0xff;
 		if (data->vendor == VENDOR_AMD && data->x86.family < 0xf)
 			data->x86.ext_family = data->x86.family;
 		else
 			data->x86.ext_family = data->x86.family + xfamily;
 		data->x86.ext_model = data->x86.model + (xmodel << 4);
 	}
-	ext = raw->ext_cpuid[0][EAX] - 0x80000000;
+	ext = cpuid_get_raw_leaf(raw, 0x80000000, 0)[EAX] - 0x80000000;
 
 	/* obtain the brand string, if present: */
 	if (ext >= 4) {
 		for (i = 0; i < 3; i++)
 			for (j = 0; j < 4; j++)
 				memcpy(brandstr + i * 16 + j * 4,
-				       &raw->ext_cpuid[2 + i][j], 4);
+				       &cpuid_get_raw_leaf(raw, 0x80000002 + i, 0)[j], 4);
 		brandstr[48] = 0;
 		i = 0;
 		while (brandstr[i] == ' ') i++;
@@ -1141,7 +2771,7 @@ static void make_list_from_string(const char* csv, struct cpu_list_t* list)
 	n = 0;
 	for (i = 0; i < l; i++) if (csv[i] == ',') n++;
 	n++;
-	list->names = (char**) malloc(sizeof(char*) * n);
+	list->names = (char**) cpuid_malloc(sizeof(char*) * n);
 	if (!list->names) { /* Memory allocation failed */
 		list->num_entries = 0;
 		cpuid_set_error(ERR_NO_MEM);
@@ -1151,11 +2781,11 @@ static void make_list_from_string(const char* csv, struct cpu_list_t* list)
 	last = -1;
 	n = 0;
 	for (i = 0; i <= l; i++) if (i == l || csv[i] == ',') {
-		list->names[n] = (char*) malloc(i - last);
+		list->names[n] = (char*) cpuid_malloc(i - last);
 		if (!list->names[n]) { /* Memory allocation failed */
 			cpuid_set_error(ERR_NO_MEM);
-			for (j = 0; j < n; j++) free(list->names[j]);
-			free(list->names);
+			for (j = 0; j < n; j++) cpuid_free(list->names[j]);
+			cpuid_free(list->names);
 			list->num_entries = 0;
 			list->names = NULL;
 			return;
@@ -1174,10 +2804,11 @@ static bool cpu_ident_id_x86(struct cpu_raw_data_t* raw, struct internal_topolog
 	uint8_t level_type = 0;
 	uint8_t mask_core_shift = 0;
 	uint32_t mask_smt_shift, core_plus_mask_width, package_mask, core_mask, smt_mask = 0;
+	const uint32_t* fn11;
 	char vendor_str[VENDOR_STR_MAX];
 
 	/* Only AMD and Intel x86 CPUs support Extended Processor Topology Eumeration */
-	const cpu_vendor_t vendor = cpuid_vendor_identify(raw->basic_cpuid[0], vendor_str);
+	const cpu_vendor_t vendor = cpuid_vendor_identify(cpuid_get_raw_leaf(raw, 0, 0), vendor_str);
 	switch (vendor) {
 		case VENDOR_INTEL:
 		case VENDOR_AMD:
@@ -1198,27 +2829,37 @@ static bool cpu_ident_id_x86(struct cpu_raw_data_t* raw, struct internal_topolog
 	*/
 
 	/* Check if leaf 0Bh is supported and if number of logical processors at this level type is greater than 0 */
-	if (!is_apic_id_supported || (raw->basic_cpuid[0][EAX] < 11) || (EXTRACTS_BITS(raw->basic_cpuid[11][EBX], 15, 0) == 0)) {
+	if (!is_apic_id_supported || (cpuid_get_raw_leaf(raw, 0, 0)[EAX] < 11) || (EXTRACTS_BITS(cpuid_get_raw_leaf(raw, 0xb, 0)[EBX], 15, 0) == 0)) {
 		warnf("Warning: APIC ID are not supported, core count can be wrong if SMT is disabled and cache instances count will not be available.\n");
 		return false;
 	}
+	/* Raw dumps of old versions only have subleaf 0 (from basic_cpuid[]), there are at least 2 levels otherwise */
+	if (EXTRACTS_BITS(cpuid_get_raw_leaf(raw, 0xb, 1)[EBX], 15, 0) == 0)
+		return false;
 
 	/* Derive core mask offsets */
-	for (subleaf = 0; (raw->intel_fn11[subleaf][EAX] != 0x0) && (raw->intel_fn11[subleaf][EBX] != 0x0) && (subleaf < MAX_INTELFN11_LEVEL); subleaf++)
-		mask_core_shift = EXTRACTS_BITS(raw->intel_fn11[subleaf][EAX], 4, 0);
+	for (subleaf = 0; subleaf < MAX_INTELFN11_LEVEL; subleaf++) {
+		fn11 = cpuid_get_raw_leaf(raw, 0xb, subleaf);
+		if ((fn11[EAX] == 0x0) || (fn11[EBX] == 0x0))
+			break;
+		mask_core_shift = EXTRACTS_BITS(fn11[EAX], 4, 0);
+	}
 
 	/* Find mask and ID for SMT and cores */
-	for (subleaf = 0; (raw->intel_fn11[subleaf][EAX] != 0x0) && (raw->intel_fn11[subleaf][EBX] != 0x0) && (subleaf < MAX_INTELFN11_LEVEL); subleaf++) {
-		level_type        = EXTRACTS_BITS(raw->intel_fn11[subleaf][ECX], 15, 8);
-		topology->apic_id = raw->intel_fn11[subleaf][EDX];
+	for (subleaf = 0; subleaf < MAX_INTELFN11_LEVEL; subleaf++) {
+		fn11 = cpuid_get_raw_leaf(raw, 0xb, subleaf);
+		if ((fn11[EAX] == 0x0) || (fn11[EBX] == 0x0))
+			break;
+		level_type        = EXTRACTS_BITS(fn11[ECX], 15, 8);
+		topology->apic_id = fn11[EDX];
 		switch (level_type) {
 			case 0x01:
-				mask_smt_shift    = EXTRACTS_BITS(raw->intel_fn11[subleaf][EAX], 4, 0);
-				smt_mask          = ~( (-1) << mask_smt_shift);
+				mask_smt_shift    = EXTRACTS_BITS(fn11[EAX], 4, 0);
+				smt_mask          = ~(~0U << mask_smt_shift);
 				topology->smt_id  = topology->apic_id & smt_mask;
 				break;
 			case 0x02:
-				core_plus_mask_width = ~( (-1) << mask_core_shift);
+				core_plus_mask_width = ~(~0U << mask_core_shift);
 				core_mask            = core_plus_mask_width ^ smt_mask;
 				topology->core_id    = topology->apic_id & core_mask;
 				break;
@@ -1228,7 +2869,7 @@ static bool cpu_ident_id_x86(struct cpu_raw_data_t* raw, struct internal_topolog
 	}
 
 	/* Find mask and ID for packages */
-	package_mask          = (-1) << mask_core_shift;
+	package_mask          = ~0U << mask_core_shift;
 	topology->package_id  = topology->apic_id & package_mask;
 
 	return (level_type > 0);
@@ -1284,7 +2925,7 @@ static bool cpu_ident_id_arm(struct cpu_raw_data_t* raw, struct internal_topolog
 	return true;
 }
 
-static bool cpu_ident_id(logical_cpu_t logical_cpu, struct cpu_raw_data_t* raw, struct internal_topology_t* topology)
+bool cpu_ident_id(logical_cpu_t logical_cpu, struct cpu_raw_data_t* raw, struct internal_topology_t* topology)
 {
 	topology_t_constructor(topology, logical_cpu);
 
@@ -1329,122 +2970,358 @@ int cpuid_present(void)
 #endif
 }
 
+/* CPUID statistics, with one slot per leaf for the basic, hypervisor and extended ranges */
+#define LEAF_STATS_RANGE_SIZE 256
+static const uint32_t leaf_stats_ranges[] = { 0x00000000, 0x40000000, 0x80000000 };
+static struct cpuid_leaf_stats_t leaf_stats[COUNT_OF(leaf_stats_ranges)][LEAF_STATS_RANGE_SIZE];
+static int leaf_stats_enabled = 0;
+
+/* The statistics are updated by the threads which collect raw data, while they can be enabled, cleared or read */
+#if defined(__GNUC__)
+# define LEAF_STATS_ADD(__field, __value)   __atomic_fetch_add(&(__field), (__value), __ATOMIC_RELAXED)
+# define LEAF_STATS_LOAD(__field)           __atomic_load_n(&(__field), __ATOMIC_RELAXED)
+# define LEAF_STATS_STORE(__field, __value) __atomic_store_n(&(__field), (__value), __ATOMIC_RELAXED)
+# define LEAF_STATS_IS_ENABLED()            __atomic_load_n(&leaf_stats_enabled, __ATOMIC_ACQUIRE)
+# define LEAF_STATS_ENABLE(__enable)        __atomic_store_n(&leaf_stats_enabled, (__enable), __ATOMIC_RELEASE)
+#elif defined(_MSC_VER)
+# define LEAF_STATS_ADD(__field, __value)   InterlockedExchangeAdd64((volatile LONG64*) &(__field), (LONG64) (__value))
+# define LEAF_STATS_LOAD(__field)           ((uint64_t) InterlockedCompareExchange64((volatile LONG64*) &(__field), 0, 0))
+# define LEAF_STATS_STORE(__field, __value) InterlockedExchange64((volatile LONG64*) &(__field), (LONG64) (__value))
+# define LEAF_STATS_IS_ENABLED()            InterlockedCompareExchange((volatile LONG*) &leaf_stats_enabled, 0, 0)
+# define LEAF_STATS_ENABLE(__enable)        InterlockedExchange((volatile LONG*) &leaf_stats_enabled, (__enable))
+#else
+/* Without atomic operations, the statistics must not be enabled, cleared or read during a collection */
+# define LEAF_STATS_ADD(__field, __value)   (__field) += (__value)
+# define LEAF_STATS_LOAD(__field)           (__field)
+# define LEAF_STATS_STORE(__field, __value) (__field) = (__value)
+# define LEAF_STATS_IS_ENABLED()            leaf_stats_enabled
+# define LEAF_STATS_ENABLE(__enable)        leaf_stats_enabled = (__enable)
+#endif
+
+static void update_leaf_stats(uint32_t leaf, uint64_t tsc_ticks)
+{
+	unsigned i;
+	for (i = 0; i < COUNT_OF(leaf_stats_ranges); i++)
+		if ((leaf >= leaf_stats_ranges[i]) && (leaf - leaf_stats_ranges[i] < LEAF_STATS_RANGE_SIZE)) {
+			LEAF_STATS_ADD(leaf_stats[i][leaf - leaf_stats_ranges[i]].count, 1);
+			LEAF_STATS_ADD(leaf_stats[i][leaf - leaf_stats_ranges[i]].tsc_ticks, tsc_ticks);
+			return;
+		}
+}
+
+static void exec_cpuid_with_stats(uint32_t* regs)
+{
+	uint64_t start, end;
+	const uint32_t leaf = regs[EAX];
+
+	if (!LEAF_STATS_IS_ENABLED()) {
+		exec_cpuid(regs);
+		return;
+	}
+	cpu_rdtsc(&start);
+	exec_cpuid(regs);
+	cpu_rdtsc(&end);
+	update_leaf_stats(leaf, end - start);
+}
+
 void cpu_exec_cpuid(uint32_t eax, uint32_t* regs)
 {
 	regs[0] = eax;
 	regs[1] = regs[2] = regs[3] = 0;
-	exec_cpuid(regs);
+	exec_cpuid_with_stats(regs);
 }
 
 void cpu_exec_cpuid_ext(uint32_t* regs)
 {
-	exec_cpuid(regs);
+	exec_cpuid_with_stats(regs);
+}
+
+void cpuid_enable_leaf_stats(bool enable)
+{
+	unsigned i, j;
+
+	/* Not memset(): other threads may be updating the statistics */
+	for (i = 0; i < COUNT_OF(leaf_stats_ranges); i++)
+		for (j = 0; j < LEAF_STATS_RANGE_SIZE; j++) {
+			LEAF_STATS_STORE(leaf_stats[i][j].count, 0);
+			LEAF_STATS_STORE(leaf_stats[i][j].tsc_ticks, 0);
+		}
+	LEAF_STATS_ENABLE(enable ? 1 : 0);
+}
+
+int cpuid_get_leaf_stats(struct cpuid_leaf_stats_t* stats, int max_stats)
+{
+	unsigned i, j;
+	int num_stats = 0;
+	uint64_t count;
+
+	for (i = 0; i < COUNT_OF(leaf_stats_ranges); i++)
+		for (j = 0; j < LEAF_STATS_RANGE_SIZE; j++) {
+			if ((count = LEAF_STATS_LOAD(leaf_stats[i][j].count)) == 0)
+				continue;
+			if ((stats != NULL) && (num_stats < max_stats)) {
+				stats[num_stats].leaf      = leaf_stats_ranges[i] + j;
+				stats[num_stats].count     = count;
+				stats[num_stats].tsc_ticks = LEAF_STATS_LOAD(leaf_stats[i][j].tsc_ticks);
+			}
+			num_stats++;
+		}
+
+	return num_stats;
 }
 
+static int cpuid_collect_raw_data(struct cpu_raw_data_t* data, logical_cpu_t logical_cpu);
+
 int cpuid_get_raw_data(struct cpu_raw_data_t* data)
 {
 	return(cpuid_get_raw_data_core(data, -1));
 }
 
+#if defined(PLATFORM_X86) || defined(PLATFORM_X64)
+/* Executes CPUID with the given leaf and subleaf, through the cpuid kernel driver if a handle is given */
+static int cpuid_exec_leaf(struct cpuid_driver_t* handle, uint32_t leaf, uint32_t subleaf, uint32_t* regs)
+{
+	int r = ERR_OK;
+	uint64_t start, end;
+
+	regs[EAX] = leaf;
+	regs[EBX] = 0;
+	regs[ECX] = subleaf;
+	regs[EDX] = 0;
+	if (handle == NULL) {
+		exec_cpuid_with_stats(regs);
+		return ERR_OK;
+	}
+	if (leaf_stats_enabled)
+		cpu_rdtsc(&start);
+	r = cpu_read_x86_cpuid(handle, regs);
+	if (leaf_stats_enabled) {
+		cpu_rdtsc(&end);
+		update_leaf_stats(leaf, end - start);
+	}
+	return r;
+}
+
+/* How the valid subleaves of a CPUID leaf are enumerated */
+typedef enum {
+	SUBLEAF_UNTIL_NULL,   /* stop after the first subleaf where the field is zero */
+	SUBLEAF_MAX_IN_FIELD, /* the field of subleaf 0 is the maximum subleaf */
+	SUBLEAF_BITMAP,       /* subleaf N is valid when bit N of the field of subleaf 0 is set */
+	SUBLEAF_XSAVE,        /* subleaves 0 and 1, then one subleaf per state component supported in XCR0 or IA32_XSS */
+} subleaf_enum_t;
+
+struct subleaf_rule_t {
+	uint32_t leaf;
+	subleaf_enum_t type;
+	uint32_t first_checked; /* for SUBLEAF_UNTIL_NULL: the lower subleaves are always valid */
+	cpu_registers_t reg;
+	uint8_t highbit, lowbit;
+};
+
+/* Leaves which are not listed here only have subleaf 0 */
+static const struct subleaf_rule_t x86_subleaf_rules[] = {
+	{ 0x00000004, SUBLEAF_UNTIL_NULL,   0, EAX,  4, 0 }, /* Deterministic cache parameters: cache type */
+	{ 0x00000007, SUBLEAF_MAX_IN_FIELD, 0, EAX, 31, 0 }, /* Structured extended feature flags */
+	{ 0x0000000B, SUBLEAF_UNTIL_NULL,   0, ECX, 15, 8 }, /* Extended topology enumeration: level type */
+	{ 0x0000000D, SUBLEAF_XSAVE,        0, EAX, 31, 0 }, /* Processor extended state enumeration */
+	{ 0x0000000F, SUBLEAF_BITMAP,       0, EDX, 31, 0 }, /* Intel RDT monitoring */
+	{ 0x00000010, SUBLEAF_BITMAP,       0, EBX, 31, 0 }, /* Intel RDT allocation */
+	{ 0x00000012, SUBLEAF_UNTIL_NULL,   2, EAX,  3, 0 }, /* SGX: capabilities, then EPC sections */
+	{ 0x00000014, SUBLEAF_MAX_IN_FIELD, 0, EAX, 31, 0 }, /* Intel Processor Trace */
+	{ 0x00000017, SUBLEAF_MAX_IN_FIELD, 0, EAX, 31, 0 }, /* SoC vendor attributes */
+	{ 0x00000018, SUBLEAF_MAX_IN_FIELD, 0, EAX, 31, 0 }, /* Deterministic address translation parameters */
+	{ 0x0000001D, SUBLEAF_MAX_IN_FIELD, 0, EAX, 31, 0 }, /* Tile information */
+	{ 0x0000001F, SUBLEAF_UNTIL_NULL,   0, ECX, 15, 8 }, /* V2 extended topology enumeration: level type */
+	{ 0x00000020, SUBLEAF_MAX_IN_FIELD, 0, EAX, 31, 0 }, /* Processor history reset */
+	{ 0x00000023, SUBLEAF_BITMAP,       0, EAX, 31, 0 }, /* Architectural performance monitoring extended */
+	{ 0x00000024, SUBLEAF_MAX_IN_FIELD, 0, EAX, 31, 0 }, /* Intel AVX10 converged vector ISA */
+	{ 0x8000001D, SUBLEAF_UNTIL_NULL,   0, EAX,  4, 0 }, /* AMD cache topology: cache type */
+	{ 0x80000020, SUBLEAF_BITMAP,       0, EBX, 31, 0 }, /* AMD platform QoS enforcement */
+	{ 0x80000026, SUBLEAF_UNTIL_NULL,   0, ECX, 15, 8 }, /* AMD extended CPU topology: level type */
+};
+
+#define MAX_X86_SUBLEAF    64
+#define MAX_X86_LEAF_RANGE 0x100
+
+static bool x86_subleaf_exists(const struct subleaf_rule_t* rule, const struct cpu_raw_data_t* data, uint32_t subleaf)
+{
+	const uint32_t* subleaf0 = cpuid_get_raw_leaf(data, rule->leaf, 0);
+	const uint32_t* subleaf1 = cpuid_get_raw_leaf(data, rule->leaf, 1);
+	const uint32_t field = (uint32_t) EXTRACTS_BITS(subleaf0[rule->reg], rule->highbit, rule->lowbit);
+	uint64_t components;
+
+	switch (rule->type) {
+		case SUBLEAF_UNTIL_NULL:
+			return true;
+		case SUBLEAF_MAX_IN_FIELD:
+			return subleaf <= field;
+		case SUBLEAF_BITMAP:
+			return (subleaf < 32) && EXTRACTS_BIT(field, subleaf);
+		case SUBLEAF_XSAVE:
+			if (subleaf == 1)
+				return true;
+			components  = subleaf0[EAX] | ((uint64_t) subleaf0[EDX] << 32);
+			components |= subleaf1[ECX] | ((uint64_t) subleaf1[EDX] << 32);
+			return EXTRACTS_BIT(components, subleaf);
+	}
+	return false;
+}
+
+/* Executes all the valid subleaves of a leaf */
+static int cpuid_get_raw_leaf_x86(struct cpu_raw_data_t* data, struct cpuid_driver_t* handle, uint32_t leaf)
+{
+	int r;
+	unsigned i;
+	uint32_t subleaf, regs[NUM_REGS];
+	const struct subleaf_rule_t* rule = NULL;
+
+	for (i = 0; i < COUNT_OF(x86_subleaf_rules); i++)
+		if (x86_subleaf_rules[i].leaf == leaf)
+			rule = &x86_subleaf_rules[i];
+
+	for (subleaf = 0; subleaf < MAX_X86_SUBLEAF; subleaf++) {
+		if ((subleaf > 0) && (rule == NULL))
+			break;
+		if ((subleaf > 0) && !x86_subleaf_exists(rule, data, subleaf))
+			continue;
+		if ((r = cpuid_exec_leaf(handle, leaf, subleaf, regs)) != ERR_OK)
+			return r;
+		/* Zeros are not stored in the table of leaves: a missing leaf reads as zero */
+		if ((r = cpuid_set_raw_leaf(data, leaf, subleaf, regs)) != ERR_OK)
+			return r;
+		if ((rule != NULL) && (rule->type == SUBLEAF_UNTIL_NULL) && (subleaf >= rule->first_checked) &&
+		    (EXTRACTS_BITS(regs[rule->reg], rule->highbit, rule->lowbit) == 0))
+			break;
+	}
+	return ERR_OK;
+}
+
+/* Only executes the leaves and subleaves which can exist: the others are left zeroed */
+static int cpuid_get_raw_data_x86(struct cpu_raw_data_t* data, struct cpuid_driver_t* handle)
+{
+	int r;
+	uint32_t leaf, max_basic, max_hv, max_ext;
+
+	raw_data_clear(data);
+	if ((r = cpuid_get_raw_leaf_x86(data, handle, 0)) != ERR_OK)
+		return r;
+	max_basic = cpuid_get_raw_leaf(data, 0, 0)[EAX];
+	for (leaf = 1; (r == ERR_OK) && (leaf < MAX_X86_LEAF_RANGE) && (leaf <= max_basic); leaf++)
+		r = cpuid_get_raw_leaf_x86(data, handle, leaf);
+	/* Leaves 0x40000000 - 0x400000FF are only defined by the hypervisor, when the hypervisor present bit is set
+	   Some hypervisors (e.g. old KVM versions) report 0 as the maximum leaf, it means 0x40000001 */
+	if ((r == ERR_OK) && (max_basic >= 1) && (cpuid_get_raw_leaf(data, 1, 0)[ECX] & (1U << 31))) {
+		r = cpuid_get_raw_leaf_x86(data, handle, 0x40000000);
+		max_hv = cpuid_get_raw_leaf(data, 0x40000000, 0)[EAX];
+		if (max_hv < 0x40000000)
+			max_hv = 0x40000001;
+		for (leaf = 0x40000001; (r == ERR_OK) && (leaf < 0x40000000 + MAX_X86_LEAF_RANGE) && (leaf <= max_hv); leaf++)
+			r = cpuid_get_raw_leaf_x86(data, handle, leaf);
+	}
+	if (r == ERR_OK)
+		r = cpuid_get_raw_leaf_x86(data, handle, 0x80000000);
+	max_ext = cpuid_get_raw_leaf(data, 0x80000000, 0)[EAX];
+	for (leaf = 0x80000001; (r == ERR_OK) && (leaf < 0x80000000 + MAX_X86_LEAF_RANGE) && (leaf <= max_ext); leaf++)
+		r = cpuid_get_raw_leaf_x86(data, handle, leaf);
+
+	return r;
+}
+#endif /* defined(PLATFORM_X86) || defined(PLATFORM_X64) */
+
 int cpuid_get_raw_data_core(struct cpu_raw_data_t* data, logical_cpu_t logical_cpu)
+{
+	if (data == NULL)
+		return cpuid_set_error(ERR_HANDLE);
+	raw_data_t_constructor(data);
+	return cpuid_collect_raw_data(data, logical_cpu);
+}
+
+/* Same as cpuid_get_raw_data_core(), with initialized raw data: its table of leaves is reused */
+static int cpuid_collect_raw_data(struct cpu_raw_data_t* data, logical_cpu_t logical_cpu)
 {
 	bool affinity_saved = false;
 
+#if defined(PLATFORM_X86) || defined(PLATFORM_X64)
+	int r;
+	struct cpuid_driver_t handle;
+
+	/* Prefer the cpuid kernel driver when available: it runs CPUID on the target CPU without migrating the current thread */
+	if ((logical_cpu != (logical_cpu_t) -1) && (cpu_cpuid_driver_open_core(&handle, logical_cpu) == ERR_OK)) {
+		debugf(2, "Using kernel driver to get raw dump for logical CPU %u\n", logical_cpu);
+		r = cpuid_get_raw_data_x86(data, &handle);
+		cpu_cpuid_driver_close(&handle);
+		if (r == ERR_OK) {
+			data->os_cpu = logical_cpu;
+			return cpuid_set_error(ERR_OK);
+		}
+		if (r == ERR_NO_MEM)
+			return cpuid_set_error(r);
+		debugf(2, "Kernel driver failed for logical CPU %u, falling back to CPU affinity\n", logical_cpu);
+	}
+#endif /* defined(PLATFORM_X86) || defined(PLATFORM_X64) */
+
 	if (logical_cpu != (logical_cpu_t) -1) {
 		debugf(2, "Getting raw dump for logical CPU %u\n", logical_cpu);
-		if (set_cpu_affinity(logical_cpu))
-			affinity_saved = save_cpu_affinity();
-		else
+		/* The CPU affinity must be saved before it is changed */
+		affinity_saved = save_cpu_affinity();
+		if (!set_cpu_affinity(logical_cpu)) {
+			if (affinity_saved)
+				restore_cpu_affinity();
+			affinity_saved = false;
 			/* Never return ERR_INVCNB for logical CPU 0 (in case set_cpu_affinity() is not supported) */
 			if (logical_cpu > 0)
 				return cpuid_set_error(ERR_INVCNB);
+		}
 	}
 
 #if defined(PLATFORM_X86) || defined(PLATFORM_X64)
-	unsigned i;
-
 	if (!cpuid_present())
 		return cpuid_set_error(ERR_NO_CPUID);
 
-	for (i = 0; i < 32; i++)
-		cpu_exec_cpuid(i, data->basic_cpuid[i]);
-	for (i = 0; i < 32; i++)
-		cpu_exec_cpuid(0x80000000 + i, data->ext_cpuid[i]);
-	for (i = 0; i < MAX_INTELFN4_LEVEL; i++) {
-		memset(data->intel_fn4[i], 0, sizeof(data->intel_fn4[i]));
-		data->intel_fn4[i][EAX] = 4;
-		data->intel_fn4[i][ECX] = i;
-		cpu_exec_cpuid_ext(data->intel_fn4[i]);
-	}
-	for (i = 0; i < MAX_INTELFN11_LEVEL; i++) {
-		memset(data->intel_fn11[i], 0, sizeof(data->intel_fn11[i]));
-		data->intel_fn11[i][EAX] = 11;
-		data->intel_fn11[i][ECX] = i;
-		cpu_exec_cpuid_ext(data->intel_fn11[i]);
-	}
-	for (i = 0; i < MAX_INTELFN12H_LEVEL; i++) {
-		memset(data->intel_fn12h[i], 0, sizeof(data->intel_fn12h[i]));
-		data->intel_fn12h[i][EAX] = 0x12;
-		data->intel_fn12h[i][ECX] = i;
-		cpu_exec_cpuid_ext(data->intel_fn12h[i]);
-	}
-	for (i = 0; i < MAX_INTELFN14H_LEVEL; i++) {
-		memset(data->intel_fn14h[i], 0, sizeof(data->intel_fn14h[i]));
-		data->intel_fn14h[i][EAX] = 0x14;
-		data->intel_fn14h[i][ECX] = i;
-		cpu_exec_cpuid_ext(data->intel_fn14h[i]);
-	}
-	for (i = 0; i < MAX_AMDFN8000001DH_LEVEL; i++) {
-		memset(data->amd_fn8000001dh[i], 0, sizeof(data->amd_fn8000001dh[i]));
-		data->amd_fn8000001dh[i][EAX] = 0x8000001d;
-		data->amd_fn8000001dh[i][ECX] = i;
-		cpu_exec_cpuid_ext(data->amd_fn8000001dh[i]);
-	}
-	for (i = 0; i < MAX_AMDFN80000026H_LEVEL; i++) {
-		memset(data->amd_fn80000026h[i], 0, sizeof(data->amd_fn80000026h[i]));
-		data->amd_fn80000026h[i][EAX] = 0x80000026;
-		data->amd_fn80000026h[i][ECX] = i;
-		cpu_exec_cpuid_ext(data->amd_fn80000026h[i]);
+	if ((r = cpuid_get_raw_data_x86(data, NULL)) != ERR_OK) {
+		if (affinity_saved)
+			restore_cpu_affinity();
+		return cpuid_set_error(r);
 	}
 #elif defined(PLATFORM_ARM) || defined(PLATFORM_AARCH64)
 	unsigned i;
-	struct cpuid_driver_t *handle;
+	struct cpuid_driver_t handle;
 
 	/* Try to use cpuid kernel driver on AArch32/AArch64 states */
-	if ((handle = cpu_cpuid_driver_open_core(logical_cpu)) != NULL) {
+	if (cpu_cpuid_driver_open_core(&handle, logical_cpu) == ERR_OK) {
 		debugf(2, "Using kernel driver to read register on logical CPU %u\n", logical_cpu);
-		cpu_read_arm_register_64b(handle, REQ_MIDR, &data->arm_midr);
-		cpu_read_arm_register_64b(handle, REQ_MPIDR, &data->arm_mpidr);
-		cpu_read_arm_register_64b(handle, REQ_REVIDR, &data->arm_revidr);
+		cpu_read_arm_register_64b(&handle, REQ_MIDR, &data->arm_midr);
+		cpu_read_arm_register_64b(&handle, REQ_MPIDR, &data->arm_mpidr);
+		cpu_read_arm_register_64b(&handle, REQ_REVIDR, &data->arm_revidr);
 		for (i = 0; i < MAX_ARM_ID_AFR_REGS; i++)
-			cpu_read_arm_register_32b(handle, REQ_ID_AFR0 + i, &data->arm_id_afr[i]);
+			cpu_read_arm_register_32b(&handle, REQ_ID_AFR0 + i, &data->arm_id_afr[i]);
 		for (i = 0; i < MAX_ARM_ID_DFR_REGS; i++)
-			cpu_read_arm_register_32b(handle, REQ_ID_DFR0 + i, &data->arm_id_dfr[i]);
+			cpu_read_arm_register_32b(&handle, REQ_ID_DFR0 + i, &data->arm_id_dfr[i]);
 		for (i = 0; i < MAX_ARM_ID_ISAR_REGS; i++)
-			cpu_read_arm_register_32b(handle, REQ_ID_ISAR0 + i, &data->arm_id_isar[i]);
+			cpu_read_arm_register_32b(&handle, REQ_ID_ISAR0 + i, &data->arm_id_isar[i]);
 		for (i = 0; i < MAX_ARM_ID_MMFR_REGS; i++)
-			cpu_read_arm_register_32b(handle, REQ_ID_MMFR0 + i, &data->arm_id_mmfr[i]);
+			cpu_read_arm_register_32b(&handle, REQ_ID_MMFR0 + i, &data->arm_id_mmfr[i]);
 		for (i = 0; i < MAX_ARM_ID_PFR_REGS; i++)
-			cpu_read_arm_register_32b(handle, REQ_ID_PFR0 + i, &data->arm_id_pfr[i]);
+			cpu_read_arm_register_32b(&handle, REQ_ID_PFR0 + i, &data->arm_id_pfr[i]);
 # if defined(PLATFORM_AARCH64)
 		for (i = 0; i < MAX_ARM_ID_AA64AFR_REGS; i++)
-			cpu_read_arm_register_64b(handle, REQ_ID_AA64AFR0 + i, &data->arm_id_aa64afr[i]);
+			cpu_read_arm_register_64b(&handle, REQ_ID_AA64AFR0 + i, &data->arm_id_aa64afr[i]);
 		for (i = 0; i < MAX_ARM_ID_AA64DFR_REGS; i++)
-			cpu_read_arm_register_64b(handle, REQ_ID_AA64DFR0 + i, &data->arm_id_aa64dfr[i]);
+			cpu_read_arm_register_64b(&handle, REQ_ID_AA64DFR0 + i, &data->arm_id_aa64dfr[i]);
 		for (i = 0; i < MAX_ARM_ID_AA64FPFR_REGS; i++)
-			cpu_read_arm_register_64b(handle, REQ_ID_AA64FPFR0 + i, &data->arm_id_aa64fpfr[i]);
+			cpu_read_arm_register_64b(&handle, REQ_ID_AA64FPFR0 + i, &data->arm_id_aa64fpfr[i]);
 		for (i = 0; i < MAX_ARM_ID_AA64ISAR_REGS; i++)
-			cpu_read_arm_register_64b(handle, REQ_ID_AA64ISAR0 + i, &data->arm_id_aa64isar[i]);
+			cpu_read_arm_register_64b(&handle, REQ_ID_AA64ISAR0 + i, &data->arm_id_aa64isar[i]);
 		for (i = 0; i < MAX_ARM_ID_AA64MMFR_REGS; i++)
-			cpu_read_arm_register_64b(handle, REQ_ID_AA64MMFR0 + i, &data->arm_id_aa64mmfr[i]);
+			cpu_read_arm_register_64b(&handle, REQ_ID_AA64MMFR0 + i, &data->arm_id_aa64mmfr[i]);
 		for (i = 0; i < MAX_ARM_ID_AA64PFR_REGS; i++)
-			cpu_read_arm_register_64b(handle, REQ_ID_AA64PFR0 + i, &data->arm_id_aa64pfr[i]);
+			cpu_read_arm_register_64b(&handle, REQ_ID_AA64PFR0 + i, &data->arm_id_aa64pfr[i]);
 		for (i = 0; i < MAX_ARM_ID_AA64SMFR_REGS; i++)
-			cpu_read_arm_register_64b(handle, REQ_ID_AA64SMFR0 + i, &data->arm_id_aa64smfr[i]);
+			cpu_read_arm_register_64b(&handle, REQ_ID_AA64SMFR0 + i, &data->arm_id_aa64smfr[i]);
 		for (i = 0; i < MAX_ARM_ID_AA64ZFR_REGS; i++)
-			cpu_read_arm_register_64b(handle, REQ_ID_AA64ZFR0 + i, &data->arm_id_aa64zfr[i]);
+			cpu_read_arm_register_64b(&handle, REQ_ID_AA64ZFR0 + i, &data->arm_id_aa64zfr[i]);
 # endif /* PLATFORM_AARCH64 */
-		cpu_cpuid_driver_close(handle);
+		cpu_cpuid_driver_close(&handle);
 	}
 	else {
 # if defined(PLATFORM_AARCH64)
@@ -1491,54 +3368,359 @@ int cpuid_get_raw_data_core(struct cpu_raw_data_t* data, logical_cpu_t logical_c
 
 	if (affinity_saved)
 		restore_cpu_affinity();
+	if (logical_cpu != (logical_cpu_t) -1)
+		data->os_cpu = logical_cpu;
+
+	return cpuid_set_error(ERR_OK);
+}
+
+/* Enumerates the logical CPUs to collect: the online logical CPUs when the OS provides them, which may have holes,
+   otherwise 0, 1, 2... until cpuid_get_raw_data_core() returns ERR_INVCNB */
+struct online_cpus_t {
+	bool has_mask;
+	cpu_affinity_mask_t mask;
+};
+
+static void online_cpus_t_constructor(struct online_cpus_t* cpus)
+{
+	cpus->has_mask = get_online_cpu_mask(&cpus->mask);
+	if (cpus->has_mask)
+		debugf(2, "Using the online logical CPUs mask from the OS\n");
+}
+
+/* Moves logical_cpu to the next logical CPU to collect (use -1 to get the first one), returns false at the end */
+static bool online_cpus_next(struct online_cpus_t* cpus, int32_t* logical_cpu)
+{
+	int32_t cpu;
+
+	for (cpu = *logical_cpu + 1; cpu < (int32_t) (__MASK_SETSIZE * __MASK_NCPUBITS); cpu++)
+		if (!cpus->has_mask || get_affinity_mask_bit((logical_cpu_t) cpu, &cpus->mask)) {
+			*logical_cpu = cpu;
+			return true;
+		}
+	return false;
+}
+
+/* Returns the number of logical CPUs to collect, used to allocate the raw data once
+   Without the online logical CPUs mask, logical CPUs are numbered from 0 to get_total_cpus() - 1 */
+static int online_cpus_count(struct online_cpus_t* cpus)
+{
+	int count = 0;
+	int32_t logical_cpu = -1;
+
+	if (!cpus->has_mask)
+		return get_total_cpus();
+	while (online_cpus_next(cpus, &logical_cpu))
+		count++;
+	return count;
+}
+
+/* Returns true when the logical CPU must be skipped: it went offline or it is not allowed for this process (e.g. cgroup cpuset) */
+static bool online_cpus_skip(const struct online_cpus_t* cpus, int32_t logical_cpu, int error)
+{
+	if (!cpus->has_mask || (error != ERR_INVCNB))
+		return false;
+	debugf(2, "Logical CPU %i is online but cannot be used, skipping it\n", logical_cpu);
+	return true;
+}
+
+int cpuid_get_all_raw_data(struct cpu_raw_data_array_t* data)
+{
+	int num_cpus, r = ERR_OK;
+	int32_t logical_cpu = -1;
+	uint32_t capacity = 0, num_leaves = 0;
+	struct cpu_raw_data_t* raw;
+	struct online_cpus_t cpus;
+
+	if (data == NULL)
+		return cpuid_set_error(ERR_HANDLE);
 
-	return cpuid_set_error(ERR_OK);
+	cpu_raw_data_array_t_constructor(data, true);
+	online_cpus_t_constructor(&cpus);
+	/* The array is allocated once for the expected logical CPUs, and grows geometrically if more of them went online meanwhile */
+	if ((num_cpus = online_cpus_count(&cpus)) > 0)
+		cpuid_reserve_raw_data_array(data, (uint32_t) num_cpus, &capacity);
+	while (online_cpus_next(&cpus, &logical_cpu)) {
+		if (!cpuid_reserve_raw_data_array(data, data->num_raw + 1, &capacity)) {
+			r = ERR_NO_MEM;
+			break;
+		}
+		/* The table of leaves is allocated once per logical CPU: they usually have the same leaves */
+		raw = &data->raw[data->num_raw];
+		raw_data_t_constructor(raw);
+		if (!raw_data_reserve_leaves(raw, num_leaves))
+			r = ERR_NO_MEM;
+		else
+			r = cpuid_collect_raw_data(raw, (logical_cpu_t) logical_cpu);
+		if (r != ERR_OK)
+			cpuid_free_raw_data(raw);
+		if (online_cpus_skip(&cpus, logical_cpu, r)) {
+			r = ERR_OK;
+			continue;
+		}
+		if (r != ERR_OK)
+			break;
+		if (raw->num_leaves > num_leaves)
+			num_leaves = raw->num_leaves;
+		data->num_raw++;
+	}
+	cpuid_shrink_raw_data_array(data, capacity);
+
+	/* On ERR_INVCNB, it means that logical_cpu value is out of bounds and we must break the loop, but it is a normal behavior. */
+	if (r == ERR_INVCNB)
+		r = ERR_OK;
+	return cpuid_set_error(r);
 }
 
-int cpuid_get_all_raw_data(struct cpu_raw_data_array_t* data)
+int cpuid_get_all_raw_data_compact(struct cpu_raw_data_compact_t* data)
 {
 	int r = ERR_OK;
-	logical_cpu_t logical_cpu = 0;
+	int32_t logical_cpu = -1;
 	struct cpu_raw_data_t raw_tmp;
+	struct online_cpus_t cpus;
 
 	if (data == NULL)
 		return cpuid_set_error(ERR_HANDLE);
 
-	cpu_raw_data_array_t_constructor(data, true);
-	do {
-		memset(&raw_tmp, 0, sizeof(struct cpu_raw_data_t));
-		if ((r = cpuid_get_raw_data_core(&raw_tmp, logical_cpu)) != ERR_OK)
+	/* Only one logical CPU is held in full at a time, its table of leaves is reused */
+	cpu_raw_data_compact_t_constructor(data, true);
+	online_cpus_t_constructor(&cpus);
+	raw_data_t_constructor(&raw_tmp);
+	while (online_cpus_next(&cpus, &logical_cpu)) {
+		r = cpuid_collect_raw_data(&raw_tmp, (logical_cpu_t) logical_cpu);
+		if (online_cpus_skip(&cpus, logical_cpu, r)) {
+			r = ERR_OK;
+			continue;
+		}
+		if ((r != ERR_OK) || ((r = cpuid_compact_append(data, &raw_tmp)) != ERR_OK))
 			break;
-		cpuid_grow_raw_data_array(data, logical_cpu + 1);
-		memcpy(&data->raw[logical_cpu], &raw_tmp, sizeof(struct cpu_raw_data_t));
-		logical_cpu++;
-	} while (r == ERR_OK);
+	}
 
 	/* On ERR_INVCNB, it means that logical_cpu value is out of bounds and we must break the loop, but it is a normal behavior. */
 	if (r == ERR_INVCNB)
 		r = ERR_OK;
+	if (r != ERR_OK)
+		cpuid_free_raw_data_compact(data);
+	cpuid_free_raw_data(&raw_tmp);
+	return cpuid_set_error(r);
+}
+
+struct raw_data_slice_t {
+	struct cpu_raw_data_t* raw;
+	const logical_cpu_t* os_cpus;
+	int* errors;
+	logical_cpu_t first;
+	logical_cpu_t last;
+};
+
+static void cpuid_get_raw_data_slice(void* arg)
+{
+	struct raw_data_slice_t* slice = (struct raw_data_slice_t*) arg;
+	logical_cpu_t i;
+
+	for (i = slice->first; i < slice->last; i++) {
+		slice->errors[i] = cpuid_collect_raw_data(&slice->raw[i], slice->os_cpus[i]);
+		if (slice->errors[i] != ERR_OK)
+			cpuid_free_raw_data(&slice->raw[i]);
+		if ((slice->errors[i] != ERR_OK) && (slice->errors[i] != ERR_INVCNB))
+			break;
+	}
+}
+
+int cpuid_get_all_raw_data_parallel(struct cpu_raw_data_array_t* data, int num_threads)
+{
+#if defined(SET_CPU_AFFINITY) && defined(HAVE_PARALLEL_TASKS)
+	int i, r = ERR_OK;
+	int32_t logical_cpu = -1;
+	int total_cpus = 0;
+	logical_cpu_t num_raw, chunk, remainder, first = 0;
+	logical_cpu_t* os_cpus = NULL;
+	int* errors = NULL;
+	struct online_cpus_t cpus;
+	struct raw_data_slice_t* slices = NULL;
+	struct parallel_task_t* tasks = NULL;
+
+	if (data == NULL)
+		return cpuid_set_error(ERR_HANDLE);
+
+	online_cpus_t_constructor(&cpus);
+	total_cpus = online_cpus_count(&cpus);
+	if ((num_threads <= 0) || (num_threads > total_cpus))
+		num_threads = total_cpus;
+	if (num_threads <= 1)
+		return cpuid_get_all_raw_data(data);
+
+	cpu_raw_data_array_t_constructor(data, true);
+	cpuid_grow_raw_data_array(data, (logical_cpu_t) total_cpus, NULL);
+	os_cpus = cpuid_malloc(total_cpus * sizeof(logical_cpu_t));
+	errors  = cpuid_calloc(total_cpus, sizeof(int));
+	slices  = cpuid_calloc(num_threads, sizeof(struct raw_data_slice_t));
+	tasks   = cpuid_calloc(num_threads, sizeof(struct parallel_task_t));
+	if ((data->raw == NULL) || (os_cpus == NULL) || (errors == NULL) || (slices == NULL) || (tasks == NULL)) {
+		cpuid_free(os_cpus);
+		cpuid_free(errors);
+		cpuid_free(slices);
+		cpuid_free(tasks);
+		cpuid_free_raw_data_array(data);
+		return cpuid_set_error(ERR_NO_MEM);
+	}
+	for (logical_cpu = -1, i = 0; i < total_cpus; i++) {
+		online_cpus_next(&cpus, &logical_cpu);
+		os_cpus[i] = (logical_cpu_t) logical_cpu;
+	}
+
+	/* Each thread collects a contiguous range of logical CPUs, the calling thread is never migrated */
+	debugf(2, "Getting raw dump for %i logical CPUs with %i threads\n", total_cpus, num_threads);
+	chunk     = (logical_cpu_t) (total_cpus / num_threads);
+	remainder = (logical_cpu_t) (total_cpus % num_threads);
+	for (i = 0; i < num_threads; i++) {
+		slices[i].raw     = data->raw;
+		slices[i].os_cpus = os_cpus;
+		slices[i].errors  = errors;
+		slices[i].first   = first;
+		slices[i].last    = first + chunk + (i < remainder ? 1 : 0);
+		tasks[i].run      = cpuid_get_raw_data_slice;
+		tasks[i].arg      = &slices[i];
+		first             = slices[i].last;
+	}
+	run_parallel_tasks(tasks, num_threads);
+
+	/* Keep the same result as the sequential path: skip the logical CPUs which cannot be used, stop at the first one which failed */
+	for (num_raw = 0, i = 0; i < total_cpus; i++) {
+		if (online_cpus_skip(&cpus, os_cpus[i], errors[i]))
+			continue;
+		if (errors[i] != ERR_OK) {
+			r = (errors[i] == ERR_INVCNB) ? ERR_OK : errors[i];
+			break;
+		}
+		if (num_raw != i)
+			memcpy(&data->raw[num_raw], &data->raw[i], sizeof(struct cpu_raw_data_t));
+		num_raw++;
+	}
+	/* The logical CPUs collected after the first one which failed are dropped */
+	for (; i < total_cpus; i++)
+		cpuid_free_raw_data(&data->raw[i]);
+	data->num_raw = num_raw;
+	cpuid_free(os_cpus);
+	cpuid_free(errors);
+	cpuid_free(slices);
+	cpuid_free(tasks);
+
 	return cpuid_set_error(r);
+#else
+	UNUSED(num_threads);
+	return cpuid_get_all_raw_data(data);
+#endif /* defined(SET_CPU_AFFINITY) && defined(HAVE_PARALLEL_TASKS) */
 }
 
 int cpuid_serialize_raw_data(struct cpu_raw_data_t* data, const char* filename)
 {
-	return cpuid_serialize_raw_data_internal(data, NULL, filename);
+	return cpuid_serialize_raw_data_internal(data, NULL, false, filename, -1);
 }
 
 int cpuid_serialize_all_raw_data(struct cpu_raw_data_array_t* data, const char* filename)
 {
-	return cpuid_serialize_raw_data_internal(NULL, data, filename);
+	return cpuid_serialize_raw_data_internal(NULL, data, false, filename, -1);
+}
+
+int cpuid_serialize_raw_data_fd(struct cpu_raw_data_t* data, int fd)
+{
+	if ((data == NULL) || (fd < 0))
+		return cpuid_set_error(ERR_HANDLE);
+	return cpuid_serialize_raw_data_internal(data, NULL, false, NULL, fd);
+}
+
+int cpuid_serialize_all_raw_data_fd(struct cpu_raw_data_array_t* data, int fd)
+{
+	if ((data == NULL) || (fd < 0))
+		return cpuid_set_error(ERR_HANDLE);
+	return cpuid_serialize_raw_data_internal(NULL, data, false, NULL, fd);
+}
+
+int cpuid_serialize_raw_data_buffer(struct cpu_raw_data_t* data, struct cpuid_buffer_t* buffer)
+{
+	if ((data == NULL) || (buffer == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	return cpuid_set_error(text_dump_write(data, NULL, false, buffer, NULL, -1));
+}
+
+int cpuid_serialize_all_raw_data_buffer(struct cpu_raw_data_array_t* data, struct cpuid_buffer_t* buffer)
+{
+	if ((data == NULL) || (buffer == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	return cpuid_set_error(text_dump_write(NULL, data, false, buffer, NULL, -1));
+}
+
+int cpuid_serialize_all_raw_data_delta(struct cpu_raw_data_array_t* data, const char* filename)
+{
+	if (data == NULL)
+		return cpuid_set_error(ERR_HANDLE);
+	return cpuid_serialize_raw_data_internal(NULL, data, true, filename, -1);
+}
+
+int cpuid_serialize_all_raw_data_delta_buffer(struct cpu_raw_data_array_t* data, struct cpuid_buffer_t* buffer)
+{
+	if ((data == NULL) || (buffer == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	return cpuid_set_error(text_dump_write(NULL, data, true, buffer, NULL, -1));
+}
+
+int cpuid_serialize_raw_data_binary(struct cpu_raw_data_t* data, const char* filename)
+{
+	if (data == NULL)
+		return cpuid_set_error(ERR_HANDLE);
+	return cpuid_serialize_binary_internal(data, NULL, filename);
+}
+
+int cpuid_serialize_all_raw_data_binary(struct cpu_raw_data_array_t* data, const char* filename)
+{
+	if ((data == NULL) || (data->num_raw == 0))
+		return cpuid_set_error(ERR_HANDLE);
+	return cpuid_serialize_binary_internal(NULL, data, filename);
 }
 
 int cpuid_deserialize_raw_data(struct cpu_raw_data_t* data, const char* filename)
 {
 	raw_data_t_constructor(data);
-	return cpuid_deserialize_raw_data_internal(data, NULL, filename);
+	return cpuid_deserialize_raw_data_internal(data, NULL, NULL, filename);
 }
 
 int cpuid_deserialize_all_raw_data(struct cpu_raw_data_array_t* data, const char* filename)
 {
-	return cpuid_deserialize_raw_data_internal(NULL, data, filename);
+	return cpuid_deserialize_raw_data_internal(NULL, data, NULL, filename);
+}
+
+int cpuid_deserialize_all_raw_data_compact(struct cpu_raw_data_compact_t* data, const char* filename)
+{
+	return cpuid_deserialize_raw_data_internal(NULL, NULL, data, filename);
+}
+
+int cpuid_deserialize_all_raw_data_parallel(struct cpu_raw_data_array_t* data, const char* filename, int num_threads)
+{
+	int r;
+	struct mapped_file_t file;
+
+	if ((r = map_file(filename, &file)) != ERR_OK)
+		return cpuid_set_error(r);
+	r = cpuid_deserialize_parallel_internal(data, file.data, file.size, !strcmp(filename, "") ? "stdin" : filename, num_threads);
+	unmap_file(&file);
+	return r;
+}
+
+int cpuid_deserialize_raw_data_buffer(struct cpu_raw_data_t* data, const void* buffer, size_t size)
+{
+	raw_data_t_constructor(data);
+	return cpuid_deserialize_buffer_internal(data, NULL, NULL, buffer, size, "buffer");
+}
+
+int cpuid_deserialize_all_raw_data_buffer(struct cpu_raw_data_array_t* data, const void* buffer, size_t size)
+{
+	return cpuid_deserialize_buffer_internal(NULL, data, NULL, buffer, size, "buffer");
+}
+
+int cpuid_deserialize_all_raw_data_compact_buffer(struct cpu_raw_data_compact_t* data, const void* buffer, size_t size)
+{
+	return cpuid_deserialize_buffer_internal(NULL, NULL, data, buffer, size, "buffer");
 }
 
 int cpu_ident_internal(struct cpu_raw_data_t* raw, struct cpu_id_t* data, struct internal_id_info_t* internal)
@@ -1546,9 +3728,10 @@ int cpu_ident_internal(struct cpu_raw_data_t* raw, struct cpu_id_t* data, struct
 	int r;
 	struct cpu_raw_data_t myraw;
 	if (!raw) {
-		if ((r = cpuid_get_raw_data(&myraw)) < 0)
-			return cpuid_set_error(r);
-		raw = &myraw;
+		if ((r = cpuid_get_raw_data(&myraw)) == ERR_OK)
+			r = cpu_ident_internal(&myraw, data, internal);
+		cpuid_free_raw_data(&myraw);
+		return cpuid_set_error(r);
 	}
 	cpu_id_t_constructor(data);
 	memset(internal->cache_mask, 0, sizeof(internal->cache_mask));
@@ -1580,6 +3763,7 @@ int cpu_ident_internal(struct cpu_raw_data_t* raw, struct cpu_id_t* data, struct
 			r = ERR_CPU_UNKN;
 			break;
 	}
+	cpu_feature_set_from_flags(&data->feature_set, data->flags);
 
 #ifndef LIBCPUID_DISABLE_DEPRECATED
 #  if defined(__GNUC__) || defined(GNUC)
@@ -1613,7 +3797,7 @@ static cpu_purpose_t cpu_ident_purpose(struct cpu_raw_data_t* raw)
 	const cpu_architecture_t architecture = cpuid_architecture_identify(raw);
 	switch (architecture) {
 		case ARCHITECTURE_X86:
-			vendor = cpuid_vendor_identify(raw->basic_cpuid[0], vendor_str);
+			vendor = cpuid_vendor_identify(cpuid_get_raw_leaf(raw, 0, 0), vendor_str);
 			switch (vendor) {
 				case VENDOR_AMD:
 					purpose = cpuid_identify_purpose_amd(raw);
@@ -1645,30 +3829,90 @@ int cpu_identify(struct cpu_raw_data_t* raw, struct cpu_id_t* data)
 	return r;
 }
 
-static void update_core_instances(struct internal_core_instances_t* cores,
-                                   struct internal_topology_t* topology)
+/* Sets of the ID table: the cores and the caches of each CPU type, then the caches of the system */
+#define CORE_ID_SET(__cpu_type)   ((__cpu_type) * (1 + NUM_CACHE_TYPES))
+#define CACHE_ID_SET(__cpu_type)  ((__cpu_type) * (1 + NUM_CACHE_TYPES) + 1)
+#define SYSTEM_CACHE_ID_SET       CACHE_ID_SET(UINT8_MAX + 1)
+
+static uint32_t id_table_hash(int32_t set, int32_t id)
 {
-	uint32_t core_id_index = 0;
+	/* Finalizer of MurmurHash3: core and cache IDs often differ only by their high bits */
+	uint32_t h = ((uint32_t) id * 0x9e3779b1U) ^ (uint32_t) set;
+	h ^= h >> 16;
+	h *= 0x85ebca6bU;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35U;
+	h ^= h >> 16;
+	return h;
+}
 
-	core_id_index = topology->core_id % CORES_HTABLE_SIZE;
-	if ((cores->htable[core_id_index].core_id == 0) || (cores->htable[core_id_index].core_id == topology->core_id)) {
-		if (cores->htable[core_id_index].num_logical_cpu == 0)
-			cores->instances++;
-		cores->htable[core_id_index].core_id = topology->core_id;
-		cores->htable[core_id_index].num_logical_cpu++;
-	}
-	else {
-		warnf("update_core_instances: collision at index %u (core ID is %i, not %i)\n",
-			core_id_index, cores->htable[core_id_index].core_id, topology->core_id);
+/* Returns the slot of an ID in a set, or the free slot where it goes */
+static struct internal_id_slot_t* id_table_slot(struct internal_id_slot_t* slots, uint32_t num_slots, int32_t set, int32_t id)
+{
+	uint32_t i = id_table_hash(set, id) & (num_slots - 1);
+
+	while ((slots[i].set >= 0) && ((slots[i].set != set) || (slots[i].id != id)))
+		i = (i + 1) & (num_slots - 1);
+	return &slots[i];
+}
+
+/* Adds an ID to a set, returns 1 if it is new, 0 if it was already there, or -1 on memory allocation failure */
+static int id_table_add(struct internal_id_table_t* table, int32_t set, int32_t id)
+{
+	uint32_t i, num_slots;
+	struct internal_id_slot_t *slot, *slots;
+
+	slot = id_table_slot(table->slots, table->num_slots, set, id);
+	if (slot->set >= 0)
+		return 0;
+
+	/* Keep the table at most 3/4 full, so each lookup is O(1) */
+	if (4 * (table->num_ids + 1) > 3 * table->num_slots) {
+		num_slots = 2 * table->num_slots;
+		debugf(3, "Growing internal_id_table_t from %u to %u slots\n", table->num_slots, num_slots);
+		slots = cpuid_malloc(sizeof(struct internal_id_slot_t) * num_slots);
+		if (slots == NULL)
+			return -1;
+		for (i = 0; i < num_slots; i++)
+			slots[i].set = -1;
+		for (i = 0; i < table->num_slots; i++)
+			if (table->slots[i].set >= 0)
+				*id_table_slot(slots, num_slots, table->slots[i].set, table->slots[i].id) = table->slots[i];
+		cpuid_free_id_table(table);
+		table->num_slots = num_slots;
+		table->slots     = slots;
+		slot = id_table_slot(table->slots, table->num_slots, set, id);
 	}
+
+	slot->set = set;
+	slot->id  = id;
+	table->num_ids++;
+	return 1;
+}
+
+static bool update_core_instances(struct internal_core_instances_t* cores,
+                                  struct internal_id_table_t* ids,
+                                  int32_t set,
+                                  struct internal_topology_t* topology)
+{
+	int r;
+
+	if (topology->core_id < 0)
+		return true;
+	if ((r = id_table_add(ids, set, topology->core_id)) < 0)
+		return false;
+	cores->instances += r;
+	return true;
 }
 
-static void update_cache_instances(struct internal_cache_instances_t* caches,
+static bool update_cache_instances(struct internal_cache_instances_t* caches,
+                                   struct internal_id_table_t* ids,
+                                   int32_t set,
                                    struct internal_topology_t* topology,
                                    struct internal_id_info_t* id_info,
                                    bool debugf_is_needed)
 {
-	uint32_t cache_id_index = 0;
+	int r;
 	cache_type_t level;
 
 	for (level = 0; level < NUM_CACHE_TYPES; level++) {
@@ -1677,65 +3921,216 @@ static void update_cache_instances(struct internal_cache_instances_t* caches,
 			continue;
 		}
 		topology->cache_id[level] = topology->apic_id & id_info->cache_mask[level];
-		cache_id_index             = topology->cache_id[level] % CACHES_HTABLE_SIZE;
-		if ((caches->htable[level][cache_id_index].cache_id == 0) || (caches->htable[level][cache_id_index].cache_id == topology->cache_id[level])) {
-			if (caches->htable[level][cache_id_index].num_logical_cpu == 0)
-				caches->instances[level]++;
-			caches->htable[level][cache_id_index].cache_id = topology->cache_id[level];
-			caches->htable[level][cache_id_index].num_logical_cpu++;
-		}
-		else {
-			warnf("update_cache_instances: collision at index %u (cache ID is %i, not %i)\n",
-				cache_id_index, caches->htable[level][cache_id_index].cache_id, topology->cache_id[level]);
-		}
+		if (topology->cache_id[level] < 0)
+			continue;
+		if ((r = id_table_add(ids, set + level, topology->cache_id[level])) < 0)
+			return false;
+		caches->instances[level] += r;
 	}
 
 	if (debugf_is_needed)
 		debugf(3, "Logical CPU %4u: APIC ID %4i, package ID %4i, core ID %4i, thread %i, L1I$ ID %4i, L1D$ ID %4i, L2$ ID %4i, L3$ ID %4i, L4$ ID %4i\n",
 			topology->logical_cpu, topology->apic_id, topology->package_id, topology->core_id, topology->smt_id,
 			topology->cache_id[L1I], topology->cache_id[L1D], topology->cache_id[L2], topology->cache_id[L3], topology->cache_id[L4]);
+
+	return true;
 }
 
-int cpu_identify_all(struct cpu_raw_data_array_t* raw_array, struct system_id_t* system)
+/* Gives the raw data of each logical CPU, from an array or from compact raw data */
+struct raw_data_reader_t {
+	struct cpu_raw_data_array_t* raw_array;
+	const struct cpu_raw_data_compact_t* compact;
+	const struct binary_dump_t* binary;
+	struct cpu_raw_data_t raw; /* compact: template with the differences of logical_cpu applied, binary: logical_cpu */
+	int32_t template_index;    /* compact: template copied in raw, -1 if none */
+	int32_t logical_cpu;       /* compact and binary: logical CPU decoded in raw, -1 if none */
+};
+
+/* Returns the raw data of a logical CPU, NULL if its table of leaves cannot be allocated */
+static struct cpu_raw_data_t* raw_data_reader_get(struct raw_data_reader_t* reader, logical_cpu_t logical_cpu)
+{
+	uint32_t i;
+	const struct cpu_raw_data_compact_t* data = reader->compact;
+	const struct cpu_raw_data_t* template_raw;
+
+	if (reader->raw_array != NULL)
+		return &reader->raw_array->raw[logical_cpu];
+	if (reader->logical_cpu == (int32_t) logical_cpu)
+		return &reader->raw;
+	if (reader->binary != NULL) {
+		reader->logical_cpu = -1;
+		if (binary_dump_get(reader->binary, logical_cpu, &reader->raw) != ERR_OK)
+			return NULL;
+		reader->logical_cpu = logical_cpu;
+		return &reader->raw;
+	}
+
+	template_raw = &data->templates[data->template_index[logical_cpu]];
+	if (reader->template_index != data->template_index[logical_cpu]) {
+		reader->template_index = -1;
+		reader->logical_cpu    = -1;
+		if (cpuid_copy_raw_data(&reader->raw, template_raw) != ERR_OK)
+			return NULL;
+		reader->template_index = data->template_index[logical_cpu];
+	}
+	else if (reader->logical_cpu >= 0) {
+		/* Same template: only the differences of the previous logical CPU are reverted */
+		for (i = data->first_delta[reader->logical_cpu]; i < data->first_delta[reader->logical_cpu + 1]; i++)
+			raw_data_set_word(&reader->raw, data->deltas[i].word, raw_data_word(template_raw, data->deltas[i].word));
+	}
+	for (i = data->first_delta[logical_cpu]; i < data->first_delta[logical_cpu + 1]; i++)
+		raw_data_set_word(&reader->raw, data->deltas[i].word, data->deltas[i].value);
+	reader->logical_cpu = logical_cpu;
+	return &reader->raw;
+}
+
+/* Clears the bits of raw data which identify a logical CPU: OS number, APIC IDs, core and node IDs.
+   They are only read by cpu_ident_id(), so raw data which only differ by these bits are identified the same way */
+static void clear_raw_data_ids(struct cpu_raw_data_t* raw)
+{
+	int i;
+
+	/* Only the inline part is cleared, see raw_leaf_id_mask() for the table of leaves */
+	raw->os_cpu                  = 0;
+	raw->basic_cpuid[0x01][EBX] &= 0x00ffffff;
+	raw->basic_cpuid[0x0b][EDX]  = 0;
+	raw->basic_cpuid[0x1f][EDX]  = 0;
+	raw->ext_cpuid[0x1e][EAX]    = 0;
+	raw->ext_cpuid[0x1e][EBX]   &= 0xffffff00;
+	raw->ext_cpuid[0x1e][ECX]   &= 0xffffff00;
+	for (i = 0; i < MAX_INTELFN11_LEVEL; i++)
+		raw->intel_fn11[i][EDX] = 0;
+	for (i = 0; i < MAX_AMDFN80000026H_LEVEL; i++)
+		raw->amd_fn80000026h[i][EDX] = 0;
+	/* Aff0, Aff1, Aff2 and Aff3 */
+	raw->arm_mpidr &= ~0xff00ffffffULL;
+}
+
+/* Bits of a register in the table of leaves which identify a logical CPU, like the ones cleared by clear_raw_data_ids() */
+static uint32_t raw_leaf_id_mask(uint32_t leaf, cpu_registers_t reg)
+{
+	switch (leaf) {
+		case 0x00000001:
+			return (reg == EBX) ? 0xff000000 : 0;
+		case 0x0000000b:
+		case 0x0000001f:
+		case 0x80000026:
+			return (reg == EDX) ? 0xffffffff : 0;
+		case 0x8000001e:
+			return (reg == EAX) ? 0xffffffff : ((reg == EBX) || (reg == ECX)) ? 0x000000ff : 0;
+		default:
+			return 0;
+	}
+}
+
+/* Hash of raw data cleared by clear_raw_data_ids(), without the IDs in its table of leaves */
+static uint64_t raw_data_hash(const struct cpu_raw_data_t* raw)
+{
+	/* FNV-1a on 32-bit words */
+	int reg;
+	uint32_t i, word;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	for (word = 0; word < RAW_DATA_WORDS; word++)
+		hash = (hash ^ raw_data_word(raw, word)) * 0x100000001b3ULL;
+	for (i = 0; i < raw->num_leaves; i++) {
+		hash = (hash ^ raw->leaves[i].leaf) * 0x100000001b3ULL;
+		hash = (hash ^ raw->leaves[i].subleaf) * 0x100000001b3ULL;
+		for (reg = 0; reg < NUM_REGS; reg++)
+			hash = (hash ^ (raw->leaves[i].regs[reg] & ~raw_leaf_id_mask(raw->leaves[i].leaf, (cpu_registers_t) reg))) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/* Returns true if two raw data cleared by clear_raw_data_ids() are the same, apart from the IDs in their table of leaves */
+static bool raw_data_same_without_ids(const struct cpu_raw_data_t* raw1, const struct cpu_raw_data_t* raw2)
+{
+	int reg;
+	uint32_t i, mask;
+
+	if (memcmp(raw1, raw2, RAW_DATA_FIXED_SIZE) || !raw_data_same_leaves(raw1, raw2))
+		return false;
+	for (i = 0; i < raw1->num_leaves; i++)
+		for (reg = 0; reg < NUM_REGS; reg++) {
+			mask = ~raw_leaf_id_mask(raw1->leaves[i].leaf, (cpu_registers_t) reg);
+			if ((raw1->leaves[i].regs[reg] & mask) != (raw2->leaves[i].regs[reg] & mask))
+				return false;
+		}
+	return true;
+}
+
+/* Returns the CPU type decoded from raw data which are identical to raw apart from the IDs of the logical CPU,
+   -1 if there is none. hash is set to the hash of raw without these IDs. */
+static int16_t cpuid_find_decoded_type(struct raw_data_reader_t* memo_reader, struct internal_type_info_array_t* type_info,
+                                       uint8_t num_types, const struct cpu_raw_data_t* raw, uint64_t* hash)
+{
+	int16_t i;
+	const struct cpu_raw_data_t* memo_raw;
+	struct cpu_raw_data_t cleared, decoded;
+
+	/* The copies share the table of leaves of the raw data, which is not modified */
+	memcpy(&cleared, raw, sizeof(struct cpu_raw_data_t));
+	clear_raw_data_ids(&cleared);
+	*hash = raw_data_hash(&cleared);
+	for (i = 0; i < num_types; i++) {
+		if (type_info->data[i].raw_hash != *hash)
+			continue;
+		/* Without memory for the raw data of a CPU type, the logical CPU is decoded again */
+		if ((memo_raw = raw_data_reader_get(memo_reader, type_info->data[i].logical_cpu)) == NULL)
+			continue;
+		memcpy(&decoded, memo_raw, sizeof(struct cpu_raw_data_t));
+		clear_raw_data_ids(&decoded);
+		if (raw_data_same_without_ids(&cleared, &decoded))
+			return i;
+	}
+	return -1;
+}
+
+static int cpu_identify_all_internal(struct raw_data_reader_t* reader, logical_cpu_t num_raw, bool with_affinity, struct system_id_t* system)
 {
 	int r = ERR_OK;
 	double smt_divisor;
 	bool is_smt_supported;
 	bool is_topology_supported = true;
-	int16_t cpu_type_index = -1;
+	int16_t cpu_type_index = -1, decoded_type_index;
 	int32_t cur_package_id = 0;
+	uint64_t raw_hash;
 	logical_cpu_t logical_cpu = 0;
 	cpu_purpose_t purpose;
 	cpu_affinity_mask_t affinity_mask;
-	struct cpu_raw_data_array_t my_raw_array;
+	struct cpu_raw_data_t* raw;
 	struct internal_topology_t topology;
 	struct internal_type_info_array_t type_info;
 	struct internal_cache_instances_t caches_all;
+	struct internal_id_table_t ids;
+	/* Reads the raw data of CPU types already decoded, without changing the raw data given by reader */
+	struct raw_data_reader_t memo_reader = { .raw_array = reader->raw_array, .compact = reader->compact, .binary = reader->binary,
+	                                         .template_index = -1, .logical_cpu = -1 };
 
 	/* Init variables */
-	if (system == NULL)
-		return cpuid_set_error(ERR_HANDLE);
-	if (!raw_array) {
-		if ((r = cpuid_get_all_raw_data(&my_raw_array)) < 0)
-			return r;
-		raw_array = &my_raw_array;
-	}
 	system_id_t_constructor(system);
 	type_info_array_t_constructor(&type_info);
 	cache_instances_t_constructor(&caches_all);
-	if (raw_array->with_affinity)
+	id_table_t_constructor(&ids);
+	if (with_affinity)
 		init_affinity_mask(&affinity_mask);
 
 	/* Iterate over all raw */
-	for (logical_cpu = 0; logical_cpu < raw_array->num_raw; logical_cpu++) {
+	for (logical_cpu = 0; logical_cpu < num_raw; logical_cpu++) {
 		debugf(2, "Identifying logical core %u\n", logical_cpu);
+		if ((raw = raw_data_reader_get(reader, logical_cpu)) == NULL) {
+			cpuid_free_type_info(&type_info);
+			cpuid_free_id_table(&ids);
+			cpuid_free_raw_data(&memo_reader.raw);
+			return cpuid_set_error(ERR_NO_MEM);
+		}
 		/* Get CPU purpose and APIC ID
 		   For hybrid CPUs, the purpose may be different than the previous iteration (e.g. from P-cores to E-cores)
 		   APIC ID are unique for each logical CPU cores.
 		*/
-		purpose = cpu_ident_purpose(&raw_array->raw[logical_cpu]);
-		if (raw_array->with_affinity && is_topology_supported) {
-			is_topology_supported = cpu_ident_id(logical_cpu, &raw_array->raw[logical_cpu], &topology);
+		purpose = cpu_ident_purpose(raw);
+		if (with_affinity && is_topology_supported) {
+			is_topology_supported = cpu_ident_id(logical_cpu, raw, &topology);
 			if (is_topology_supported)
 				cur_package_id = topology.package_id;
 		}
@@ -1747,31 +4142,50 @@ int cpu_identify_all(struct cpu_raw_data_array_t* raw_array, struct system_id_t*
 			cpu_type_index = system->num_cpu_types;
 			cpuid_grow_system_id(system, system->num_cpu_types + 1);
 			cpuid_grow_type_info(&type_info, type_info.num + 1);
-			if ((r = cpu_ident_internal(&raw_array->raw[logical_cpu], &system->cpu_types[cpu_type_index], &type_info.data[cpu_type_index].id_info)) != ERR_OK)
+			/* Packages of the same model and CPU types of hybrid CPUs already decoded are not decoded again */
+			decoded_type_index = cpuid_find_decoded_type(&memo_reader, &type_info, (uint8_t) cpu_type_index, raw, &raw_hash);
+			if (decoded_type_index >= 0) {
+				debugf(3, "Logical CPU %u is identified as CPU type %i\n", logical_cpu, decoded_type_index);
+				system->cpu_types[cpu_type_index] = system->cpu_types[decoded_type_index];
+				memset(&system->cpu_types[cpu_type_index].affinity_mask, 0, sizeof(cpu_affinity_mask_t));
+				type_info.data[cpu_type_index].id_info = type_info.data[decoded_type_index].id_info;
+			}
+			else if ((r = cpu_ident_internal(raw, &system->cpu_types[cpu_type_index], &type_info.data[cpu_type_index].id_info)) != ERR_OK) {
+				cpuid_free_type_info(&type_info);
+				cpuid_free_id_table(&ids);
+				cpuid_free_raw_data(&memo_reader.raw);
 				return r;
-			type_info.data[cpu_type_index].purpose = purpose;
+			}
+			type_info.data[cpu_type_index].logical_cpu = logical_cpu;
+			type_info.data[cpu_type_index].raw_hash    = raw_hash;
+			type_info.data[cpu_type_index].purpose     = purpose;
 			if (is_topology_supported)
 				type_info.data[cpu_type_index].package_id = cur_package_id;
-			if (raw_array->with_affinity)
+			if (with_affinity)
 				system->cpu_types[cpu_type_index].num_logical_cpus = 0;
 		}
 
 		/* Increment counters */
-		if (raw_array->with_affinity) {
-			set_affinity_mask_bit(logical_cpu, &system->cpu_types[cpu_type_index].affinity_mask);
+		if (with_affinity) {
+			set_affinity_mask_bit(raw->os_cpu, &system->cpu_types[cpu_type_index].affinity_mask);
 			system->cpu_types[cpu_type_index].num_logical_cpus++;
-			if (is_topology_supported) {
-				update_core_instances(&type_info.data[cpu_type_index].core_instances, &topology);
-				update_cache_instances(&type_info.data[cpu_type_index].cache_instances, &topology, &type_info.data[cpu_type_index].id_info, true);
-				update_cache_instances(&caches_all,  &topology, &type_info.data[cpu_type_index].id_info, false);
+			if (is_topology_supported &&
+			    (!update_core_instances(&type_info.data[cpu_type_index].core_instances, &ids, CORE_ID_SET(cpu_type_index), &topology) ||
+			     !update_cache_instances(&type_info.data[cpu_type_index].cache_instances, &ids, CACHE_ID_SET(cpu_type_index), &topology, &type_info.data[cpu_type_index].id_info, true) ||
+			     !update_cache_instances(&caches_all, &ids, SYSTEM_CACHE_ID_SET, &topology, &type_info.data[cpu_type_index].id_info, false))) {
+				cpuid_free_type_info(&type_info);
+				cpuid_free_id_table(&ids);
+				cpuid_free_raw_data(&memo_reader.raw);
+				return cpuid_set_error(ERR_NO_MEM);
 			}
 		}
 	}
+	cpuid_free_raw_data(&memo_reader.raw);
 
 	/* Update counters for all CPU types */
 	for (cpu_type_index = 0; cpu_type_index < system->num_cpu_types; cpu_type_index++) {
 		/* Overwrite core and cache counters when information is available per core */
-		if (raw_array->with_affinity) {
+		if (with_affinity) {
 			if (is_topology_supported) {
 				system->cpu_types[cpu_type_index].num_cores                = type_info.data[cpu_type_index].core_instances.instances;
 				system->cpu_types[cpu_type_index].l1_instruction_instances = type_info.data[cpu_type_index].cache_instances.instances[L1I];
@@ -1792,6 +4206,7 @@ int cpu_identify_all(struct cpu_raw_data_array_t* raw_array, struct system_id_t*
 		system->cpu_types[cpu_type_index].total_logical_cpus = logical_cpu;
 	}
 	cpuid_free_type_info(&type_info);
+	cpuid_free_id_table(&ids);
 
 	/* Update the grand total of cache instances */
 	if (is_topology_supported) {
@@ -1805,6 +4220,56 @@ int cpu_identify_all(struct cpu_raw_data_array_t* raw_array, struct system_id_t*
 	return cpuid_set_error(ERR_OK);
 }
 
+int cpu_identify_all(struct cpu_raw_data_array_t* raw_array, struct system_id_t* system)
+{
+	int r;
+	struct cpu_raw_data_array_t my_raw_array;
+	struct raw_data_reader_t reader = { .compact = NULL, .binary = NULL };
+
+	if (system == NULL)
+		return cpuid_set_error(ERR_HANDLE);
+	if (raw_array != NULL) {
+		reader.raw_array = raw_array;
+		return cpu_identify_all_internal(&reader, raw_array->num_raw, raw_array->with_affinity, system);
+	}
+
+	if ((r = cpuid_get_all_raw_data(&my_raw_array)) < 0)
+		return r;
+	reader.raw_array = &my_raw_array;
+	r = cpu_identify_all_internal(&reader, my_raw_array.num_raw, my_raw_array.with_affinity, system);
+	cpuid_free_raw_data_array(&my_raw_array);
+	return r;
+}
+
+int cpu_identify_all_compact(struct cpu_raw_data_compact_t* data, struct system_id_t* system)
+{
+	int r;
+	struct raw_data_reader_t reader = { .raw_array = NULL, .binary = NULL, .template_index = -1, .logical_cpu = -1 };
+
+	if ((data == NULL) || (system == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	reader.compact = data;
+	r = cpu_identify_all_internal(&reader, data->num_raw, data->with_affinity, system);
+	cpuid_free_raw_data(&reader.raw);
+	return r;
+}
+
+int cpu_identify_all_mapped(struct cpu_raw_data_mapped_t* data, struct system_id_t* system)
+{
+	int r;
+	struct binary_dump_t dump;
+	struct raw_data_reader_t reader = { .raw_array = NULL, .compact = NULL, .template_index = -1, .logical_cpu = -1 };
+
+	if ((data == NULL) || (data->image == NULL) || (system == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	if ((r = binary_dump_open(&dump, data->image, data->image_size)) != ERR_OK)
+		return cpuid_set_error(r);
+	reader.binary = &dump;
+	r = cpu_identify_all_internal(&reader, data->num_raw, data->with_affinity, system);
+	cpuid_free_raw_data(&reader.raw);
+	return r;
+}
+
 int cpu_request_core_type(cpu_purpose_t purpose, struct cpu_raw_data_array_t* raw_array, struct cpu_id_t* data)
 {
 	int r;
@@ -1815,7 +4280,9 @@ int cpu_request_core_type(cpu_purpose_t purpose, struct cpu_raw_data_array_t* ra
 	if (!raw_array) {
 		if ((r = cpuid_get_all_raw_data(&my_raw_array)) < 0)
 			return r;
-		raw_array = &my_raw_array;
+		r = cpu_request_core_type(purpose, &my_raw_array, data);
+		cpuid_free_raw_data_array(&my_raw_array);
+		return cpuid_set_error(r);
 	}
 
 	for (logical_cpu = 0; logical_cpu < raw_array->num_raw; logical_cpu++) {
@@ -1956,7 +4423,7 @@ char* affinity_mask_str(cpu_affinity_mask_t* affinity_mask)
 
 const char* cpu_feature_str(cpu_feature_t feature)
 {
-	const struct { cpu_feature_t feature; const char* name; }
+	static const struct { cpu_feature_t feature; const char* name; }
 	matchtable[] = {
 		{ CPU_FEATURE_FPU, "fpu" },
 		{ CPU_FEATURE_VME, "vme" },
@@ -2345,6 +4812,9 @@ const char* cpu_feature_str(cpu_feature_t feature)
 	if (n != NUM_CPU_FEATURES) {
 		warnf("Warning: incomplete library, feature matchtable size differs from the actual number of features.\n");
 	}
+	/* The table is in the order of cpu_feature_t */
+	if ((feature >= 0) && ((unsigned) feature < n) && (matchtable[feature].feature == feature))
+		return matchtable[feature].name;
 	for (i = 0; i < n; i++)
 		if (matchtable[i].feature == feature)
 			return matchtable[i].name;
@@ -2401,6 +4871,11 @@ void cpuid_set_verbosiness_level(int level)
 	_current_verboselevel = level;
 }
 
+void cpuid_set_allocator(const struct cpuid_allocator_t* allocator)
+{
+	_allocator = (allocator != NULL) ? *allocator : _default_allocator;
+}
+
 cpu_vendor_t cpuid_get_vendor(void)
 {
 	static cpu_vendor_t vendor = VENDOR_UNKNOWN;
@@ -2485,8 +4960,10 @@ void cpuid_get_cpu_list(cpu_vendor_t vendor, struct cpu_list_t* list)
 hypervisor_vendor_t cpuid_get_hypervisor(struct cpu_raw_data_t* raw, struct cpu_id_t* data)
 {
 	int i, r;
-	uint32_t hypervisor_fn40000000h[NUM_REGS];
+	hypervisor_vendor_t hypervisor;
+	const uint32_t* hypervisor_fn40000000h;
 	char hypervisor_str[VENDOR_STR_MAX];
+	struct cpu_raw_data_t myraw;
 	struct cpu_id_t mydata;
 	const struct { hypervisor_vendor_t hypervisor; char match[16]; }
 	matchtable[NUM_HYPERVISOR_VENDORS] = {
@@ -2501,6 +4978,14 @@ hypervisor_vendor_t cpuid_get_hypervisor(struct cpu_raw_data_t* raw, struct cpu_
 		{ HYPERVISOR_XEN        , "XenVMMXenVMM"    },
 	};
 
+	if (!raw) {
+		if (cpuid_get_raw_data(&myraw) < 0)
+			hypervisor = HYPERVISOR_UNKNOWN;
+		else
+			hypervisor = cpuid_get_hypervisor(&myraw, data);
+		cpuid_free_raw_data(&myraw);
+		return hypervisor;
+	}
 	if (!data) {
 		if ((r = cpu_identify(raw, &mydata)) < 0)
 			return HYPERVISOR_UNKNOWN;
@@ -2523,10 +5008,9 @@ hypervisor_vendor_t cpuid_get_hypervisor(struct cpu_raw_data_t* raw, struct cpu_
 	Hypervisors can use these leaves to provide an interface to pass information
 	from the hypervisor to the guest operating system running inside a virtual machine.
 	The hypervisor bit indicates the presence of a hypervisor
-	and that it is safe to test these additional software leaves. */
-	memset(hypervisor_fn40000000h, 0, sizeof(hypervisor_fn40000000h));
-	hypervisor_fn40000000h[EAX] = 0x40000000;
-	cpu_exec_cpuid_ext(hypervisor_fn40000000h);
+	and that it is safe to test these additional software leaves.
+	They are collected in the raw data, so raw dumps give the same result as the current system. */
+	hypervisor_fn40000000h = cpuid_get_raw_leaf(raw, 0x40000000, 0);
 
 	/* Copy the hypervisor CPUID information leaf */
 	memcpy(hypervisor_str + 0, &hypervisor_fn40000000h[1], 4);
@@ -2546,22 +5030,137 @@ void cpuid_free_cpu_list(struct cpu_list_t* list)
 	int i;
 	if (list->num_entries <= 0) return;
 	for (i = 0; i < list->num_entries; i++)
-		free(list->names[i]);
-	free(list->names);
+		cpuid_free(list->names[i]);
+	cpuid_free(list->names);
 	list->names = NULL;
 	list->num_entries = 0;
 }
 
+void cpuid_free_raw_data(struct cpu_raw_data_t* raw)
+{
+	if (raw == NULL)
+		return;
+	if (raw->max_leaves > 0)
+		cpuid_free(raw->leaves);
+	raw_data_t_constructor(raw);
+}
+
 void cpuid_free_raw_data_array(struct cpu_raw_data_array_t* raw_array)
 {
+	logical_cpu_t logical_cpu;
+
 	if (raw_array->num_raw <= 0) return;
-	free(raw_array->raw);
+	for (logical_cpu = 0; logical_cpu < raw_array->num_raw; logical_cpu++)
+		cpuid_free_raw_data(&raw_array->raw[logical_cpu]);
+	cpuid_free(raw_array->raw);
 	raw_array->num_raw = 0;
 }
 
+int cpuid_compact_raw_data_array(const struct cpu_raw_data_array_t* raw_array, struct cpu_raw_data_compact_t* data)
+{
+	int r = ERR_OK;
+	logical_cpu_t logical_cpu;
+
+	if ((raw_array == NULL) || (data == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+
+	cpu_raw_data_compact_t_constructor(data, raw_array->with_affinity);
+	data->with_affinity = raw_array->with_affinity;
+	for (logical_cpu = 0; (r == ERR_OK) && (logical_cpu < raw_array->num_raw); logical_cpu++)
+		r = cpuid_compact_append(data, &raw_array->raw[logical_cpu]);
+	if (r != ERR_OK)
+		cpuid_free_raw_data_compact(data);
+	return cpuid_set_error(r);
+}
+
+int cpuid_get_compact_raw_data(const struct cpu_raw_data_compact_t* data, logical_cpu_t logical_cpu, struct cpu_raw_data_t* raw)
+{
+	if ((data == NULL) || (raw == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	if (logical_cpu >= data->num_raw)
+		return cpuid_set_error(ERR_INVCNB);
+
+	raw_data_t_constructor(raw);
+	return cpuid_set_error(compact_raw_data_get(data, logical_cpu, raw));
+}
+
+void cpuid_free_raw_data_compact(struct cpu_raw_data_compact_t* data)
+{
+	uint16_t i;
+
+	for (i = 0; i < data->num_templates; i++)
+		cpuid_free_raw_data(&data->templates[i]);
+	cpuid_free(data->templates);
+	cpuid_free(data->template_index);
+	cpuid_free(data->first_delta);
+	cpuid_free(data->deltas);
+	cpu_raw_data_compact_t_constructor(data, false);
+}
+
+void cpuid_free_buffer(struct cpuid_buffer_t* buffer)
+{
+	cpuid_free(buffer->data);
+	buffer->data     = NULL;
+	buffer->size     = 0;
+	buffer->capacity = 0;
+}
+
+int cpuid_map_raw_data(struct cpu_raw_data_mapped_t* data, const char* filename)
+{
+	int r;
+	struct mapped_file_t file;
+	struct binary_dump_t dump;
+
+	if (data == NULL)
+		return cpuid_set_error(ERR_HANDLE);
+	memset(data, 0, sizeof(struct cpu_raw_data_mapped_t));
+	if ((r = map_file(filename, &file)) != ERR_OK)
+		return cpuid_set_error(r);
+	if ((r = binary_dump_open(&dump, file.data, file.size)) != ERR_OK) {
+		unmap_file(&file);
+		return cpuid_set_error(r);
+	}
+	data->with_affinity = (dump.flags & BINARY_DUMP_FLAG_ARRAY) != 0;
+	data->num_raw       = dump.num_cpus;
+	data->image         = file.data;
+	data->image_size    = file.size;
+	data->is_mapped     = file.is_mapped;
+	return cpuid_set_error(ERR_OK);
+}
+
+int cpuid_get_mapped_raw_data(const struct cpu_raw_data_mapped_t* data, logical_cpu_t logical_cpu, struct cpu_raw_data_t* raw)
+{
+	int r;
+	struct binary_dump_t dump;
+
+	if ((data == NULL) || (data->image == NULL) || (raw == NULL))
+		return cpuid_set_error(ERR_HANDLE);
+	if ((r = binary_dump_open(&dump, data->image, data->image_size)) != ERR_OK)
+		return cpuid_set_error(r);
+	if (logical_cpu >= dump.num_cpus)
+		return cpuid_set_error(ERR_INVCNB);
+	raw_data_t_constructor(raw);
+	if ((r = binary_dump_get(&dump, logical_cpu, raw)) != ERR_OK)
+		cpuid_free_raw_data(raw);
+	return cpuid_set_error(r);
+}
+
+void cpuid_unmap_raw_data(struct cpu_raw_data_mapped_t* data)
+{
+	struct mapped_file_t file;
+
+	if ((data == NULL) || (data->image == NULL))
+		return;
+	file.data      = data->image;
+	file.size      = data->image_size;
+	file.is_mapped = data->is_mapped;
+	unmap_file(&file);
+	memset(data, 0, sizeof(struct cpu_raw_data_mapped_t));
+}
+
 void cpuid_free_system_id(struct system_id_t* system)
 {
 	if (system->num_cpu_types <= 0) return;
-	free(system->cpu_types);
+	cpuid_free(system->cpu_types);
 	system->num_cpu_types = 0;
 }
@@ -93,6 +93,26 @@ SOURCE=.\cpuid_main.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\cpuid_decompress.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\cpuid_json.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\cpuid_feature_set.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\cpuid_archive.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\cpuid_cache.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\libcpuid_util.c
 # End Source File
 # Begin Source File
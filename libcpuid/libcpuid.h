@@ -120,6 +120,9 @@
 /* Include C99 booleans: */
 #include <stdbool.h>
 
+/* Include size_t: */
+#include <stddef.h>
+
 /* Include some integer type specifications: */
 #include "libcpuid_types.h"
 
@@ -283,6 +286,22 @@ typedef enum {
 } hypervisor_vendor_t;
 #define NUM_HYPERVISOR_VENDORS NUM_HYPERVISOR_VENDORS
 
+/**
+ * @brief Contains the result of CPUID for one leaf and subleaf.
+ *
+ * @see cpu_raw_data_t, cpuid_get_raw_leaf
+ */
+struct cpu_raw_leaf_t {
+	/** CPUID leaf (value of EAX) */
+	uint32_t leaf;
+
+	/** CPUID subleaf (value of ECX) */
+	uint32_t subleaf;
+
+	/** values of EAX, EBX, ECX and EDX after CPUID */
+	uint32_t regs[NUM_REGS];
+};
+
 /**
  * @brief Contains just the raw CPUID data.
  *
@@ -393,6 +412,29 @@ struct cpu_raw_data_t {
 	/** when then CPU is ARM-based and supports ID_AA64ZFR*
 	 * (SVE Feature ID register) */
 	uint64_t arm_id_aa64zfr[MAX_ARM_ID_AA64ZFR_REGS];
+
+	/** the OS number of the logical CPU where this data was collected.
+	 *  It differs from the index in \ref cpu_raw_data_array_t when some
+	 *  logical CPUs are offline (e.g. "0-3,8-11" on Linux). */
+	logical_cpu_t os_cpu;
+
+	/** number of entries in \ref leaves */
+	uint32_t num_leaves;
+
+	/** allocated length of \ref leaves (internal use) */
+	uint32_t max_leaves;
+
+	/** the results of CPUID for every x86 leaf and subleaf which was
+	 *  collected (including the hypervisor leaves 40000000h-400000FFh when
+	 *  the hypervisor present bit is set), sorted by leaf and subleaf.
+	 *  Leaves which returned only zeros are not stored.
+	 *  This table is allocated by libcpuid and it is where the leaves are
+	 *  read from: the arrays above (basic_cpuid, ext_cpuid, intel_fn4...)
+	 *  only hold a copy of the leaves which fit in them, and they are only
+	 *  read when this table is empty (raw data filled by the caller).
+	 *  Use \ref cpuid_get_raw_leaf and \ref cpuid_set_raw_leaf to access
+	 *  it, and \ref cpuid_free_raw_data to release it. */
+	struct cpu_raw_leaf_t* leaves;
 };
 
 /**
@@ -418,6 +460,153 @@ struct cpu_raw_data_array_t {
 	struct cpu_raw_data_t* raw;
 };
 
+/**
+ * @brief Contains one difference between the raw CPUID data of a logical CPU and its template.
+ *
+ * @see cpu_raw_data_compact_t
+ */
+struct cpu_raw_data_delta_t {
+	/** offset of the differing 32-bit word, in 32-bit words: the words of
+	 *  \ref cpu_raw_data_t before cpu_raw_data_t::num_leaves come first,
+	 *  then the registers of each entry of cpu_raw_data_t::leaves */
+	uint16_t word;
+
+	/** value of this word for the logical CPU */
+	uint32_t value;
+};
+
+/**
+ * @brief Contains the raw CPUID data of several logical CPUs, without duplicates.
+ *
+ * Logical CPUs of the same type usually differ only in a few registers
+ * (like the APIC ID in leaf 1 EBX, leaves 0Bh/1Fh EDX or leaf 8000001Eh).
+ * Here, each logical CPU refers to a template \ref cpu_raw_data_t, and only
+ * its differences with this template are stored. A logical CPU only refers
+ * to a template with the same leaves and subleaves in cpu_raw_data_t::leaves.
+ *
+ * @see cpuid_get_all_raw_data_compact, cpuid_deserialize_all_raw_data_compact,
+ *      cpuid_compact_raw_data_array, cpuid_get_compact_raw_data,
+ *      cpu_identify_all_compact, cpuid_free_raw_data_compact
+ */
+struct cpu_raw_data_compact_t {
+	/** same meaning as \ref cpu_raw_data_array_t::with_affinity */
+	bool with_affinity;
+
+	/** number of logical CPUs */
+	logical_cpu_t num_raw;
+
+	/** \ref templates length */
+	uint16_t num_templates;
+
+	/** array of template raw CPUID data */
+	struct cpu_raw_data_t* templates;
+
+	/** for each logical CPU, index of its template in \ref templates */
+	uint16_t* template_index;
+
+	/** for each logical CPU, index of its first difference in \ref deltas:
+	 *  the differences of logical CPU i are deltas[first_delta[i]] to deltas[first_delta[i + 1] - 1]
+	 *  (this array contains num_raw + 1 elements) */
+	uint32_t* first_delta;
+
+	/** \ref deltas length */
+	uint32_t num_deltas;
+
+	/** array of differences with the templates, sorted by logical CPU */
+	struct cpu_raw_data_delta_t* deltas;
+
+	/** allocated length of \ref template_index and \ref first_delta (internal use) */
+	logical_cpu_t max_raw;
+
+	/** allocated length of \ref deltas (internal use) */
+	uint32_t max_deltas;
+};
+
+/**
+ * @brief Contains the raw CPUID data of several logical CPUs, mapped from a binary raw dump.
+ *
+ * The raw CPUID data of a logical CPU is decoded from the file only when it is
+ * needed, so the whole array is never copied in memory.
+ *
+ * @see cpuid_serialize_all_raw_data_binary, cpuid_map_raw_data,
+ *      cpuid_get_mapped_raw_data, cpu_identify_all_mapped, cpuid_unmap_raw_data
+ */
+struct cpu_raw_data_mapped_t {
+	/** same meaning as \ref cpu_raw_data_array_t::with_affinity */
+	bool with_affinity;
+
+	/** number of logical CPUs */
+	logical_cpu_t num_raw;
+
+	/** the binary raw dump in memory (internal use) */
+	const void* image;
+	size_t image_size;
+	bool is_mapped;
+};
+
+/**
+ * @brief A growable memory buffer, filled by the serialization functions.
+ *
+ * Initialize it to zero, or reuse one already filled: the data is appended.
+ *
+ * @see cpuid_serialize_raw_data_buffer, cpuid_serialize_all_raw_data_buffer,
+ *      cpuid_free_buffer
+ */
+struct cpuid_buffer_t {
+	/** the data, allocated with the allocator of the library (not NUL-terminated) */
+	char* data;
+
+	/** number of bytes of data */
+	size_t size;
+
+	/** number of bytes allocated */
+	size_t capacity;
+};
+
+/**
+ * @brief An archive of raw CPUID dumps of many systems, each one stored under a key.
+ *
+ * The entries are kept sorted by key, so one of them can be found without
+ * reading the others. The raw CPUID data of identical logical CPUs (in the same
+ * system or in different ones) is stored once.
+ *
+ * @see cpuid_open_raw_data_archive, cpuid_add_to_raw_data_archive,
+ *      cpuid_find_in_raw_data_archive, cpuid_get_archived_raw_data,
+ *      cpuid_save_raw_data_archive, cpuid_close_raw_data_archive
+ */
+struct cpu_raw_data_archive_t {
+	/** number of entries (systems) in the archive */
+	uint32_t num_entries;
+
+	/** internal state of the archive (internal use) */
+	void* internal;
+};
+
+/**
+ * @brief Options of the JSON serialization functions
+ * @see cpuid_serialize_system_id_json
+ */
+typedef enum {
+	CPUID_JSON_PRETTY = 1, /*!< Indent the output, one member per line. Otherwise, the output
+	                            is a single line, which can be used as an NDJSON record */
+} cpuid_json_flags_t;
+
+/**
+ * @brief Contains statistics of the CPUID instructions executed for one leaf.
+ *
+ * @see cpuid_enable_leaf_stats, cpuid_get_leaf_stats
+ */
+struct cpuid_leaf_stats_t {
+	/** CPUID leaf (value of EAX) */
+	uint32_t leaf;
+
+	/** number of CPUID instructions executed for this leaf (all subleaves and logical CPUs) */
+	uint64_t count;
+
+	/** total time spent to execute these instructions, in TSC ticks */
+	uint64_t tsc_ticks;
+};
+
 /**
  * @brief This contains information about SGX features of the processor
  * Example usage:
@@ -532,6 +721,18 @@ struct arm_id_t {
 	uint8_t revision;
 };
 
+/**
+ * @brief Set of CPU features, packed in 64-bit words
+ *
+ * The feature f (a \ref cpu_feature_t value) is present if bit (f % 64) of
+ * bits[f / 64] is set. It holds the same information as \ref cpu_id_t::flags,
+ * but a set of features can be compared with another one in a few operations.
+ * @see cpu_feature_set_is_subset, cpu_feature_set_next
+ */
+typedef struct {
+	uint64_t bits[CPU_FEATURE_SET_WORDS]; /*!< one bit per feature */
+} cpu_feature_set_t;
+
 /**
  * @brief This contains the recognized CPU features/info
  */
@@ -767,6 +968,13 @@ struct cpu_id_t {
 
 	/** contains the technology node string, e.g. "32 nm" */
 	char technology_node[TECHNOLOGY_STR_MAX];
+
+	/**
+	 * contains the same CPU flags as \ref flags, as a bit set.
+	 * Used to test for many features at once.
+	 * @see cpu_feature_set_t
+	 */
+	cpu_feature_set_t feature_set;
 };
 
 /**
@@ -795,6 +1003,51 @@ struct system_id_t {
 	int32_t l4_total_instances;
 };
 
+/**
+ * @brief Topology of a logical CPU in a \ref cpu_snapshot_t
+ */
+struct cpu_topology_t {
+	/** the OS number of the logical CPU */
+	logical_cpu_t os_cpu;
+
+	/** index of the logical CPU type in system_id_t::cpu_types */
+	uint8_t cpu_type;
+
+	/** APIC ID (x86) or MPIDR (ARM) based identifiers. -1 if undetermined */
+	int32_t apic_id;
+	int32_t package_id;
+	int32_t core_id;
+	int32_t smt_id;
+};
+
+/**
+ * @brief A read-only snapshot of the identified system
+ *
+ * It is either mapped from shared memory, as published by
+ * \ref cpuid_publish_shared_snapshot, or identified by the calling process.
+ */
+struct cpu_snapshot_t {
+	/** true if the snapshot is mapped from shared memory */
+	bool is_shared;
+
+	/** the recognized CPU features/info, do not call cpuid_free_system_id() on it */
+	struct system_id_t system;
+
+	/** number of logical CPUs in \ref raw and \ref topology */
+	logical_cpu_t num_raw;
+
+	/** raw CPUID data of each logical CPU, with their tables of leaves
+	 *  (do not call cpuid_free_raw_data() on them) */
+	const struct cpu_raw_data_t* raw;
+
+	/** topology of each logical CPU */
+	const struct cpu_topology_t* topology;
+
+	/** private: the memory which holds the snapshot */
+	void* image;
+	size_t image_size;
+};
+
 /**
  * @brief CPU feature identifiers
  *
@@ -1319,18 +1572,53 @@ void cpu_exec_cpuid_ext(uint32_t* regs);
 /**
  * @brief Obtains the raw CPUID data from the current CPU
  * @param data - a pointer to cpu_raw_data_t structure
+ * @note On x86, only the leaves up to the maximum reported by leaves 0 and
+ *       0x80000000, and the subleaves up to their terminating subleaf, are
+ *       executed. The other entries of cpu_raw_data_t are set to zero.
+ * @note Be sure to call cpuid_free_raw_data() after you're done with the data.
  * @returns zero if successful, and some negative number on error.
  *          The error message can be obtained by calling \ref cpuid_error.
  *          @see cpu_error_t
  */
 int cpuid_get_raw_data(struct cpu_raw_data_t* data);
 
+/**
+ * @brief Loads the cpuid kernel driver
+ *
+ * On Linux, and on FreeBSD on ARM, the raw CPUID data of each logical CPU can be read
+ * through the cpuid kernel driver (/dev/cpu/N/cpuid or /dev/cpuidN), without changing
+ * the CPU affinity of the calling thread. This function loads the kernel module
+ * (with modprobe or kldload) if the device does not exist yet.
+ * The other functions never load it by themselves.
+ * On other systems (including FreeBSD on x86), ERR_NOT_IMP is returned.
+ *
+ * @note Loading the kernel module requires root privileges.
+ * @returns zero if the driver is readable, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_load_driver(void);
+
 /**
  * @brief Obtains the raw CPUID data from the specified CPU
  * @param data - a pointer to cpu_raw_data_t structure
- * @param logical_cpu specify the core number.
+ * @param logical_cpu specify the core number, as numbered by the OS.
  *          The first core number is 0.
- *          The last core number is \ref cpuid_get_total_cpus - 1.
+ *          The last core number is \ref cpuid_get_total_cpus - 1, unless
+ *          some logical CPUs are offline (the numbering then has holes).
+ * @note On Linux x86, the cpuid kernel driver (/dev/cpu/N/cpuid) is used when it
+ *       is readable, so the calling thread is not moved to the specified core.
+ *       Otherwise, the CPU affinity of the calling thread is changed.
+ *       The kernel module is never loaded implicitly, see \ref cpuid_load_driver.
+ * @note On Linux x86, the LIBCPUID_CPUID_DEVICE_DIR environment variable replaces the
+ *       /dev/cpu directory, e.g. to replay the CPUID data of another machine.
+ *       Its N/cpuid entries may be character devices, read like the kernel driver,
+ *       or regular files. A regular file holds one 16-byte record
+ *       (EAX, EBX, ECX, EDX, as native-endian 32-bit values) per leaf and subleaf,
+ *       at the offset ((subleaf << 32) | leaf) * 16; missing records read as zero.
+ *       Like LIBCPUID_SYSFS_CPU_DIR (which replaces /sys/devices/system/cpu), it is
+ *       ignored in setuid and setgid programs (see secure_getenv(3)).
+ * @note Be sure to call cpuid_free_raw_data() after you're done with the data.
  * @returns zero if successful, and some negative number on error.
  *          The error message can be obtained by calling \ref cpuid_error.
  *          @see cpu_error_t
@@ -1340,6 +1628,9 @@ int cpuid_get_raw_data_core(struct cpu_raw_data_t* data, logical_cpu_t logical_c
 /**
  * @brief Obtains the raw CPUID data from all CPUs
  * @param data - a pointer to cpu_raw_data_array_t structure
+ * @note On Linux, the online logical CPUs are read from /sys/devices/system/cpu/online,
+ *       so offline logical CPUs are skipped. The OS number of each logical CPU is stored
+ *       in cpu_raw_data_t::os_cpu.
  * @note As the memory is dynamically allocated, be sure to call
  *       cpuid_free_raw_data_array() after you're done with the data
  * @returns zero if successful, and some negative number on error.
@@ -1348,6 +1639,143 @@ int cpuid_get_raw_data_core(struct cpu_raw_data_t* data, logical_cpu_t logical_c
  */
 int cpuid_get_all_raw_data(struct cpu_raw_data_array_t* data);
 
+/**
+ * @brief Obtains the raw CPUID data from all CPUs, using several threads
+ * @param data - a pointer to cpu_raw_data_array_t structure
+ * @param num_threads - the number of worker threads to use. Each thread collects
+ *                      a contiguous range of logical CPUs.
+ *                      If zero or negative, one thread per logical CPU is used.
+ * @note The content of the array is the same as with \ref cpuid_get_all_raw_data,
+ *       but only the worker threads are bound to each logical CPU: the CPU affinity
+ *       of the calling thread is left unchanged.
+ *       On systems without thread or CPU affinity support, this function behaves
+ *       like \ref cpuid_get_all_raw_data.
+ * @note As the memory is dynamically allocated, be sure to call
+ *       cpuid_free_raw_data_array() after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_get_all_raw_data_parallel(struct cpu_raw_data_array_t* data, int num_threads);
+
+/**
+ * @brief Obtains the raw CPUID data from all CPUs, without duplicates
+ * @param data - a pointer to cpu_raw_data_compact_t structure
+ * @note The content is the same as with \ref cpuid_get_all_raw_data, but only
+ *       the differences with a few templates are stored for each logical CPU.
+ * @note As the memory is dynamically allocated, be sure to call
+ *       cpuid_free_raw_data_compact() after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_get_all_raw_data_compact(struct cpu_raw_data_compact_t* data);
+
+/**
+ * @brief Builds the compact form of an array of raw CPUID data
+ * @param raw_array - the raw CPUID data of all logical CPUs.
+ * @param data - a pointer to cpu_raw_data_compact_t structure, which is filled.
+ * @note As the memory is dynamically allocated, be sure to call
+ *       cpuid_free_raw_data_compact() after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_compact_raw_data_array(const struct cpu_raw_data_array_t* raw_array, struct cpu_raw_data_compact_t* data);
+
+/**
+ * @brief Gets the raw CPUID data of one logical CPU from compact raw CPUID data
+ * @param data - the compact raw CPUID data.
+ * @param logical_cpu - the logical CPU number.
+ * @param raw - a pointer to cpu_raw_data_t structure, which is filled.
+ * @note Be sure to call cpuid_free_raw_data() after you're done with the data.
+ * @returns zero if successful, and some negative number on error (ERR_INVCNB
+ *          if logical_cpu is out of bounds).
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_get_compact_raw_data(const struct cpu_raw_data_compact_t* data, logical_cpu_t logical_cpu, struct cpu_raw_data_t* raw);
+
+/**
+ * @brief Frees compact raw CPUID data
+ * @param data - the compact raw CPUID data.
+ */
+void cpuid_free_raw_data_compact(struct cpu_raw_data_compact_t* data);
+
+/**
+ * @brief Gets the result of CPUID for a leaf and subleaf from raw CPUID data
+ * @param raw - the raw CPUID data.
+ * @param leaf - the CPUID leaf (value of EAX).
+ * @param subleaf - the CPUID subleaf (value of ECX).
+ * @note The leaf is read from \ref cpu_raw_data_t::leaves. If this table is
+ *       empty (raw data filled by the caller), it is read from the arrays of
+ *       \ref cpu_raw_data_t instead (e.g. basic_cpuid or intel_fn4).
+ * @returns a pointer to the values of EAX, EBX, ECX and EDX (indexed by
+ *          \ref cpu_registers_t), which are all zero if the leaf and subleaf
+ *          were not collected (which means that CPUID returned only zeros).
+ *          It is never NULL, and it is valid until raw is modified.
+ */
+const uint32_t* cpuid_get_raw_leaf(const struct cpu_raw_data_t* raw, uint32_t leaf, uint32_t subleaf);
+
+/**
+ * @brief Stores the result of CPUID for a leaf and subleaf in raw CPUID data
+ * @param raw - the raw CPUID data, initialized (e.g. with zeros, or by
+ *              \ref cpuid_get_raw_data).
+ * @param leaf - the CPUID leaf (value of EAX).
+ * @param subleaf - the CPUID subleaf (value of ECX).
+ * @param regs - the values of EAX, EBX, ECX and EDX, indexed by \ref cpu_registers_t.
+ * @note The values are stored in \ref cpu_raw_data_t::leaves, which grows as
+ *       needed (zeros remove the leaf from it), and they are copied in every
+ *       array of \ref cpu_raw_data_t where this leaf and subleaf fit (e.g. both
+ *       basic_cpuid[4] and intel_fn4[0] for leaf 4 and subleaf 0).
+ *       If the table is empty, the leaves of these arrays are added to it first.
+ * @note Be sure to call \ref cpuid_free_raw_data after you're done with the data.
+ * @returns zero if successful, and some negative number on error (ERR_NO_MEM
+ *          if the table cannot grow).
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_set_raw_leaf(struct cpu_raw_data_t* raw, uint32_t leaf, uint32_t subleaf, const uint32_t* regs);
+
+/**
+ * @brief Copies raw CPUID data
+ * @param dst - the copy, initialized (e.g. with zeros). Its table of leaves
+ *              is reused, or allocated if needed.
+ * @param src - the raw CPUID data to copy.
+ * @note Assigning a \ref cpu_raw_data_t shares its table of leaves: only one
+ *       of both may then be released or modified.
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_copy_raw_data(struct cpu_raw_data_t* dst, const struct cpu_raw_data_t* src);
+
+/**
+ * @brief Enables or disables the CPUID statistics
+ * @param enable - if true, the library counts and times each CPUID instruction
+ *                 it executes (including through the cpuid kernel driver),
+ *                 grouped by leaf.
+ * @note Existing statistics are cleared.
+ *       It can be called while other threads collect raw data (e.g. \ref cpuid_get_all_raw_data_parallel),
+ *       but the CPUID instructions executed meanwhile may be partially counted.
+ *       With compilers other than GCC, Clang and MSVC, it must not be called during a collection.
+ *       When enabled, each CPUID instruction is surrounded by two RDTSC instructions.
+ *       Statistics are gathered for the basic (0x00000000-0x000000FF),
+ *       hypervisor (0x40000000-0x400000FF) and extended (0x80000000-0x800000FF) leaves.
+ */
+void cpuid_enable_leaf_stats(bool enable);
+
+/**
+ * @brief Gets the CPUID statistics
+ * @param stats - an array where the statistics will be written, sorted by leaf.
+ *                Only the leaves executed at least once are written.
+ *                It can be NULL to get the number of leaves only.
+ * @param max_stats - the number of elements in \ref stats.
+ * @returns the number of leaves executed at least once since the last call to
+ *          \ref cpuid_enable_leaf_stats. It can be greater than max_stats.
+ */
+int cpuid_get_leaf_stats(struct cpuid_leaf_stats_t* stats, int max_stats);
+
 /**
  * @brief Writes the raw CPUID data to a text file
  * @param data - a pointer to cpu_raw_data_t structure
@@ -1386,6 +1814,23 @@ int cpuid_serialize_raw_data(struct cpu_raw_data_t* data, const char* filename);
  */
 int cpuid_serialize_all_raw_data(struct cpu_raw_data_array_t* data, const char* filename);
 
+/**
+ * @brief Writes all the raw CPUID data to a text file, with references between logical CPUs
+ * @param data - a pointer to cpu_raw_data_array_t structure
+ * @param filename - the path of the file, where the serialized data for all CPUs
+ *                   should be written. If empty, stdout will be used.
+ * @note Same as \ref cpuid_serialize_all_raw_data, but the block of a logical CPU
+ *       which is nearly identical to a previous one starts with "same_as_cpu=<n>",
+ *       followed only by the registers which differ from those of logical CPU <n>.
+ *       This makes the dumps of many-core systems much smaller and faster to load.
+ *       They are read back by \ref cpuid_deserialize_all_raw_data and
+ *       \ref cpuid_deserialize_all_raw_data_compact.
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_serialize_all_raw_data_delta(struct cpu_raw_data_array_t* data, const char* filename);
+
 /**
  * @brief Reads raw CPUID data from file
  * @param data - a pointer to cpu_raw_data_t structure. The deserialized data will
@@ -1394,6 +1839,11 @@ int cpuid_serialize_all_raw_data(struct cpu_raw_data_array_t* data, const char*
  *                   If empty, stdin will be used.
  * @note This function may fail, if the file is created by different version of
  *       the library. Also, see the notes on cpuid_serialize_raw_data.
+ * @note Binary raw dumps, written by cpuid_serialize_raw_data_binary, are also recognized.
+ * @note Raw dumps compressed with xz, gzip or zstd are decompressed as they are read,
+ *       if the library is built with liblzma, zlib or libzstd respectively
+ *       (ERR_NOT_IMP is returned otherwise).
+ * @note Be sure to call cpuid_free_raw_data() after you're done with the data.
  * @returns zero if successful, and some negative number on error.
  *          The error message can be obtained by calling \ref cpuid_error.
  *          @see cpu_error_t
@@ -1408,6 +1858,12 @@ int cpuid_deserialize_raw_data(struct cpu_raw_data_t* data, const char* filename
  *                   If empty, stdin will be used.
  * @note This function may fail, if the file is created by different version of
  *       the library. Also, see the notes on cpuid_serialize_all_raw_data.
+ * @note Binary raw dumps, written by cpuid_serialize_all_raw_data_binary, and delta
+ *       text raw dumps, written by cpuid_serialize_all_raw_data_delta, are also recognized.
+ * @note AIDA64 and InstLatx64 CPUID dumps are recognized too. InstLatx64 dumps without
+ *       any header are read as one logical CPU per block of lines, blocks being
+ *       separated by empty lines.
+ * @note Compressed raw dumps are recognized, see \ref cpuid_deserialize_raw_data.
  * @note As the memory is dynamically allocated, be sure to call
  *       cpuid_free_raw_data_array() after you're done with the data
  * @returns zero if successful, and some negative number on error.
@@ -1416,6 +1872,358 @@ int cpuid_deserialize_raw_data(struct cpu_raw_data_t* data, const char* filename
 */
 int cpuid_deserialize_all_raw_data(struct cpu_raw_data_array_t* data, const char* filename);
 
+/**
+ * @brief Reads all raw CPUID data from file, without duplicates
+ * @param data - a pointer to cpu_raw_data_compact_t structure. The deserialized data will
+ *               be written here.
+ * @param filename - the path of the file, containing the serialized raw data.
+ *                   If empty, stdin will be used.
+ * @note Same as \ref cpuid_deserialize_all_raw_data, but the logical CPUs are
+ *       stored in compact form as they are read. The logical CPUs must appear
+ *       in ascending order in the file.
+ * @note As the memory is dynamically allocated, be sure to call
+ *       cpuid_free_raw_data_compact() after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+*/
+int cpuid_deserialize_all_raw_data_compact(struct cpu_raw_data_compact_t* data, const char* filename);
+
+/**
+ * @brief Reads all raw CPUID data from file, using several threads
+ * @param data - a pointer to cpu_raw_data_array_t structure. The deserialized array data will
+ *               be written here.
+ * @param filename - the path of the file, containing the serialized raw data.
+ *                   If empty, stdin will be used.
+ * @param num_threads - the number of worker threads to use. Each thread parses
+ *                      a contiguous range of logical CPUs.
+ *                      If zero or negative, one thread per logical CPU of the system is used.
+ * @note The content of the array is the same as with \ref cpuid_deserialize_all_raw_data.
+ *       Only text raw dumps written by this library, with logical CPUs in ascending order,
+ *       are parsed in parallel, and only if they have enough logical CPUs (at least 16 per
+ *       thread). Other raw dumps, or systems without thread support, are read sequentially.
+ * @note As the memory is dynamically allocated, be sure to call
+ *       cpuid_free_raw_data_array() after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+*/
+int cpuid_deserialize_all_raw_data_parallel(struct cpu_raw_data_array_t* data, const char* filename, int num_threads);
+
+/**
+ * @brief Writes the raw CPUID data to a file descriptor
+ * @param data - a pointer to cpu_raw_data_t structure
+ * @param fd - an open file descriptor (a file, a pipe, a socket...)
+ * @note Same as \ref cpuid_serialize_raw_data, the data is formatted in memory
+ *       and written at once. The file descriptor is not closed.
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_serialize_raw_data_fd(struct cpu_raw_data_t* data, int fd);
+
+/**
+ * @brief Writes all the raw CPUID data to a file descriptor
+ * @param data - a pointer to cpu_raw_data_array_t structure
+ * @param fd - an open file descriptor (a file, a pipe, a socket...)
+ * @note Same as \ref cpuid_serialize_all_raw_data, each logical CPU is formatted
+ *       in memory and written at once. The file descriptor is not closed.
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_serialize_all_raw_data_fd(struct cpu_raw_data_array_t* data, int fd);
+
+/**
+ * @brief Writes the raw CPUID data to a memory buffer
+ * @param data - a pointer to cpu_raw_data_t structure
+ * @param buffer - a pointer to cpuid_buffer_t structure, the text raw dump is
+ *                 appended to it.
+ * @note Same as \ref cpuid_serialize_raw_data, without any file. Be sure to call
+ *       cpuid_free_buffer() after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_serialize_raw_data_buffer(struct cpu_raw_data_t* data, struct cpuid_buffer_t* buffer);
+
+/**
+ * @brief Writes all the raw CPUID data to a memory buffer
+ * @param data - a pointer to cpu_raw_data_array_t structure
+ * @param buffer - a pointer to cpuid_buffer_t structure, the text raw dump is
+ *                 appended to it.
+ * @note Same as \ref cpuid_serialize_all_raw_data, without any file. Be sure to
+ *       call cpuid_free_buffer() after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_serialize_all_raw_data_buffer(struct cpu_raw_data_array_t* data, struct cpuid_buffer_t* buffer);
+
+/**
+ * @brief Writes all the raw CPUID data to a memory buffer, with references between logical CPUs
+ * @param data - a pointer to cpu_raw_data_array_t structure
+ * @param buffer - a pointer to cpuid_buffer_t structure, the text raw dump is
+ *                 appended to it.
+ * @note Same as \ref cpuid_serialize_all_raw_data_delta, without any file. Be sure
+ *       to call cpuid_free_buffer() after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_serialize_all_raw_data_delta_buffer(struct cpu_raw_data_array_t* data, struct cpuid_buffer_t* buffer);
+
+/**
+ * @brief Frees a buffer filled by the serialization functions
+ * @param buffer - a pointer to cpuid_buffer_t structure, which is reset to zero.
+ */
+void cpuid_free_buffer(struct cpuid_buffer_t* buffer);
+
+/**
+ * @brief Reads raw CPUID data from memory
+ * @param data - a pointer to cpu_raw_data_t structure. The deserialized data will
+ *               be written here.
+ * @param buffer - the serialized raw data, in any format recognized by
+ *                 \ref cpuid_deserialize_raw_data (it does not need to be
+ *                 NUL-terminated, e.g. a received message or a mapped file).
+ * @param size - the size of buffer, in bytes.
+ * @note Be sure to call cpuid_free_raw_data() after you're done with the data.
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+*/
+int cpuid_deserialize_raw_data_buffer(struct cpu_raw_data_t* data, const void* buffer, size_t size);
+
+/**
+ * @brief Reads all raw CPUID data from memory
+ * @param data - a pointer to cpu_raw_data_array_t structure. The deserialized array data will
+ *               be written here.
+ * @param buffer - the serialized raw data, in any format recognized by
+ *                 \ref cpuid_deserialize_all_raw_data (it does not need to be
+ *                 NUL-terminated).
+ * @param size - the size of buffer, in bytes.
+ * @note As the memory is dynamically allocated, be sure to call
+ *       cpuid_free_raw_data_array() after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+*/
+int cpuid_deserialize_all_raw_data_buffer(struct cpu_raw_data_array_t* data, const void* buffer, size_t size);
+
+/**
+ * @brief Reads all raw CPUID data from memory, without duplicates
+ * @param data - a pointer to cpu_raw_data_compact_t structure. The deserialized data will
+ *               be written here.
+ * @param buffer - the serialized raw data, see \ref cpuid_deserialize_all_raw_data_compact.
+ * @param size - the size of buffer, in bytes.
+ * @note As the memory is dynamically allocated, be sure to call
+ *       cpuid_free_raw_data_compact() after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+*/
+int cpuid_deserialize_all_raw_data_compact_buffer(struct cpu_raw_data_compact_t* data, const void* buffer, size_t size);
+
+/**
+ * @brief Writes the raw CPUID data to a binary file
+ * @param data - a pointer to cpu_raw_data_t structure
+ * @param filename - the path of the file, where the serialized data should be
+ *                   written. If empty, stdout will be used.
+ * @note The binary format is versioned and its integers are little-endian, so
+ *       the files can be exchanged between systems. It is read back by
+ *       \ref cpuid_deserialize_raw_data, which recognizes both formats.
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_serialize_raw_data_binary(struct cpu_raw_data_t* data, const char* filename);
+
+/**
+ * @brief Writes all the raw CPUID data to a binary file
+ * @param data - a pointer to cpu_raw_data_array_t structure
+ * @param filename - the path of the file, where the serialized data for all CPUs
+ *                   should be written. If empty, stdout will be used.
+ * @note Same as \ref cpuid_serialize_all_raw_data, but the file is much smaller
+ *       and faster to read. It is read back by \ref cpuid_deserialize_all_raw_data
+ *       and \ref cpuid_deserialize_all_raw_data_compact, which recognize both
+ *       formats, or mapped by \ref cpuid_map_raw_data.
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_serialize_all_raw_data_binary(struct cpu_raw_data_array_t* data, const char* filename);
+
+/**
+ * @brief Maps a binary raw CPUID dump in memory
+ * @param data - a pointer to cpu_raw_data_mapped_t structure, which is filled.
+ * @param filename - the path of a file written by \ref cpuid_serialize_all_raw_data_binary.
+ *                   If empty, stdin will be read.
+ * @note The file is mapped where the platform allows it, and read in memory
+ *       otherwise. Be sure to call cpuid_unmap_raw_data() after you're done with the data.
+ * @returns zero if successful, and some negative number on error (ERR_BADFMT
+ *          if the file is not a binary raw dump).
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_map_raw_data(struct cpu_raw_data_mapped_t* data, const char* filename);
+
+/**
+ * @brief Gets the raw CPUID data of one logical CPU from a mapped binary raw dump
+ * @param data - the mapped raw CPUID data.
+ * @param logical_cpu - the logical CPU number.
+ * @param raw - a pointer to cpu_raw_data_t structure, which is filled.
+ * @note Be sure to call cpuid_free_raw_data() after you're done with the data.
+ * @returns zero if successful, and some negative number on error (ERR_INVCNB
+ *          if logical_cpu is out of bounds).
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_get_mapped_raw_data(const struct cpu_raw_data_mapped_t* data, logical_cpu_t logical_cpu, struct cpu_raw_data_t* raw);
+
+/**
+ * @brief Unmaps a binary raw CPUID dump mapped by \ref cpuid_map_raw_data
+ * @param data - the mapped raw CPUID data.
+ */
+void cpuid_unmap_raw_data(struct cpu_raw_data_mapped_t* data);
+
+/**
+ * @brief Opens an archive of raw CPUID dumps
+ * @param archive - a pointer to cpu_raw_data_archive_t structure, which is filled.
+ * @param filename - the path of a file written by \ref cpuid_save_raw_data_archive.
+ *                   If NULL, a new empty archive is created in memory.
+ * @note The file is mapped where the platform allows it, and its entries are
+ *       decoded only when they are requested. Be sure to call
+ *       cpuid_close_raw_data_archive() after you're done with the archive.
+ * @returns zero if successful, and some negative number on error (ERR_BADFMT
+ *          if the file is not a raw data archive).
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_open_raw_data_archive(struct cpu_raw_data_archive_t* archive, const char* filename);
+
+/**
+ * @brief Adds the raw CPUID data of a system to an archive
+ * @param archive - the archive, opened by \ref cpuid_open_raw_data_archive.
+ * @param key - the identifier of the system (e.g. its host name), unique in the archive.
+ * @param raw_array - the raw CPUID data of all the logical CPUs of the system.
+ * @note The archive is only modified in memory, call \ref cpuid_save_raw_data_archive
+ *       to write it. The keys returned by \ref cpuid_get_archived_raw_data
+ *       before this call are no longer valid.
+ * @returns zero if successful, and some negative number on error (ERR_REQUEST
+ *          if the key is already in the archive).
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_add_to_raw_data_archive(struct cpu_raw_data_archive_t* archive, const char* key, const struct cpu_raw_data_array_t* raw_array);
+
+/**
+ * @brief Finds the raw CPUID data of a system in an archive, by its key
+ * @param archive - the archive, opened by \ref cpuid_open_raw_data_archive.
+ * @param key - the identifier of the system.
+ * @param raw_array - a pointer to cpu_raw_data_array_t structure, which is filled.
+ * @note The lookup is a binary search in the index of the archive. Be sure to
+ *       call cpuid_free_raw_data_array() after you're done with the data
+ * @returns zero if successful, and some negative number on error (ERR_NOT_FOUND
+ *          if the key is not in the archive).
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_find_in_raw_data_archive(struct cpu_raw_data_archive_t* archive, const char* key, struct cpu_raw_data_array_t* raw_array);
+
+/**
+ * @brief Gets an entry of an archive, by its index
+ * @param archive - the archive, opened by \ref cpuid_open_raw_data_archive.
+ * @param index - the index of the entry, between 0 and archive->num_entries - 1.
+ *                The entries are sorted by key.
+ * @param key - if not NULL, the key of the entry is written here. It is valid
+ *              until the archive is modified or closed.
+ * @param raw_array - if not NULL, a pointer to cpu_raw_data_array_t structure,
+ *                    which is filled.
+ * @note Be sure to call cpuid_free_raw_data_array() after you're done with the data
+ * @returns zero if successful, and some negative number on error (ERR_INVRANGE
+ *          if index is out of bounds).
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_get_archived_raw_data(struct cpu_raw_data_archive_t* archive, uint32_t index, const char** key, struct cpu_raw_data_array_t* raw_array);
+
+/**
+ * @brief Writes an archive of raw CPUID dumps to a file
+ * @param archive - the archive, opened by \ref cpuid_open_raw_data_archive.
+ * @param filename - the path of the file. It can be the file the archive was
+ *                   opened from.
+ * @note The integers are little-endian, so the files can be exchanged between systems.
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_save_raw_data_archive(struct cpu_raw_data_archive_t* archive, const char* filename);
+
+/**
+ * @brief Closes an archive opened by \ref cpuid_open_raw_data_archive
+ * @param archive - the archive, which is reset to zero.
+ * @note Changes which were not saved with \ref cpuid_save_raw_data_archive are lost.
+ */
+void cpuid_close_raw_data_archive(struct cpu_raw_data_archive_t* archive);
+
+/**
+ * @brief Writes the identified CPU types of a system in JSON
+ * @param system - the system, identified by \ref cpu_identify_all.
+ * @param filename - the path of the file, where the JSON should be written.
+ *                   If empty, stdout will be used.
+ * @param flags - a combination of \ref cpuid_json_flags_t values.
+ * @note The output is a single JSON object, described by the JSON schema in
+ *       libcpuid.schema.json. It is written while the data is read, in blocks,
+ *       without building the whole document in memory. Without CPUID_JSON_PRETTY,
+ *       it is one line: the outputs of many systems can be concatenated in an
+ *       NDJSON file.
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_serialize_system_id_json(const struct system_id_t* system, const char* filename, int flags);
+
+/**
+ * @brief Writes the identified CPU types of a system in JSON to a file descriptor
+ * @param system - the system, identified by \ref cpu_identify_all.
+ * @param fd - the file descriptor (e.g. a pipe or a socket), which is not closed.
+ * @param flags - a combination of \ref cpuid_json_flags_t values.
+ * @note Same as \ref cpuid_serialize_system_id_json.
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_serialize_system_id_json_fd(const struct system_id_t* system, int fd, int flags);
+
+/**
+ * @brief Writes the identified CPU types of a system in JSON to a memory buffer
+ * @param system - the system, identified by \ref cpu_identify_all.
+ * @param buffer - a pointer to cpuid_buffer_t structure, the JSON is appended to it
+ *                 (it is not NUL-terminated).
+ * @param flags - a combination of \ref cpuid_json_flags_t values.
+ * @note Same as \ref cpuid_serialize_system_id_json. Be sure to call
+ *       cpuid_free_buffer() after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_serialize_system_id_json_buffer(const struct system_id_t* system, struct cpuid_buffer_t* buffer, int flags);
+
+/**
+ * @brief Writes one identified CPU type in JSON to a memory buffer
+ * @param id - the CPU type, identified by \ref cpu_identify or \ref cpu_identify_all.
+ * @param buffer - a pointer to cpuid_buffer_t structure, the JSON is appended to it
+ *                 (it is not NUL-terminated).
+ * @param flags - a combination of \ref cpuid_json_flags_t values.
+ * @note The object is the same as an item of "cpu_types" in the output of
+ *       \ref cpuid_serialize_system_id_json. Be sure to call cpuid_free_buffer()
+ *       after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_serialize_cpu_id_json_buffer(const struct cpu_id_t* id, struct cpuid_buffer_t* buffer, int flags);
+
 /**
  * @brief Identifies the CPU
  * @param raw - Input - a pointer to the raw CPUID data, which is obtained
@@ -1457,6 +2265,108 @@ int cpu_identify(struct cpu_raw_data_t* raw, struct cpu_id_t* data);
  */
 int cpu_identify_all(struct cpu_raw_data_array_t* raw_array, struct system_id_t* system);
 
+/**
+ * @brief Identifies all the CPUs from compact raw CPUID data
+ * @param data - Input - a pointer to the compact raw CPUID data, which is obtained
+ *              either by cpuid_get_all_raw_data_compact, cpuid_deserialize_all_raw_data_compact
+ *              or cpuid_compact_raw_data_array.
+ * @param system - Output - the decoded CPU features/info is written here for each CPU type.
+ * @note The result is the same as with \ref cpu_identify_all, but the raw CPUID data
+ *       of each logical CPU is never copied: only its differences with its template are applied.
+ * @note As the memory is dynamically allocated, be sure to call
+ *       cpuid_free_system_id() after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpu_identify_all_compact(struct cpu_raw_data_compact_t* data, struct system_id_t* system);
+
+/**
+ * @brief Identifies all the CPUs from a mapped binary raw CPUID dump
+ * @param data - Input - a pointer to the mapped raw CPUID data, which is obtained
+ *              by cpuid_map_raw_data.
+ * @param system - Output - the decoded CPU features/info is written here for each CPU type.
+ * @note The result is the same as with \ref cpu_identify_all, but the raw CPUID data
+ *       of each logical CPU is decoded from the mapped file when it is identified.
+ * @note As the memory is dynamically allocated, be sure to call
+ *       cpuid_free_system_id() after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpu_identify_all_mapped(struct cpu_raw_data_mapped_t* data, struct system_id_t* system);
+
+/**
+ * @brief Identifies all the CPUs, with a cache shared between processes
+ * @param raw_array - Output - a pointer to cpu_raw_data_array_t, which receives the
+ *              raw CPUID data of all the logical CPUs. Can also be NULL.
+ * @param system - Output - the decoded CPU features/info is written here for each CPU type.
+ * @param cache_dir - the directory of the cache file. If NULL, the LIBCPUID_CACHE_DIR
+ *              environment variable is used, unless the program is setuid or setgid.
+ *              When no directory is given, nothing is cached and the function behaves
+ *              like cpu_identify_all.
+ * @note The cache file is only used while the boot ID, the online logical CPUs and the
+ *       microcode revision are the same, and if it was written by the current user or root.
+ *       It is written atomically, and an invalid or outdated file is replaced.
+ *       It is not written by a process which cannot use all the online logical
+ *       CPUs (e.g. restricted by taskset or a cgroup cpuset), since its result
+ *       would be partial. The cache is only available on Linux.
+ * @note ERR_OPEN is returned if the path of the cache file is too long.
+ * @note As the memory is dynamically allocated, be sure to call
+ *       cpuid_free_raw_data_array() and cpuid_free_system_id() after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpu_identify_all_cached(struct cpu_raw_data_array_t* raw_array, struct system_id_t* system, const char* cache_dir);
+
+/**
+ * @brief Publishes a snapshot of the identified system in shared memory
+ * @param name - the name of the POSIX shared memory object (e.g. "/libcpuid").
+ *              If NULL, "/libcpuid" is used.
+ * @note The system is identified once, then other processes can use
+ *       \ref cpuid_attach_shared_snapshot instead of identifying it again.
+ *       A previous snapshot with the same name is replaced: processes which
+ *       attached it keep their mapping.
+ *       Shared memory snapshots are only available on Linux.
+ * @returns zero if successful, and some negative number on error
+ *          (ERR_REQUEST if the calling process cannot use all the online
+ *          logical CPUs, e.g. restricted by taskset or a cgroup cpuset).
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_publish_shared_snapshot(const char* name);
+
+/**
+ * @brief Removes a snapshot published by \ref cpuid_publish_shared_snapshot
+ * @param name - the name of the POSIX shared memory object, or NULL for "/libcpuid".
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_unpublish_shared_snapshot(const char* name);
+
+/**
+ * @brief Gets a snapshot of the identified system
+ * @param snapshot - Output - the snapshot.
+ * @param name - the name of the POSIX shared memory object, or NULL for "/libcpuid".
+ * @note The published snapshot is mapped read-only, without executing CPUID or
+ *       changing the CPU affinity. When no valid snapshot is published (or it was
+ *       published before a change of the online logical CPUs or of the microcode),
+ *       the system is identified by the calling process and snapshot->is_shared is false.
+ * @note Be sure to call \ref cpuid_detach_shared_snapshot after you're done with the data
+ * @returns zero if successful, and some negative number on error.
+ *          The error message can be obtained by calling \ref cpuid_error.
+ *          @see cpu_error_t
+ */
+int cpuid_attach_shared_snapshot(struct cpu_snapshot_t* snapshot, const char* name);
+
+/**
+ * @brief Frees a snapshot obtained by \ref cpuid_attach_shared_snapshot
+ * @param snapshot - the snapshot.
+ */
+void cpuid_detach_shared_snapshot(struct cpu_snapshot_t* snapshot);
+
 /**
  * @brief Identifies a given CPU type
  * @param purpose - Input - a \ref cpu_purpose_t to request
@@ -1518,6 +2428,102 @@ char* affinity_mask_str(cpu_affinity_mask_t *affinity_mask);
  */
 const char* cpu_feature_str(cpu_feature_t feature);
 
+/**
+ * @brief Removes all the features of a feature set
+ * @param set - the feature set to clear.
+ */
+void cpu_feature_set_clear(cpu_feature_set_t* set);
+
+/**
+ * @brief Adds a feature to a feature set
+ * @param set - the feature set.
+ * @param feature - the feature to add.
+ *
+ * Usage: does the CPU have all the features needed by a program?
+ * @code
+ * ...
+ * static const cpu_feature_t needed[] = { CPU_FEATURE_AVX2, CPU_FEATURE_BMI2, CPU_FEATURE_FMA3 };
+ * cpu_feature_set_t needed_set;
+ * cpu_feature_set_clear(&needed_set);
+ * for (i = 0; i < sizeof(needed) / sizeof(needed[0]); i++)
+ *     cpu_feature_set_add(&needed_set, needed[i]);
+ * if (cpu_identify(NULL, &id) == 0 && cpu_feature_set_is_subset(&needed_set, &id.feature_set))
+ *     // All the needed features are present...
+ * @endcode
+ * @returns zero if successful, and some negative number on error
+ *          (ERR_INVRANGE if feature is not a \ref cpu_feature_t value).
+ */
+int cpu_feature_set_add(cpu_feature_set_t* set, cpu_feature_t feature);
+
+/**
+ * @brief Builds a feature set from an array of CPU flags
+ * @param set - the feature set to fill.
+ * @param flags - an array of CPU_FLAGS_MAX flags, like \ref cpu_id_t::flags.
+ * @note \ref cpu_identify and \ref cpu_identify_all already fill
+ *       \ref cpu_id_t::feature_set from \ref cpu_id_t::flags.
+ */
+void cpu_feature_set_from_flags(cpu_feature_set_t* set, const uint8_t* flags);
+
+/**
+ * @brief Checks if all the features of a set are in another set
+ * @param subset - the features to look for.
+ * @param set - the features to look in (e.g. the feature_set of a \ref cpu_id_t).
+ * @returns true if each feature of subset is in set.
+ */
+bool cpu_feature_set_is_subset(const cpu_feature_set_t* subset, const cpu_feature_set_t* set);
+
+/**
+ * @brief Computes the features present in two sets
+ * @param result - the features of a which are also in b.
+ *                 It may be the same pointer as a or b.
+ * @param a - the first feature set.
+ * @param b - the second feature set.
+ * @note e.g. the features common to all the CPU types of a fleet.
+ */
+void cpu_feature_set_intersection(cpu_feature_set_t* result, const cpu_feature_set_t* a, const cpu_feature_set_t* b);
+
+/**
+ * @brief Computes the features present in at least one of two sets
+ * @param result - the features in a or in b.
+ *                 It may be the same pointer as a or b.
+ * @param a - the first feature set.
+ * @param b - the second feature set.
+ */
+void cpu_feature_set_union(cpu_feature_set_t* result, const cpu_feature_set_t* a, const cpu_feature_set_t* b);
+
+/**
+ * @brief Computes the features of a set which are not in another set
+ * @param result - the features of a which are not in b.
+ *                 It may be the same pointer as a or b.
+ * @param a - the first feature set.
+ * @param b - the second feature set.
+ * @note e.g. the features missing on a CPU: the needed features minus its feature_set.
+ */
+void cpu_feature_set_difference(cpu_feature_set_t* result, const cpu_feature_set_t* a, const cpu_feature_set_t* b);
+
+/**
+ * @brief Counts the features of a set
+ * @param set - the feature set.
+ * @returns the number of features in set.
+ */
+int cpu_feature_set_count(const cpu_feature_set_t* set);
+
+/**
+ * @brief Iterates over the features of a set, in increasing order
+ * @param set - the feature set.
+ * @param feature - the previous feature returned, or -1 to get the first one.
+ *
+ * Usage:
+ * @code
+ * ...
+ * int feature;
+ * for (feature = cpu_feature_set_next(&id.feature_set, -1); feature >= 0; feature = cpu_feature_set_next(&id.feature_set, feature))
+ *     printf(" %s", cpu_feature_str((cpu_feature_t) feature));
+ * @endcode
+ * @returns the first feature of set greater than feature, or -1 if there is none.
+ */
+int cpu_feature_set_next(const cpu_feature_set_t* set, int feature);
+
 /**
  * @brief Returns textual description of the last error
  *
@@ -1725,6 +2731,8 @@ int cpu_clock_by_ic(int millis, int runs);
  *
  * NOTE: only x86 Intel CPUs since Skylake (6th generation of Intel Core
  * processors) are supported. Other vendors do not support this feature.
+ * In virtual machines, the TSC frequency advertised by the hypervisor
+ * (CPUID leaf 0x40000010 on VMware, KVM and QEMU) is used for all vendors.
  *
  * @returns the CPU clock frequency in MHz.
  * If TSC frequency is not supported, the result is -1.
@@ -1738,7 +2746,8 @@ int cpu_clock_by_tsc(struct cpu_raw_data_t* raw);
  *
  * This is an all-in-one method for getting the CPU clock frequency.
  * It tries to use the OS for that. If the OS doesn't have this info, it
- * uses cpu_clock_measure with 200ms time interval and quadruple checking.
+ * uses the TSC frequency advertised by the hypervisor in virtual machines,
+ * otherwise cpu_clock_measure with 200ms time interval and quadruple checking.
  *
  * @returns the CPU clock frequency in MHz. If every possible method fails,
  * the result is -1.
@@ -1763,8 +2772,8 @@ struct cpu_epc_t {
  * @param index - zero-based index, valid range [0..cpu_id_t.egx.num_epc_sections)
  * @param raw   - a pointer to fetched raw CPUID data. Needed only for testing,
  *                you can safely pass NULL here (if you pass a real structure,
- *                it will be used for fetching the leaf 12h data if index < 2;
- *                otherwise the real CPUID instruction will be used).
+ *                it will be used for fetching the leaf 12h data; otherwise
+ *                the real CPUID instruction will be used).
  * @returns the requested data. If the CPU doesn't support SGX, or if
  *          index >= cpu_id_t.egx.num_epc_sections, both fields of the returned
  *          structure will be zeros.
@@ -1807,6 +2816,43 @@ libcpuid_warn_fn_t cpuid_set_warn_function(libcpuid_warn_fn_t warn_fun);
  */
 void cpuid_set_verbosiness_level(int level);
 
+/**
+ * @brief Memory allocation functions used by libcpuid
+ *
+ * Each function receives \ref user_data as its last argument. For instance,
+ * an arena allocator can hand out memory from a pre-allocated block and
+ * ignore free_fn.
+ */
+struct cpuid_allocator_t {
+	/** allocates memory, like malloc() */
+	void* (*malloc_fn)(size_t size, void* user_data);
+
+	/** resizes memory returned by malloc_fn or realloc_fn, like realloc() */
+	void* (*realloc_fn)(void* ptr, size_t size, void* user_data);
+
+	/** releases memory returned by malloc_fn or realloc_fn, like free() */
+	void (*free_fn)(void* ptr, void* user_data);
+
+	/** passed to each function, e.g. the arena */
+	void* user_data;
+};
+
+/**
+ * @brief Sets the memory allocation functions
+ *
+ * All the memory that libcpuid returns (e.g. in \ref cpu_raw_data_array_t,
+ * \ref system_id_t or \ref cpu_list_t) or uses internally is allocated with
+ * these functions, and released with them by the cpuid_free_* functions.
+ * Memory must be released with the allocator which allocated it, so the
+ * allocator should be set before calling other libcpuid functions.
+ * The functions may be called concurrently, from the threads of the
+ * *_parallel functions (e.g. \ref cpuid_get_all_raw_data_parallel).
+ *
+ * @param allocator - the allocation functions, which are copied. If NULL,
+ *                    malloc(), realloc() and free() are used.
+ */
+void cpuid_set_allocator(const struct cpuid_allocator_t* allocator);
+
 
 /**
  * @brief Obtains the CPU vendor from CPUID from the current CPU
@@ -1825,6 +2871,9 @@ cpu_vendor_t cpuid_get_vendor(void);
  * @param data - Optional input - the decoded CPU features/info is written here.
  *              Can also be NULL, in which case the functions calls
  *              cpu_identify itself.
+ * @note The hypervisor leaves (0x40000000-0x400000FF) are read from the raw data,
+ *       so raw dumps are supported. Dumps without these leaves give HYPERVISOR_UNKNOWN
+ *       when the hypervisor present bit is set.
  * @note If no hypervisor is detected, the hypervisor can be hidden in some cases.
  *       Refer to https://github.com/anrieff/libcpuid/issues/90#issuecomment-296568713.
  * @returns HYPERVISOR_UNKNOWN if failed,
@@ -1874,6 +2923,18 @@ void cpuid_get_cpu_list(cpu_vendor_t vendor, struct cpu_list_t* list);
  */
 void cpuid_free_cpu_list(struct cpu_list_t* list);
 
+/**
+ * @brief Frees raw CPUID data
+ *
+ * This function deletes the table of leaves of raw CPUID data, as obtained by
+ * cpuid_get_raw_data(), cpuid_get_raw_data_core(), cpuid_deserialize_raw_data(),
+ * cpuid_get_compact_raw_data(), cpuid_get_mapped_raw_data(), cpuid_set_raw_leaf()
+ * or cpuid_copy_raw_data(). The raw data is then empty, and it can be reused.
+ *
+ * @param raw - the raw CPUID data to be free()'d.
+ */
+void cpuid_free_raw_data(struct cpu_raw_data_t* raw);
+
 /**
  * @brief Frees a raw array
  *
@@ -37,6 +37,7 @@
 #define CODENAME_STR_MAX	64
 #define TECHNOLOGY_STR_MAX	16
 #define CPU_FLAGS_MAX		384
+#define CPU_FEATURE_SET_WORDS	(CPU_FLAGS_MAX / 64)
 #define MAX_CPUID_LEVEL		32
 #define MAX_EXT_CPUID_LEVEL	32
 #define MAX_INTELFN4_LEVEL	8
@@ -57,31 +57,34 @@ struct internal_topology_t {
 	logical_cpu_t logical_cpu;
 };
 
-struct internal_core_id_t {
-	logical_cpu_t num_logical_cpu;
-	int32_t core_id;
+struct internal_core_instances_t {
+	int32_t instances;
 };
 
-struct internal_cache_id_t {
-	logical_cpu_t num_logical_cpu;
-	int32_t cache_id;
+struct internal_cache_instances_t {
+	int32_t instances[NUM_CACHE_TYPES];
 };
 
-#define CORES_HTABLE_SIZE 256
-struct internal_core_instances_t {
-	uint8_t instances;
-	struct internal_core_id_t htable[CORES_HTABLE_SIZE];
+/* Open addressing hash table of core and cache IDs, each one in a set (see cpuid_main.c).
+   It uses inline_slots until it needs more slots, then it doubles its size */
+#define ID_TABLE_INLINE_SLOTS 256
+struct internal_id_slot_t {
+	int32_t set; // -1 if the slot is free
+	int32_t id;
 };
 
-#define CACHES_HTABLE_SIZE 256
-struct internal_cache_instances_t {
-	uint8_t instances[NUM_CACHE_TYPES];
-	struct internal_cache_id_t htable[NUM_CACHE_TYPES][CACHES_HTABLE_SIZE];
+struct internal_id_table_t {
+	uint32_t num_ids;
+	uint32_t num_slots;
+	struct internal_id_slot_t* slots;
+	struct internal_id_slot_t inline_slots[ID_TABLE_INLINE_SLOTS];
 };
 
 struct internal_type_info_t {
 	cpu_purpose_t purpose;
 	int32_t package_id;
+	logical_cpu_t logical_cpu; // first logical CPU of this type, whose raw data were decoded
+	uint64_t raw_hash;         // hash of these raw data without the IDs of the logical CPU
 	struct internal_id_info_t id_info;
 	struct internal_core_instances_t core_instances;
 	struct internal_cache_instances_t cache_instances;
@@ -95,4 +98,34 @@ struct internal_type_info_array_t {
 int cpu_ident_internal(struct cpu_raw_data_t* raw, struct cpu_id_t* data,
 		       struct internal_id_info_t* internal);
 
+/* Records of the binary raw dumps, one for each non-zero item of cpu_raw_data_t (see cpuid_main.c) */
+#define BINARY_DUMP_RECORD_SIZE 28
+
+/* Writes the records of a logical CPU if records is not NULL, returns their number */
+uint32_t binary_dump_write_records(const struct cpu_raw_data_t* raw, uint8_t* records);
+
+/* Decodes num_records records of record_size bytes each in raw, which is initialized (its table of leaves is reused)
+   os_cpu is left to zero, returns ERR_NO_MEM if the table of leaves cannot grow */
+int binary_dump_read_records(const uint8_t* records, uint32_t num_records, uint32_t record_size, struct cpu_raw_data_t* raw);
+
+/* Compressed raw dumps (see cpuid_decompress.c) */
+typedef enum {
+	COMPRESSION_NONE,
+	COMPRESSION_XZ,
+	COMPRESSION_GZIP,
+	COMPRESSION_ZSTD,
+} compression_t;
+
+/* Receives a chunk of decompressed data, returns false to stop the decompression */
+typedef bool (*decompress_consumer_t)(void* arg, const void* chunk, size_t size);
+
+/* Returns the compression format of data, from its magic number */
+compression_t detect_compression(const void* data, size_t size);
+
+const char* compression_str(compression_t compression);
+
+/* Decompresses data and passes it to consume in chunks, until it returns false
+   Returns ERR_NOT_IMP if libcpuid is built without support for the format */
+int decompress(compression_t compression, const void* data, size_t size, decompress_consumer_t consume, void* arg);
+
 #endif /* __LIBCPUID_INTERNAL_H__ */
@@ -35,6 +35,20 @@
 #include "libcpuid.h"
 #include "libcpuid_util.h"
 #include "libcpuid_internal.h"
+#if defined(__unix__) || defined(__unix) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#define HAVE_MMAP
+#define HAVE_WRITE
+#elif defined(_WIN32)
+#include <io.h>
+#include <windows.h>
+#define HAVE_WRITE
+#define write(fd, data, size) _write(fd, data, (unsigned int) (size))
+#endif
 
 int _current_verboselevel;
 
@@ -53,6 +67,81 @@ static void default_warn(const char *msg)
 
 libcpuid_warn_fn_t _warn_fun = default_warn;
 
+static void* default_malloc(size_t size, void* user_data)
+{
+	UNUSED(user_data);
+	return malloc(size);
+}
+
+static void* default_realloc(void* ptr, size_t size, void* user_data)
+{
+	UNUSED(user_data);
+	return realloc(ptr, size);
+}
+
+static void default_free(void* ptr, void* user_data)
+{
+	UNUSED(user_data);
+	free(ptr);
+}
+
+const struct cpuid_allocator_t _default_allocator = { default_malloc, default_realloc, default_free, NULL };
+struct cpuid_allocator_t _allocator = { default_malloc, default_realloc, default_free, NULL };
+
+void* cpuid_malloc(size_t size)
+{
+	return _allocator.malloc_fn(size, _allocator.user_data);
+}
+
+void* cpuid_calloc(size_t count, size_t size)
+{
+	void* ptr;
+
+	if ((size > 0) && (count > SIZE_MAX / size))
+		return NULL;
+	if ((ptr = cpuid_malloc(count * size)) != NULL)
+		memset(ptr, 0, count * size);
+	return ptr;
+}
+
+void* cpuid_realloc(void* ptr, size_t size)
+{
+	if (ptr == NULL)
+		return cpuid_malloc(size);
+	return _allocator.realloc_fn(ptr, size, _allocator.user_data);
+}
+
+void cpuid_free(void* ptr)
+{
+	if (ptr != NULL)
+		_allocator.free_fn(ptr, _allocator.user_data);
+}
+
+char* cpuid_strdup(const char* str)
+{
+	const size_t size = strlen(str) + 1;
+	char* copy = (char*) cpuid_malloc(size);
+
+	if (copy != NULL)
+		memcpy(copy, str, size);
+	return copy;
+}
+
+char* cpuid_buffer_reserve(struct cpuid_buffer_t* buffer, size_t size)
+{
+	size_t capacity;
+	char* data;
+
+	if ((buffer->data == NULL) || (buffer->capacity - buffer->size < size)) {
+		for (capacity = (buffer->capacity == 0) ? 4096 : buffer->capacity; capacity - buffer->size < size; capacity *= 2);
+		if ((data = cpuid_realloc(buffer->data, capacity)) == NULL)
+			return NULL;
+		buffer->data     = data;
+		buffer->capacity = capacity;
+	}
+	return buffer->data + buffer->size;
+}
+
 #if defined(_MSC_VER)
 #	define vsnprintf _vsnprintf
 #endif
@@ -80,10 +169,54 @@ void debugf(int verboselevel, const char* format, ...)
 	_warn_fun(buff);
 }
 
-static int score(const struct match_entry_t* entry, const struct cpu_id_t* data)
+const char* cpuid_getenv_path(const char* name)
 {
-	int i, res = 0;
+#if defined(HAVE_SECURE_GETENV)
+	return secure_getenv(name);
+#elif defined(__FreeBSD__) || defined(__DragonFly__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__)
+	return issetugid() ? NULL : getenv(name);
+#elif defined(__unix__) || defined(__unix)
+	return ((getuid() != geteuid()) || (getgid() != getegid())) ? NULL : getenv(name);
+#else
+	return getenv(name);
+#endif
+}
+
+static int xmatch_entry(char c, const char* p);
+
+#define MATCH_TRIE_MAX_ACTIVE  64
+#define MATCH_TRIE_MAX_MATCHES 64
+
+/* Brand string of a CPU, matched against the brand patterns of a codename database */
+struct brand_matcher_t {
 	char brand_str[BRAND_STR_MAX];
+	const struct match_entry_t* matchtable;
+	const struct match_index_t* index; /* NULL if the trie is not used */
+	int state;                         /* 0: not searched yet, 1: end_nodes are found, -1: use match_pattern() */
+	int num_end_nodes;
+	uint16_t end_nodes[MATCH_TRIE_MAX_MATCHES];
+};
+
+/* Normalizes a brand string before matching the patterns of the codename databases */
+static void normalize_brand_str(char* brand_str, const struct cpu_id_t* data)
+{
+	strncpy(brand_str, data->brand_str, BRAND_STR_MAX);
+	brand_str[BRAND_STR_MAX - 1] = '\0';
+	/* Remove useless substrings in brand_str */
+	remove_substring(brand_str, "CPU");
+	remove_substring(brand_str, "Processor");
+	collapse_spaces(brand_str);
+}
+
+static bool has_brand_pattern(const struct match_entry_t* entry)
+{
+	return (entry->brand.score > 0) && (entry->brand.pattern[0] != '\0');
+}
+
+/* Score of the numeric fields of entry */
+static int score_fields(const struct match_entry_t* entry, const struct cpu_id_t* data)
+{
+	int i, res = 0;
 	const struct { const char *field; int entry; int data; int score; } array[] = {
 		{ "family",     entry->family,     data->x86.family,     2 },
 		{ "model",      entry->model,      data->x86.model,      2 },
@@ -100,41 +233,301 @@ static int score(const struct match_entry_t* entry, const struct cpu_id_t* data)
 			debugf(4, "Score: %-12s matches, adding %2i (current score for this entry: %2i)\n", array[i].field, array[i].score, res);
 		}
 	}
+	return res;
+}
 
-	if ((entry->brand.score > 0) && (strlen(entry->brand.pattern) > 0)) {
-		/* Remove useless substrings in brand_str */
-		strncpy(brand_str, data->brand_str, BRAND_STR_MAX);
-		remove_substring(brand_str, "CPU");
-		remove_substring(brand_str, "Processor");
-		collapse_spaces(brand_str);
+/* Finds the brand patterns of the trie which match the brand string, in a single pass over it */
+static void match_brand_patterns(struct brand_matcher_t* matcher)
+{
+	uint16_t active[2][MATCH_TRIE_MAX_ACTIVE];
+	int num_active[2] = { 0, 0 };
+	int i, a, j, cur = 0, child;
+	const struct match_trie_node_t* nodes = matcher->index->nodes;
+	const struct match_trie_node_t* node;
+
+	matcher->state = -1;
+	matcher->num_end_nodes = 0;
+	/* A '[' in the brand string matches the first character of a '[<chars>]' element, which the trie cannot follow */
+	if (strchr(matcher->brand_str, '[') != NULL)
+		return;
+	/* Each character moves a match one node deeper, so a node cannot be active twice */
+	for (i = 0; matcher->brand_str[i] != '\0'; i++, cur = !cur) {
+		if (num_active[cur] == MATCH_TRIE_MAX_ACTIVE)
+			return;
+		active[cur][num_active[cur]++] = 0;
+		num_active[!cur] = 0;
+		for (a = 0; a < num_active[cur]; a++) {
+			for (child = nodes[active[cur][a]].first_child; child != 0; child = node->next_sibling) {
+				node = &nodes[child];
+				if (xmatch_entry(matcher->brand_str[i], matcher->matchtable[node->entry].brand.pattern + node->offset) == -1)
+					continue;
+				if (node->is_end) {
+					for (j = 0; (j < matcher->num_end_nodes) && (matcher->end_nodes[j] != child); j++);
+					if (j == MATCH_TRIE_MAX_MATCHES)
+						return;
+					if (j == matcher->num_end_nodes)
+						matcher->end_nodes[matcher->num_end_nodes++] = (uint16_t) child;
+				}
+				if (node->first_child != 0) {
+					if (num_active[!cur] == MATCH_TRIE_MAX_ACTIVE)
+						return;
+					active[!cur][num_active[!cur]++] = (uint16_t) child;
+				}
+			}
+		}
+	}
+	matcher->state = 1;
+}
+
+/* Score of the brand pattern of the entry i */
+static int score_brand(struct brand_matcher_t* matcher, int i)
+{
+	int j;
+	bool matches;
+	const struct match_entry_t* entry = &matcher->matchtable[i];
+	const uint16_t end_node = (matcher->index != NULL) ? matcher->index->end_nodes[i] : 0;
+
+	if (!has_brand_pattern(entry))
+		return 0;
+	if ((end_node != 0) && (matcher->state == 0))
+		match_brand_patterns(matcher);
+	if ((end_node != 0) && (matcher->state == 1)) {
+		for (j = 0; (j < matcher->num_end_nodes) && (matcher->end_nodes[j] != end_node); j++);
+		matches = (j < matcher->num_end_nodes);
+	}
+	else {
 		/* Test pattern */
-		debugf(5, "Test if '%s' brand pattern matches '%s'...\n", entry->brand.pattern, brand_str);
-		if (match_pattern(brand_str, entry->brand.pattern)) {
-			res += entry->brand.score;
-			debugf(4, "Score: %-12s matches, adding %2i (current score for this entry: %2i)\n", "brand", entry->brand.score, res);
+		debugf(5, "Test if '%s' brand pattern matches '%s'...\n", entry->brand.pattern, matcher->brand_str);
+		matches = (match_pattern(matcher->brand_str, entry->brand.pattern) != 0);
+	}
+	if (!matches)
+		return 0;
+	debugf(4, "Score: %-12s matches, adding %2i\n", "brand", entry->brand.score);
+	return entry->brand.score;
+}
+
+/* Score of the fields of entry which can match, except family, ext_family and ext_model (the key of the index) */
+static int max_score_without_key(const struct match_entry_t* entry)
+{
+	return 2 * (entry->model >= 0) + 2 * (entry->stepping >= 0) + 2 * (entry->ncores >= 0) +
+	       (entry->l2cache >= 0) + (entry->l3cache >= 0) + (has_brand_pattern(entry) ? entry->brand.score : 0);
+}
+
+static bool same_bucket(const struct match_bucket_t* bucket, const struct match_entry_t* entry)
+{
+	return (bucket->family == entry->family) && (bucket->ext_family == entry->ext_family) && (bucket->ext_model == entry->ext_model);
+}
+
+/* Length of the pattern element at p, 0 for a '[' without ']' */
+static int pattern_element_length(const char* p)
+{
+	int j;
+	if (p[0] != '[')
+		return 1;
+	for (j = 1; p[j] && p[j] != ']'; j++);
+	return p[j] ? j + 1 : 0;
+}
+
+static bool same_pattern_element(const char* p1, const char* p2, int length)
+{
+	int j;
+	for (j = 0; j < length; j++)
+		if (tolower(p1[j]) != tolower(p2[j]))
+			return false;
+	return true;
+}
+
+/* Adds the brand pattern of the entry i to the trie, returns false if the trie is full */
+static bool add_brand_pattern(const struct match_entry_t* matchtable, int i, struct match_index_t* index)
+{
+	int offset, length, parent = 0, child;
+	const char* pattern = matchtable[i].brand.pattern;
+	struct match_trie_node_t* node;
+
+	for (offset = 0; pattern[offset] != '\0'; offset += length, parent = child) {
+		length = pattern_element_length(pattern + offset);
+		if (length == 0)
+			return true; /* left to match_pattern() */
+		for (child = index->nodes[parent].first_child; child != 0; child = node->next_sibling) {
+			node = &index->nodes[child];
+			if ((node->length == length) && same_pattern_element(matchtable[node->entry].brand.pattern + node->offset, pattern + offset, length))
+				break;
+		}
+		if (child == 0) {
+			if ((index->num_nodes == index->max_nodes) || (index->num_nodes > 0xffff))
+				return false;
+			child = index->num_nodes++;
+			node  = &index->nodes[child];
+			node->entry        = (uint16_t) i;
+			node->offset       = (uint8_t) offset;
+			node->length       = (uint8_t) length;
+			node->is_end       = 0;
+			node->first_child  = 0;
+			node->next_sibling = index->nodes[parent].first_child;
+			index->nodes[parent].first_child = (uint16_t) child;
+		}
+	}
+	index->nodes[parent].is_end = 1;
+	index->end_nodes[i] = (uint16_t) parent;
+	return true;
+}
+
+static void build_match_index(const struct match_entry_t* matchtable, int count, struct match_index_t* index)
+{
+	int i, b, first;
+	struct match_bucket_t* bucket;
+
+	/* Buckets are in the order of their first entry, then entries are sorted by bucket (counting sort) */
+	index->num_buckets = 0;
+	for (i = 0; i < count; i++) {
+		for (b = 0; (b < index->num_buckets) && !same_bucket(&index->buckets[b], &matchtable[i]); b++);
+		bucket = &index->buckets[b];
+		if (b == index->num_buckets) {
+			bucket->family     = matchtable[i].family;
+			bucket->ext_family = matchtable[i].ext_family;
+			bucket->ext_model  = matchtable[i].ext_model;
+			bucket->max_score  = 0;
+			bucket->count      = 0;
+			index->num_buckets++;
 		}
+		if (max_score_without_key(&matchtable[i]) > bucket->max_score)
+			bucket->max_score = max_score_without_key(&matchtable[i]);
+		bucket->count++;
+	}
+	for (first = 0, b = 0; b < index->num_buckets; b++) {
+		index->buckets[b].first = (uint16_t) first;
+		first += index->buckets[b].count;
+		index->buckets[b].count = 0;
+	}
+	for (i = 0; i < count; i++) {
+		for (b = 0; !same_bucket(&index->buckets[b], &matchtable[i]); b++);
+		bucket = &index->buckets[b];
+		index->entries[bucket->first + bucket->count++] = (uint16_t) i;
+	}
+
+	/* Brand patterns which do not fit in the trie are matched by match_pattern() */
+	memset(&index->nodes[0], 0, sizeof(index->nodes[0]));
+	index->num_nodes = 1;
+	for (i = 0; i < count; i++) {
+		index->end_nodes[i] = 0;
+		if (has_brand_pattern(&matchtable[i]) && !add_brand_pattern(matchtable, i, index))
+			debugf(2, "Brand pattern `%s' not compiled, the trie is full\n", matchtable[i].brand.pattern);
 	}
+	debugf(3, "Codename database indexed: %d entries in %d buckets, %d trie nodes\n", count, index->num_buckets, index->num_nodes);
+}
+
+/* State of a codename index, shared by the threads which identify CPUs */
+#if defined(__GNUC__)
+# define MATCH_INDEX_IS_READY(__index)  (__atomic_load_n(&(__index)->state, __ATOMIC_ACQUIRE) == 2)
+# define MATCH_INDEX_CLAIM(__index)     __atomic_compare_exchange_n(&(__index)->state, &(int) { 0 }, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)
+# define MATCH_INDEX_PUBLISH(__index)   __atomic_store_n(&(__index)->state, 2, __ATOMIC_RELEASE)
+#elif defined(_MSC_VER)
+# define MATCH_INDEX_IS_READY(__index)  (InterlockedCompareExchange((volatile LONG*) &(__index)->state, 2, 2) == 2)
+# define MATCH_INDEX_CLAIM(__index)     (InterlockedCompareExchange((volatile LONG*) &(__index)->state, 1, 0) == 0)
+# define MATCH_INDEX_PUBLISH(__index)   InterlockedExchange((volatile LONG*) &(__index)->state, 2)
+#elif defined(MATCH_INDEX_C11_ATOMICS)
+# define MATCH_INDEX_IS_READY(__index)  (atomic_load_explicit(&(__index)->state, memory_order_acquire) == 2)
+# define MATCH_INDEX_CLAIM(__index)     atomic_compare_exchange_strong_explicit(&(__index)->state, &(int) { 0 }, 1, memory_order_acquire, memory_order_relaxed)
+# define MATCH_INDEX_PUBLISH(__index)   atomic_store_explicit(&(__index)->state, 2, memory_order_release)
+#else
+/* The index cannot be shared safely between threads: match_cpu_codename() scores every entry */
+# define MATCH_INDEX_IS_READY(__index)  false
+# define MATCH_INDEX_CLAIM(__index)     false
+# define MATCH_INDEX_PUBLISH(__index)
+#endif
 
+/* Returns true if index is ready, it is built by the first caller (the others do not wait for it) */
+static bool match_index_ready(const struct match_entry_t* matchtable, int count, struct match_index_t* index)
+{
+	if (index == NULL)
+		return false;
+	if (MATCH_INDEX_IS_READY(index))
+		return true;
+	if (!MATCH_INDEX_CLAIM(index))
+		return false;
+	build_match_index(matchtable, count, index);
+	MATCH_INDEX_PUBLISH(index);
+	return true;
+}
+
+/* Score of the key fields of a bucket, see score_fields() */
+static int bucket_key_score(const struct match_bucket_t* bucket, const struct cpu_id_t* data, bool* is_candidate)
+{
+	int res = 0;
+	const struct { int entry; int data; } array[] = {
+		{ bucket->family,     data->x86.family     },
+		{ bucket->ext_family, data->x86.ext_family },
+		{ bucket->ext_model,  data->x86.ext_model  },
+	};
+	unsigned i;
+
+	*is_candidate = true;
+	for (i = 0; i < sizeof(array) / sizeof(array[0]); i++) {
+		if (array[i].entry < 0)
+			continue;
+		if (array[i].entry == array[i].data)
+			res += 2;
+		else
+			*is_candidate = false;
+	}
 	return res;
 }
 
-int match_cpu_codename(const struct match_entry_t* matchtable, int count, struct cpu_id_t* data)
+int match_cpu_codename(const struct match_entry_t* matchtable, int count, struct match_index_t* index, struct cpu_id_t* data)
 {
 	int bestscore = -1;
 	int bestindex = 0;
-	int i, t;
+	int i, t, b, pass, key_score, max_score;
+	bool is_candidate;
+	struct brand_matcher_t matcher;
+	const struct match_bucket_t* bucket;
+	const struct match_entry_t* entry;
 
 	debugf(3, "Matching cpu f:%d, m:%d, s:%d, xf:%d, xm:%d, ncore:%d, l2:%d, l3:%d\n",
 		data->x86.family, data->x86.model, data->x86.stepping, data->x86.ext_family,
 		data->x86.ext_model, data->num_cores, data->l2_cache, data->l3_cache);
+	normalize_brand_str(matcher.brand_str, data);
+	matcher.matchtable = matchtable;
+	matcher.index      = NULL;
+	matcher.state      = 0;
 
-	for (i = 0; i < count; i++) {
-		t = score(&matchtable[i], data);
-		debugf(3, "Entry %d, `%s', score %d\n", i, matchtable[i].name, t);
-		if (t > bestscore) {
-			debugf(2, "Entry `%s' selected - best score so far (%d)\n", matchtable[i].name, t);
-			bestscore = t;
-			bestindex = i;
+	if (!match_index_ready(matchtable, count, index)) {
+		for (i = 0; i < count; i++) {
+			t = score_fields(&matchtable[i], data) + score_brand(&matcher, i);
+			debugf(3, "Entry %d, `%s', score %d\n", i, matchtable[i].name, t);
+			if (t > bestscore) {
+				debugf(2, "Entry `%s' selected - best score so far (%d)\n", matchtable[i].name, t);
+				bestscore = t;
+				bestindex = i;
+			}
+		}
+	}
+	else {
+		matcher.index = index;
+		/* The buckets of the CPU are scored first, the others only if they can reach the best score so far.
+		   On a tie, the first entry in the table wins, as when all entries are scored in order. */
+		for (pass = 0; pass < 2; pass++) {
+			for (b = 0; b < index->num_buckets; b++) {
+				bucket    = &index->buckets[b];
+				key_score = bucket_key_score(bucket, data, &is_candidate);
+				if ((is_candidate != (pass == 0)) || (key_score + bucket->max_score < bestscore))
+					continue;
+				for (i = bucket->first; i < bucket->first + bucket->count; i++) {
+					entry = &matchtable[index->entries[i]];
+					/* The brand pattern is only tested if it can make the entry the best one */
+					t = score_fields(entry, data);
+					max_score = t + (has_brand_pattern(entry) ? entry->brand.score : 0);
+					if ((max_score < bestscore) || ((max_score == bestscore) && (index->entries[i] > bestindex)))
+						continue;
+					t += score_brand(&matcher, index->entries[i]);
+					debugf(3, "Entry %d, `%s', score %d\n", index->entries[i], entry->name, t);
+					if ((t > bestscore) || ((t == bestscore) && (index->entries[i] < bestindex))) {
+						debugf(2, "Entry `%s' selected - best score so far (%d)\n", entry->name, t);
+						bestscore = t;
+						bestindex = index->entries[i];
+					}
+				}
+			}
 		}
 	}
 	strncpy(data->cpu_codename,    matchtable[bestindex].name,       CODENAME_STR_MAX);
@@ -147,7 +540,7 @@ void generic_get_cpu_list(const struct match_entry_t* matchtable, int count,
 {
 	int i, j, n, good;
 	n = 0;
-	list->names = (char**) malloc(sizeof(char*) * count);
+	list->names = (char**) cpuid_malloc(sizeof(char*) * count);
 	if (!list->names) { /* Memory allocation failure */
 		cpuid_set_error(ERR_NO_MEM);
 		list->num_entries = 0;
@@ -162,18 +555,14 @@ void generic_get_cpu_list(const struct match_entry_t* matchtable, int count,
 				break;
 			}
 		if (!good) continue;
-#if defined(_MSC_VER)
-		list->names[n] = _strdup(matchtable[i].name);
-#else
-		list->names[n] = strdup(matchtable[i].name);
-#endif
+		list->names[n] = cpuid_strdup(matchtable[i].name);
 		if (!list->names[n]) { /* Memory allocation failure */
 			cpuid_set_error(ERR_NO_MEM);
 			list->num_entries = 0;
 			for (j = 0; j < n; j++) {
-				free(list->names[j]);
+				cpuid_free(list->names[j]);
 			}
-			free(list->names);
+			cpuid_free(list->names);
 			list->names = NULL;
 			return;
 		}
@@ -309,6 +698,28 @@ void clear_affinity_mask_bit(logical_cpu_t logical_cpu, cpu_affinity_mask_t *aff
 	affinity_mask->__bits[logical_cpu / __MASK_NCPUBITS] &= ~(0x1 << (logical_cpu % __MASK_NCPUBITS));
 }
 
+bool read_cpu_list(FILE *f, cpu_affinity_mask_t *affinity_mask)
+{
+	int c;
+	unsigned first, last, cpu;
+	bool has_cpus = false;
+
+	init_affinity_mask(affinity_mask);
+	while (fscanf(f, "%u", &first) == 1) {
+		last = first;
+		if (((c = fgetc(f)) == '-') && (fscanf(f, "%u", &last) == 1))
+			c = fgetc(f);
+		if ((last < first) || (last >= __MASK_SETSIZE * __MASK_NCPUBITS))
+			return false;
+		for (cpu = first; cpu <= last; cpu++)
+			set_affinity_mask_bit((logical_cpu_t) cpu, affinity_mask);
+		has_cpus = true;
+		if (c != ',')
+			break;
+	}
+	return has_cpus;
+}
+
 /* https://github.com/torvalds/linux/blob/3e5c673f0d75bc22b3c26eade87e4db4f374cd34/include/linux/bitops.h#L210-L216 */
 static int get_count_order(unsigned int x)
 {
@@ -381,10 +792,10 @@ void decode_number_of_cores_x86(struct cpu_raw_data_t* raw, struct cpu_id_t* dat
 {
 	int logical_cpus = -1, num_cores = -1;
 
-	if (raw->basic_cpuid[0][EAX] >= 1) {
-		logical_cpus = (raw->basic_cpuid[1][EBX] >> 16) & 0xff;
-		if (raw->basic_cpuid[0][EAX] >= 4) {
-			num_cores = 1 + ((raw->basic_cpuid[4][EAX] >> 26) & 0x3f);
+	if (cpuid_get_raw_leaf(raw, 0, 0)[EAX] >= 1) {
+		logical_cpus = (cpuid_get_raw_leaf(raw, 1, 0)[EBX] >> 16) & 0xff;
+		if (cpuid_get_raw_leaf(raw, 0, 0)[EAX] >= 4) {
+			num_cores = 1 + ((cpuid_get_raw_leaf(raw, 4, 0)[EAX] >> 26) & 0x3f);
 		}
 	}
 	if (data->flags[CPU_FEATURE_HT]) {
@@ -402,18 +813,24 @@ void decode_number_of_cores_x86(struct cpu_raw_data_t* raw, struct cpu_id_t* dat
 	}
 }
 
-void decode_deterministic_cache_info_x86(uint32_t cache_regs[][NUM_REGS],
+bool decode_deterministic_cache_info_x86(const struct cpu_raw_data_t* raw,
+                                         uint32_t leaf,
                                          uint8_t subleaf_count,
                                          struct cpu_id_t* data,
                                          struct internal_id_info_t* internal)
 {
 	uint8_t i;
 	uint32_t cache_level, cache_type, ways, partitions, linesize, sets, size, num_sharing_cache, index_msb;
+	const uint32_t* cache_regs;
 	cache_type_t type;
 
+	/* Raw dumps of old versions only have subleaf 0 (from basic_cpuid[] or ext_cpuid[]), there are at least 2 caches otherwise */
+	if ((EXTRACTS_BITS(cpuid_get_raw_leaf(raw, leaf, 0)[EAX], 4, 0) == 0) || (EXTRACTS_BITS(cpuid_get_raw_leaf(raw, leaf, 1)[EAX], 4, 0) == 0))
+		return false;
 	for (i = 0; i < subleaf_count; i++) {
-		cache_level = EXTRACTS_BITS(cache_regs[i][EAX], 7, 5);
-		cache_type  = EXTRACTS_BITS(cache_regs[i][EAX], 4, 0);
+		cache_regs  = cpuid_get_raw_leaf(raw, leaf, i);
+		cache_level = EXTRACTS_BITS(cache_regs[EAX], 7, 5);
+		cache_type  = EXTRACTS_BITS(cache_regs[EAX], 4, 0);
 		if ((cache_level == 0) || (cache_type == 0))
 			break;
 		if (cache_level == 1 && cache_type == 1)
@@ -431,16 +848,17 @@ void decode_deterministic_cache_info_x86(uint32_t cache_regs[][NUM_REGS],
 			warnf("deterministic_cache: recognize cache type\n");
 			continue;
 		}
-		num_sharing_cache       = EXTRACTS_BITS(cache_regs[i][EAX], 25, 14) + 1;
-		ways                    = EXTRACTS_BITS(cache_regs[i][EBX], 31, 22) + 1;
-		partitions              = EXTRACTS_BITS(cache_regs[i][EBX], 21, 12) + 1;
-		linesize                = EXTRACTS_BITS(cache_regs[i][EBX], 11,  0) + 1;
-		sets                    = EXTRACTS_BITS(cache_regs[i][ECX], 31,  0) + 1;
+		num_sharing_cache       = EXTRACTS_BITS(cache_regs[EAX], 25, 14) + 1;
+		ways                    = EXTRACTS_BITS(cache_regs[EBX], 31, 22) + 1;
+		partitions              = EXTRACTS_BITS(cache_regs[EBX], 21, 12) + 1;
+		linesize                = EXTRACTS_BITS(cache_regs[EBX], 11,  0) + 1;
+		sets                    = EXTRACTS_BITS(cache_regs[ECX], 31,  0) + 1;
 		size                    = ways * partitions * linesize * sets / 1024;
 		index_msb               = get_count_order(num_sharing_cache);
 		internal->cache_mask[i] = ~((1 << index_msb) - 1);
 		assign_cache_data(1, type, size, ways, linesize, data);
 	}
+	return true;
 }
 
 void decode_architecture_version_x86(struct cpu_id_t* data)
@@ -544,3 +962,166 @@ void decode_architecture_version_x86(struct cpu_id_t* data)
 	else
 		debugf(2, "x86 architecture version is %s\n", cpu_feature_level_str(feature_level));
 }
+
+#if defined(_WIN32)
+static DWORD WINAPI parallel_task_entry(LPVOID arg)
+{
+	struct parallel_task_t* task = (struct parallel_task_t*) arg;
+	task->run(task->arg);
+	return 0;
+}
+
+static bool parallel_task_start(struct parallel_task_t* task)
+{
+	task->handle = CreateThread(NULL, 0, parallel_task_entry, task, 0, NULL);
+	return task->handle != NULL;
+}
+
+static void parallel_task_join(struct parallel_task_t* task)
+{
+	WaitForSingleObject(task->handle, INFINITE);
+	CloseHandle(task->handle);
+}
+#elif defined(HAVE_PARALLEL_TASKS)
+static void* parallel_task_entry(void* arg)
+{
+	struct parallel_task_t* task = (struct parallel_task_t*) arg;
+	task->run(task->arg);
+	return NULL;
+}
+
+static bool parallel_task_start(struct parallel_task_t* task)
+{
+	return pthread_create(&task->handle, NULL, parallel_task_entry, task) == 0;
+}
+
+static void parallel_task_join(struct parallel_task_t* task)
+{
+	pthread_join(task->handle, NULL);
+}
+#endif /* HAVE_PARALLEL_TASKS */
+
+int run_parallel_tasks(struct parallel_task_t* tasks, int count)
+{
+	int i, started = 0;
+
+	for (i = 0; i < count; i++) {
+#ifdef HAVE_PARALLEL_TASKS
+		tasks[i].running = parallel_task_start(&tasks[i]);
+		if (tasks[i].running)
+			started++;
+		else
+			debugf(2, "Cannot create thread for task %i, it will run in the calling thread\n", i);
+#else
+		tasks[i].running = false;
+#endif /* HAVE_PARALLEL_TASKS */
+	}
+	for (i = 0; i < count; i++)
+		if (!tasks[i].running)
+			tasks[i].run(tasks[i].arg);
+#ifdef HAVE_PARALLEL_TASKS
+	for (i = 0; i < count; i++)
+		if (tasks[i].running)
+			parallel_task_join(&tasks[i]);
+#endif /* HAVE_PARALLEL_TASKS */
+
+	return started;
+}
+
+static int read_whole_file(FILE* f, struct mapped_file_t* file)
+{
+	size_t capacity = 0, n;
+	char *buffer = NULL, *tmp;
+
+	file->size = 0;
+	do {
+		if (file->size == capacity) {
+			capacity = (capacity == 0) ? 65536 : 2 * capacity;
+			if ((tmp = cpuid_realloc(buffer, capacity)) == NULL) {
+				cpuid_free(buffer);
+				return ERR_NO_MEM;
+			}
+			buffer = tmp;
+		}
+		n = fread(buffer + file->size, 1, capacity - file->size, f);
+		file->size += n;
+	} while (n > 0);
+	file->data      = buffer;
+	file->is_mapped = false;
+	return ERR_OK;
+}
+
+int map_file(const char* filename, struct mapped_file_t* file)
+{
+	int r;
+	FILE *f;
+#ifdef HAVE_MMAP
+	int fd;
+	struct stat st;
+	void* map;
+
+	if (strcmp(filename, "") && ((fd = open(filename, O_RDONLY)) >= 0)) {
+		map = MAP_FAILED;
+		if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0))
+			map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (map != MAP_FAILED) {
+			debugf(3, "Mapped %lld bytes from '%s'\n", (long long) st.st_size, filename);
+			file->data      = map;
+			file->size      = (size_t) st.st_size;
+			file->is_mapped = true;
+			return ERR_OK;
+		}
+	}
+#endif /* HAVE_MMAP */
+
+	f = !strcmp(filename, "") ? stdin : fopen(filename, "rb");
+	if (!f)
+		return ERR_OPEN;
+	r = read_whole_file(f, file);
+	if (f != stdin)
+		fclose(f);
+	return r;
+}
+
+void unmap_file(struct mapped_file_t* file)
+{
+#ifdef HAVE_MMAP
+	if (file->is_mapped) {
+		munmap((void*) file->data, file->size);
+		file->data = NULL;
+		return;
+	}
+#endif /* HAVE_MMAP */
+	cpuid_free((void*) file->data);
+	file->data = NULL;
+}
+
+int write_fd(int fd, const void* data, size_t size)
+{
+#ifdef HAVE_WRITE
+	long n;
+	size_t chunk;
+	const char* p = data;
+
+	while (size > 0) {
+		chunk = (size > 0x40000000) ? 0x40000000 : size;
+		n = (long) write(fd, p, chunk);
+		if (n < 0) {
+# ifdef EINTR
+			if (errno == EINTR)
+				continue;
+# endif /* EINTR */
+			return ERR_OPEN;
+		}
+		p    += n;
+		size -= (size_t) n;
+	}
+	return ERR_OK;
+#else
+	UNUSED(fd);
+	UNUSED(data);
+	UNUSED(size);
+	return ERR_NOT_IMP;
+#endif /* HAVE_WRITE */
+}
@@ -26,7 +26,15 @@
 #ifndef __LIBCPUID_UTIL_H__
 #define __LIBCPUID_UTIL_H__
 
+#include <stdio.h>
 #include "libcpuid_internal.h"
+#if defined(_WIN32)
+# include <windows.h>
+# define HAVE_PARALLEL_TASKS
+#elif defined(__unix__) || defined(__unix) || defined(__APPLE__) || defined(__HAIKU__)
+# include <pthread.h>
+# define HAVE_PARALLEL_TASKS
+#endif
 
 #define COUNT_OF(array) (sizeof(array) / sizeof(array[0]))
 #define UNUSED(x) (void)(x)
@@ -51,9 +59,63 @@ struct match_entry_t {
 	char technology[TECHNOLOGY_STR_MAX];
 };
 
-// returns the match score:
+/*
+ * Index of a codename database by (family, ext_family, ext_model), built on first use.
+ * Each bucket holds the entries with the same values of these fields (-1 included), in table order.
+ */
+struct match_bucket_t {
+	int family, ext_family, ext_model;
+	int max_score; /* best score of its entries, without the fields above */
+	uint16_t first, count;
+};
 
-int match_cpu_codename(const struct match_entry_t* matchtable, int count, struct cpu_id_t* data);
+/*
+ * Brand patterns of a codename database, compiled into a trie of pattern elements (a character,
+ * '.', '#' or '[<chars>]', see match_pattern()). Node 0 is the root, 0 also means "no node".
+ */
+#define MATCH_TRIE_NODES_PER_ENTRY 8
+
+struct match_trie_node_t {
+	uint16_t entry;               /* entry whose brand pattern holds the element of this node */
+	uint8_t offset, length;       /* element in this brand pattern */
+	uint8_t is_end;               /* the brand pattern of an entry ends at this node */
+	uint16_t first_child, next_sibling;
+};
+
+/* The state of an index is updated with the GCC or MSVC atomic builtins, or else with C11 atomics */
+#if !defined(__GNUC__) && !defined(_MSC_VER) && defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && !defined(__STDC_NO_ATOMICS__)
+# include <stdatomic.h>
+# define MATCH_INDEX_C11_ATOMICS
+typedef atomic_int match_index_state_t;
+#else
+typedef int match_index_state_t;
+#endif
+
+struct match_index_t {
+	match_index_state_t state;      /* 0: not built, 1: being built, 2: ready */
+	int num_buckets;
+	struct match_bucket_t* buckets; /* one per entry at most */
+	uint16_t* entries;              /* indices of the entries of each bucket */
+	int num_nodes, max_nodes;
+	struct match_trie_node_t* nodes;
+	uint16_t* end_nodes;            /* node where the brand pattern of each entry ends, 0 if not in the trie */
+};
+
+/*
+ * Defines the static index of a codename database with __count entries, see match_cpu_codename().
+ * Without any of the atomic operations above, the index is never built and every entry is scored.
+ */
+#define DEFINE_MATCH_INDEX(__index, __count) \
+	static struct match_bucket_t __index##_buckets[__count]; \
+	static uint16_t __index##_entries[__count]; \
+	static struct match_trie_node_t __index##_nodes[(__count) * MATCH_TRIE_NODES_PER_ENTRY]; \
+	static uint16_t __index##_end_nodes[__count]; \
+	static struct match_index_t __index = { 0, 0, __index##_buckets, __index##_entries, \
+		0, (__count) * MATCH_TRIE_NODES_PER_ENTRY, __index##_nodes, __index##_end_nodes }
+
+// returns the match score (index is optional, it gives the same result as scoring every entry):
+
+int match_cpu_codename(const struct match_entry_t* matchtable, int count, struct match_index_t* index, struct cpu_id_t* data);
 
 void warnf(const char* format, ...)
 #ifdef __GNUC__
@@ -113,8 +175,31 @@ int cpuid_set_error(cpu_error_t err);
  */
 int cpuid_get_error(void);
 
+/*
+ * Gets an environment variable which replaces a path used to collect or cache the CPUID data.
+ * It is ignored (NULL is returned) in setuid and setgid programs, whose environment is not trusted
+ */
+const char* cpuid_getenv_path(const char* name);
+
 extern libcpuid_warn_fn_t _warn_fun;
 extern int _current_verboselevel;
+extern const struct cpuid_allocator_t _default_allocator;
+extern struct cpuid_allocator_t _allocator;
+
+/*
+ * Allocate and release memory with the allocator set by cpuid_set_allocator()
+ */
+void* cpuid_malloc(size_t size);
+void* cpuid_calloc(size_t count, size_t size);
+void* cpuid_realloc(void* ptr, size_t size);
+void cpuid_free(void* ptr);
+char* cpuid_strdup(const char* str);
+
+/*
+ * Makes room for size more bytes at the end of a cpuid_buffer_t, growing it as needed.
+ * Returns a pointer to buffer->data + buffer->size, or NULL if out of memory
+ */
+char* cpuid_buffer_reserve(struct cpuid_buffer_t* buffer, size_t size);
 
 /*
  * Manage cpu_affinity_mask_t type
@@ -135,14 +220,18 @@ bool get_affinity_mask_bit(logical_cpu_t logical_cpu, cpu_affinity_mask_t *affin
 /* set bit corresponding to 'logical_cpu' to '0' */
 void clear_affinity_mask_bit(logical_cpu_t logical_cpu, cpu_affinity_mask_t *affinity_mask);
 
+/* parse a list of CPUs in the Linux sysfs format (e.g. "0-3,8,10-11") into affinity_mask */
+bool read_cpu_list(FILE *f, cpu_affinity_mask_t *affinity_mask);
+
 /* assign cache values in cpu_id_t type */
 void assign_cache_data(uint8_t on, cache_type_t cache, int size, int assoc, int linesize, struct cpu_id_t* data);
 
 /* generic way to retrieve core count for x86 CPUs */
 void decode_number_of_cores_x86(struct cpu_raw_data_t* raw, struct cpu_id_t* data);
 
-/* generic way to retrieve cache topology for x86 CPUs */
-void decode_deterministic_cache_info_x86(uint32_t cache_regs[][NUM_REGS],
+/* generic way to retrieve cache topology for x86 CPUs, returns false if the caches are not enumerated by the leaf */
+bool decode_deterministic_cache_info_x86(const struct cpu_raw_data_t* raw,
+                                         uint32_t leaf,
                                          uint8_t subleaf_count,
                                          struct cpu_id_t* data,
                                          struct internal_id_info_t* internal);
@@ -150,4 +239,67 @@ void decode_deterministic_cache_info_x86(uint32_t cache_regs[][NUM_REGS],
 /* generic way to get microarchitecture levels for x86 CPUs */
 void decode_architecture_version_x86(struct cpu_id_t* data);
 
+/* get the APIC/MPIDR based topology of a logical CPU (implemented in cpuid_main.c), returns false if not supported */
+bool cpu_ident_id(logical_cpu_t logical_cpu, struct cpu_raw_data_t* raw, struct internal_topology_t* topology);
+
+/*
+ * Minimal threading support, used to spread independent work across CPUs
+ */
+struct parallel_task_t {
+	void (*run)(void* arg);
+	void* arg;
+	bool running;
+#if defined(_WIN32)
+	HANDLE handle;
+#elif defined(HAVE_PARALLEL_TASKS)
+	pthread_t handle;
+#endif
+};
+
+/*
+ * Runs each task on its own thread and waits for all of them.
+ * A task which cannot get a thread runs in the calling thread instead.
+ * Returns the number of tasks which ran on a separate thread.
+ */
+int run_parallel_tasks(struct parallel_task_t* tasks, int count);
+
+/* Little-endian 32-bit integers, used by the binary file formats */
+static inline uint32_t get_le32(const uint8_t* p)
+{
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline void set_le32(uint8_t* p, uint32_t value)
+{
+	p[0] = (uint8_t) value;
+	p[1] = (uint8_t) (value >> 8);
+	p[2] = (uint8_t) (value >> 16);
+	p[3] = (uint8_t) (value >> 24);
+}
+
+/*
+ * A read-only file loaded in memory: it is mapped when the platform supports it,
+ * or read in an allocated buffer otherwise (e.g. for pipes).
+ */
+struct mapped_file_t {
+	const void* data;
+	size_t size;
+	bool is_mapped;
+};
+
+/*
+ * Loads a whole file in memory. If filename is empty, stdin is read.
+ * Returns ERR_OK, ERR_OPEN or ERR_NO_MEM.
+ */
+int map_file(const char* filename, struct mapped_file_t* file);
+
+/* Releases a file loaded by map_file() */
+void unmap_file(struct mapped_file_t* file);
+
+/*
+ * Writes size bytes to a file descriptor, retrying after partial writes.
+ * Returns ERR_OK, ERR_OPEN or ERR_NOT_IMP.
+ */
+int write_fd(int fd, const void* data, size_t size);
+
 #endif /* __LIBCPUID_UTIL_H__ */
@@ -27,79 +27,84 @@
 /* freebsd requires _XOPEN_SOURCE 600 for snprintf()
  * for linux it is enough 500 */
 #define _XOPEN_SOURCE 600
+/* pread() offsets used by the Linux cpuid driver are 64-bit wide */
+#define _FILE_OFFSET_BITS 64
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "libcpuid.h"
 #include "libcpuid_util.h"
 #include "libcpuid_arm_driver.h"
+#include "asm-bits.h"
 #include "rdcpuid.h"
 
-#define CPUID_PATH_LEN 32
+#define CPUID_PATH_LEN 256
 
-#if defined (__linux__) || defined (__gnu_linux__) || defined (__FreeBSD__) || defined (__DragonFly__)
+#if defined (__linux__) || defined (__gnu_linux__) || \
+    ((defined (__FreeBSD__) || defined (__DragonFly__)) && !defined (PLATFORM_X86) && !defined (PLATFORM_X64))
 /* Assuming linux with /dev/cpu/x/cpuid: */
-/* Assuming FreeBSD with /dev/cpuctlX */
+/* Assuming FreeBSD with /dev/cpuidX, created by the libcpuid driver for ARM (drivers/arm/freebsd).
+   It cannot execute CPUID on x86, where the dummy functions below are used. */
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <fcntl.h>
 #include <errno.h>
-struct cpuid_driver_t { int fd; };
-static int load_driver(char *cpuid_path)
+static int get_device_path(char* cpuid_path, const char* device_dir, unsigned core_num)
 {
-	const int file_exists   = !access(cpuid_path, F_OK);
-	const int file_readable = !access(cpuid_path, R_OK);
-
-	if (file_exists && file_readable)
-		return 1;
-	else if (file_exists && !file_readable)
-		return 0;
-	else if (getuid() != 0)
-		return 0;
-	else
 # if defined (__linux__) || defined (__gnu_linux__)
-		return !system("modprobe cpuid 2> /dev/null");
+	const int len = snprintf(cpuid_path, CPUID_PATH_LEN, "%s/%u/cpuid", device_dir ? device_dir : "/dev/cpu", core_num);
 # elif defined (__FreeBSD__) || defined (__DragonFly__)
-		return !system("kldload -n cpuid 2> /dev/null");
+	const int len = snprintf(cpuid_path, CPUID_PATH_LEN, "%s/cpuid%u", device_dir ? device_dir : "/dev", core_num);
 # endif
+	return (len >= 0) && (len < CPUID_PATH_LEN);
 }
 
-struct cpuid_driver_t* cpu_cpuid_driver_open_core(unsigned core_num)
+int cpuid_load_driver(void)
 {
 	char cpuid[CPUID_PATH_LEN];
-	struct cpuid_driver_t* handle;
-	if (core_num >= cpuid_get_total_cpus()) {
-		cpuid_set_error(ERR_INVCNB);
-		return NULL;
-	}
+	/* LIBCPUID_CPUID_DEVICE_DIR allows to use another directory than /dev, for testing purposes */
+	const char* device_dir = cpuid_getenv_path("LIBCPUID_CPUID_DEVICE_DIR");
+
+	if (!get_device_path(cpuid, device_dir, 0))
+		return cpuid_set_error(ERR_NO_DRIVER);
+	if (!access(cpuid, R_OK))
+		return cpuid_set_error(ERR_OK);
+	/* The device exists but is not readable, or the module cannot be loaded there */
+	if (!access(cpuid, F_OK) || (device_dir != NULL))
+		return cpuid_set_error(ERR_NO_DRIVER);
+	if (getuid() != 0)
+		return cpuid_set_error(ERR_NO_PERMS);
 # if defined (__linux__) || defined (__gnu_linux__)
-	snprintf(cpuid, CPUID_PATH_LEN, "/dev/cpu/%u/cpuid", core_num);
+	if (system("modprobe cpuid 2> /dev/null"))
+		return cpuid_set_error(ERR_NO_DRIVER);
 # elif defined (__FreeBSD__) || defined (__DragonFly__)
-	snprintf(cpuid, CPUID_PATH_LEN, "/dev/cpuid%u", core_num);
+	if (system("kldload -n cpuid 2> /dev/null"))
+		return cpuid_set_error(ERR_NO_DRIVER);
 # endif
-	if(!load_driver(cpuid)) {
-		cpuid_set_error(ERR_NO_DRIVER);
-		return NULL;
-	}
+	return cpuid_set_error(access(cpuid, R_OK) ? ERR_NO_DRIVER : ERR_OK);
+}
+
+int cpu_cpuid_driver_open_core(struct cpuid_driver_t* handle, unsigned core_num)
+{
+	char cpuid[CPUID_PATH_LEN];
+	struct stat st;
+	/* LIBCPUID_CPUID_DEVICE_DIR allows to use another directory than /dev, for testing purposes */
+	const char* device_dir = cpuid_getenv_path("LIBCPUID_CPUID_DEVICE_DIR");
+	/* Logical CPU numbers may have holes (offline CPUs) and be above cpuid_get_total_cpus(),
+	   the device of an offline CPU does not exist */
+	if (core_num >= (logical_cpu_t) -1)
+		return cpuid_set_error(ERR_INVCNB);
+	/* The kernel module is not loaded here: see cpuid_load_driver() */
+	if (!get_device_path(cpuid, device_dir, core_num))
+		return cpuid_set_error(ERR_NO_DRIVER);
 	int fd = open(cpuid, O_RDONLY);
-	if (fd < 0) {
-		if (errno == EIO) {
-			cpuid_set_error(ERR_NO_CPUID);
-			return NULL;
-		}
-		cpuid_set_error(ERR_NO_DRIVER);
-		return NULL;
-	}
-	handle = (struct cpuid_driver_t*) malloc(sizeof(struct cpuid_driver_t));
-	if (!handle) {
-		cpuid_set_error(ERR_NO_MEM);
-		close(fd);
-		return NULL;
-	}
+	if (fd < 0)
+		return cpuid_set_error((errno == EIO) ? ERR_NO_CPUID : ERR_NO_DRIVER);
 	handle->fd = fd;
-	return handle;
+	handle->is_regular_file = (fstat(fd, &st) == 0) && S_ISREG(st.st_mode);
+	return 0;
 }
 
 int cpu_read_arm_register_32b(struct cpuid_driver_t* driver, reg_request_t request, uint32_t* result)
@@ -138,26 +143,59 @@ int cpu_read_arm_register_64b(struct cpuid_driver_t* driver, reg_request_t reque
 	return 0;
 }
 
+int cpu_read_x86_cpuid(struct cpuid_driver_t* driver, uint32_t* regs)
+{
+# if defined (__linux__) || defined (__gnu_linux__)
+	/* The Linux cpuid driver executes CPUID on the target CPU, with EAX in the low 32 bits of the file offset and ECX in the high 32 bits */
+	const uint64_t request = ((uint64_t) regs[ECX] << 32) | regs[EAX];
+	ssize_t ret;
+
+	if (!driver || driver->fd < 0)
+		return cpuid_set_error(ERR_HANDLE);
+
+	if (driver->is_regular_file) {
+		/* Regular files cannot overlap the results of consecutive leaves like the driver does:
+		   each result is stored as a 16-byte record, see the documentation of cpuid_get_raw_data_core() */
+		memset(regs, 0, 4 * sizeof(uint32_t));
+		ret = pread(driver->fd, regs, 4 * sizeof(uint32_t), (off_t) (request * 4 * sizeof(uint32_t)));
+		return (ret >= 0) ? 0 : cpuid_set_error(ERR_NO_CPUID);
+	}
+
+	ret = pread(driver->fd, regs, 4 * sizeof(uint32_t), (off_t) request);
+	if (ret != 4 * sizeof(uint32_t))
+		return cpuid_set_error(ERR_NO_CPUID);
+
+	return 0;
+# else
+	UNUSED(driver);
+	UNUSED(regs);
+	return cpuid_set_error(ERR_NOT_IMP);
+# endif
+}
+
 int cpu_cpuid_driver_close(struct cpuid_driver_t* drv)
 {
 	if (drv && drv->fd >= 0) {
 		close(drv->fd);
-		free(drv);
+		drv->fd = -1;
 	}
 	return 0;
 }
 
 #else /* Unsupported OS */
-/* On others OS (i.e., Darwin), we still do not support RDCPUID, so supply dummy struct
-   and functions */
+/* On others OS (i.e., Darwin, or FreeBSD on x86), we still do not support RDCPUID, so supply dummy
+   functions */
 
-struct cpuid_driver_t { int dummy; };
+int cpuid_load_driver(void)
+{
+	return cpuid_set_error(ERR_NOT_IMP);
+}
 
-struct cpuid_driver_t* cpu_cpuid_driver_open_core(unsigned core_num)
+int cpu_cpuid_driver_open_core(struct cpuid_driver_t* handle, unsigned core_num)
 {
+	UNUSED(handle);
 	UNUSED(core_num);
-	cpuid_set_error(ERR_NOT_IMP);
-	return NULL;
+	return cpuid_set_error(ERR_NOT_IMP);
 }
 
 int cpu_read_arm_register_32b(struct cpuid_driver_t* driver, reg_request_t request, uint32_t* result)
@@ -176,6 +214,13 @@ int cpu_read_arm_register_64b(struct cpuid_driver_t* driver, reg_request_t reque
 	return cpuid_set_error(ERR_NOT_IMP);
 }
 
+int cpu_read_x86_cpuid(struct cpuid_driver_t* driver, uint32_t* regs)
+{
+	UNUSED(driver);
+	UNUSED(regs);
+	return cpuid_set_error(ERR_NOT_IMP);
+}
+
 int cpu_cpuid_driver_close(struct cpuid_driver_t* driver)
 {
 	UNUSED(driver);
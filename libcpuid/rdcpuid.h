@@ -26,9 +26,13 @@
 #ifndef __RDCPUID_H__
 #define __RDCPUID_H__
 
-struct cpuid_driver_t* cpu_cpuid_driver_open_core(unsigned core_num);
+/* The handle is provided by the caller, so opening the driver of each logical CPU does not allocate memory */
+struct cpuid_driver_t { int fd; int is_regular_file; };
+
+int cpu_cpuid_driver_open_core(struct cpuid_driver_t* handle, unsigned core_num);
 int cpu_read_arm_register_32b(struct cpuid_driver_t* driver, reg_request_t request, uint32_t* result);
 int cpu_read_arm_register_64b(struct cpuid_driver_t* driver, reg_request_t request, uint64_t* result);
+int cpu_read_x86_cpuid(struct cpuid_driver_t* driver, uint32_t* regs);
 int cpu_cpuid_driver_close(struct cpuid_driver_t* drv);
 
 #endif /* __RDCPUID_H__ */
@@ -93,7 +93,7 @@ struct msr_driver_t* cpu_msr_driver_open_core(unsigned core_num)
 		cpuid_set_error(ERR_NO_DRIVER);
 		return NULL;
 	}
-	handle = (struct msr_driver_t*) malloc(sizeof(struct msr_driver_t));
+	handle = (struct msr_driver_t*) cpuid_malloc(sizeof(struct msr_driver_t));
 	if (!handle) {
 		cpuid_set_error(ERR_NO_MEM);
 		close(fd);
@@ -119,7 +119,7 @@ int cpu_msr_driver_close(struct msr_driver_t* drv)
 {
 	if (drv && drv->fd >= 0) {
 		close(drv->fd);
-		free(drv);
+		cpuid_free(drv);
 	}
 	return 0;
 }
@@ -182,7 +182,7 @@ struct msr_driver_t* cpu_msr_driver_open_core(unsigned core_num)
 		cpuid_set_error(ERR_NO_DRIVER);
 		return NULL;
 	}
-	handle = (struct msr_driver_t*) malloc(sizeof(struct msr_driver_t));
+	handle = (struct msr_driver_t*) cpuid_malloc(sizeof(struct msr_driver_t));
 	if (!handle) {
 		cpuid_set_error(ERR_NO_MEM);
 		return NULL;
@@ -210,7 +210,7 @@ int cpu_msr_driver_close(struct msr_driver_t* drv)
 {
 	if (drv && drv->fd >= 0) {
 		close(drv->fd);
-		free(drv);
+		cpuid_free(drv);
 	}
 	return 0;
 }
@@ -249,7 +249,7 @@ struct msr_driver_t* cpu_msr_driver_open(void)
 		return NULL;
 	}
 
-	drv = (struct msr_driver_t*) malloc(sizeof(struct msr_driver_t));
+	drv = (struct msr_driver_t*) cpuid_malloc(sizeof(struct msr_driver_t));
 	if (!drv) {
 		cpuid_set_error(ERR_NO_MEM);
 		return NULL;
@@ -257,7 +257,7 @@ struct msr_driver_t* cpu_msr_driver_open(void)
 	memset(drv, 0, sizeof(struct msr_driver_t));
 
 	if (!extract_driver(drv)) {
-		free(drv);
+		cpuid_free(drv);
 		cpuid_set_error(ERR_EXTRACT);
 		return NULL;
 	}
@@ -267,7 +267,7 @@ struct msr_driver_t* cpu_msr_driver_open(void)
 		debugf(1, "Deleting temporary driver file failed.\n");
 	if (!status) {
 		cpuid_set_error(drv->errorcode ? drv->errorcode : ERR_NO_DRIVER);
-		free(drv);
+		cpuid_free(drv);
 		return NULL;
 	}
 	return drv;
@@ -360,14 +360,14 @@ static int load_driver(struct msr_driver_t* drv)
 
 					QueryServiceConfig(drv->scDriver, NULL, 0, &dwBytesNeeded);
 					if((dwLastError = GetLastError()) == ERROR_INSUFFICIENT_BUFFER){
-						lpqsc = calloc(1, dwBytesNeeded);
+						lpqsc = cpuid_calloc(1, dwBytesNeeded);
 						if(!QueryServiceConfig(drv->scDriver, lpqsc, dwBytesNeeded, &dwBytesNeeded)){
-							free(lpqsc);
+							cpuid_free(lpqsc);
 							debugf(1, "Error query service config(adjusted buffer): %d\n", GetLastError());
 							goto clean_up;
 						}
 						else{
-							free(lpqsc);
+							cpuid_free(lpqsc);
 						}
 					}
 					else{
@@ -634,6 +634,7 @@ static const uint32_t intel_msr[] = {
 
 struct msr_info_t {
 	int cpu_clock;
+	uint32_t bus_clock_khz; /* advertised by the hypervisor, 0 if unknown */
 	struct msr_driver_t *handle;
 	struct cpu_id_t *id;
 	struct internal_id_info_t *internal;
@@ -1166,7 +1167,9 @@ static double get_info_bus_clock(struct msr_info_t *info)
 	uint32_t addr;
 	uint64_t reg;
 
-	if(msr_platform_info_supported(info)) {
+	if (info->bus_clock_khz > 0)
+		return (double) info->bus_clock_khz / 1000;
+	else if(msr_platform_info_supported(info)) {
 		/* Refer links above
 		Table 35-12.  MSRs in Next Generation Intel Atom Processors Based on the Goldmont Microarchitecture
 		Table 35-13.  MSRs in Processors Based on Intel® Microarchitecture Code Name Nehalem
@@ -1215,6 +1218,7 @@ int cpu_rdmsr_range(struct msr_driver_t* handle, uint32_t msr_index, uint8_t hig
 int cpu_msrinfo(struct msr_driver_t* handle, cpu_msrinfo_request_t which)
 {
 	static int err = 0, init = 0;
+	uint32_t tsc_khz;
 	struct cpu_raw_data_t raw;
 	static struct cpu_id_t id;
 	static struct internal_id_info_t internal;
@@ -1229,7 +1233,12 @@ int cpu_msrinfo(struct msr_driver_t* handle, cpu_msrinfo_request_t which)
 	if (!init) {
 		err  = cpuid_get_raw_data(&raw);
 		err += cpu_ident_internal(&raw, &id, &internal);
-		info.cpu_clock = cpu_clock_measure(250, 1);
+		/* Virtual machines do not need to measure the clock when the hypervisor advertises it */
+		if (!err && get_hypervisor_timing_info(&raw, &tsc_khz, &info.bus_clock_khz))
+			info.cpu_clock = (int) (tsc_khz / 1000);
+		else
+			info.cpu_clock = cpu_clock_measure(250, 1);
+		cpuid_free_raw_data(&raw);
 		info.id = &id;
 		info.internal = &internal;
 		init = 1;
@@ -321,6 +321,33 @@ int cpu_clock_by_ic(int millis, int runs)
 	return max_value;
 }
 
+bool get_hypervisor_timing_info(struct cpu_raw_data_t* raw, uint32_t* tsc_khz, uint32_t* bus_khz)
+{
+	/* The generic timing leaf 0x40000010 was defined by VMware, KVM and QEMU also provide it (e.g. with vmware-cpuid-freq=on)
+	EAX is the (virtual) TSC frequency in kHz, EBX is the (virtual) bus (local APIC timer) frequency in kHz */
+	const uint32_t* max_leaf;
+	const uint32_t* timing_leaf;
+
+	*tsc_khz = *bus_khz = 0;
+	switch (cpuid_get_hypervisor(raw, NULL)) {
+		case HYPERVISOR_KVM:
+		case HYPERVISOR_QEMU:
+		case HYPERVISOR_VMWARE:
+			break;
+		default:
+			return false;
+	}
+	max_leaf    = cpuid_get_raw_leaf(raw, 0x40000000, 0);
+	timing_leaf = cpuid_get_raw_leaf(raw, 0x40000010, 0);
+	if ((max_leaf[EAX] < 0x40000010) || (timing_leaf[EAX] == 0))
+		return false;
+
+	*tsc_khz = timing_leaf[EAX];
+	*bus_khz = timing_leaf[EBX];
+	debugf(1, "Hypervisor timing information: TSC frequency %u kHz, bus frequency %u kHz\n", *tsc_khz, *bus_khz);
+	return true;
+}
+
 int cpu_clock_by_tsc(struct cpu_raw_data_t* raw)
 {
 	/* Documentation:
@@ -328,8 +355,9 @@ int cpu_clock_by_tsc(struct cpu_raw_data_t* raw)
 	 * Combined Volumes: 1, 2A, 2B, 2C, 2D, 3A, 3B, 3C, 3D, and 4
 	 * 20.7.3 Determining the Processor Base Frequency
 	 */
+	int result;
 	uint16_t base_freq_mhz;
-	uint32_t denominator, numerator, nominal_freq_khz;
+	uint32_t denominator, numerator, nominal_freq_khz, tsc_khz, bus_khz;
 	struct cpu_raw_data_t myraw;
 	struct cpu_id_t id;
 
@@ -337,24 +365,31 @@ int cpu_clock_by_tsc(struct cpu_raw_data_t* raw)
 	if (!raw) {
 		if (cpuid_get_raw_data(&myraw) < 0) {
 			warnf("cpu_clock_by_tsc: raw CPUID cannot be obtained\n");
+			cpuid_free_raw_data(&myraw);
 			return -2;
 		}
-		raw = &myraw;
+		result = cpu_clock_by_tsc(&myraw);
+		cpuid_free_raw_data(&myraw);
+		return result;
 	}
 	if (cpu_identify(raw, &id) != ERR_OK) {
 		warnf("cpu_clock_by_tsc: CPU cannot be identified\n");
 		return -2;
 	}
 
+	/* In virtual machines, the hypervisor may advertise the TSC frequency */
+	if (get_hypervisor_timing_info(raw, &tsc_khz, &bus_khz))
+		return (int) (tsc_khz / 1000);
+
 	/* Check if Time Stamp Counter and Nominal Core Crystal Clock Information Leaf is supported */
-	if ((id.vendor != VENDOR_INTEL) || (raw->basic_cpuid[0][EAX] < 0x15)) {
+	if ((id.vendor != VENDOR_INTEL) || (cpuid_get_raw_leaf(raw, 0, 0)[EAX] < 0x15)) {
 		debugf(1, "cpu_clock_by_tsc: Time Stamp Counter and Nominal Core Crystal Clock Information Leaf is not supported\n");
 		return -1;
 	}
 
-	denominator      = raw->basic_cpuid[0x15][EAX]; // Bits 31-00: An unsigned integer which is the denominator of the TSC/”core crystal clock” ratio
-	numerator        = raw->basic_cpuid[0x15][EBX]; // Bits 31-00: An unsigned integer which is the numerator of the TSC/”core crystal clock” ratio
-	nominal_freq_khz = raw->basic_cpuid[0x15][ECX] / 1000; // Bits 31-00: An unsigned integer which is the nominal frequency of the core crystal clock in Hz
+	denominator      = cpuid_get_raw_leaf(raw, 0x15, 0)[EAX]; // Bits 31-00: An unsigned integer which is the denominator of the TSC/”core crystal clock” ratio
+	numerator        = cpuid_get_raw_leaf(raw, 0x15, 0)[EBX]; // Bits 31-00: An unsigned integer which is the numerator of the TSC/”core crystal clock” ratio
+	nominal_freq_khz = cpuid_get_raw_leaf(raw, 0x15, 0)[ECX] / 1000; // Bits 31-00: An unsigned integer which is the nominal frequency of the core crystal clock in Hz
 
 	/* If EBX[31:0] (numerator) is 0, the TSC/”core crystal clock” ratio is not enumerated. */
 	if ((numerator == 0) || (denominator == 0)) {
@@ -393,8 +428,8 @@ int cpu_clock_by_tsc(struct cpu_raw_data_t* raw)
 	Some Intel SoCs like Skylake and Kabylake don't report the crystal
 	clock, but we can easily calculate it to a high degree of accuracy
 	by considering the crystal ratio and the CPU speed. */
-	if ((nominal_freq_khz == 0) && (raw->basic_cpuid[0][EAX] >= 0x16)) {
-		base_freq_mhz    = EXTRACTS_BITS(raw->basic_cpuid[0x16][EAX], 15, 0);
+	if ((nominal_freq_khz == 0) && (cpuid_get_raw_leaf(raw, 0, 0)[EAX] >= 0x16)) {
+		base_freq_mhz    = EXTRACTS_BITS(cpuid_get_raw_leaf(raw, 0x16, 0)[EAX], 15, 0);
 		nominal_freq_khz = base_freq_mhz * 1000 * denominator / numerator;
 		debugf(1, "cpu_clock_by_tsc: no crystal clock frequency detected, using base frequency (%u MHz) to calculate it\n", base_freq_mhz);
 	}
@@ -417,7 +452,16 @@ int cpu_clock_by_tsc(struct cpu_raw_data_t* raw)
 int cpu_clock(void)
 {
 	int result;
+	uint32_t tsc_khz, bus_khz;
+	struct cpu_raw_data_t raw;
+
 	result = cpu_clock_by_os();
+	/* Virtual machines do not need to measure the clock when the hypervisor advertises it */
+	if (result <= 0) {
+		if ((cpuid_get_raw_data(&raw) == ERR_OK) && get_hypervisor_timing_info(&raw, &tsc_khz, &bus_khz))
+			result = (int) (tsc_khz / 1000);
+		cpuid_free_raw_data(&raw);
+	}
 	if (result <= 0)
 		result = cpu_clock_measure(200, 1);
 	return result;
@@ -29,5 +29,8 @@
 void sys_precise_clock(uint64_t *result);
 int busy_loop_delay(int milliseconds);
 
+/* Gets the TSC and bus frequencies (in kHz) advertised by the hypervisor, returns false if they are not available */
+bool get_hypervisor_timing_info(struct cpu_raw_data_t* raw, uint32_t* tsc_khz, uint32_t* bus_khz);
+
 
 #endif /* __RDTSC_H__ */
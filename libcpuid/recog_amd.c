@@ -431,6 +431,7 @@ const struct match_entry_t cpudb_amd[] = {
 	{ 15, -1, -1, 26,  112,  -1,    -1,    -1, { "Ryzen AI MAX",           6 }, "Ryzen AI MAX (Strix Halo)",      "TSMC N4P" },
 //     F   M   S  EF    EM #cores  L2$    L3$  Pattern                          Codename                          Technology
 };
+DEFINE_MATCH_INDEX(cpudb_amd_index, COUNT_OF(cpudb_amd));
 
 
 static void load_amd_features(struct cpu_raw_data_t* raw, struct cpu_id_t* data)
@@ -472,22 +473,22 @@ static void load_amd_features(struct cpu_raw_data_t* raw, struct cpu_id_t* data)
 		{ 11, CPU_FEATURE_PFI },
 		{ 12, CPU_FEATURE_PA },
 	};
-	if (raw->ext_cpuid[0][EAX] >= 0x80000001) {
-		match_features(matchtable_edx81, COUNT_OF(matchtable_edx81), raw->ext_cpuid[1][EDX], data);
-		match_features(matchtable_ecx81, COUNT_OF(matchtable_ecx81), raw->ext_cpuid[1][ECX], data);
+	if (cpuid_get_raw_leaf(raw, 0x80000000, 0)[EAX] >= 0x80000001) {
+		match_features(matchtable_edx81, COUNT_OF(matchtable_edx81), cpuid_get_raw_leaf(raw, 0x80000001, 0)[EDX], data);
+		match_features(matchtable_ecx81, COUNT_OF(matchtable_ecx81), cpuid_get_raw_leaf(raw, 0x80000001, 0)[ECX], data);
 	}
-	if (raw->ext_cpuid[0][EAX] >= 0x80000007)
-		match_features(matchtable_edx87, COUNT_OF(matchtable_edx87), raw->ext_cpuid[7][EDX], data);
-	if (raw->ext_cpuid[0][EAX] >= 0x8000001a) {
+	if (cpuid_get_raw_leaf(raw, 0x80000000, 0)[EAX] >= 0x80000007)
+		match_features(matchtable_edx87, COUNT_OF(matchtable_edx87), cpuid_get_raw_leaf(raw, 0x80000007, 0)[EDX], data);
+	if (cpuid_get_raw_leaf(raw, 0x80000000, 0)[EAX] >= 0x8000001a) {
 		/* We have the extended info about SSE unit size
 		Extracted from BKDG, about CPUID_Fn8000001A_EAX [Performance Optimization Identifiers] (Core::X86::Cpuid::PerfOptId):
 		- bit 2: FP256
 		- bit 1: MOVU
 		- bit 0: FP128 */
 		data->detection_hints[CPU_HINT_SSE_SIZE_AUTH] = 1;
-		if ((raw->ext_cpuid[0x1a][EAX] >> 2) & 1)
+		if ((cpuid_get_raw_leaf(raw, 0x8000001a, 0)[EAX] >> 2) & 1)
 			data->x86.sse_size = 256;
-		else if ((raw->ext_cpuid[0x1a][EAX]) & 1)
+		else if ((cpuid_get_raw_leaf(raw, 0x8000001a, 0)[EAX]) & 1)
 			data->x86.sse_size = 128;
 		else
 			data->x86.sse_size = 64;
@@ -500,31 +501,33 @@ static void decode_amd_cache_info(struct cpu_raw_data_t* raw, struct cpu_id_t* d
 	const int assoc_table[16] = {
 		0, 1, 2, 0, 4, 0, 8, 0, 16, 16, 32, 48, 64, 96, 128, 255
 	};
-	unsigned n = raw->ext_cpuid[0][EAX];
+	unsigned n = cpuid_get_raw_leaf(raw, 0x80000000, 0)[EAX];
+	const uint32_t* fn80000005h = cpuid_get_raw_leaf(raw, 0x80000005, 0);
+	const uint32_t* fn80000006h = cpuid_get_raw_leaf(raw, 0x80000006, 0);
 
 	if (n >= 0x80000005) {
 		/* L1 Data Cache */
-		data->l1_data_cache     = EXTRACTS_BITS(raw->ext_cpuid[5][ECX], 31, 24); // L1DcSize
-		data->l1_data_assoc     = EXTRACTS_BITS(raw->ext_cpuid[5][ECX], 23, 16); // L1DcAssoc
-		data->l1_data_cacheline = EXTRACTS_BITS(raw->ext_cpuid[5][ECX],  7,  0); // L1DcLineSize
+		data->l1_data_cache     = EXTRACTS_BITS(fn80000005h[ECX], 31, 24); // L1DcSize
+		data->l1_data_assoc     = EXTRACTS_BITS(fn80000005h[ECX], 23, 16); // L1DcAssoc
+		data->l1_data_cacheline = EXTRACTS_BITS(fn80000005h[ECX],  7,  0); // L1DcLineSize
 
 		/* L1 Instruction Cache */
-		data->l1_instruction_cache     = EXTRACTS_BITS(raw->ext_cpuid[5][EDX], 31, 24); // L1IcSize
-		data->l1_instruction_assoc     = EXTRACTS_BITS(raw->ext_cpuid[5][EDX], 23, 16); // L1IcAssoc
-		data->l1_instruction_cacheline = EXTRACTS_BITS(raw->ext_cpuid[5][EDX],  7,  0); // L1IcLineSize
+		data->l1_instruction_cache     = EXTRACTS_BITS(fn80000005h[EDX], 31, 24); // L1IcSize
+		data->l1_instruction_assoc     = EXTRACTS_BITS(fn80000005h[EDX], 23, 16); // L1IcAssoc
+		data->l1_instruction_cacheline = EXTRACTS_BITS(fn80000005h[EDX],  7,  0); // L1IcLineSize
 	}
 	if (n >= 0x80000006) {
-		data->l2_cache = (raw->ext_cpuid[6][ECX] >> 16) & 0xffff;
-		data->l2_assoc = assoc_table[(raw->ext_cpuid[6][ECX] >> 12) & 0xf];
-		data->l2_cacheline = (raw->ext_cpuid[6][ECX]) & 0xff;
+		data->l2_cache = (fn80000006h[ECX] >> 16) & 0xffff;
+		data->l2_assoc = assoc_table[(fn80000006h[ECX] >> 12) & 0xf];
+		data->l2_cacheline = (fn80000006h[ECX]) & 0xff;
 
-		l3_result = (raw->ext_cpuid[6][EDX] >> 18);
+		l3_result = (fn80000006h[EDX] >> 18);
 		if (l3_result > 0) {
 			l3_result *= 512; /* AMD spec says it's a range, but we take the lower bound */
-			l3_assoc = (raw->ext_cpuid[6][EDX] >> 12) & 0xf;
+			l3_assoc = (fn80000006h[EDX] >> 12) & 0xf;
 			data->l3_cache = l3_result;
 			data->l3_assoc = assoc_table[l3_assoc];
-			data->l3_cacheline = (raw->ext_cpuid[6][EDX]) & 0xff;
+			data->l3_cacheline = (fn80000006h[EDX]) & 0xff;
 		} else {
 			data->l3_cache = -1;
 		}
@@ -535,21 +538,21 @@ static void decode_amd_number_of_cores(struct cpu_raw_data_t* raw, struct cpu_id
 {
 	int logical_cpus = -1, num_cores = -1;
 
-	if (raw->basic_cpuid[0][EAX] >= 1) {
-		logical_cpus = (raw->basic_cpuid[1][EBX] >> 16) & 0xff;
-		if (raw->ext_cpuid[0][EAX] >= 8) {
-			num_cores = 1 + (raw->ext_cpuid[8][ECX] & 0xff);
+	if (cpuid_get_raw_leaf(raw, 0, 0)[EAX] >= 1) {
+		logical_cpus = (cpuid_get_raw_leaf(raw, 1, 0)[EBX] >> 16) & 0xff;
+		if (cpuid_get_raw_leaf(raw, 0x80000000, 0)[EAX] >= 8) {
+			num_cores = 1 + (cpuid_get_raw_leaf(raw, 0x80000008, 0)[ECX] & 0xff);
 		}
 	}
 	if (data->flags[CPU_FEATURE_HT]) {
 		if (num_cores > 1) {
-			if ((data->x86.ext_family >= 23) && (raw->ext_cpuid[0][EAX] >= 30))
+			if ((data->x86.ext_family >= 23) && (cpuid_get_raw_leaf(raw, 0x80000000, 0)[EAX] >= 30))
 				/* Ryzen 3 has SMT flag, but in fact cores count is equal to threads count.
 				Ryzen 5/7 reports twice as many "real" cores (e.g. 16 cores instead of 8) because of SMT. */
 				/* On PPR 17h, page 82:
 				CPUID_Fn8000001E_EBX [Core Identifiers][15:8] is ThreadsPerCore
 				ThreadsPerCore: [...] The number of threads per core is ThreadsPerCore+1 */
-				num_cores /= ((raw->ext_cpuid[30][EBX] >> 8) & 0xff) + 1;
+				num_cores /= ((cpuid_get_raw_leaf(raw, 0x8000001e, 0)[EBX] >> 8) & 0xff) + 1;
 			data->num_cores = num_cores;
 			data->num_logical_cpus = logical_cpus;
 		} else {
@@ -564,14 +567,13 @@ static void decode_amd_number_of_cores(struct cpu_raw_data_t* raw, struct cpu_id
 int cpuid_identify_amd(struct cpu_raw_data_t* raw, struct cpu_id_t* data, struct internal_id_info_t* internal)
 {
 	load_amd_features(raw, data);
-	if ((EXTRACTS_BIT(raw->ext_cpuid[1][ECX], 22) == 1) && (EXTRACTS_BITS(raw->amd_fn8000001dh[0][EAX], 4, 0) != 0)) /* TopologyExtensions supported */
-		decode_deterministic_cache_info_x86(raw->amd_fn8000001dh, MAX_AMDFN8000001DH_LEVEL, data, internal);
-	else
+	if ((EXTRACTS_BIT(cpuid_get_raw_leaf(raw, 0x80000001, 0)[ECX], 22) == 0) || /* TopologyExtensions not supported */
+	    !decode_deterministic_cache_info_x86(raw, 0x8000001d, MAX_AMDFN8000001DH_LEVEL, data, internal))
 		decode_amd_cache_info(raw, data);
 	decode_amd_number_of_cores(raw, data);
 	decode_architecture_version_x86(data);
 	data->purpose = cpuid_identify_purpose_amd(raw);
-	internal->score = match_cpu_codename(cpudb_amd, COUNT_OF(cpudb_amd), data);
+	internal->score = match_cpu_codename(cpudb_amd, COUNT_OF(cpudb_amd), &cpudb_amd_index, data);
 
 	return 0;
 }
@@ -584,9 +586,10 @@ void cpuid_get_list_amd(struct cpu_list_t* list)
 cpu_purpose_t cpuid_identify_purpose_amd(struct cpu_raw_data_t* raw)
 {
 	int i;
+	const uint32_t* fn80000026h;
 
 	/* Check if Extended CPU Topology is supported */
-	if (raw->amd_fn80000026h[0][EAX] == 0x0)
+	if (cpuid_get_raw_leaf(raw, 0x80000026, 0)[EAX] == 0x0)
 		return PURPOSE_GENERAL;
 
 	/* Check for heterogeneous cores
@@ -602,10 +605,13 @@ cpu_purpose_t cpuid_identify_purpose_amd(struct cpu_raw_data_t* raw)
 	- CPUID_Fn80000026_EBX [Extended CPU Topology][31:28] is CoreType.
 	  Only valid while LevelType=Core.
 	*/
-	for (i = 0; (raw->amd_fn80000026h[i][EBX] != 0x0) && (raw->amd_fn80000026h[i][ECX] != 0x0) && (i < MAX_AMDFN80000026H_LEVEL); i++) {
-		if ((EXTRACTS_BIT(raw->amd_fn80000026h[i][EAX], 30) == 0x1) && (EXTRACTS_BITS(raw->amd_fn80000026h[i][ECX], 15, 8) == 0x1)) {
+	for (i = 0; i < MAX_AMDFN80000026H_LEVEL; i++) {
+		fn80000026h = cpuid_get_raw_leaf(raw, 0x80000026, i);
+		if ((fn80000026h[EBX] == 0x0) || (fn80000026h[ECX] == 0x0))
+			break;
+		if ((EXTRACTS_BIT(fn80000026h[EAX], 30) == 0x1) && (EXTRACTS_BITS(fn80000026h[ECX], 15, 8) == 0x1)) {
 			debugf(3, "Detected AMD CPU with heterogeneous cores\n");
-			switch (EXTRACTS_BITS(raw->amd_fn80000026h[i][EBX], 31, 28)) {
+			switch (EXTRACTS_BITS(fn80000026h[EBX], 31, 28)) {
 				case 0x0: return PURPOSE_PERFORMANCE;
 				case 0x1: return PURPOSE_EFFICIENCY;
 				default:  return PURPOSE_GENERAL;
@@ -2811,7 +2811,7 @@ void cpuid_get_list_arm(cpu_vendor_t vendor, struct cpu_list_t* list)
 
 	/* Grow current list */
 	n = list->num_entries;
-	tmp_names = (char**) realloc(list->names, sizeof(char*) * total_count);
+	tmp_names = (char**) cpuid_realloc(list->names, sizeof(char*) * total_count);
 	if (!tmp_names) { /* Memory allocation failure */
 		cpuid_set_error(ERR_NO_MEM);
 		return;
@@ -2828,18 +2828,14 @@ void cpuid_get_list_arm(cpu_vendor_t vendor, struct cpu_list_t* list)
 				break;
 			}
 		if (!good) continue;
-#if defined(_MSC_VER)
-		list->names[n] = _strdup(hw_impl->parts[i].name);
-#else
-		list->names[n] = strdup(hw_impl->parts[i].name);
-#endif
+		list->names[n] = cpuid_strdup(hw_impl->parts[i].name);
 		if (!list->names[n]) { /* Memory allocation failure */
 			cpuid_set_error(ERR_NO_MEM);
 			list->num_entries = 0;
 			for (j = 0; j < n; j++) {
-				free(list->names[j]);
+				cpuid_free(list->names[j]);
 			}
-			free(list->names);
+			cpuid_free(list->names);
 			list->names = NULL;
 			return;
 		}
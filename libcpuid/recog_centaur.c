@@ -84,14 +84,15 @@ const struct match_entry_t cpudb_centaur[] = {
 	{  7, -1, -1, -1,   91,  -1,    -1,    -1, { "ZHAOXIN KaiXian KX-7###",    8 }, "Zhaoxin KaiXian (Yongfeng)",    "16 nm"  }, // KX (7000)
 //     F   M   S  EF    EM #cores  L2$    L3$  Pattern                              Codename                         Technology
 };
+DEFINE_MATCH_INDEX(cpudb_centaur_index, COUNT_OF(cpudb_centaur));
 
 int cpuid_identify_centaur(struct cpu_raw_data_t* raw, struct cpu_id_t* data, struct internal_id_info_t* internal)
 {
-	if (raw->basic_cpuid[0][EAX] >= 4)
-		decode_deterministic_cache_info_x86(raw->intel_fn4, MAX_INTELFN4_LEVEL, data, internal);
+	if (cpuid_get_raw_leaf(raw, 0, 0)[EAX] >= 4)
+		decode_deterministic_cache_info_x86(raw, 0x4, MAX_INTELFN4_LEVEL, data, internal);
 	decode_number_of_cores_x86(raw, data);
 	decode_architecture_version_x86(data);
-	internal->score = match_cpu_codename(cpudb_centaur, COUNT_OF(cpudb_centaur), data);
+	internal->score = match_cpu_codename(cpudb_centaur, COUNT_OF(cpudb_centaur), &cpudb_centaur_index, data);
 
 	return 0;
 }
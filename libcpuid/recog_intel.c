@@ -642,6 +642,7 @@ const struct match_entry_t cpudb_intel[] = {
 	{  7, -1, -1, -1, -1,   1,    -1,    -1, { "",  0 }, "Itanium",   UNKN_STR },
 	{ 15, -1, -1, 16, -1,   1,    -1,    -1, { "",  0 }, "Itanium 2", UNKN_STR },
 };
+DEFINE_MATCH_INDEX(cpudb_intel_index, COUNT_OF(cpudb_intel));
 
 
 static void load_intel_features(struct cpu_raw_data_t* raw, struct cpu_id_t* data)
@@ -681,16 +682,16 @@ static void load_intel_features(struct cpu_raw_data_t* raw, struct cpu_id_t* dat
 		/* id 28 to 31 are handled in common */
 	};
 
-	if (raw->basic_cpuid[0][EAX] >= 1) {
-		match_features(matchtable_edx1, COUNT_OF(matchtable_edx1), raw->basic_cpuid[1][EDX], data);
-		match_features(matchtable_ecx1, COUNT_OF(matchtable_ecx1), raw->basic_cpuid[1][ECX], data);
+	if (cpuid_get_raw_leaf(raw, 0, 0)[EAX] >= 1) {
+		match_features(matchtable_edx1, COUNT_OF(matchtable_edx1), cpuid_get_raw_leaf(raw, 1, 0)[EDX], data);
+		match_features(matchtable_ecx1, COUNT_OF(matchtable_ecx1), cpuid_get_raw_leaf(raw, 1, 0)[ECX], data);
 	}
-	if (raw->ext_cpuid[0][EAX] >= 1) {
-		match_features(matchtable_edx81, COUNT_OF(matchtable_edx81), raw->ext_cpuid[1][EDX], data);
+	if (cpuid_get_raw_leaf(raw, 0x80000000, 0)[EAX] >= 1) {
+		match_features(matchtable_edx81, COUNT_OF(matchtable_edx81), cpuid_get_raw_leaf(raw, 0x80000001, 0)[EDX], data);
 	}
 	// detect TSX/AVX512:
-	if (raw->basic_cpuid[0][EAX] >= 7) {
-		match_features(matchtable_ebx7, COUNT_OF(matchtable_ebx7), raw->basic_cpuid[7][EBX], data);
+	if (cpuid_get_raw_leaf(raw, 0, 0)[EAX] >= 7) {
+		match_features(matchtable_ebx7, COUNT_OF(matchtable_ebx7), cpuid_get_raw_leaf(raw, 7, 0)[EBX], data);
 	}
 }
 
@@ -700,7 +701,7 @@ static void decode_intel_oldstyle_cache_info(struct cpu_raw_data_t* raw, struct
 	int reg, off;
 	uint32_t x;
 	for (reg = 0; reg < 4; reg++) {
-		x = raw->basic_cpuid[2][reg];
+		x = cpuid_get_raw_leaf(raw, 2, 0)[reg];
 		if (x & 0x80000000) continue;
 		for (off = 0; off < 4; off++) {
 			f[x & 0xff] = 1;
@@ -794,15 +795,19 @@ static void decode_intel_oldstyle_cache_info(struct cpu_raw_data_t* raw, struct
 static int decode_intel_extended_topology(struct cpu_raw_data_t* raw, struct cpu_id_t* data)
 {
 	int i, level_type, num_smt = -1, num_core = -1;
+	const uint32_t* fn11;
 
-	for (i = 0; (i < MAX_INTELFN11_LEVEL) && (raw->intel_fn11[i][EAX] != 0x0) && (raw->intel_fn11[i][EBX] != 0x0); i++) {
-		level_type = EXTRACTS_BITS(raw->intel_fn11[i][ECX], 15, 8);
+	for (i = 0; i < MAX_INTELFN11_LEVEL; i++) {
+		fn11 = cpuid_get_raw_leaf(raw, 0xb, i);
+		if ((fn11[EAX] == 0x0) || (fn11[EBX] == 0x0))
+			break;
+		level_type = EXTRACTS_BITS(fn11[ECX], 15, 8);
 		switch (level_type) {
 			case 0x01:
-				num_smt = EXTRACTS_BITS(raw->intel_fn11[i][EBX], 15, 0);
+				num_smt = EXTRACTS_BITS(fn11[EBX], 15, 0);
 				break;
 			case 0x02:
-				num_core = EXTRACTS_BITS(raw->intel_fn11[i][EBX], 15, 0);
+				num_core = EXTRACTS_BITS(fn11[EBX], 15, 0);
 				break;
 			default:
 				break;
@@ -822,22 +827,24 @@ static void decode_intel_sgx_features(const struct cpu_raw_data_t* raw, struct c
 {
 	struct cpu_epc_t epc;
 	int i;
+	const uint32_t* fn12h_0 = cpuid_get_raw_leaf(raw, 0x12, 0);
+	const uint32_t* fn12h_1 = cpuid_get_raw_leaf(raw, 0x12, 1);
 
-	if (raw->basic_cpuid[0][EAX] < 0x12) return; // no 12h leaf
-	if (raw->basic_cpuid[0x12][EAX] == 0) return; // no sub-leafs available, probably it's disabled by BIOS
+	if (cpuid_get_raw_leaf(raw, 0, 0)[EAX] < 0x12) return; // no 12h leaf
+	if (fn12h_0[EAX] == 0) return; // no sub-leafs available, probably it's disabled by BIOS
 
 	// decode sub-leaf 0:
-	if (raw->basic_cpuid[0x12][EAX] & 1) data->x86.sgx.flags[INTEL_SGX1] = 1;
-	if (raw->basic_cpuid[0x12][EAX] & 2) data->x86.sgx.flags[INTEL_SGX2] = 1;
+	if (fn12h_0[EAX] & 1) data->x86.sgx.flags[INTEL_SGX1] = 1;
+	if (fn12h_0[EAX] & 2) data->x86.sgx.flags[INTEL_SGX2] = 1;
 	if (data->x86.sgx.flags[INTEL_SGX1] || data->x86.sgx.flags[INTEL_SGX2])
 		data->x86.sgx.present = 1;
-	data->x86.sgx.misc_select = raw->basic_cpuid[0x12][EBX];
-	data->x86.sgx.max_enclave_32bit = (raw->basic_cpuid[0x12][EDX]     ) & 0xff;
-	data->x86.sgx.max_enclave_64bit = (raw->basic_cpuid[0x12][EDX] >> 8) & 0xff;
+	data->x86.sgx.misc_select = fn12h_0[EBX];
+	data->x86.sgx.max_enclave_32bit = (fn12h_0[EDX]     ) & 0xff;
+	data->x86.sgx.max_enclave_64bit = (fn12h_0[EDX] >> 8) & 0xff;
 
 	// decode sub-leaf 1:
-	data->x86.sgx.secs_attributes = raw->intel_fn12h[1][EAX] | (((uint64_t) raw->intel_fn12h[1][EBX]) << 32);
-	data->x86.sgx.secs_xfrm       = raw->intel_fn12h[1][ECX] | (((uint64_t) raw->intel_fn12h[1][EDX]) << 32);
+	data->x86.sgx.secs_attributes = fn12h_1[EAX] | (((uint64_t) fn12h_1[EBX]) << 32);
+	data->x86.sgx.secs_xfrm       = fn12h_1[ECX] | (((uint64_t) fn12h_1[EDX]) << 32);
 
 	// decode higher-order subleafs, whenever present:
 	data->x86.sgx.num_epc_sections = -1;
@@ -859,9 +866,9 @@ struct cpu_epc_t cpuid_get_epc(int index, const struct cpu_raw_data_t* raw)
 {
 	uint32_t regs[4];
 	struct cpu_epc_t retval = {0, 0};
-	if (raw && index < MAX_INTELFN12H_LEVEL - 2) {
-		// this was queried already, use the data:
-		memcpy(regs, raw->intel_fn12h[2 + index], sizeof(regs));
+	if (raw) {
+		// this was queried already, use the data (missing subleafs read as zeros):
+		memcpy(regs, cpuid_get_raw_leaf(raw, 0x12, 2 + index), sizeof(regs));
 	} else {
 		// query this ourselves:
 		regs[0] = 0x12;
@@ -883,17 +890,17 @@ struct cpu_epc_t cpuid_get_epc(int index, const struct cpu_raw_data_t* raw)
 int cpuid_identify_intel(struct cpu_raw_data_t* raw, struct cpu_id_t* data, struct internal_id_info_t* internal)
 {
 	load_intel_features(raw, data);
-	if (raw->basic_cpuid[0][EAX] >= 4) {
+	if (cpuid_get_raw_leaf(raw, 0, 0)[EAX] >= 4) {
 		/* Deterministic way is preferred, being more generic */
-		decode_deterministic_cache_info_x86(raw->intel_fn4, MAX_INTELFN4_LEVEL, data, internal);
-	} else if (raw->basic_cpuid[0][EAX] >= 2) {
+		decode_deterministic_cache_info_x86(raw, 0x4, MAX_INTELFN4_LEVEL, data, internal);
+	} else if (cpuid_get_raw_leaf(raw, 0, 0)[EAX] >= 2) {
 		decode_intel_oldstyle_cache_info(raw, data);
 	}
-	if ((raw->basic_cpuid[0][EAX] < 11) || (decode_intel_extended_topology(raw, data) == 0))
+	if ((cpuid_get_raw_leaf(raw, 0, 0)[EAX] < 11) || (decode_intel_extended_topology(raw, data) == 0))
 		decode_number_of_cores_x86(raw, data);
 	decode_architecture_version_x86(data);
 	data->purpose = cpuid_identify_purpose_intel(raw);
-	internal->score = match_cpu_codename(cpudb_intel, COUNT_OF(cpudb_intel), data);
+	internal->score = match_cpu_codename(cpudb_intel, COUNT_OF(cpudb_intel), &cpudb_intel_index, data);
 
 	if (data->flags[CPU_FEATURE_SGX]) {
 		debugf(2, "SGX seems to be present, decoding...\n");
@@ -921,15 +928,15 @@ cpu_purpose_t cpuid_identify_purpose_intel(struct cpu_raw_data_t* raw)
 	- CPUID[1Ah] is Hybrid Information Enumeration Leaf (EAX = 1AH, ECX = 0)
 	  EAX, bits 31-24: Core type
 	*/
-	if (EXTRACTS_BIT(raw->basic_cpuid[0x7][EDX], 15) == 0x1) {
+	if (EXTRACTS_BIT(cpuid_get_raw_leaf(raw, 0x7, 0)[EDX], 15) == 0x1) {
 		debugf(3, "Detected Intel CPU hybrid architecture\n");
-		switch (EXTRACTS_BITS(raw->basic_cpuid[0x1a][EAX], 31, 24)) {
+		switch (EXTRACTS_BITS(cpuid_get_raw_leaf(raw, 0x1a, 0)[EAX], 31, 24)) {
 			case 0x20: /* Atom */
 				/* Acccording to Ramyer M. from Intel, LP E-Cores do not have a L3 cache
 				   https://community.intel.com/t5/Processors/Detecting-LP-E-Cores-on-Meteor-Lake-in-software/m-p/1584555/highlight/true#M70732
 				   If sub-leaf 3 is set, it is an E-Cores.
 				*/
-				return (EXTRACTS_BITS(raw->intel_fn4[3][EAX], 31, 0)) ? PURPOSE_EFFICIENCY : PURPOSE_LP_EFFICIENCY;
+				return (EXTRACTS_BITS(cpuid_get_raw_leaf(raw, 4, 3)[EAX], 31, 0)) ? PURPOSE_EFFICIENCY : PURPOSE_LP_EFFICIENCY;
 			case 0x40: /* Core */
 				return PURPOSE_PERFORMANCE;
 			default:
@@ -15,6 +15,8 @@ class CPURawData:
     """
 
     def __init__(self, c_cpu_raw_data):
+        # The table of leaves is released with c_cpu_raw_data when it is owned
+        # (see the class methods), or with the CPURawDataArray it belongs to.
         self._c_cpu_raw_data = c_cpu_raw_data
 
     @property
@@ -32,7 +34,7 @@ class CPURawData:
         c_cpu_raw_data = ffi.new("struct cpu_raw_data_t *")
         if lib.cpuid_get_raw_data(c_cpu_raw_data) != 0:
             raise CLibraryError
-        return cls(c_cpu_raw_data)
+        return cls(ffi.gc(c_cpu_raw_data, lib.cpuid_free_raw_data))
 
     @classmethod
     def from_cpu_core(cls, logical_cpu: int):
@@ -40,7 +42,7 @@ class CPURawData:
         c_cpu_raw_data = ffi.new("struct cpu_raw_data_t *")
         if lib.cpuid_get_raw_data_core(c_cpu_raw_data, logical_cpu) != 0:
             raise CLibraryError
-        return cls(c_cpu_raw_data)
+        return cls(ffi.gc(c_cpu_raw_data, lib.cpuid_free_raw_data))
 
     @classmethod
     def from_file(cls, filename: str):
@@ -48,7 +50,7 @@ class CPURawData:
         c_cpu_raw_data = ffi.new("struct cpu_raw_data_t *")
         if lib.cpuid_deserialize_raw_data(c_cpu_raw_data, filename.encode()) != 0:
             raise CLibraryError
-        return cls(c_cpu_raw_data)
+        return cls(ffi.gc(c_cpu_raw_data, lib.cpuid_free_raw_data))
 
 
 class CPURawDataArray:
@@ -0,0 +1,185 @@
+/* Checks the number of memory allocations made by libcpuid, with an allocator set by cpuid_set_allocator() which counts them.
+cpuid_get_all_raw_data() allocates the raw data array once, and the table of leaves of each logical CPU once (the first one may
+grow a few times). cpu_identify_all() allocates per CPU type (not per logical CPU), plus the growth of its table of core and
+cache IDs, which is logarithmic. All the allocated memory must be released.
+The identification of many logical CPUs is checked on a synthetic system: the current logical CPU repeated, with its own APIC ID.
+
+Usage: run_alloc_tests
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libcpuid.h"
+
+#define SYNTHETIC_CPUS 4096
+#define LEAVES_GROWTH  4 /* reallocations of the table of leaves of the first logical CPU: 16, 32, 64... leaves */
+
+struct alloc_stats_t {
+	int count; /* allocations, including each realloc() */
+	int live;  /* blocks which are not released */
+};
+
+static struct alloc_stats_t stats;
+
+static void* counting_malloc(size_t size, void* user_data)
+{
+	void* ptr = malloc(size);
+
+	(void) user_data;
+	if (ptr != NULL) {
+		stats.count++;
+		stats.live++;
+	}
+	return ptr;
+}
+
+static void* counting_realloc(void* ptr, size_t size, void* user_data)
+{
+	void* new_ptr = realloc(ptr, size);
+
+	(void) user_data;
+	if (new_ptr != NULL) {
+		stats.count++;
+		if (ptr == NULL)
+			stats.live++;
+	}
+	return new_ptr;
+}
+
+static void counting_free(void* ptr, void* user_data)
+{
+	(void) user_data;
+	if (ptr != NULL)
+		stats.live--;
+	free(ptr);
+}
+
+/* Allocations of the table of core and cache IDs in cpu_identify_all(): it has 256 inline slots, it doubles when 3/4 full,
+   and it holds up to 11 IDs per logical CPU (its core, and its 5 cache levels for its CPU type and for the system) */
+static int id_table_allocs(logical_cpu_t num_cpus)
+{
+	int allocs = 0;
+	uint64_t num_slots;
+
+	for (num_slots = 256; 4 * 11 * (uint64_t) num_cpus > 3 * num_slots; num_slots *= 2)
+		allocs++;
+	return allocs;
+}
+
+static const char* test_collect_and_identify(void)
+{
+	int max_count;
+	const char* error = NULL;
+	struct cpu_raw_data_array_t raw_array;
+	struct system_id_t system;
+
+	stats.count = 0;
+	if (cpuid_get_all_raw_data(&raw_array) < 0)
+		return cpuid_error();
+	if (cpu_identify_all(&raw_array, &system) < 0) {
+		cpuid_free_raw_data_array(&raw_array);
+		return cpuid_error();
+	}
+	max_count = 2 + LEAVES_GROWTH + raw_array.num_raw + 2 * system.num_cpu_types + id_table_allocs(raw_array.num_raw);
+	if (stats.count > max_count)
+		error = "too many allocations";
+	cpuid_free_raw_data_array(&raw_array);
+	cpuid_free_system_id(&system);
+	return error;
+}
+
+static const char* test_identify_synthetic(void)
+{
+	int i, subleaf, max_count;
+	const char* error = NULL;
+	struct cpu_raw_data_t raw;
+	struct cpu_raw_data_array_t synthetic;
+	struct system_id_t system;
+	uint32_t regs[NUM_REGS];
+
+	if (cpuid_get_raw_data(&raw) < 0)
+		return cpuid_error();
+	synthetic.with_affinity = true;
+	synthetic.num_raw       = SYNTHETIC_CPUS;
+	if ((synthetic.raw = calloc(SYNTHETIC_CPUS, sizeof(struct cpu_raw_data_t))) == NULL) {
+		cpuid_free_raw_data(&raw);
+		return "cannot allocate the synthetic system";
+	}
+	for (i = 0; (i < SYNTHETIC_CPUS) && (error == NULL); i++) {
+		if (cpuid_copy_raw_data(&synthetic.raw[i], &raw) < 0) {
+			error = cpuid_error();
+			break;
+		}
+		synthetic.raw[i].os_cpu = (logical_cpu_t) i;
+		memcpy(regs, cpuid_get_raw_leaf(&raw, 1, 0), sizeof(regs));
+		regs[EBX] = (regs[EBX] & 0x00ffffff) | ((uint32_t) (i & 0xff) << 24);
+		cpuid_set_raw_leaf(&synthetic.raw[i], 1, 0, regs);
+		/* Leaf 0Bh: one package, 2 threads per core, and the x2APIC ID of the logical CPU */
+		if (cpuid_get_raw_leaf(&raw, 0, 0)[EAX] >= 0xb)
+			for (subleaf = 0; subleaf < 4; subleaf++) {
+				memset(regs, 0, sizeof(regs));
+				if (subleaf < 2) {
+					regs[EAX] = (subleaf == 0) ? 1 : 12;
+					regs[EBX] = (subleaf == 0) ? 2 : SYNTHETIC_CPUS;
+					regs[ECX] = (subleaf == 0) ? 0x100 : 0x201;
+					regs[EDX] = (uint32_t) i;
+				}
+				if (cpuid_set_raw_leaf(&synthetic.raw[i], 0xb, (uint32_t) subleaf, regs) < 0)
+					error = cpuid_error();
+			}
+	}
+	cpuid_free_raw_data(&raw);
+
+	stats.count = 0;
+	if (error == NULL) {
+		if (cpu_identify_all(&synthetic, &system) < 0)
+			error = cpuid_error();
+		else {
+			max_count = 2 * system.num_cpu_types + id_table_allocs(SYNTHETIC_CPUS);
+			if (stats.count > max_count)
+				error = "too many allocations";
+			cpuid_free_system_id(&system);
+		}
+	}
+	/* The array is allocated by the test, the tables of leaves by libcpuid */
+	for (i = 0; i < SYNTHETIC_CPUS; i++)
+		cpuid_free_raw_data(&synthetic.raw[i]);
+	free(synthetic.raw);
+	return error;
+}
+
+static const struct {
+	const char* name;
+	const char* (*run)(void);
+} tests[] = {
+	{ "collect and identify", test_collect_and_identify },
+	{ "identify a synthetic system", test_identify_synthetic },
+};
+#define NUM_TESTS ((int) (sizeof(tests) / sizeof(tests[0])))
+
+int main(void)
+{
+	int i, errors = 0;
+	const char* result;
+	const struct cpuid_allocator_t counting = { counting_malloc, counting_realloc, counting_free, NULL };
+
+	if (!cpuid_present()) {
+		printf("0 tests passed, 0 failed, %d skipped\n", NUM_TESTS);
+		return 0;
+	}
+	cpuid_set_allocator(&counting);
+	for (i = 0; i < NUM_TESTS; i++) {
+		result = tests[i].run();
+		if ((result == NULL) && (stats.live != 0))
+			result = "the allocated memory is not released";
+		if (result != NULL) {
+			errors++;
+			printf("Test [%s]: %s (%d allocations)\n", tests[i].name, result, stats.count);
+		}
+		stats.live = 0;
+	}
+	cpuid_set_allocator(NULL);
+
+	printf("%d tests passed, %d failed, 0 skipped\n", NUM_TESTS - errors, errors);
+	return (errors > 0) ? 1 : 0;
+}
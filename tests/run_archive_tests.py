@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+
+# Checks the raw data archives: the raw data of all tests is packed by 'cpuid_tool' in an archive
+# with '--pack' (in two passes and in reverse order, so the archive is appended to and sorted),
+# unpacked with '--unpack', and the raw data of each unpacked dump must be identical to the original one.
+
+import argparse, lzma, os, subprocess, sys, tempfile
+from pathlib import Path
+
+
+### Constants:
+os.environ["LIBCPUID_NO_WARN"] = "1"
+delimiter = "-" * 80
+
+
+### Functions:
+def read_test_file(test_file):
+	lines = []
+	with (lzma.open(test_file, "rt") if test_file.suffix == ".xz" else open(test_file, "rt")) as f:
+		for line in f.read().splitlines():
+			if line == delimiter:
+				break
+			lines.append(line)
+	return lines
+
+def run(binary, *options, cwd=None, check=True):
+	return subprocess.run([binary, *options], check=check, cwd=cwd, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+
+
+### Main
+parser = argparse.ArgumentParser(description="Test the raw data archives.")
+parser.add_argument("cpuid_tool", type=Path, help="path to the cpuid_tool binary")
+parser.add_argument("tests", nargs="+", type=Path, help="test files or directories containing test files")
+args = parser.parse_args()
+cpuid_tool = args.cpuid_tool.resolve()
+
+test_files = []
+for path in args.tests:
+	test_files += sorted(path.rglob("*.test*")) if path.is_dir() else [path]
+
+errors = skipped = 0
+with tempfile.TemporaryDirectory(prefix="libcpuid-archive-") as tmp_dir:
+	packed_dir, unpacked_dir, archive = Path(tmp_dir, "packed"), Path(tmp_dir, "unpacked"), Path(tmp_dir, "tests.cpar")
+	keys = []
+	for i, test_file in enumerate(test_files):
+		try:
+			lines = read_test_file(test_file)
+		except lzma.LZMAError:
+			# Not fetched from Git LFS
+			skipped += 1
+			continue
+		keys.append(f"{i // 100}/{test_file.name.removesuffix('.xz')}.{i}")
+		Path(packed_dir, keys[-1]).parent.mkdir(parents=True, exist_ok=True)
+		Path(packed_dir, keys[-1]).write_text("\n".join(lines) + "\n")
+
+	keys.reverse()
+	middle = len(keys) // 2
+	run(cpuid_tool, f"--pack={archive}", *keys[:middle], cwd=packed_dir)
+	run(cpuid_tool, f"--pack={archive}", *keys[middle:], cwd=packed_dir)
+	if keys and run(cpuid_tool, f"--pack={archive}", keys[0], cwd=packed_dir, check=False).returncode == 0:
+		errors += 1
+		print("A raw dump was added twice to the archive")
+
+	unpacked_dir.mkdir()
+	run(cpuid_tool, f"--unpack={archive}", cwd=unpacked_dir)
+	for key in keys:
+		unpacked_dump = Path(unpacked_dir, key)
+		if not unpacked_dump.exists():
+			result = "the raw dump was not unpacked"
+		elif run(cpuid_tool, f"--load={Path(packed_dir, key)}", "--save=-").stdout != run(cpuid_tool, f"--load={unpacked_dump}", "--save=-").stdout:
+			result = "the raw data unpacked from the archive is different"
+		else:
+			continue
+		errors += 1
+		print(f"Test [{key}]: {result}")
+
+print(f"{len(test_files) - errors - skipped} tests passed, {errors} failed, {skipped} skipped")
+sys.exit(1 if errors > 0 else 0)
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+
+# Checks the binary raw dump format: for each test, its raw data is loaded by 'cpuid_tool',
+# written in the binary format with '--save --binary', and loaded back. The raw data and the
+# decoded CPU report must be identical to the ones from the text dump.
+# With '--format=delta', the same is done for delta text dumps ('--save --delta').
+
+import argparse, lzma, os, subprocess, sys, tempfile
+from pathlib import Path
+
+
+### Constants:
+os.environ["LIBCPUID_NO_WARN"] = "1"
+delimiter = "-" * 80
+
+
+### Functions:
+def read_test_file(test_file):
+	lines = []
+	with (lzma.open(test_file, "rt") if test_file.suffix == ".xz" else open(test_file, "rt")) as f:
+		for line in f.read().splitlines():
+			if line == delimiter:
+				break
+			lines.append(line)
+	return lines
+
+def run(binary, *options):
+	return subprocess.run([binary, *options], check=True, stdout=subprocess.PIPE).stdout
+
+def do_test(binary, test_file, save_format):
+	try:
+		lines = read_test_file(test_file)
+	except lzma.LZMAError:
+		# Not fetched from Git LFS
+		return None
+	with tempfile.TemporaryDirectory(prefix="libcpuid-binary-") as tmp_dir:
+		text_dump, saved_dump = Path(tmp_dir, "raw.txt"), Path(tmp_dir, f"raw.{save_format}")
+		text_dump.write_text("\n".join(lines) + "\n")
+		full_dump = run(binary, f"--load={text_dump}", "--save=-")
+		run(binary, f"--load={text_dump}", f"--save={saved_dump}", f"--{save_format}")
+		if save_format == "binary":
+			if saved_dump.read_bytes()[:8] != b"\x7fLCPUID\x1a":
+				return "the binary raw dump has no magic"
+			reference = text_dump
+		else:
+			if saved_dump.stat().st_size > len(full_dump):
+				return "the delta raw dump is larger than the full one"
+			# A text dump without logical CPU headers is written with them, this changes the affinity of the CPUs
+			reference = Path(tmp_dir, "full.txt")
+			reference.write_bytes(full_dump)
+		if full_dump != run(binary, f"--load={saved_dump}", "--save=-"):
+			return f"the raw data loaded from the {save_format} raw dump is different"
+		if run(binary, f"--load={reference}", "--report") != run(binary, f"--load={saved_dump}", "--report"):
+			return f"the report from the {save_format} raw dump is different"
+	return "OK"
+
+
+### Main
+parser = argparse.ArgumentParser(description="Test the binary (or delta) raw dump format.")
+parser.add_argument("cpuid_tool", type=Path, help="path to the cpuid_tool binary")
+parser.add_argument("tests", nargs="+", type=Path, help="test files or directories containing test files")
+parser.add_argument("--format", choices=["binary", "delta"], default="binary", help="raw dump format to test")
+args = parser.parse_args()
+
+test_files = []
+for path in args.tests:
+	test_files += sorted(path.rglob("*.test*")) if path.is_dir() else [path]
+
+errors = skipped = 0
+for test_file in test_files:
+	result = do_test(args.cpuid_tool, test_file, args.format)
+	if result is None:
+		skipped += 1
+	elif result != "OK":
+		errors += 1
+		print(f"Test [{test_file}]: {result}")
+
+print(f"{len(test_files) - errors - skipped} tests passed, {errors} failed, {skipped} skipped")
+sys.exit(1 if errors > 0 else 0)
@@ -0,0 +1,471 @@
+/* Checks the identification cache of cpu_identify_all_cached() in a temporary directory (LIBCPUID_CACHE_DIR).
+The online logical CPUs and the microcode revision are read from a fake /sys/devices/system/cpu
+(LIBCPUID_SYSFS_CPU_DIR, like in run_device_tests.py), so the cache key can be changed, and the cpuid
+kernel driver is not used (LIBCPUID_CPUID_DEVICE_DIR is an empty directory).
+A cache file which is used keeps its inode, a cache file which is (re)written gets a new one.
+The shared memory snapshots are published under a name unique to this process. When the CPUIDD environment
+variable gives the path of the cpuidd daemon, it is run with that name too.
+
+Usage: run_cache_tests
+*/
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "libcpuid.h"
+
+#define NUM_WRITERS      8
+#define RESTRICTED_CPU   8191 /* an online logical CPU which does not exist, so it is not usable */
+#define DAEMON_TIMEOUT   10   /* seconds */
+
+static char tmp_dir[]        = "/tmp/libcpuid-cache-XXXXXX";
+static char sysfs_dir[64], device_dir[64], cache_file[128], snapshot_name[64];
+static int first_cpu;
+static struct cpu_raw_data_array_t reference;
+static struct system_id_t system_reference;
+
+static int write_file(const char* path, const char* content)
+{
+	FILE* f;
+
+	if ((f = fopen(path, "w")) == NULL)
+		return 0;
+	fputs(content, f);
+	return fclose(f) == 0;
+}
+
+/* Writes the fake sysfs files read by the cache key: the online logical CPUs, and the microcode revision of the first one */
+static int set_sysfs(const char* online, const char* microcode)
+{
+	char path[256], content[64];
+
+	snprintf(path, sizeof(path), "%s/online", sysfs_dir);
+	snprintf(content, sizeof(content), "%s\n", online);
+	if (!write_file(path, content))
+		return 0;
+	snprintf(path, sizeof(path), "%s/cpu%d", sysfs_dir, first_cpu);
+	mkdir(path, 0755);
+	strcat(path, "/microcode");
+	mkdir(path, 0755);
+	strcat(path, "/version");
+	snprintf(content, sizeof(content), "%s\n", microcode);
+	return write_file(path, content);
+}
+
+/* Returns the inode of the cache file, 0 if it does not exist */
+static ino_t cache_inode(void)
+{
+	struct stat st;
+
+	return (stat(cache_file, &st) == 0) ? st.st_ino : 0;
+}
+
+/* Returns true if the raw data are the same as the reference: the fixed part, and the content of the tables of leaves */
+static int same_raw_data(const struct cpu_raw_data_t* raw, logical_cpu_t num_raw)
+{
+	logical_cpu_t i;
+
+	if (num_raw != reference.num_raw)
+		return 0;
+	for (i = 0; i < num_raw; i++)
+		if (memcmp(&raw[i], &reference.raw[i], offsetof(struct cpu_raw_data_t, max_leaves)) ||
+		    ((raw[i].num_leaves > 0) && memcmp(raw[i].leaves, reference.raw[i].leaves, raw[i].num_leaves * sizeof(struct cpu_raw_leaf_t))))
+			return 0;
+	return 1;
+}
+
+/* Calls cpu_identify_all_cached() and compares its result with the reference, returns an error message or NULL */
+static const char* identify_cached(void)
+{
+	const char* error = NULL;
+	struct cpu_raw_data_array_t raw_array;
+	struct system_id_t system;
+
+	if (cpu_identify_all_cached(&raw_array, &system, NULL) < 0)
+		return cpuid_error();
+	if (!same_raw_data(raw_array.raw, raw_array.num_raw))
+		error = "the raw data are not the same as cpuid_get_all_raw_data()";
+	else if ((system.num_cpu_types != system_reference.num_cpu_types) ||
+	         memcmp(system.cpu_types, system_reference.cpu_types, system.num_cpu_types * sizeof(struct cpu_id_t)))
+		error = "the identification is not the same as cpu_identify_all()";
+	cpuid_free_raw_data_array(&raw_array);
+	cpuid_free_system_id(&system);
+	return error;
+}
+
+/* Checks that the cache file is valid: it is used without being written again */
+static const char* check_cache_used(void)
+{
+	const char* error;
+	const ino_t inode = cache_inode();
+
+	if (inode == 0)
+		return "the cache file is not written";
+	if ((error = identify_cached()) != NULL)
+		return error;
+	return (cache_inode() == inode) ? NULL : "the cache file is written again instead of being used";
+}
+
+/* Checks that the cache file is replaced, and then used */
+static const char* check_cache_replaced(void)
+{
+	const char* error;
+	const ino_t inode = cache_inode();
+
+	if ((error = identify_cached()) != NULL)
+		return error;
+	if (cache_inode() == inode)
+		return "the cache file is not replaced";
+	return check_cache_used();
+}
+
+static const char* test_store_and_load(void)
+{
+	const char* error;
+
+	unlink(cache_file);
+	if ((error = identify_cached()) != NULL)
+		return error;
+	return check_cache_used();
+}
+
+static const char* test_outdated_key(void)
+{
+	const char* error = NULL;
+	char online[16];
+
+	snprintf(online, sizeof(online), "%d", first_cpu);
+	if (!set_sysfs(online, "0x2"))
+		return "cannot write the fake sysfs files";
+	error = check_cache_replaced();
+	set_sysfs(online, "0x1");
+	return error ? error : check_cache_replaced();
+}
+
+static const char* test_truncated(void)
+{
+	struct stat st;
+
+	if ((stat(cache_file, &st) < 0) || (truncate(cache_file, st.st_size / 2) < 0))
+		return "cannot truncate the cache file";
+	return check_cache_replaced();
+}
+
+static const char* test_corrupted(void)
+{
+	int fd;
+	char byte;
+	struct stat st;
+
+	/* The last byte belongs to the payload, which is covered by the checksum */
+	if ((stat(cache_file, &st) < 0) || ((fd = open(cache_file, O_RDWR)) < 0))
+		return "cannot open the cache file";
+	if ((pread(fd, &byte, 1, st.st_size - 1) != 1) || ((byte ^= 0x5a), pwrite(fd, &byte, 1, st.st_size - 1) != 1)) {
+		close(fd);
+		return "cannot corrupt the cache file";
+	}
+	close(fd);
+	return check_cache_replaced();
+}
+
+static const char* test_other_owner(void)
+{
+	const char* error;
+	struct stat st;
+
+	/* Only root can give a file to another user, root trusts the files of root only */
+	if (geteuid() != 0)
+		return "";
+	if (chown(cache_file, 1, 1) < 0)
+		return "cannot change the owner of the cache file";
+	if ((error = check_cache_replaced()) != NULL)
+		return error;
+	return ((stat(cache_file, &st) == 0) && (st.st_uid == geteuid())) ? NULL : "the cache file of another user is not replaced";
+}
+
+static const char* test_concurrent_writers(void)
+{
+	int i, status, failures = 0;
+	pid_t pids[NUM_WRITERS];
+	DIR* dir;
+	struct dirent* entry;
+
+	unlink(cache_file);
+	for (i = 0; i < NUM_WRITERS; i++) {
+		if ((pids[i] = fork()) == 0)
+			_exit(identify_cached() == NULL ? 0 : 1);
+		if (pids[i] < 0)
+			return "cannot create the writer processes";
+	}
+	for (i = 0; i < NUM_WRITERS; i++)
+		if ((waitpid(pids[i], &status, 0) < 0) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+			failures++;
+	if (failures > 0)
+		return "a writer process did not get the right identification";
+	/* The temporary files are renamed or removed */
+	if ((dir = opendir(tmp_dir)) == NULL)
+		return "cannot list the cache directory";
+	while ((entry = readdir(dir)) != NULL)
+		if (!strncmp(entry->d_name, "libcpuid.cache.", 15))
+			failures++;
+	closedir(dir);
+	if (failures > 0)
+		return "temporary cache files are left";
+	return check_cache_used();
+}
+
+static const char* test_restricted(void)
+{
+	const char* error = NULL;
+	char online[32];
+	struct cpu_raw_data_array_t raw_array;
+	struct system_id_t system;
+
+	if (sysconf(_SC_NPROCESSORS_CONF) > RESTRICTED_CPU)
+		return "";
+	unlink(cache_file);
+	snprintf(online, sizeof(online), "%d,%d", first_cpu, RESTRICTED_CPU);
+	if (!set_sysfs(online, "0x1"))
+		return "cannot write the fake sysfs files";
+	if (cpu_identify_all_cached(&raw_array, &system, NULL) < 0)
+		error = cpuid_error();
+	else {
+		if (raw_array.num_raw != 1)
+			error = "the logical CPU which cannot be used is collected";
+		else if (cache_inode() != 0)
+			error = "the partial identification is stored in the cache";
+		cpuid_free_raw_data_array(&raw_array);
+		cpuid_free_system_id(&system);
+	}
+	snprintf(online, sizeof(online), "%d", first_cpu);
+	set_sysfs(online, "0x1");
+	return error;
+}
+
+/* Compares the snapshot with the reference, returns an error message or NULL */
+static const char* compare_snapshot(const struct cpu_snapshot_t* snapshot)
+{
+	if (!same_raw_data(snapshot->raw, snapshot->num_raw))
+		return "the raw data of the snapshot are not the same as cpuid_get_all_raw_data()";
+	if ((snapshot->system.num_cpu_types != system_reference.num_cpu_types) ||
+	    memcmp(snapshot->system.cpu_types, system_reference.cpu_types, system_reference.num_cpu_types * sizeof(struct cpu_id_t)))
+		return "the identification of the snapshot is not the same as cpu_identify_all()";
+	return NULL;
+}
+
+/* Calls cpuid_attach_shared_snapshot() and checks where the snapshot comes from, returns an error message or NULL */
+static const char* attach_snapshot(bool is_shared)
+{
+	const char* error;
+	struct cpu_snapshot_t snapshot;
+
+	if (cpuid_attach_shared_snapshot(&snapshot, snapshot_name) < 0)
+		return cpuid_error();
+	if ((error = compare_snapshot(&snapshot)) == NULL) {
+		if (is_shared && !snapshot.is_shared)
+			error = "the published snapshot is not attached";
+		else if (!is_shared && snapshot.is_shared)
+			error = "an invalid snapshot is attached instead of identifying the system";
+	}
+	cpuid_detach_shared_snapshot(&snapshot);
+	return error;
+}
+
+static const char* test_snapshot_published(void)
+{
+	if (cpuid_publish_shared_snapshot(snapshot_name) < 0)
+		return cpuid_error();
+	return attach_snapshot(true);
+}
+
+static const char* test_snapshot_outdated(void)
+{
+	const char* error;
+	char online[16];
+
+	snprintf(online, sizeof(online), "%d", first_cpu);
+	if (!set_sysfs(online, "0x2"))
+		return "cannot write the fake sysfs files";
+	error = attach_snapshot(false);
+	set_sysfs(online, "0x1");
+	return error ? error : attach_snapshot(true);
+}
+
+static const char* test_snapshot_corrupted(void)
+{
+	int fd;
+	uint8_t* map;
+	struct stat st;
+
+	if ((fd = shm_open(snapshot_name, O_RDWR, 0)) < 0)
+		return "cannot open the snapshot";
+	if ((fstat(fd, &st) < 0) || ((map = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)) {
+		close(fd);
+		return "cannot map the snapshot";
+	}
+	close(fd);
+	/* The last byte belongs to the payload, which is covered by the checksum */
+	map[st.st_size - 1] ^= 0x5a;
+	munmap(map, (size_t) st.st_size);
+	return attach_snapshot(false);
+}
+
+static const char* test_snapshot_restricted(void)
+{
+	int r;
+	char online[32];
+
+	if (sysconf(_SC_NPROCESSORS_CONF) > RESTRICTED_CPU)
+		return "";
+	snprintf(online, sizeof(online), "%d,%d", first_cpu, RESTRICTED_CPU);
+	if (!set_sysfs(online, "0x1"))
+		return "cannot write the fake sysfs files";
+	r = cpuid_publish_shared_snapshot(snapshot_name);
+	snprintf(online, sizeof(online), "%d", first_cpu);
+	set_sysfs(online, "0x1");
+	return (r == ERR_REQUEST) ? NULL : "a partial identification is published";
+}
+
+static const char* test_snapshot_unpublished(void)
+{
+	if ((cpuid_publish_shared_snapshot(snapshot_name) < 0) || (cpuid_unpublish_shared_snapshot(snapshot_name) < 0))
+		return cpuid_error();
+	if (cpuid_unpublish_shared_snapshot(snapshot_name) != ERR_OPEN)
+		return "a snapshot which is not published can be removed";
+	return attach_snapshot(false);
+}
+
+/* Waits until the snapshot is published, returns false after DAEMON_TIMEOUT seconds */
+static bool wait_snapshot(void)
+{
+	int i;
+
+	for (i = 0; i < DAEMON_TIMEOUT * 10; i++) {
+		if (attach_snapshot(true) == NULL)
+			return true;
+		usleep(100000);
+	}
+	return false;
+}
+
+static const char* test_daemon(void)
+{
+	int status;
+	pid_t pid;
+	char online[16];
+	const char* error = NULL;
+	const char* cpuidd = getenv("CPUIDD");
+
+	if ((cpuidd == NULL) || (cpuidd[0] == '\0'))
+		return "";
+	if ((pid = fork()) == 0) {
+		execl(cpuidd, cpuidd, snapshot_name, "1", (char*) NULL);
+		_exit(127);
+	}
+	if (pid < 0)
+		return "cannot run the daemon";
+	snprintf(online, sizeof(online), "%d", first_cpu);
+	if (!wait_snapshot())
+		error = "the daemon does not publish the snapshot";
+	/* A new microcode revision makes the snapshot outdated, the daemon publishes it again */
+	else if (!set_sysfs(online, "0x2"))
+		error = "cannot write the fake sysfs files";
+	else if (!wait_snapshot())
+		error = "the daemon does not publish the outdated snapshot again";
+	kill(pid, SIGTERM);
+	if ((waitpid(pid, &status, 0) < 0) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+		error = error ? error : "the daemon does not exit successfully";
+	else if (!error && (shm_open(snapshot_name, O_RDONLY, 0) >= 0))
+		error = "the daemon does not remove the snapshot when it exits";
+	set_sysfs(online, "0x1");
+	return error;
+}
+
+static void remove_tmp_dir(void)
+{
+	char path[256];
+
+	snprintf(path, sizeof(path), "rm -rf '%s'", tmp_dir);
+	if (system(path) != 0)
+		fprintf(stderr, "Cannot remove %s\n", tmp_dir);
+}
+
+static const struct {
+	const char* name;
+	const char* (*run)(void);
+} tests[] = {
+	{ "store and load", test_store_and_load },
+	{ "outdated key", test_outdated_key },
+	{ "truncated file", test_truncated },
+	{ "corrupted file", test_corrupted },
+	{ "file of another user", test_other_owner },
+	{ "concurrent writers", test_concurrent_writers },
+	{ "restricted logical CPUs", test_restricted },
+	{ "published snapshot", test_snapshot_published },
+	{ "outdated snapshot", test_snapshot_outdated },
+	{ "corrupted snapshot", test_snapshot_corrupted },
+	{ "snapshot of restricted logical CPUs", test_snapshot_restricted },
+	{ "unpublished snapshot", test_snapshot_unpublished },
+	{ "daemon", test_daemon },
+};
+#define NUM_TESTS ((int) (sizeof(tests) / sizeof(tests[0])))
+
+int main(void)
+{
+	int i, errors = 0, skipped = 0;
+	const char* result;
+	char online[16];
+	cpu_set_t affinity;
+
+	if (access("/proc/sys/kernel/random/boot_id", R_OK) || (sched_getaffinity(0, sizeof(affinity), &affinity) < 0)) {
+		printf("0 tests passed, 0 failed, %d skipped\n", NUM_TESTS);
+		return 0;
+	}
+	for (first_cpu = 0; !CPU_ISSET(first_cpu, &affinity); first_cpu++);
+	if (mkdtemp(tmp_dir) == NULL) {
+		perror(tmp_dir);
+		return 1;
+	}
+	snprintf(sysfs_dir, sizeof(sysfs_dir), "%s/sys", tmp_dir);
+	snprintf(device_dir, sizeof(device_dir), "%s/dev", tmp_dir);
+	snprintf(cache_file, sizeof(cache_file), "%s/libcpuid.cache", tmp_dir);
+	snprintf(snapshot_name, sizeof(snapshot_name), "/libcpuid-test-%ld", (long) getpid());
+	snprintf(online, sizeof(online), "%d", first_cpu);
+	mkdir(sysfs_dir, 0755);
+	mkdir(device_dir, 0755);
+	setenv("LIBCPUID_CACHE_DIR", tmp_dir, 1);
+	setenv("LIBCPUID_SYSFS_CPU_DIR", sysfs_dir, 1);
+	setenv("LIBCPUID_CPUID_DEVICE_DIR", device_dir, 1);
+	setenv("LIBCPUID_NO_WARN", "1", 1);
+	if (!set_sysfs(online, "0x1") || (cpuid_get_all_raw_data(&reference) < 0) || (cpu_identify_all(&reference, &system_reference) < 0)) {
+		printf("Cannot identify the system: %s\n", cpuid_error());
+		remove_tmp_dir();
+		return 1;
+	}
+
+	for (i = 0; i < NUM_TESTS; i++) {
+		result = tests[i].run();
+		if ((result != NULL) && (result[0] == '\0'))
+			skipped++;
+		else if (result != NULL) {
+			errors++;
+			printf("Test [%s]: %s\n", tests[i].name, result);
+		}
+	}
+
+	cpuid_unpublish_shared_snapshot(snapshot_name);
+	cpuid_free_raw_data_array(&reference);
+	cpuid_free_system_id(&system_reference);
+	remove_tmp_dir();
+	printf("%d tests passed, %d failed, %d skipped\n", NUM_TESTS - errors - skipped, errors, skipped);
+	return (errors > 0) ? 1 : 0;
+}
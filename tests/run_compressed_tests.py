@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+
+# Checks the compressed raw dumps: for each test, its raw data is compressed with xz, gzip (with CRLF
+# line endings) and zstd (if the zstd command is available), and loaded by 'cpuid_tool'. The raw data
+# must be identical to the one loaded from the plain text dump. A format which 'cpuid_tool' is built
+# without is skipped.
+
+import argparse, gzip, lzma, os, shutil, subprocess, sys, tempfile
+from pathlib import Path
+
+
+### Constants:
+os.environ["LIBCPUID_NO_WARN"] = "1"
+delimiter = "-" * 80
+
+
+### Functions:
+def read_test_file(test_file):
+	lines = []
+	with (lzma.open(test_file, "rt") if test_file.suffix == ".xz" else open(test_file, "rt")) as f:
+		for line in f.read().splitlines():
+			if line == delimiter:
+				break
+			lines.append(line)
+	return lines
+
+def compress_xz(lines):
+	return lzma.compress(("\n".join(lines) + "\n").encode())
+
+def compress_gzip(lines):
+	return gzip.compress(("\r\n".join(lines) + "\r\n").encode())
+
+def compress_zstd(lines):
+	return subprocess.run(["zstd", "-q", "-c"], input=("\n".join(lines) + "\n").encode(), check=True, stdout=subprocess.PIPE).stdout
+
+def load(binary, dump):
+	return subprocess.run([binary, f"--load={dump}", "--save=-"], stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+
+def do_test(binary, test_file, formats, unsupported):
+	try:
+		lines = read_test_file(test_file)
+	except lzma.LZMAError:
+		# Not fetched from Git LFS
+		return None
+	with tempfile.TemporaryDirectory(prefix="libcpuid-compressed-") as tmp_dir:
+		text_dump = Path(tmp_dir, "raw.txt")
+		text_dump.write_text("\n".join(lines) + "\n")
+		expected = load(binary, text_dump).stdout
+		for name, compress in formats.items():
+			if name in unsupported:
+				continue
+			compressed_dump = Path(tmp_dir, f"raw.{name}")
+			compressed_dump.write_bytes(compress(lines))
+			result = load(binary, compressed_dump)
+			if b"Not implemented" in result.stderr:
+				unsupported.add(name)
+			elif result.returncode != 0:
+				return f"the {name} raw dump cannot be loaded: {result.stderr.decode().strip()}"
+			elif result.stdout != expected:
+				return f"the raw data loaded from the {name} raw dump is different"
+	return "OK"
+
+
+### Main
+parser = argparse.ArgumentParser(description="Test the compressed raw dumps.")
+parser.add_argument("cpuid_tool", type=Path, help="path to the cpuid_tool binary")
+parser.add_argument("tests", nargs="+", type=Path, help="test files or directories containing test files")
+args = parser.parse_args()
+
+formats = { "xz": compress_xz, "gz": compress_gzip }
+if shutil.which("zstd"):
+	formats["zst"] = compress_zstd
+
+test_files = []
+for path in args.tests:
+	test_files += sorted(path.rglob("*.test*")) if path.is_dir() else [path]
+
+errors = skipped = 0
+unsupported = set()
+for test_file in test_files:
+	result = do_test(args.cpuid_tool, test_file, formats, unsupported)
+	if result is None:
+		skipped += 1
+	elif result != "OK":
+		errors += 1
+		print(f"Test [{test_file}]: {result}")
+
+for name in sorted(unsupported):
+	print(f"The {name} format is not supported by {args.cpuid_tool}, it is not tested")
+print(f"{len(test_files) - errors - skipped} tests passed, {errors} failed, {skipped} skipped")
+sys.exit(1 if errors > 0 else 0)
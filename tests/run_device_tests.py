@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+
+# Checks the raw data collection through the cpuid kernel driver (/dev/cpu/N/cpuid on Linux x86):
+# for each test, fake device files are generated from its raw data, then 'cpuid_tool --save'
+# must write back the same raw data.
+# Then, a fake /sys/devices/system/cpu/online with holes checks that all the online logical CPUs
+# are collected, with their OS number.
+
+import argparse, os, platform, re, struct, subprocess, sys, tempfile
+from pathlib import Path
+
+
+### Constants:
+os.environ["LIBCPUID_NO_WARN"] = "1"
+cpu_header = re.compile(r"^_________________ Logical CPU #(\d+) _________________$")
+os_cpu_line = re.compile(r"^os_cpu=(\d+)$")
+raw_line = re.compile(r"^(\w+)\[(\d+)\]=([0-9a-f]{8}) ([0-9a-f]{8}) ([0-9a-f]{8}) ([0-9a-f]{8})$")
+sparse_line = re.compile(r"^sparse_cpuid\[([0-9a-f]{8})\]\[(\d+)\]=([0-9a-f]{8}) ([0-9a-f]{8}) ([0-9a-f]{8}) ([0-9a-f]{8})$")
+leaves = {
+	# name in the raw dump: (leaf, is index a subleaf)
+	"basic_cpuid":     (0x00000000, False),
+	"ext_cpuid":       (0x80000000, False),
+	"intel_fn4":       (0x00000004, True),
+	"intel_fn11":      (0x0000000b, True),
+	"intel_fn12h":     (0x00000012, True),
+	"intel_fn14h":     (0x00000014, True),
+	"amd_fn8000001dh": (0x8000001d, True),
+	"amd_fn80000026h": (0x80000026, True),
+}
+
+
+### Functions:
+def split_logical_cpus(lines):
+	cpus = {}
+	current = 0
+	for line in lines:
+		if (match := cpu_header.match(line)) is not None:
+			current = int(match.group(1))
+		elif (match := os_cpu_line.match(line)) is not None:
+			cpus.setdefault(current, {})[("os_cpu", 0)] = int(match.group(1))
+		elif (match := raw_line.match(line)) is not None:
+			name, index, *regs = match.groups()
+			cpus.setdefault(current, {})[(name, int(index))] = regs
+		elif (match := sparse_line.match(line)) is not None:
+			leaf, subleaf, *regs = match.groups()
+			cpus.setdefault(current, {})[("sparse_cpuid", (int(leaf, 16), int(subleaf)))] = regs
+	return cpus
+
+def read_test_file(test_file):
+	lines = []
+	with open(test_file, "rt") as f:
+		for line in f.read().splitlines():
+			if line == "-" * 80:
+				break
+			lines.append(line)
+	return lines
+
+def write_device(device_dir, logical_cpu, registers):
+	values = {}
+	for (name, index), regs in registers.items():
+		if name == "sparse_cpuid":
+			key = index
+		elif name in leaves:
+			leaf, is_subleaf = leaves[name]
+			key = (leaf, index) if is_subleaf else (leaf + index, 0)
+		else:
+			continue
+		data = struct.pack("<4I", *[int(reg, 16) for reg in regs])
+		if values.setdefault(key, data) != data:
+			# Inconsistent dump (e.g. basic_cpuid[4] differs from intel_fn4[0])
+			return False
+	if not values:
+		return False
+	device = Path(device_dir, str(logical_cpu), "cpuid")
+	device.parent.mkdir(parents=True)
+	with open(device, "wb") as f:
+		# A regular file stores each result as a 16-byte record (see cpuid_get_raw_data_core()),
+		# so the file is sparse and leaves which are not in the dump read as zero
+		for (leaf, subleaf), data in values.items():
+			f.seek(((subleaf << 32) | leaf) * 16)
+			f.write(data)
+	return True
+
+def reg(registers, name, index, reg_index):
+	return int(registers.get((name, index), ["0"] * 4)[reg_index], 16)
+
+def is_collected(registers, name, index):
+	"""Returns True if the library executes CPUID for this entry (see cpuid_get_raw_data_x86())"""
+	max_basic = reg(registers, "basic_cpuid", 0, 0)
+	max_ext   = reg(registers, "ext_cpuid", 0, 0)
+	previous  = lambda reg_index, mask: (index == 0) or (reg(registers, name, index - 1, reg_index) & mask) != 0
+	rules = {
+		"basic_cpuid":     lambda: index <= max_basic,
+		"ext_cpuid":       lambda: index == 0 or 0x80000000 + index <= max_ext,
+		"intel_fn4":       lambda: max_basic >= 0x4 and previous(0, 0x1f),
+		"intel_fn11":      lambda: max_basic >= 0xb and previous(2, 0xff00),
+		"intel_fn12h":     lambda: max_basic >= 0x12 and (index <= 2 or previous(0, 0xf)),
+		"intel_fn14h":     lambda: max_basic >= 0x14 and index <= reg(registers, name, 0, 0),
+		"amd_fn8000001dh": lambda: max_ext >= 0x8000001d and previous(0, 0x1f),
+		"amd_fn80000026h": lambda: max_ext >= 0x80000026 and previous(2, 0xff00),
+	}
+	if name in rules:
+		return rules[name]()
+	return True
+
+def do_test(binary, test_file):
+	# Only dumps in the libcpuid format are used, as they map directly to device reads
+	expected = split_logical_cpus(read_test_file(test_file))
+	if not expected:
+		return None
+	env = dict(os.environ)
+	with tempfile.TemporaryDirectory(prefix="libcpuid-dev-cpu-") as device_dir:
+		for logical_cpu, registers in expected.items():
+			if not write_device(device_dir, logical_cpu, registers):
+				return None
+		env["LIBCPUID_CPUID_DEVICE_DIR"] = device_dir
+		with tempfile.NamedTemporaryFile("rt", suffix=".txt") as f:
+			subprocess.run([binary, f"--save={f.name}"], env=env, check=True, stdout=subprocess.DEVNULL)
+			real = split_logical_cpus(f.read().splitlines())
+	if len(real) > len(expected):
+		# This system has more logical CPUs than the dump
+		return None
+	for logical_cpu in real:
+		for key, regs in real[logical_cpu].items():
+			# Old dumps may not contain all the subleaves collected today
+			if key not in expected[logical_cpu]:
+				continue
+			# Leaves and subleaves which cannot exist are not executed, they must be zero
+			if not is_collected(expected[logical_cpu], *key):
+				if regs != ["00000000"] * 4:
+					return f"logical CPU #{logical_cpu}: {key[0]}[{key[1]}] is {' '.join(regs)}, but it should not be collected"
+			elif expected[logical_cpu][key] != regs:
+				return f"logical CPU #{logical_cpu}: {key[0]}[{key[1]}] is {' '.join(regs)}"
+	return "OK"
+
+def parse_cpu_list(cpu_list):
+	cpus = []
+	for item in cpu_list.split(","):
+		first, _, last = item.partition("-")
+		cpus += range(int(first), int(last or first) + 1)
+	return cpus
+
+def do_online_test(binary, test_file, cpu_list):
+	registers = split_logical_cpus(read_test_file(test_file))[0]
+	online = parse_cpu_list(cpu_list)
+	env = dict(os.environ)
+	with tempfile.TemporaryDirectory(prefix="libcpuid-sys-cpu-") as tmp_dir:
+		sysfs_dir, device_dir = Path(tmp_dir, "sys"), Path(tmp_dir, "dev")
+		sysfs_dir.mkdir()
+		Path(sysfs_dir, "online").write_text(cpu_list + "\n")
+		for logical_cpu in online:
+			write_device(device_dir, logical_cpu, registers)
+		env["LIBCPUID_SYSFS_CPU_DIR"] = str(sysfs_dir)
+		env["LIBCPUID_CPUID_DEVICE_DIR"] = str(device_dir)
+		save_file = Path(tmp_dir, "raw.txt")
+		subprocess.run([binary, f"--save={save_file}"], env=env, check=True, stdout=subprocess.DEVNULL)
+		real = split_logical_cpus(save_file.read_text().splitlines())
+	if len(real) != len(online):
+		return f"{len(real)} logical CPUs collected instead of {len(online)}"
+	for index, os_cpu in enumerate(online):
+		if real[index].get(("os_cpu", 0), index) != os_cpu:
+			return f"logical CPU #{index} is not OS CPU {os_cpu}"
+	return "OK"
+
+
+### Main
+parser = argparse.ArgumentParser(description="Test the cpuid kernel driver backend with fake device files.")
+parser.add_argument("cpuid_tool", type=Path, help="path to the cpuid_tool binary")
+parser.add_argument("tests", nargs="+", type=Path, help="test files or directories containing test files")
+args = parser.parse_args()
+
+if platform.system() != "Linux" or platform.machine() not in ["x86_64", "i386", "i686", "AMD64"]:
+	print("The cpuid kernel driver backend is only available on Linux x86, skipping tests")
+	sys.exit(0)
+
+test_files = []
+for path in args.tests:
+	test_files += sorted(path.rglob("*.test")) if path.is_dir() else [path]
+
+errors = skipped = 0
+for test_file in test_files:
+	result = do_test(args.cpuid_tool, test_file)
+	if result is None:
+		skipped += 1
+	elif result != "OK":
+		errors += 1
+		print(f"Test [{test_file}]: {result}")
+
+# Synthetic online masks, with holes and above the 1024 logical CPUs of a static cpu_set_t
+online_test_file = Path(Path(__file__).parent, "amd", "zen4", "amd-ryzen-7-8845hs-with-radeon-780m-graphics.test")
+online_masks = ["0-3", "0,2,5-7", "0-1,1024-1027,8190-8191", "0-4095,4160-8191"]
+for cpu_list in online_masks:
+	result = do_online_test(args.cpuid_tool, online_test_file, cpu_list)
+	if result != "OK":
+		errors += 1
+		print(f"Online CPUs [{cpu_list}]: {result}")
+
+total = len(test_files) + len(online_masks)
+print(f"{total - errors - skipped} tests passed, {errors} failed, {skipped} skipped")
+sys.exit(1 if errors > 0 else 0)
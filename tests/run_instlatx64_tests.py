@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+
+# Checks the InstLatx64 raw dumps without headers: the raw data of each test from AIDA64/InstLatx64
+# is rewritten with only its CPUID lines, the logical CPUs separated by empty lines (as downloaded
+# from InstLatx64). The raw data and the decoded CPU report loaded by 'cpuid_tool' must be identical
+# to the ones from the original test. Tests with a libcpuid raw dump are skipped.
+
+import argparse, lzma, os, re, subprocess, sys, tempfile
+from pathlib import Path
+
+
+### Constants:
+os.environ["LIBCPUID_NO_WARN"] = "1"
+delimiter = "-" * 80
+logical_cpu_header = re.compile(r"^(?:------\[ (?:CPUID Registers / )?Logical CPU #(\d+)|CPUID Registers \(CPU #(\d+)|CPU#(\d+) AffMask: 0x)")
+
+
+### Functions:
+def read_test_file(test_file):
+	lines = []
+	with (lzma.open(test_file, "rt") if test_file.suffix == ".xz" else open(test_file, "rt")) as f:
+		for line in f.read().splitlines():
+			if line == delimiter:
+				break
+			lines.append(line)
+	return lines
+
+def instlatx64_lines(lines):
+	"""Returns the CPUID lines of an AIDA64 raw dump, with an empty line between logical CPUs
+	   None if a logical CPU has no CPUID lines, since it cannot be written without headers"""
+	result, logical_cpu = [], None
+	for line in lines:
+		header = logical_cpu_header.match(line)
+		if line.startswith("CPUID "):
+			result.append(line)
+		elif header and (logical_cpu != next(filter(None, header.groups()))):
+			# Some dumps have several headers for the same logical CPU
+			if logical_cpu is not None and (not result or result[-1] == ""):
+				return None
+			if result:
+				result.append("")
+			logical_cpu = next(filter(None, header.groups()))
+	return result
+
+def run(binary, *options):
+	return subprocess.run([binary, *options], check=True, stdout=subprocess.PIPE).stdout
+
+def do_test(binary, test_file):
+	try:
+		lines = read_test_file(test_file)
+	except lzma.LZMAError:
+		# Not fetched from Git LFS
+		return None
+	if not any(logical_cpu_header.match(line) for line in lines) or instlatx64_lines(lines) is None:
+		# Not an AIDA64 raw dump, or with empty logical CPUs
+		return None
+	with tempfile.TemporaryDirectory(prefix="libcpuid-instlatx64-") as tmp_dir:
+		original_dump, instlatx64_dump = Path(tmp_dir, "raw.txt"), Path(tmp_dir, "instlatx64.txt")
+		original_dump.write_text("\n".join(lines) + "\n")
+		instlatx64_dump.write_text("\n".join(instlatx64_lines(lines)) + "\n")
+		if run(binary, f"--load={original_dump}", "--save=-") != run(binary, f"--load={instlatx64_dump}", "--save=-"):
+			return "the raw data loaded from the InstLatx64 raw dump is different"
+		if run(binary, f"--load={original_dump}", "--report") != run(binary, f"--load={instlatx64_dump}", "--report"):
+			return "the report from the InstLatx64 raw dump is different"
+	return "OK"
+
+
+### Main
+parser = argparse.ArgumentParser(description="Test the InstLatx64 raw dumps without headers.")
+parser.add_argument("cpuid_tool", type=Path, help="path to the cpuid_tool binary")
+parser.add_argument("tests", nargs="+", type=Path, help="test files or directories containing test files")
+args = parser.parse_args()
+
+test_files = []
+for path in args.tests:
+	test_files += sorted(path.rglob("*.test*")) if path.is_dir() else [path]
+
+errors = skipped = 0
+for test_file in test_files:
+	result = do_test(args.cpuid_tool, test_file)
+	if result is None:
+		skipped += 1
+	elif result != "OK":
+		errors += 1
+		print(f"Test [{test_file}]: {result}")
+
+print(f"{len(test_files) - errors - skipped} tests passed, {errors} failed, {skipped} skipped")
+sys.exit(1 if errors > 0 else 0)
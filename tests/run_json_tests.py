@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+
+# Checks the JSON output: for each test, 'cpuid_tool --json' and '--ndjson' must be valid JSON,
+# conform to libcpuid/libcpuid.schema.json, and contain the same values as the expected output
+# of the test (which is printed by the query switches of 'cpuid_tool').
+# The brand string of a dump is also replaced by bytes which are not valid UTF-8, which must be escaped.
+
+import argparse, json, lzma, os, re, struct, subprocess, sys, tempfile
+from pathlib import Path
+
+
+### Constants:
+os.environ["LIBCPUID_NO_WARN"] = "1"
+delimiter = "-" * 80
+schema_file = Path(__file__).resolve().parent.parent / "libcpuid" / "libcpuid.schema.json"
+
+
+### Functions:
+def check(instance, schema, root, path="$"):
+	"""Validates instance against the subset of JSON Schema used by libcpuid.schema.json, returns a list of errors"""
+	if "$ref" in schema:
+		target = root
+		for part in schema["$ref"].removeprefix("#/").split("/"):
+			target = target[part]
+		return check(instance, target, root, path)
+	types = { "object": dict, "array": list, "string": str, "boolean": bool }
+	expected_type = schema.get("type")
+	if expected_type == "integer":
+		if not isinstance(instance, int) or isinstance(instance, bool):
+			return [f"{path}: not an integer"]
+	elif expected_type is not None and not isinstance(instance, types[expected_type]):
+		return [f"{path}: not of type {expected_type}"]
+	errors = []
+	if "minimum" in schema and instance < schema["minimum"]:
+		errors.append(f"{path}: {instance} is less than {schema['minimum']}")
+	if "pattern" in schema and not re.search(schema["pattern"], instance):
+		errors.append(f"{path}: `{instance}' does not match {schema['pattern']}")
+	if isinstance(instance, dict):
+		errors += [f"{path}: `{key}' is missing" for key in schema.get("required", []) if key not in instance]
+		for key, value in instance.items():
+			if key in schema.get("properties", {}):
+				errors += check(value, schema["properties"][key], root, f"{path}.{key}")
+			elif schema.get("additionalProperties", True) is False:
+				errors.append(f"{path}: unexpected `{key}'")
+	if isinstance(instance, list) and "items" in schema:
+		for i, item in enumerate(instance):
+			errors += check(item, schema["items"], root, f"{path}[{i}]")
+	return errors
+
+def expected_values(cpu_type):
+	"""Returns the values of a CPU type in the order of run_tests.py (fields_x86 or fields_arm)"""
+	values = [cpu_type["architecture"], cpu_type["feature_level"], cpu_type["purpose"]]
+	if cpu_type["architecture"] == "x86":
+		x86, caches = cpu_type["x86"], cpu_type["caches"]
+		values += [x86["family"], x86["model"], x86["stepping"], x86["ext_family"], x86["ext_model"]]
+		values += [cpu_type["num_cores"], cpu_type["num_logical_cpus"]]
+		for field in ["size_kb", "assoc", "cacheline", "instances"]:
+			values += [caches[level][field] for level in ["l1_data", "l1_instruction", "l2", "l3", "l4"]]
+		values.append(f"{x86['sse_size']} ({'authoritative' if x86['sse_size_authoritative'] else 'non-authoritative'})")
+	elif cpu_type["architecture"] == "ARM":
+		arm = cpu_type["arm"]
+		values += [arm["implementer"], arm["variant"], arm["part_num"], arm["revision"]]
+		values += [cpu_type["num_cores"], cpu_type["num_logical_cpus"]]
+	else:
+		return []
+	values += [cpu_type["codename"], cpu_type["technology_node"], " ".join(cpu_type["features"])]
+	return [str(value) for value in values]
+
+def do_test(binary, test_file, schema):
+	with (lzma.open(test_file, "rt") if test_file.suffix == ".xz" else open(test_file, "rt")) as f:
+		try:
+			lines = f.read().splitlines()
+		except lzma.LZMAError:
+			# Not fetched from Git LFS
+			return None
+	raw_lines = lines[:lines.index(delimiter)] if delimiter in lines else lines
+	expected = [line.strip() for line in lines[len(raw_lines):] if line != delimiter]
+	with tempfile.NamedTemporaryFile("wt", prefix="libcpuid-json-", suffix=".txt") as raw_dump:
+		raw_dump.write("\n".join(raw_lines) + "\n")
+		raw_dump.flush()
+		output  = subprocess.run([binary, f"--load={raw_dump.name}", "--json"], check=True, stdout=subprocess.PIPE).stdout
+		ndjson  = subprocess.run([binary, f"--load={raw_dump.name}", "--ndjson"], check=True, stdout=subprocess.PIPE).stdout
+	try:
+		system = json.loads(output)
+		if ndjson.count(b"\n") != 1 or json.loads(ndjson) != system:
+			return "the NDJSON output is not the same object on a single line"
+	except ValueError as e:
+		return f"invalid JSON: {e}"
+	errors = check(system, schema, schema)
+	if errors:
+		return "\n".join(errors)
+	if system["num_cpu_types"] != len(system["cpu_types"]):
+		return "num_cpu_types is not the length of cpu_types"
+	real = sum([expected_values(cpu_type) for cpu_type in system["cpu_types"]], [])
+	if real != expected:
+		return "\n".join([f"  expected `{e}'\n  got      `{r}'" for e, r in zip(expected, real) if e != r] or ["different number of values"])
+	return "OK"
+
+def do_brand_test(binary, test_file):
+	"""The brand string is read from the CPU: bytes which are not valid UTF-8 must be escaped"""
+	# Overlong form, UTF-16 surrogate, code point above U+10FFFF, and a valid 2-byte sequence
+	brand = b"A\xe0\x80\x80 B\xed\xa0\x80 C\xf4\x90\x80\x80 D\xc3\xa9"
+	expected = brand.decode("latin-1").replace("\xc3\xa9", "\xe9")
+	registers = struct.unpack("<12I", brand.ljust(48, b"\0"))
+	with open(test_file, "rt") as f:
+		lines = f.read().splitlines()
+	raw_lines = lines[:lines.index(delimiter)] if delimiter in lines else lines
+	for leaf in range(3):
+		regs = " ".join(f"{reg:08x}" for reg in registers[4 * leaf:4 * leaf + 4])
+		raw_lines = [f"ext_cpuid[{leaf + 2}]={regs}" if line.startswith(f"ext_cpuid[{leaf + 2}]=") else line for line in raw_lines]
+	with tempfile.NamedTemporaryFile("wt", prefix="libcpuid-json-", suffix=".txt") as raw_dump:
+		raw_dump.write("\n".join(raw_lines) + "\n")
+		raw_dump.flush()
+		output = subprocess.run([binary, f"--load={raw_dump.name}", "--ndjson"], check=True, stdout=subprocess.PIPE).stdout
+	try:
+		real = json.loads(output)["cpu_types"][0]["brand_str"]
+	except ValueError as e:
+		return f"invalid JSON: {e}"
+	return "OK" if real == expected else f"brand string is `{real}' instead of `{expected}'"
+
+
+### Main
+parser = argparse.ArgumentParser(description="Test the JSON output against its schema and the expected output of the tests.")
+parser.add_argument("cpuid_tool", type=Path, help="path to the cpuid_tool binary")
+parser.add_argument("tests", nargs="+", type=Path, help="test files or directories containing test files")
+args = parser.parse_args()
+
+with open(schema_file, "rt") as f:
+	schema = json.load(f)
+
+test_files = []
+for path in args.tests:
+	test_files += sorted(path.rglob("*.test*")) if path.is_dir() else [path]
+
+errors = skipped = 0
+for test_file in test_files:
+	result = do_test(args.cpuid_tool, test_file, schema)
+	if result is None:
+		skipped += 1
+	elif result != "OK":
+		errors += 1
+		print(f"Test [{test_file}]: {result}")
+
+brand_test_file = Path(__file__).resolve().parent / "intel" / "qemu" / "qemu-virtual-cpu-version.test"
+result = do_brand_test(args.cpuid_tool, brand_test_file)
+if result != "OK":
+	errors += 1
+	print(f"Test [brand string]: {result}")
+
+print(f"{len(test_files) + 1 - errors - skipped} tests passed, {errors} failed, {skipped} skipped")
+sys.exit(1 if errors > 0 else 0)
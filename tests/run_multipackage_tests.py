@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+
+# Checks the identification of multi-package systems: for each test, its raw data is loaded by
+# 'cpuid_tool' and written twice, the second copy with other APIC IDs (as a second package). Each CPU
+# type of this raw dump must be identical to the CPU type of the test in the same position, apart from
+# total_logical_cpus and affinity_mask. Tests with a single logical CPU or without APIC IDs are skipped.
+
+import argparse, json, lzma, os, re, subprocess, sys, tempfile
+from pathlib import Path
+
+
+### Constants:
+os.environ["LIBCPUID_NO_WARN"] = "1"
+delimiter = "-" * 80
+logical_cpu_header = re.compile(r"^(_________________ Logical CPU #)(\d+)( .*)$")
+register_line = re.compile(r"^(\w+\[\d+\])=(\S+) (\S+) (\S+) (\S+)$")
+# x2APIC IDs in EDX, and the extended APIC ID of AMD CPUs in EAX
+apic_id_registers = { "basic_cpuid[11]": 3, "basic_cpuid[31]": 3, "ext_cpuid[30]": 0 }
+apic_id_leaves = ["intel_fn11", "amd_fn80000026h"]
+second_package = 0x10000
+ignored_fields = ["total_logical_cpus", "affinity_mask"]
+
+
+### Functions:
+def read_test_file(test_file):
+	lines = []
+	with (lzma.open(test_file, "rt") if test_file.suffix == ".xz" else open(test_file, "rt")) as f:
+		for line in f.read().splitlines():
+			if line == delimiter:
+				break
+			lines.append(line)
+	return lines
+
+def run(binary, *options):
+	return subprocess.run([binary, *options], check=True, stdout=subprocess.PIPE).stdout
+
+def second_package_line(line, num_raw):
+	"""Returns a line of a text raw dump for the same logical CPU in the second package"""
+	header = logical_cpu_header.match(line)
+	if header:
+		return f"{header[1]}{int(header[2]) + num_raw}{header[3]}"
+	if line.startswith("os_cpu="):
+		return f"os_cpu={int(line[7:]) + num_raw}"
+	register = register_line.match(line)
+	if register:
+		name, regs = register[1], [int(reg, 16) for reg in register.groups()[1:]]
+		if name in apic_id_registers:
+			regs[apic_id_registers[name]] |= second_package
+		elif name.split("[")[0] in apic_id_leaves:
+			regs[3] |= second_package
+		elif name == "basic_cpuid[1]":
+			regs[1] ^= 0x80000000
+		return f"{name}=" + " ".join(f"{reg:08x}" for reg in regs)
+	return line
+
+def two_package_dump(dump):
+	"""Returns a text raw dump with the logical CPUs of dump, then the same ones in a second package"""
+	lines = dump.splitlines()
+	num_raw = sum(1 for line in lines if logical_cpu_header.match(line))
+	first_cpu = next(i for i, line in enumerate(lines) if logical_cpu_header.match(line))
+	return "\n".join(lines + [second_package_line(line, num_raw) for line in lines[first_cpu:]]) + "\n"
+
+def do_test(binary, test_file):
+	try:
+		lines = read_test_file(test_file)
+	except lzma.LZMAError:
+		# Not fetched from Git LFS
+		return None
+	with tempfile.TemporaryDirectory(prefix="libcpuid-multipackage-") as tmp_dir:
+		text_dump, two_packages = Path(tmp_dir, "raw.txt"), Path(tmp_dir, "two-packages.txt")
+		text_dump.write_text("\n".join(lines) + "\n")
+		dump = run(binary, f"--load={text_dump}", "--save=-").decode()
+		if sum(1 for line in dump.splitlines() if logical_cpu_header.match(line)) < 2:
+			# Raw data without affinity, or the counters of a single logical CPU (which do not come from APIC IDs)
+			return None
+		two_packages.write_text(two_package_dump(dump))
+		expected = json.loads(run(binary, f"--load={text_dump}", "--json"))["cpu_types"]
+		real = json.loads(run(binary, f"--load={two_packages}", "--json"))["cpu_types"]
+	if len(real) == len(expected):
+		# No APIC IDs, both packages are in the same CPU types
+		return None
+	if len(real) != 2 * len(expected):
+		return f"{len(real)} CPU types instead of {2 * len(expected)}"
+	for i, cpu_type in enumerate(real):
+		for field in ignored_fields:
+			cpu_type.pop(field)
+			expected[i % len(expected)].pop(field, None)
+		if cpu_type != expected[i % len(expected)]:
+			fields = [key for key in cpu_type if cpu_type[key] != expected[i % len(expected)].get(key)]
+			return f"CPU type #{i} is different: {', '.join(fields)}"
+	return "OK"
+
+
+### Main
+parser = argparse.ArgumentParser(description="Test the identification of multi-package systems.")
+parser.add_argument("cpuid_tool", type=Path, help="path to the cpuid_tool binary")
+parser.add_argument("tests", nargs="+", type=Path, help="test files or directories containing test files")
+args = parser.parse_args()
+
+test_files = []
+for path in args.tests:
+	test_files += sorted(path.rglob("*.test*")) if path.is_dir() else [path]
+
+errors = skipped = 0
+for test_file in test_files:
+	result = do_test(args.cpuid_tool, test_file)
+	if result is None:
+		skipped += 1
+	elif result != "OK":
+		errors += 1
+		print(f"Test [{test_file}]: {result}")
+
+print(f"{len(test_files) - errors - skipped} tests passed, {errors} failed, {skipped} skipped")
+sys.exit(1 if errors > 0 else 0)
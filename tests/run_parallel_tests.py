@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+
+# Checks the parallel deserialization: for each test, its raw data is loaded by 'cpuid_tool' and
+# replicated to a large raw dump (at least 256 logical CPUs), written in full, with '--delta', and
+# mixed (logical CPUs alternately from both). The raw data loaded with '--threads' must be identical
+# to the one loaded sequentially, for the test itself, for these large raw dumps, and for the large
+# raw dump with logical CPUs in reverse order (which is always read sequentially).
+
+import argparse, lzma, os, subprocess, sys, tempfile
+from pathlib import Path
+
+
+### Constants:
+os.environ["LIBCPUID_NO_WARN"] = "1"
+delimiter = "-" * 80
+logical_cpu_header = "_________________ Logical CPU #"
+min_logical_cpus = 256
+threads = ["--threads=2", "--threads=4", "--threads=7"]
+
+
+### Functions:
+def read_test_file(test_file):
+	lines = []
+	with (lzma.open(test_file, "rt") if test_file.suffix == ".xz" else open(test_file, "rt")) as f:
+		for line in f.read().splitlines():
+			if line == delimiter:
+				break
+			lines.append(line)
+	return lines
+
+def run(binary, *options):
+	return subprocess.run([binary, *options], check=True, stdout=subprocess.PIPE).stdout
+
+def split_dump(dump):
+	"""Returns the first line of a text raw dump and the lines of each logical CPU (without its header)"""
+	lines = dump.splitlines()
+	blocks = []
+	for line in lines[1:]:
+		if line.startswith(logical_cpu_header):
+			blocks.append([])
+		elif blocks:
+			blocks[-1].append(line)
+	return lines[:1], blocks
+
+def write_dump(header, numbers, blocks):
+	result = header
+	for number, block in zip(numbers, blocks):
+		result += [f"{logical_cpu_header}{number} _________________"] + block
+	return "\n".join(result) + "\n"
+
+def large_dump(full_dump, reverse=False):
+	"""Returns a text raw dump with the logical CPUs of full_dump repeated, renumbered from 0"""
+	header, blocks = split_dump(full_dump.decode())
+	blocks = blocks * (min_logical_cpus // len(blocks) + 1)
+	numbers = list(range(len(blocks)))
+	if reverse:
+		blocks, numbers = blocks[::-1], numbers[::-1]
+	return write_dump(header, numbers, blocks)
+
+def mixed_dump(full_dump, delta_dump):
+	"""Returns a text raw dump with the even logical CPUs of full_dump and the odd ones of delta_dump"""
+	header, full_blocks = split_dump(full_dump)
+	delta_blocks = split_dump(delta_dump)[1]
+	blocks = [delta_blocks[i] if i % 2 else full_blocks[i] for i in range(len(full_blocks))]
+	return write_dump(header, range(len(blocks)), blocks)
+
+def do_test(binary, test_file):
+	try:
+		lines = read_test_file(test_file)
+	except lzma.LZMAError:
+		# Not fetched from Git LFS
+		return None
+	with tempfile.TemporaryDirectory(prefix="libcpuid-parallel-") as tmp_dir:
+		text_dump, large_full, large_delta, large_mixed, large_reverse = (Path(tmp_dir, name) for name in ["raw.txt", "full.txt", "delta.txt", "mixed.txt", "reverse.txt"])
+		text_dump.write_text("\n".join(lines) + "\n")
+		full_dump = run(binary, f"--load={text_dump}", "--save=-")
+		large_full.write_text(large_dump(full_dump))
+		run(binary, f"--load={large_full}", f"--save={large_delta}", "--delta")
+		large_mixed.write_text(mixed_dump(large_full.read_text(), large_delta.read_text()))
+		large_reverse.write_text(large_dump(full_dump, reverse=True))
+		for dump in [text_dump, large_full, large_delta, large_mixed, large_reverse]:
+			expected = run(binary, f"--load={dump}", "--save=-")
+			for option in threads:
+				if run(binary, f"--load={dump}", option, "--save=-") != expected:
+					return f"the raw data loaded from {dump.name} with {option} is different"
+	return "OK"
+
+
+### Main
+parser = argparse.ArgumentParser(description="Test the parallel deserialization of raw dumps.")
+parser.add_argument("cpuid_tool", type=Path, help="path to the cpuid_tool binary")
+parser.add_argument("tests", nargs="+", type=Path, help="test files or directories containing test files")
+args = parser.parse_args()
+
+test_files = []
+for path in args.tests:
+	test_files += sorted(path.rglob("*.test*")) if path.is_dir() else [path]
+
+errors = skipped = 0
+for test_file in test_files:
+	result = do_test(args.cpuid_tool, test_file)
+	if result is None:
+		skipped += 1
+	elif result != "OK":
+		errors += 1
+		print(f"Test [{test_file}]: {result}")
+
+print(f"{len(test_files) - errors - skipped} tests passed, {errors} failed, {skipped} skipped")
+sys.exit(1 if errors > 0 else 0)
@@ -0,0 +1,46 @@
+/* A small daemon which publishes the identified system in shared memory,
+so processes can call cpuid_attach_shared_snapshot() instead of executing CPUID on each logical CPU.
+It is built with libcpuid when enabled: cmake -DLIBCPUID_BUILD_CPUIDD=ON, or ./configure --enable-cpuidd
+
+Usage: cpuidd [shared memory name] [check interval in seconds]
+*/
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../libcpuid/libcpuid.h"
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int signum)
+{
+	(void) signum;
+	running = 0;
+}
+
+int main(int argc, char** argv)
+{
+	const char* name = (argc > 1) ? argv[1] : NULL;
+	unsigned interval = (argc > 2) ? (unsigned) atoi(argv[2]) : 10;
+	struct cpu_snapshot_t snapshot;
+
+	signal(SIGTERM, stop);
+	signal(SIGINT, stop);
+	if (cpuid_publish_shared_snapshot(name) < 0) {
+		fprintf(stderr, "%s: cannot publish snapshot: %s\n", argv[0], cpuid_error());
+		return 1;
+	}
+
+	while (running) {
+		sleep(interval);
+		/* The snapshot becomes outdated when logical CPUs go online/offline or the microcode is updated */
+		if (cpuid_attach_shared_snapshot(&snapshot, name) < 0)
+			continue;
+		if (!snapshot.is_shared && (cpuid_publish_shared_snapshot(name) < 0))
+			fprintf(stderr, "%s: cannot publish snapshot: %s\n", argv[0], cpuid_error());
+		cpuid_detach_shared_snapshot(&snapshot);
+	}
+
+	cpuid_unpublish_shared_snapshot(name);
+	return 0;
+}
@@ -15,7 +15,6 @@ MAX_UNCOMPRESSED_SIZE_KB=128
 # Variables
 raw_file=""
 raw_file_tmp_download=""
-raw_file_tmp_fix=""
 output_dir=""
 output_file="/dev/stdout"
 cpuid_tool="$GIT_ROOT_DIR/build/cpuid_tool/cpuid_tool"
@@ -25,7 +24,6 @@ create_test="$GIT_ROOT_DIR/tests/create_test.py"
 on_exit() {
 	rm "$REPORT_FILE"
 	[[ -f "$raw_file_tmp_download" ]] && rm "$raw_file_tmp_download"
-	[[ -f "$raw_file_tmp_fix"      ]] && rm "$raw_file_tmp_fix"
 }
 
 # Display usage
@@ -69,23 +67,6 @@ if [[ "$raw_file" =~ ^https?:\/\/ ]]; then
 	raw_file="$raw_file_tmp_download"
 fi
 
-# Fix raw file if there is no header for logical cores
-if [[ -z "$(grep -Ev "CPUID [0-9A-F]{8}" "$raw_file" | xargs)" ]]; then
-	raw_file_tmp_fix="$(mktemp --tmpdir libcpuid-raw.XXXXXX)"
-	echo -e "\033[34mFixing '$raw_file' raw file as '$raw_file_tmp_fix'...\033[0m"
-	logical_cpu=0
-	echo "------[ Logical CPU #$logical_cpu ]------" > "$raw_file_tmp_fix"
-	while IFS= read -r line || [[ -n "$line" ]]; do
-		if [[ -z "$line" ]]; then
-			logical_cpu=$((logical_cpu + 1))
-			echo -e "\n------[ Logical CPU #$logical_cpu ]------" >> "$raw_file_tmp_fix"
-		else
-			echo "$line" >> "$raw_file_tmp_fix"
-		fi
-	done < "$raw_file"
-	raw_file="$raw_file_tmp_fix"
-fi
-
 echo -e "\033[34mLoading '$raw_file' raw file...\033[0m"
 "$cpuid_tool" --load="$raw_file" --report
 
@@ -11,16 +11,20 @@ gcc decode_cpuid_revision.c -lcpuid -o decode_cpuid_revision
 
 int main(int argc, char** argv)
 {
-	struct cpu_raw_data_t raw;
+	struct cpu_raw_data_t raw = { 0 };
 	struct cpu_id_t data;
+	uint32_t regs[NUM_REGS] = { 0 };
 
 	if (argc < 2) {
 		printf("%s: x86 CPUID Revision is required as argument.\n", argv[0]);
 		return 1;
 	}
-	raw.basic_cpuid[0][EAX] = ANSWER_TO_THE_ULTIMATE_QUESTION_OF_LIFE_THE_UNIVERSE_AND_EVERYTHING;
-	raw.basic_cpuid[1][EAX] = strtol(argv[1], NULL, 16);
+	regs[EAX] = ANSWER_TO_THE_ULTIMATE_QUESTION_OF_LIFE_THE_UNIVERSE_AND_EVERYTHING;
+	cpuid_set_raw_leaf(&raw, 0, 0, regs);
+	regs[EAX] = strtol(argv[1], NULL, 16);
+	cpuid_set_raw_leaf(&raw, 1, 0, regs);
 	cpu_identify(&raw, &data);
+	cpuid_free_raw_data(&raw);
 
 	printf("%s decoded to:\n", argv[1]);
 	printf("  family     : %1$d (%1$02Xh)\n", data.x86.family);
@@ -0,0 +1,1330 @@
+/* A simple tool to measure the performance of some libcpuid operations.
+Build with:
+gcc libcpuid_benchmark.c -lcpuid -o libcpuid_benchmark
+
+Usage: libcpuid_benchmark <benchmark> [arguments...]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../libcpuid/libcpuid.h"
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* Compares the fixed part of the raw data and the content of their tables of leaves */
+static int same_raw_data(const struct cpu_raw_data_t* a, const struct cpu_raw_data_t* b)
+{
+	return !memcmp(a, b, offsetof(struct cpu_raw_data_t, max_leaves)) &&
+	       ((a->num_leaves == 0) || !memcmp(a->leaves, b->leaves, a->num_leaves * sizeof(struct cpu_raw_leaf_t)));
+}
+
+static int same_raw_data_array(struct cpu_raw_data_array_t* a, struct cpu_raw_data_array_t* b)
+{
+	logical_cpu_t cpu;
+
+	if (a->num_raw != b->num_raw)
+		return 0;
+	for (cpu = 0; cpu < a->num_raw; cpu++)
+		if (!same_raw_data(&a->raw[cpu], &b->raw[cpu]))
+			return 0;
+	return 1;
+}
+
+/* Compares cpuid_get_all_raw_data() with cpuid_get_all_raw_data_parallel() for 1, 2, 4... threads */
+static int bench_collect(int argc, char** argv)
+{
+	int threads, max_threads = (argc > 0) ? atoi(argv[0]) : cpuid_get_total_cpus();
+	double start, elapsed;
+	struct cpu_raw_data_array_t reference, raw_array;
+
+	start = now_ms();
+	if (cpuid_get_all_raw_data(&reference) < 0) {
+		fprintf(stderr, "cpuid_get_all_raw_data(): %s\n", cpuid_error());
+		return 1;
+	}
+	elapsed = now_ms() - start;
+	printf("%-10s %7s %12s\n", "mode", "threads", "time (ms)");
+	printf("%-10s %7d %12.3f\n", "sequential", 1, elapsed);
+
+	for (threads = 1; threads <= max_threads; threads *= 2) {
+		start = now_ms();
+		if (cpuid_get_all_raw_data_parallel(&raw_array, threads) < 0) {
+			fprintf(stderr, "cpuid_get_all_raw_data_parallel(): %s\n", cpuid_error());
+			return 1;
+		}
+		elapsed = now_ms() - start;
+		printf("%-10s %7d %12.3f%s\n", "parallel", threads, elapsed,
+			same_raw_data_array(&reference, &raw_array) ? "" : " (MISMATCH)");
+		cpuid_free_raw_data_array(&raw_array);
+	}
+
+	cpuid_free_raw_data_array(&reference);
+	return 0;
+}
+
+/* Measures the memory used by the raw data and the time of cpu_identify_all() on raw dumps (e.g. tests/) */
+static int bench_layout(int argc, char** argv)
+{
+	/* sizeof(struct cpu_raw_data_t) on x86-64 when it only had the fixed arrays, before the table of leaves */
+	static const size_t previous_size = 1736;
+	int i, files = 0;
+	logical_cpu_t cpu;
+	long cpus = 0, used = 0, allocated = 0;
+	double start, elapsed = 0.0;
+	struct cpu_raw_data_array_t raw_array;
+	struct system_id_t system;
+
+	for (i = 0; i < argc; i++) {
+		if (cpuid_deserialize_all_raw_data(&raw_array, argv[i]) < 0) {
+			fprintf(stderr, "%s: %s\n", argv[i], cpuid_error());
+			continue;
+		}
+		for (cpu = 0; cpu < raw_array.num_raw; cpu++) {
+			used      += raw_array.raw[cpu].num_leaves;
+			allocated += raw_array.raw[cpu].max_leaves;
+		}
+		start = now_ms();
+		if (cpu_identify_all(&raw_array, &system) == 0) {
+			elapsed += now_ms() - start;
+			cpuid_free_system_id(&system);
+			files++;
+			cpus += raw_array.num_raw;
+		}
+		cpuid_free_raw_data_array(&raw_array);
+	}
+	if (cpus == 0) {
+		fprintf(stderr, "No raw dump could be identified\n");
+		return 1;
+	}
+
+	printf("%ld logical CPUs in %d dumps\n", cpus, files);
+	printf("sizeof(struct cpu_raw_data_t): %zu bytes (%zu before)\n", sizeof(struct cpu_raw_data_t), previous_size);
+	printf("leaves per CPU:                %.1f used, %.1f allocated (%.0f bytes)\n",
+		(double) used / cpus, (double) allocated / cpus, (double) allocated / cpus * sizeof(struct cpu_raw_leaf_t));
+	printf("bytes per CPU:                 %.0f (%+.0f)\n",
+		sizeof(struct cpu_raw_data_t) + (double) allocated / cpus * sizeof(struct cpu_raw_leaf_t),
+		sizeof(struct cpu_raw_data_t) + (double) allocated / cpus * sizeof(struct cpu_raw_leaf_t) - previous_size);
+	printf("cpu_identify_all():            %.3f ms, %.3f us per CPU\n", elapsed, elapsed * 1000.0 / cpus);
+	return 0;
+}
+
+static size_t compact_size(const struct cpu_raw_data_compact_t* data)
+{
+	uint16_t i;
+	size_t leaves = 0;
+
+	for (i = 0; i < data->num_templates; i++)
+		leaves += data->templates[i].max_leaves * sizeof(struct cpu_raw_leaf_t);
+	return data->num_templates * sizeof(struct cpu_raw_data_t) + leaves +
+	       data->num_raw * (sizeof(uint16_t) + sizeof(uint32_t)) +
+	       data->num_deltas * sizeof(struct cpu_raw_data_delta_t);
+}
+
+static int same_system_id(const struct system_id_t* a, const struct system_id_t* b)
+{
+	return (a->num_cpu_types == b->num_cpu_types) &&
+	       !memcmp(a->cpu_types, b->cpu_types, a->num_cpu_types * sizeof(struct cpu_id_t)) &&
+	       (a->l1_data_total_instances == b->l1_data_total_instances) &&
+	       (a->l2_total_instances == b->l2_total_instances) &&
+	       (a->l3_total_instances == b->l3_total_instances);
+}
+
+/* Compares cpu_raw_data_array_t with cpu_raw_data_compact_t on raw dumps (e.g. tests/), grouped by number of logical CPUs */
+static int bench_compact(int argc, char** argv)
+{
+	static const int bounds[] = { 1, 8, 64, 512, 65536 };
+	enum { NUM_GROUPS = sizeof(bounds) / sizeof(bounds[0]) };
+	int i, g, mismatches = 0;
+	long cpus[NUM_GROUPS] = { 0 };
+	double array_bytes[NUM_GROUPS] = { 0 }, compact_bytes[NUM_GROUPS] = { 0 };
+	double array_ms[NUM_GROUPS] = { 0 }, compact_ms[NUM_GROUPS] = { 0 };
+	double start;
+	logical_cpu_t cpu;
+	struct cpu_raw_data_array_t raw_array;
+	struct cpu_raw_data_compact_t compact;
+	struct cpu_raw_data_t raw;
+	struct system_id_t system_array, system_compact;
+
+	raw.num_leaves = raw.max_leaves = 0;
+	raw.leaves     = NULL;
+	for (i = 0; i < argc; i++) {
+		if ((cpuid_deserialize_all_raw_data(&raw_array, argv[i]) < 0) ||
+		    (cpuid_deserialize_all_raw_data_compact(&compact, argv[i]) < 0)) {
+			fprintf(stderr, "%s: %s\n", argv[i], cpuid_error());
+			continue;
+		}
+		for (g = 0; raw_array.num_raw > bounds[g]; g++);
+		for (cpu = 0; cpu < raw_array.num_raw; cpu++) {
+			cpuid_free_raw_data(&raw);
+			if ((cpuid_get_compact_raw_data(&compact, cpu, &raw) < 0) || !same_raw_data(&raw, &raw_array.raw[cpu])) {
+				printf("%s: logical CPU %u differs (MISMATCH)\n", argv[i], cpu);
+				mismatches++;
+				break;
+			}
+		}
+
+		start = now_ms();
+		cpu_identify_all(&raw_array, &system_array);
+		array_ms[g] += now_ms() - start;
+		start = now_ms();
+		cpu_identify_all_compact(&compact, &system_compact);
+		compact_ms[g] += now_ms() - start;
+		if (!same_system_id(&system_array, &system_compact)) {
+			printf("%s: identification differs (MISMATCH)\n", argv[i]);
+			mismatches++;
+		}
+
+		cpus[g]          += raw_array.num_raw;
+		array_bytes[g]   += (double) raw_array.num_raw * sizeof(struct cpu_raw_data_t);
+		for (cpu = 0; cpu < raw_array.num_raw; cpu++)
+			array_bytes[g] += (double) raw_array.raw[cpu].max_leaves * sizeof(struct cpu_raw_leaf_t);
+		compact_bytes[g] += (double) compact_size(&compact);
+		cpuid_free_system_id(&system_array);
+		cpuid_free_system_id(&system_compact);
+		cpuid_free_raw_data_compact(&compact);
+		cpuid_free_raw_data_array(&raw_array);
+	}
+	cpuid_free_raw_data(&raw);
+
+	printf("%-12s %8s %14s %14s %14s %14s\n", "logical CPUs", "total", "array B/CPU", "compact B/CPU", "array us/CPU", "compact us/CPU");
+	for (g = 0; g < NUM_GROUPS; g++)
+		if (cpus[g] > 0)
+			printf("<= %-9d %8ld %14.0f %14.0f %14.3f %14.3f\n", bounds[g], cpus[g],
+				array_bytes[g] / cpus[g], compact_bytes[g] / cpus[g],
+				array_ms[g] * 1000.0 / cpus[g], compact_ms[g] * 1000.0 / cpus[g]);
+	return (mismatches > 0) ? 1 : 0;
+}
+
+static long file_size(const char* filename)
+{
+	long size = -1;
+	FILE* f = fopen(filename, "rb");
+	if (f != NULL) {
+		fseek(f, 0, SEEK_END);
+		size = ftell(f);
+		fclose(f);
+	}
+	return size;
+}
+
+/* Compares the text and binary raw dump formats on raw dumps (e.g. tests/): size, deserialization, and identification of the mapped binary dump */
+static int bench_binary(int argc, char** argv)
+{
+	static const char binary_file[] = "libcpuid_benchmark.bin";
+	int i, mismatches = 0;
+	long cpus = 0;
+	double text_bytes = 0, binary_bytes = 0, text_ms = 0, binary_ms = 0, identify_ms = 0, mapped_ms = 0;
+	double start;
+	struct cpu_raw_data_array_t text_array, binary_array;
+	struct cpu_raw_data_mapped_t mapped;
+	struct system_id_t system_array, system_mapped;
+
+	for (i = 0; i < argc; i++) {
+		start = now_ms();
+		if (cpuid_deserialize_all_raw_data(&text_array, argv[i]) < 0) {
+			fprintf(stderr, "%s: %s\n", argv[i], cpuid_error());
+			continue;
+		}
+		text_ms += now_ms() - start;
+		if (cpuid_serialize_all_raw_data_binary(&text_array, binary_file) < 0) {
+			fprintf(stderr, "%s: %s\n", binary_file, cpuid_error());
+			cpuid_free_raw_data_array(&text_array);
+			return 1;
+		}
+		start = now_ms();
+		cpuid_deserialize_all_raw_data(&binary_array, binary_file);
+		binary_ms += now_ms() - start;
+		if (!same_raw_data_array(&text_array, &binary_array) || (text_array.with_affinity != binary_array.with_affinity)) {
+			printf("%s: raw data differs (MISMATCH)\n", argv[i]);
+			mismatches++;
+		}
+
+		start = now_ms();
+		cpu_identify_all(&text_array, &system_array);
+		identify_ms += now_ms() - start;
+		start = now_ms();
+		cpuid_map_raw_data(&mapped, binary_file);
+		cpu_identify_all_mapped(&mapped, &system_mapped);
+		cpuid_unmap_raw_data(&mapped);
+		mapped_ms += now_ms() - start;
+		if (!same_system_id(&system_array, &system_mapped)) {
+			printf("%s: identification differs (MISMATCH)\n", argv[i]);
+			mismatches++;
+		}
+
+		cpus         += text_array.num_raw;
+		text_bytes   += (double) file_size(argv[i]);
+		binary_bytes += (double) file_size(binary_file);
+		cpuid_free_system_id(&system_array);
+		cpuid_free_system_id(&system_mapped);
+		cpuid_free_raw_data_array(&binary_array);
+		cpuid_free_raw_data_array(&text_array);
+	}
+	remove(binary_file);
+
+	if (cpus == 0)
+		return 1;
+	printf("%ld logical CPUs in %d raw dumps\n", cpus, argc);
+	printf("%-30s %12s %12s %12s\n", "", "B/CPU", "us/CPU", "MB/s");
+	printf("%-30s %12.0f %12.3f %12.1f\n", "text: deserialize", text_bytes / cpus, text_ms * 1000.0 / cpus, text_bytes / 1000.0 / text_ms);
+	printf("%-30s %12.0f %12.3f %12.1f\n", "binary: deserialize", binary_bytes / cpus, binary_ms * 1000.0 / cpus, binary_bytes / 1000.0 / binary_ms);
+	printf("%-30s %12s %12.3f\n", "array: identify", "", identify_ms * 1000.0 / cpus);
+	printf("%-30s %12s %12.3f\n", "binary: map and identify", "", mapped_ms * 1000.0 / cpus);
+	return (mismatches > 0) ? 1 : 0;
+}
+
+/* Measures the text deserializer on raw dumps (e.g. tests/), for the libcpuid and AIDA64 formats */
+static int bench_parse(int argc, char** argv)
+{
+	enum { LIBCPUID_FORMAT, AIDA64_FORMAT, NUM_FORMATS };
+	static const char* format_names[NUM_FORMATS] = { "libcpuid", "AIDA64" };
+	static const int runs = 10;
+	int i, run, format;
+	long dumps[NUM_FORMATS] = { 0 };
+	double bytes[NUM_FORMATS] = { 0 }, elapsed_ms[NUM_FORMATS] = { 0 };
+	double start;
+	char head[9] = "";
+	FILE* f;
+	struct cpu_raw_data_array_t raw_array;
+
+	for (i = 0; i < argc; i++) {
+		if ((f = fopen(argv[i], "rt")) == NULL)
+			continue;
+		head[fread(head, 1, sizeof(head) - 1, f)] = '\0';
+		fclose(f);
+		format = (!strncmp(head, "version=", 8) || !strncmp(head, "basic_cp", 8) || !strncmp(head, "________", 8)) ? LIBCPUID_FORMAT : AIDA64_FORMAT;
+		start = now_ms();
+		for (run = 0; run < runs; run++) {
+			if (cpuid_deserialize_all_raw_data(&raw_array, argv[i]) < 0) {
+				fprintf(stderr, "%s: %s\n", argv[i], cpuid_error());
+				break;
+			}
+			cpuid_free_raw_data_array(&raw_array);
+		}
+		if (run < runs)
+			continue;
+		elapsed_ms[format] += now_ms() - start;
+		bytes[format]      += (double) file_size(argv[i]) * runs;
+		dumps[format]      += runs;
+	}
+
+	printf("%-10s %8s %12s %12s\n", "format", "dumps", "MB/s", "dumps/s");
+	for (format = 0; format < NUM_FORMATS; format++)
+		if (dumps[format] > 0)
+			printf("%-10s %8ld %12.1f %12.0f\n", format_names[format], dumps[format] / runs,
+				bytes[format] / 1000.0 / elapsed_ms[format], dumps[format] * 1000.0 / elapsed_ms[format]);
+	return 0;
+}
+
+/* Compares cpuid_get_all_raw_data() + cpu_identify_all() with cpu_identify_all_cached() once the cache is written */
+static int bench_memory(int argc, char** argv)
+{
+	enum { SERIALIZE, DESERIALIZE, NUM_STEPS };
+	static const char temp_file[] = "libcpuid_benchmark.txt";
+	static const int runs = 10;
+	int i, run, step, mismatches = 0;
+	long dumps = 0;
+	double file_ms[NUM_STEPS] = { 0 }, memory_ms[NUM_STEPS] = { 0 };
+	double start;
+	struct cpu_raw_data_array_t raw_array, file_array, memory_array;
+	struct cpuid_buffer_t buffer = { NULL, 0, 0 };
+
+	for (i = 0; i < argc; i++) {
+		if (cpuid_deserialize_all_raw_data(&raw_array, argv[i]) < 0) {
+			fprintf(stderr, "%s: %s\n", argv[i], cpuid_error());
+			continue;
+		}
+		for (run = 0; run < runs; run++) {
+			/* Round trip through a temporary file */
+			start = now_ms();
+			cpuid_serialize_all_raw_data(&raw_array, temp_file);
+			file_ms[SERIALIZE] += now_ms() - start;
+			start = now_ms();
+			cpuid_deserialize_all_raw_data(&file_array, temp_file);
+			file_ms[DESERIALIZE] += now_ms() - start;
+
+			/* Round trip through memory */
+			buffer.size = 0;
+			start = now_ms();
+			cpuid_serialize_all_raw_data_buffer(&raw_array, &buffer);
+			memory_ms[SERIALIZE] += now_ms() - start;
+			start = now_ms();
+			cpuid_deserialize_all_raw_data_buffer(&memory_array, buffer.data, buffer.size);
+			memory_ms[DESERIALIZE] += now_ms() - start;
+
+			if ((run == 0) && (!same_raw_data_array(&file_array, &memory_array) || (buffer.size != (size_t) file_size(temp_file)))) {
+				printf("%s: memory round trip differs (MISMATCH)\n", argv[i]);
+				mismatches++;
+			}
+			cpuid_free_raw_data_array(&file_array);
+			cpuid_free_raw_data_array(&memory_array);
+		}
+		dumps += runs;
+		cpuid_free_raw_data_array(&raw_array);
+	}
+	cpuid_free_buffer(&buffer);
+	remove(temp_file);
+
+	if (dumps == 0)
+		return 1;
+	printf("%ld round trips of %d raw dumps\n", dumps, argc);
+	printf("%-24s %14s %14s %14s\n", "us/dump", "serialize", "deserialize", "round trip");
+	printf("%-24s", "temporary file");
+	for (step = 0; step < NUM_STEPS; step++)
+		printf(" %14.2f", file_ms[step] * 1000.0 / dumps);
+	printf(" %14.2f\n", (file_ms[SERIALIZE] + file_ms[DESERIALIZE]) * 1000.0 / dumps);
+	printf("%-24s", "memory buffer");
+	for (step = 0; step < NUM_STEPS; step++)
+		printf(" %14.2f", memory_ms[step] * 1000.0 / dumps);
+	printf(" %14.2f\n", (memory_ms[SERIALIZE] + memory_ms[DESERIALIZE]) * 1000.0 / dumps);
+	return (mismatches > 0) ? 1 : 0;
+}
+
+static int bench_delta(int argc, char** argv)
+{
+	enum { FULL, DELTA, NUM_FORMATS };
+	static const char* format_names[NUM_FORMATS] = { "full text", "delta text" };
+	static const int runs = 20;
+	int i, run, format, mismatches = 0;
+	long cpus = 0;
+	double bytes[NUM_FORMATS] = { 0 }, elapsed_ms[NUM_FORMATS] = { 0 };
+	double start;
+	struct cpu_raw_data_array_t raw_array, loaded;
+	struct cpuid_buffer_t buffers[NUM_FORMATS] = { { NULL, 0, 0 }, { NULL, 0, 0 } };
+
+	for (i = 0; i < argc; i++) {
+		if (cpuid_deserialize_all_raw_data(&raw_array, argv[i]) < 0) {
+			fprintf(stderr, "%s: %s\n", argv[i], cpuid_error());
+			continue;
+		}
+		buffers[FULL].size = buffers[DELTA].size = 0;
+		cpuid_serialize_all_raw_data_buffer(&raw_array, &buffers[FULL]);
+		cpuid_serialize_all_raw_data_delta_buffer(&raw_array, &buffers[DELTA]);
+		for (format = 0; format < NUM_FORMATS; format++) {
+			start = now_ms();
+			for (run = 0; run < runs; run++) {
+				cpuid_deserialize_all_raw_data_buffer(&loaded, buffers[format].data, buffers[format].size);
+				if (run < runs - 1)
+					cpuid_free_raw_data_array(&loaded);
+			}
+			elapsed_ms[format] += now_ms() - start;
+			bytes[format]      += (double) buffers[format].size;
+			if (!same_raw_data_array(&raw_array, &loaded)) {
+				printf("%s: %s raw data differs (MISMATCH)\n", argv[i], format_names[format]);
+				mismatches++;
+			}
+			cpuid_free_raw_data_array(&loaded);
+		}
+		cpus += raw_array.num_raw;
+		cpuid_free_raw_data_array(&raw_array);
+	}
+	for (format = 0; format < NUM_FORMATS; format++)
+		cpuid_free_buffer(&buffers[format]);
+
+	if (cpus == 0)
+		return 1;
+	printf("%ld logical CPUs in %d raw dumps\n", cpus, argc);
+	printf("%-12s %12s %12s %12s\n", "format", "KB", "B/CPU", "us/CPU");
+	for (format = 0; format < NUM_FORMATS; format++)
+		printf("%-12s %12.1f %12.0f %12.3f\n", format_names[format], bytes[format] / 1000.0, bytes[format] / cpus,
+			elapsed_ms[format] * 1000.0 / runs / cpus);
+	return (mismatches > 0) ? 1 : 0;
+}
+
+/* Measures an archive of raw dumps: packing, random lookups and a scan of all its entries, compared to the separate files */
+static int bench_archive(int argc, char** argv)
+{
+	static const char temp_file[] = "libcpuid_benchmark.cpar";
+	static const int lookups = 10000;
+	int i, mismatches = 0;
+	long files_size = 0, cpus = 0;
+	uint32_t index;
+	double start, pack_ms = 0.0, save_ms, open_ms, lookup_ms, scan_ms, files_ms;
+	struct cpu_raw_data_array_t raw_array, archived;
+	struct cpu_raw_data_archive_t archive;
+
+	cpuid_open_raw_data_archive(&archive, NULL);
+	for (i = 0; i < argc; i++) {
+		if (cpuid_deserialize_all_raw_data(&raw_array, argv[i]) < 0) {
+			fprintf(stderr, "%s: %s\n", argv[i], cpuid_error());
+			argv[i] = NULL;
+			continue;
+		}
+		start = now_ms();
+		if (cpuid_add_to_raw_data_archive(&archive, argv[i], &raw_array) < 0)
+			argv[i] = NULL;
+		pack_ms += now_ms() - start;
+		if (argv[i] != NULL)
+			files_size += file_size(argv[i]);
+		cpuid_free_raw_data_array(&raw_array);
+	}
+	start = now_ms();
+	if (cpuid_save_raw_data_archive(&archive, temp_file) < 0) {
+		fprintf(stderr, "cpuid_save_raw_data_archive(): %s\n", cpuid_error());
+		return 1;
+	}
+	save_ms = now_ms() - start;
+	cpuid_close_raw_data_archive(&archive);
+
+	start = now_ms();
+	if (cpuid_open_raw_data_archive(&archive, temp_file) < 0) {
+		fprintf(stderr, "cpuid_open_raw_data_archive(): %s\n", cpuid_error());
+		return 1;
+	}
+	open_ms = now_ms() - start;
+	if (archive.num_entries == 0)
+		return 1;
+
+	/* Every entry must be found, with the same raw data as its file */
+	for (i = 0; i < argc; i++) {
+		if (argv[i] == NULL)
+			continue;
+		cpuid_deserialize_all_raw_data(&raw_array, argv[i]);
+		if ((cpuid_find_in_raw_data_archive(&archive, argv[i], &archived) < 0) || !same_raw_data_array(&raw_array, &archived)) {
+			printf("%s: archived raw data differs (MISMATCH)\n", argv[i]);
+			mismatches++;
+		}
+		cpuid_free_raw_data_array(&raw_array);
+		cpuid_free_raw_data_array(&archived);
+	}
+
+	srand(1);
+	start = now_ms();
+	for (i = 0; i < lookups; i++) {
+		const char* key;
+		cpuid_get_archived_raw_data(&archive, (uint32_t) rand() % archive.num_entries, &key, NULL);
+		cpuid_find_in_raw_data_archive(&archive, key, &archived);
+		cpuid_free_raw_data_array(&archived);
+	}
+	lookup_ms = now_ms() - start;
+
+	start = now_ms();
+	for (index = 0; index < archive.num_entries; index++) {
+		cpuid_get_archived_raw_data(&archive, index, NULL, &archived);
+		cpus += archived.num_raw;
+		cpuid_free_raw_data_array(&archived);
+	}
+	scan_ms = now_ms() - start;
+
+	start = now_ms();
+	for (i = 0; i < argc; i++)
+		if ((argv[i] != NULL) && (cpuid_deserialize_all_raw_data(&raw_array, argv[i]) >= 0))
+			cpuid_free_raw_data_array(&raw_array);
+	files_ms = now_ms() - start;
+
+	printf("%u raw dumps, %ld logical CPUs\n", archive.num_entries, cpus);
+	printf("%-28s %12.1f KB (files: %.1f KB)\n", "archive size", file_size(temp_file) / 1000.0, files_size / 1000.0);
+	printf("%-28s %12.2f us/dump (+ %.3f ms to save)\n", "pack", pack_ms * 1000.0 / archive.num_entries, save_ms);
+	printf("%-28s %12.3f ms\n", "open", open_ms);
+	printf("%-28s %12.2f us\n", "random lookup", lookup_ms * 1000.0 / lookups);
+	printf("%-28s %12.2f us/dump %10.0f CPUs/s\n", "scan archive", scan_ms * 1000.0 / archive.num_entries, cpus * 1000.0 / scan_ms);
+	printf("%-28s %12.2f us/dump %10.0f CPUs/s\n", "scan files", files_ms * 1000.0 / archive.num_entries, cpus * 1000.0 / files_ms);
+	cpuid_close_raw_data_archive(&archive);
+	remove(temp_file);
+	return (mismatches > 0) ? 1 : 0;
+}
+
+/* Measures the JSON emitter on identified raw dumps, in memory and through a file descriptor */
+static int bench_json(int argc, char** argv)
+{
+	enum { COMPACT_BUFFER, PRETTY_BUFFER, COMPACT_FD, NUM_MODES };
+	static const char* mode_names[NUM_MODES] = { "NDJSON buffer", "pretty buffer", "NDJSON fd" };
+	static const int runs = 200;
+	int i, run, mode, fd;
+	long systems = 0;
+	double bytes[NUM_MODES] = { 0 }, elapsed_ms[NUM_MODES] = { 0 };
+	double start;
+	struct cpu_raw_data_array_t raw_array;
+	struct system_id_t system;
+	struct cpuid_buffer_t buffer = { NULL, 0, 0 };
+
+	if ((fd = open("/dev/null", O_WRONLY)) < 0)
+		return 1;
+	for (i = 0; i < argc; i++) {
+		if ((cpuid_deserialize_all_raw_data(&raw_array, argv[i]) < 0) || (cpu_identify_all(&raw_array, &system) < 0)) {
+			fprintf(stderr, "%s: %s\n", argv[i], cpuid_error());
+			continue;
+		}
+		for (mode = 0; mode < NUM_MODES; mode++) {
+			start = now_ms();
+			for (run = 0; run < runs; run++) {
+				buffer.size = 0;
+				if (mode == COMPACT_FD)
+					cpuid_serialize_system_id_json_fd(&system, fd, 0);
+				else
+					cpuid_serialize_system_id_json_buffer(&system, &buffer, (mode == PRETTY_BUFFER) ? CPUID_JSON_PRETTY : 0);
+			}
+			elapsed_ms[mode] += now_ms() - start;
+			bytes[mode]      += (double) buffer.size * runs;
+		}
+		bytes[COMPACT_FD] = bytes[COMPACT_BUFFER];
+		systems += runs;
+		cpuid_free_system_id(&system);
+		cpuid_free_raw_data_array(&raw_array);
+	}
+	cpuid_free_buffer(&buffer);
+	close(fd);
+
+	if (systems == 0)
+		return 1;
+	printf("%ld systems\n", systems / runs);
+	printf("%-16s %12s %12s %12s\n", "mode", "B/system", "us/system", "MB/s");
+	for (mode = 0; mode < NUM_MODES; mode++)
+		printf("%-16s %12.0f %12.3f %12.1f\n", mode_names[mode], bytes[mode] / systems,
+			elapsed_ms[mode] * 1000.0 / systems, bytes[mode] / 1000.0 / elapsed_ms[mode]);
+	return 0;
+}
+
+/* Measures the load time of raw dumps (cpuid_deserialize_all_raw_data()), by compression format of the files */
+static int bench_compressed(int argc, char** argv)
+{
+	enum { PLAIN, XZ, GZIP, ZSTD, NUM_FORMATS };
+	static const char* format_names[NUM_FORMATS] = { "plain", "xz", "gzip", "zstd" };
+	static const int runs = 10;
+	int i, run, format;
+	long dumps[NUM_FORMATS] = { 0 };
+	double bytes[NUM_FORMATS] = { 0 }, elapsed_ms[NUM_FORMATS] = { 0 };
+	double start;
+	unsigned char head[6] = { 0 };
+	FILE* f;
+	struct cpu_raw_data_array_t raw_array;
+
+	for (i = 0; i < argc; i++) {
+		if ((f = fopen(argv[i], "rb")) == NULL)
+			continue;
+		if (fread(head, 1, sizeof(head), f) == 0)
+			head[0] = '\0';
+		fclose(f);
+		if (!memcmp(head, "\xFD" "7zXZ\0", 6))
+			format = XZ;
+		else if ((head[0] == 0x1F) && (head[1] == 0x8B))
+			format = GZIP;
+		else if (!memcmp(head, "\x28\xB5\x2F\xFD", 4))
+			format = ZSTD;
+		else
+			format = PLAIN;
+		start = now_ms();
+		for (run = 0; run < runs; run++) {
+			if (cpuid_deserialize_all_raw_data(&raw_array, argv[i]) < 0) {
+				fprintf(stderr, "%s: %s\n", argv[i], cpuid_error());
+				break;
+			}
+			cpuid_free_raw_data_array(&raw_array);
+		}
+		if (run < runs)
+			continue;
+		elapsed_ms[format] += now_ms() - start;
+		bytes[format]      += (double) file_size(argv[i]);
+		dumps[format]      += runs;
+	}
+
+	printf("%-10s %8s %12s %12s %12s\n", "format", "dumps", "KB on disk", "total ms", "us/dump");
+	for (format = 0; format < NUM_FORMATS; format++)
+		if (dumps[format] > 0)
+			printf("%-10s %8ld %12.0f %12.1f %12.1f\n", format_names[format], dumps[format] / runs, bytes[format] / 1024.0,
+				elapsed_ms[format] / runs, elapsed_ms[format] * 1000.0 / dumps[format]);
+	return 0;
+}
+
+static int bench_cache(int argc, char** argv)
+{
+	int i, runs = (argc > 1) ? atoi(argv[1]) : 100;
+	double start, elapsed;
+	struct cpu_raw_data_array_t reference, raw_array;
+	struct system_id_t system_reference, system;
+
+	if (argc < 1) {
+		fprintf(stderr, "A cache directory is required\n");
+		return 1;
+	}
+
+	start = now_ms();
+	if ((cpuid_get_all_raw_data(&reference) < 0) || (cpu_identify_all(&reference, &system_reference) < 0)) {
+		fprintf(stderr, "cpu_identify_all(): %s\n", cpuid_error());
+		return 1;
+	}
+	elapsed = now_ms() - start;
+	printf("%-10s %12s\n", "mode", "time (ms)");
+	printf("%-10s %12.3f\n", "uncached", elapsed);
+
+	/* The first call writes the cache */
+	if (cpu_identify_all_cached(NULL, &system, argv[0]) < 0) {
+		fprintf(stderr, "cpu_identify_all_cached(): %s\n", cpuid_error());
+		return 1;
+	}
+	cpuid_free_system_id(&system);
+
+	start = now_ms();
+	for (i = 0; i < runs; i++) {
+		cpu_identify_all_cached(&raw_array, &system, argv[0]);
+		if (i < runs - 1) {
+			cpuid_free_raw_data_array(&raw_array);
+			cpuid_free_system_id(&system);
+		}
+	}
+	elapsed = (now_ms() - start) / runs;
+	printf("%-10s %12.3f%s\n", "cached", elapsed,
+		(same_raw_data_array(&reference, &raw_array) && same_system_id(&system_reference, &system)) ? "" : " (MISMATCH)");
+
+	cpuid_free_raw_data_array(&raw_array);
+	cpuid_free_system_id(&system);
+	cpuid_free_raw_data_array(&reference);
+	cpuid_free_system_id(&system_reference);
+	return 0;
+}
+
+/* Compares cpuid_get_all_raw_data() + cpu_identify_all() with cpuid_attach_shared_snapshot() once the snapshot is published */
+static int bench_snapshot(int argc, char** argv)
+{
+	int i, runs = 1000;
+	const char* name = (argc > 0) ? argv[0] : NULL;
+	double start, elapsed;
+	struct cpu_raw_data_array_t reference;
+	struct system_id_t system_reference;
+	struct cpu_snapshot_t snapshot;
+
+	start = now_ms();
+	if ((cpuid_get_all_raw_data(&reference) < 0) || (cpu_identify_all(&reference, &system_reference) < 0)) {
+		fprintf(stderr, "cpu_identify_all(): %s\n", cpuid_error());
+		return 1;
+	}
+	elapsed = now_ms() - start;
+	printf("%-10s %12s\n", "mode", "time (ms)");
+	printf("%-10s %12.3f\n", "local", elapsed);
+
+	if (cpuid_publish_shared_snapshot(name) < 0) {
+		fprintf(stderr, "cpuid_publish_shared_snapshot(): %s\n", cpuid_error());
+		return 1;
+	}
+	start = now_ms();
+	for (i = 0; i < runs; i++) {
+		cpuid_attach_shared_snapshot(&snapshot, name);
+		if (i < runs - 1)
+			cpuid_detach_shared_snapshot(&snapshot);
+	}
+	elapsed = (now_ms() - start) / runs;
+	printf("%-10s %12.3f%s%s\n", "shared", elapsed,
+		snapshot.is_shared ? "" : " (NOT SHARED)",
+		((snapshot.num_raw == reference.num_raw) && !memcmp(snapshot.raw, reference.raw, reference.num_raw * sizeof(struct cpu_raw_data_t)) &&
+		 same_system_id(&system_reference, &snapshot.system)) ? "" : " (MISMATCH)");
+	for (i = 0; i < snapshot.num_raw; i++)
+		if (snapshot.topology[i].os_cpu != reference.raw[i].os_cpu)
+			printf("logical CPU %i: wrong topology (MISMATCH)\n", i);
+	cpuid_detach_shared_snapshot(&snapshot);
+
+	/* Without a published snapshot, the process identifies the system itself */
+	cpuid_unpublish_shared_snapshot(name);
+	start = now_ms();
+	cpuid_attach_shared_snapshot(&snapshot, name);
+	elapsed = now_ms() - start;
+	printf("%-10s %12.3f%s\n", "fallback", elapsed, snapshot.is_shared ? " (SHARED)" : "");
+	cpuid_detach_shared_snapshot(&snapshot);
+
+	cpuid_free_raw_data_array(&reference);
+	cpuid_free_system_id(&system_reference);
+	return 0;
+}
+
+/* Allocators for the "alloc" benchmark: malloc() with a counter, or an arena which is released at once */
+struct alloc_stats_t {
+	int count;
+	char* arena;
+	size_t arena_used, arena_size;
+};
+
+static void* counting_malloc(size_t size, void* user_data)
+{
+	((struct alloc_stats_t*) user_data)->count++;
+	return malloc(size);
+}
+
+static void* counting_realloc(void* ptr, size_t size, void* user_data)
+{
+	((struct alloc_stats_t*) user_data)->count++;
+	return realloc(ptr, size);
+}
+
+static void counting_free(void* ptr, void* user_data)
+{
+	(void) user_data;
+	free(ptr);
+}
+
+static void* arena_malloc(size_t size, void* user_data)
+{
+	struct alloc_stats_t* stats = user_data;
+	/* Each block starts with its size, for arena_realloc() */
+	const size_t block_size = (sizeof(size_t) + size + 15) & ~(size_t) 15;
+	char* block;
+
+	if (stats->arena_used + block_size > stats->arena_size)
+		return NULL;
+	stats->count++;
+	block = stats->arena + stats->arena_used;
+	stats->arena_used += block_size;
+	*(size_t*) block = size;
+	return block + sizeof(size_t);
+}
+
+static void* arena_realloc(void* ptr, size_t size, void* user_data)
+{
+	const size_t old_size = *(size_t*) ((char*) ptr - sizeof(size_t));
+	void* new_ptr = arena_malloc(size, user_data);
+
+	if (new_ptr != NULL)
+		memcpy(new_ptr, ptr, (old_size < size) ? old_size : size);
+	return new_ptr;
+}
+
+static void arena_free(void* ptr, void* user_data)
+{
+	(void) ptr;
+	(void) user_data;
+}
+
+/* Counts the allocations of cpuid_get_all_raw_data() + cpu_identify_all(), and of cpu_identify_all() on a synthetic raw data array
+   (their upper bounds are checked by tests/run_alloc_tests.c) */
+static int bench_alloc(int argc, char** argv)
+{
+	int i, runs = 10;
+	logical_cpu_t num_cpus = (argc > 0) ? (logical_cpu_t) atoi(argv[0]) : 4096;
+	double start, elapsed;
+	struct alloc_stats_t stats = { 0 };
+	struct cpuid_allocator_t counting = { counting_malloc, counting_realloc, counting_free, &stats };
+	struct cpuid_allocator_t arena = { arena_malloc, arena_realloc, arena_free, &stats };
+	struct cpu_raw_data_t raw;
+	struct cpu_raw_data_array_t raw_array, synthetic;
+	struct system_id_t system;
+
+	cpuid_set_allocator(&counting);
+	start = now_ms();
+	if ((cpuid_get_all_raw_data(&raw_array) < 0) || (cpu_identify_all(&raw_array, &system) < 0)) {
+		fprintf(stderr, "cpu_identify_all(): %s\n", cpuid_error());
+		return 1;
+	}
+	elapsed = now_ms() - start;
+	printf("%-24s %9s %10s %12s\n", "operation", "CPUs", "allocs", "time (ms)");
+	printf("%-24s %9u %10d %12.3f\n", "collect+identify", raw_array.num_raw, stats.count, elapsed);
+	cpuid_free_raw_data_array(&raw_array);
+	cpuid_free_system_id(&system);
+
+	/* Synthetic system: the current logical CPU repeated */
+	if (cpuid_get_raw_data(&raw) < 0) {
+		fprintf(stderr, "cpuid_get_raw_data(): %s\n", cpuid_error());
+		return 1;
+	}
+	synthetic.with_affinity = true;
+	synthetic.num_raw       = num_cpus;
+	synthetic.raw           = malloc(num_cpus * sizeof(struct cpu_raw_data_t));
+	for (i = 0; i < num_cpus; i++) {
+		synthetic.raw[i]        = raw;
+		synthetic.raw[i].os_cpu = (logical_cpu_t) i;
+	}
+
+	stats.count = 0;
+	start = now_ms();
+	for (i = 0; i < runs; i++) {
+		cpu_identify_all(&synthetic, &system);
+		if (i < runs - 1)
+			cpuid_free_system_id(&system);
+	}
+	elapsed = (now_ms() - start) / runs;
+	printf("%-24s %9u %10d %12.3f\n", "identify", num_cpus, stats.count / runs, elapsed);
+	cpuid_free_system_id(&system);
+
+	stats.count      = 0;
+	stats.arena_size = 64 * 1024 * 1024;
+	stats.arena      = malloc(stats.arena_size);
+	cpuid_set_allocator(&arena);
+	start = now_ms();
+	for (i = 0; i < runs; i++) {
+		stats.arena_used = 0;
+		cpu_identify_all(&synthetic, &system);
+	}
+	elapsed = (now_ms() - start) / runs;
+	printf("%-24s %9u %10d %12.3f\n", "identify (arena)", num_cpus, stats.count / runs, elapsed);
+	cpuid_set_allocator(NULL);
+
+	free(stats.arena);
+	free(synthetic.raw);
+	return 0;
+}
+
+/* Synthetic system: the current logical CPU repeated, each one with its own APIC ID */
+static int make_synthetic_system(struct cpu_raw_data_array_t* synthetic, logical_cpu_t num_cpus)
+{
+	logical_cpu_t i;
+	struct cpu_raw_data_t raw;
+
+	if (cpuid_get_raw_data(&raw) < 0) {
+		fprintf(stderr, "cpuid_get_raw_data(): %s\n", cpuid_error());
+		return 0;
+	}
+	synthetic->with_affinity = true;
+	synthetic->num_raw       = num_cpus;
+	synthetic->raw           = malloc(num_cpus * sizeof(struct cpu_raw_data_t));
+	for (i = 0; i < num_cpus; i++) {
+		synthetic->raw[i]                   = raw;
+		synthetic->raw[i].os_cpu            = i;
+		synthetic->raw[i].basic_cpuid[1][1] = (raw.basic_cpuid[1][1] & 0x00ffffff) | ((uint32_t) i << 24);
+	}
+	return 1;
+}
+
+/* Compares cpuid_deserialize_all_raw_data() with cpuid_deserialize_all_raw_data_parallel() for 1, 2, 4... threads,
+   on full and delta raw dumps of a synthetic system */
+static int bench_deserialize(int argc, char** argv)
+{
+	enum { FULL, DELTA, NUM_FORMATS };
+	static const char* format_names[NUM_FORMATS] = { "full", "delta" };
+	static const char* temp_files[NUM_FORMATS] = { "libcpuid_benchmark_full.txt", "libcpuid_benchmark_delta.txt" };
+	static const int runs = 5;
+	int run, format, threads, mismatches = 0;
+	logical_cpu_t num_cpus = (argc > 0) ? (logical_cpu_t) atoi(argv[0]) : 4096;
+	int max_threads = (argc > 1) ? atoi(argv[1]) : cpuid_get_total_cpus();
+	double start, elapsed;
+	struct cpu_raw_data_array_t synthetic, loaded;
+
+	if (!make_synthetic_system(&synthetic, num_cpus))
+		return 1;
+	if ((cpuid_serialize_all_raw_data(&synthetic, temp_files[FULL]) < 0) ||
+	    (cpuid_serialize_all_raw_data_delta(&synthetic, temp_files[DELTA]) < 0)) {
+		fprintf(stderr, "cpuid_serialize_all_raw_data(): %s\n", cpuid_error());
+		free(synthetic.raw);
+		return 1;
+	}
+
+	printf("%u logical CPUs\n", num_cpus);
+	printf("%-8s %-10s %7s %12s %10s\n", "format", "mode", "threads", "time (ms)", "us/CPU");
+	for (format = 0; format < NUM_FORMATS; format++) {
+		/* threads = 0 is the sequential reference */
+		for (threads = 0; threads <= max_threads; threads = (threads > 0) ? threads * 2 : 1) {
+			start = now_ms();
+			for (run = 0; run < runs; run++) {
+				if (((threads == 0) ? cpuid_deserialize_all_raw_data(&loaded, temp_files[format]) :
+				     cpuid_deserialize_all_raw_data_parallel(&loaded, temp_files[format], threads)) < 0) {
+					fprintf(stderr, "%s: %s\n", temp_files[format], cpuid_error());
+					mismatches++;
+					break;
+				}
+				if (!same_raw_data_array(&synthetic, &loaded))
+					mismatches++;
+				cpuid_free_raw_data_array(&loaded);
+			}
+			elapsed = (now_ms() - start) / runs;
+			printf("%-8s %-10s %7d %12.3f %10.3f%s\n", format_names[format], (threads == 0) ? "sequential" : "parallel",
+				(threads == 0) ? 1 : threads, elapsed, elapsed * 1000.0 / num_cpus, (mismatches > 0) ? " (MISMATCH)" : "");
+		}
+		remove(temp_files[format]);
+	}
+
+	free(synthetic.raw);
+	return (mismatches > 0) ? 1 : 0;
+}
+
+/* Measures the text serializer on a synthetic system, to a memory buffer, a file descriptor and a file */
+static int bench_serialize(int argc, char** argv)
+{
+	enum { BUFFER, DELTA_BUFFER, FD, FILENAME, NUM_TARGETS };
+	static const char* target_names[NUM_TARGETS] = { "buffer", "delta buffer", "fd", "file" };
+	static const char temp_file[] = "libcpuid_benchmark_serialize.txt";
+	static const int runs = 10;
+	int run, target, fd, r = 0, mismatches = 0;
+	logical_cpu_t num_cpus = (argc > 0) ? (logical_cpu_t) atoi(argv[0]) : 4096;
+	double start, elapsed;
+	long size = 0;
+	struct cpu_raw_data_array_t synthetic;
+	char* content;
+	struct cpuid_buffer_t buffer = { NULL, 0, 0 }, reference = { NULL, 0, 0 };
+	FILE* f;
+
+	if (!make_synthetic_system(&synthetic, num_cpus))
+		return 1;
+	cpuid_serialize_all_raw_data_buffer(&synthetic, &reference);
+
+	printf("%u logical CPUs\n", num_cpus);
+	printf("%-14s %12s %12s %10s %10s\n", "target", "KB", "time (ms)", "us/CPU", "MB/s");
+	for (target = 0; target < NUM_TARGETS; target++) {
+		start = now_ms();
+		for (run = 0; run < runs; run++) {
+			buffer.size = 0;
+			switch (target) {
+				case BUFFER:
+					r = cpuid_serialize_all_raw_data_buffer(&synthetic, &buffer);
+					size = (long) buffer.size;
+					break;
+				case DELTA_BUFFER:
+					r = cpuid_serialize_all_raw_data_delta_buffer(&synthetic, &buffer);
+					size = (long) buffer.size;
+					break;
+				case FD:
+					fd = open(temp_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+					r = cpuid_serialize_all_raw_data_fd(&synthetic, fd);
+					close(fd);
+					size = file_size(temp_file);
+					break;
+				case FILENAME:
+					r = cpuid_serialize_all_raw_data(&synthetic, temp_file);
+					size = file_size(temp_file);
+					break;
+			}
+			if (r < 0) {
+				fprintf(stderr, "%s: %s\n", target_names[target], cpuid_error());
+				mismatches++;
+				break;
+			}
+		}
+		elapsed = (now_ms() - start) / runs;
+		/* Files must have the same content as the buffer */
+		if ((target == FD) || (target == FILENAME)) {
+			content = malloc(reference.size);
+			if (((f = fopen(temp_file, "rb")) == NULL) || ((size_t) size != reference.size) ||
+			    (fread(content, 1, reference.size, f) != reference.size) || memcmp(content, reference.data, reference.size))
+				mismatches++;
+			if (f != NULL)
+				fclose(f);
+			free(content);
+		}
+		printf("%-14s %12.1f %12.3f %10.3f %10.1f%s\n", target_names[target], size / 1000.0, elapsed, elapsed * 1000.0 / num_cpus,
+			size / 1000.0 / elapsed, (mismatches > 0) ? " (MISMATCH)" : "");
+	}
+	remove(temp_file);
+
+	cpuid_free_buffer(&buffer);
+	cpuid_free_buffer(&reference);
+	free(synthetic.raw);
+	return (mismatches > 0) ? 1 : 0;
+}
+
+/* Measures cpu_identify() (decoding and codename lookup) on the first logical CPU of each raw dump, grouped by vendor */
+static int bench_identify(int argc, char** argv)
+{
+	static const int runs = 200;
+	int i, run, vendor, num_vendors = 0;
+	char vendor_names[NUM_CPU_VENDORS][VENDOR_STR_MAX] = { "" };
+	long lookups[NUM_CPU_VENDORS] = { 0 };
+	double elapsed_ms[NUM_CPU_VENDORS] = { 0 };
+	double start;
+	struct cpu_raw_data_array_t raw_array;
+	struct cpu_id_t id;
+
+	for (i = 0; i < argc; i++) {
+		if ((cpuid_deserialize_all_raw_data(&raw_array, argv[i]) < 0) || (raw_array.num_raw == 0))
+			continue;
+		if ((cpu_identify(&raw_array.raw[0], &id) < 0) || (id.vendor < 0) || (id.vendor >= NUM_CPU_VENDORS)) {
+			cpuid_free_raw_data_array(&raw_array);
+			continue;
+		}
+		vendor = id.vendor;
+		strcpy(vendor_names[vendor], id.vendor_str);
+		start = now_ms();
+		for (run = 0; run < runs; run++)
+			cpu_identify(&raw_array.raw[0], &id);
+		elapsed_ms[vendor] += now_ms() - start;
+		lookups[vendor]    += runs;
+		cpuid_free_raw_data_array(&raw_array);
+	}
+
+	printf("%-14s %8s %12s\n", "vendor", "dumps", "us/identify");
+	for (vendor = 0; vendor < NUM_CPU_VENDORS; vendor++)
+		if (lookups[vendor] > 0) {
+			num_vendors++;
+			printf("%-14s %8ld %12.3f\n", vendor_names[vendor], lookups[vendor] / runs, elapsed_ms[vendor] * 1000.0 / lookups[vendor]);
+		}
+	return (num_vendors > 0) ? 0 : 1;
+}
+
+/* Measures cpu_identify_all() on a synthetic system with several packages: the current logical CPU repeated,
+   with the x2APIC IDs of leaves 01h and 0Bh (2 threads per core), for 256, 512... logical CPUs.
+   The number of cores must be half the number of logical CPUs */
+static int bench_identify_all(int argc, char** argv)
+{
+	static const int runs = 20;
+	int run, ret = 0, num_packages = (argc > 1) ? atoi(argv[1]) : 8;
+	int32_t num_cores;
+	logical_cpu_t i, num_cpus, max_cpus = (argc > 0) ? (logical_cpu_t) atoi(argv[0]) : 2048, cpus_per_package;
+	uint32_t apic_id, core_shift;
+	double start, elapsed;
+	struct cpu_raw_data_array_t synthetic;
+	struct cpu_raw_data_t* raw;
+	struct system_id_t system;
+
+	printf("%9s %9s %10s %9s %12s %10s\n", "CPUs", "packages", "CPU types", "cores", "time (ms)", "us/CPU");
+	for (num_cpus = 256; num_cpus <= max_cpus; num_cpus *= 2) {
+		if (!make_synthetic_system(&synthetic, num_cpus))
+			return 1;
+		cpus_per_package = (num_cpus + num_packages - 1) / num_packages;
+		for (core_shift = 0; (1U << core_shift) < cpus_per_package; core_shift++);
+		for (i = 0; i < num_cpus; i++) {
+			raw     = &synthetic.raw[i];
+			apic_id = ((i / cpus_per_package) << core_shift) | (i % cpus_per_package);
+			/* Registers: 0 = EAX, 1 = EBX, 2 = ECX, 3 = EDX */
+			raw->basic_cpuid[1][1] = (raw->basic_cpuid[1][1] & 0x00ffffff) | ((apic_id & 0xff) << 24);
+			raw->intel_fn11[0][0] = 1;          raw->intel_fn11[0][1] = 2;
+			raw->intel_fn11[0][2] = 0x100;      raw->intel_fn11[0][3] = apic_id;
+			raw->intel_fn11[1][0] = core_shift; raw->intel_fn11[1][1] = cpus_per_package;
+			raw->intel_fn11[1][2] = 0x201;      raw->intel_fn11[1][3] = apic_id;
+			raw->intel_fn11[2][0] = 0;          raw->intel_fn11[2][1] = 0;
+			memcpy(raw->basic_cpuid[11], raw->intel_fn11[0], sizeof(raw->basic_cpuid[11]));
+		}
+		start = now_ms();
+		for (run = 0; run < runs; run++) {
+			if (cpu_identify_all(&synthetic, &system) < 0) {
+				fprintf(stderr, "cpu_identify_all(): %s\n", cpuid_error());
+				free(synthetic.raw);
+				return 1;
+			}
+			if (run < runs - 1)
+				cpuid_free_system_id(&system);
+		}
+		elapsed = (now_ms() - start) / runs;
+		for (num_cores = 0, run = 0; run < system.num_cpu_types; run++)
+			num_cores += system.cpu_types[run].num_cores;
+		printf("%9u %9d %10u %9i %12.3f %10.3f%s\n", num_cpus, num_packages, system.num_cpu_types, num_cores, elapsed, elapsed * 1000.0 / num_cpus,
+			(2 * num_cores == num_cpus) ? "" : " (MISMATCH)");
+		ret |= 2 * num_cores != num_cpus;
+		cpuid_free_system_id(&system);
+		free(synthetic.raw);
+	}
+	return ret;
+}
+
+/* Byte-array equivalents of the feature set functions, on cpu_id_t.flags */
+static bool flags_have_all(const uint8_t* flags, const cpu_feature_t* features, int num_features)
+{
+	int i;
+
+	for (i = 0; i < num_features; i++)
+		if (!flags[features[i]])
+			return false;
+	return true;
+}
+
+static int flags_count(const uint8_t* flags)
+{
+	int i, count = 0;
+
+	for (i = 0; i < CPU_FLAGS_MAX; i++)
+		count += flags[i] != 0;
+	return count;
+}
+
+static bool same_features(const uint8_t* flags, const cpu_feature_set_t* set)
+{
+	cpu_feature_set_t from_flags;
+
+	cpu_feature_set_from_flags(&from_flags, flags);
+	return !memcmp(&from_flags, set, sizeof(from_flags));
+}
+
+/* Compares the feature set functions with the byte-array equivalents on the CPU types of raw dumps (e.g. tests/):
+   "all of 30 features" for each CPU type, the features common to the fleet, the features of any CPU type,
+   the features of each CPU type missing on the first one, the count of features, and the iteration over them */
+static int bench_feature_set(int argc, char** argv)
+{
+	static const int runs = 2000;
+	static const cpu_feature_t needed[] = {
+		CPU_FEATURE_FPU, CPU_FEATURE_TSC, CPU_FEATURE_CX8, CPU_FEATURE_APIC, CPU_FEATURE_CMOV, CPU_FEATURE_CLFLUSH,
+		CPU_FEATURE_MMX, CPU_FEATURE_FXSR, CPU_FEATURE_SSE, CPU_FEATURE_SSE2, CPU_FEATURE_PNI, CPU_FEATURE_PCLMUL,
+		CPU_FEATURE_SSSE3, CPU_FEATURE_FMA3, CPU_FEATURE_CX16, CPU_FEATURE_SSE4_1, CPU_FEATURE_SSE4_2, CPU_FEATURE_MOVBE,
+		CPU_FEATURE_POPCNT, CPU_FEATURE_AES, CPU_FEATURE_XSAVE, CPU_FEATURE_OSXSAVE, CPU_FEATURE_AVX, CPU_FEATURE_F16C,
+		CPU_FEATURE_RDRAND, CPU_FEATURE_LM, CPU_FEATURE_BMI1, CPU_FEATURE_AVX2, CPU_FEATURE_BMI2, CPU_FEATURE_ABM,
+	};
+	const int num_needed = sizeof(needed) / sizeof(needed[0]);
+	int i, j, run, num_ids = 0, errors = 0, feature;
+	long sink = 0;
+	double start, bytes_ms, set_ms;
+	uint8_t flags[CPU_FLAGS_MAX];
+	cpu_feature_set_t needed_set, set;
+	struct cpu_raw_data_array_t raw_array;
+	struct system_id_t system;
+	struct cpu_id_t* ids = NULL;
+
+	for (i = 0; i < argc; i++) {
+		if ((cpuid_deserialize_all_raw_data(&raw_array, argv[i]) < 0) || (cpu_identify_all(&raw_array, &system) < 0)) {
+			cpuid_free_raw_data_array(&raw_array);
+			continue;
+		}
+		ids = realloc(ids, (num_ids + system.num_cpu_types) * sizeof(struct cpu_id_t));
+		for (j = 0; j < system.num_cpu_types; j++)
+			ids[num_ids++] = system.cpu_types[j];
+		cpuid_free_system_id(&system);
+		cpuid_free_raw_data_array(&raw_array);
+	}
+	if (num_ids == 0) {
+		fprintf(stderr, "No CPU types in the raw dumps\n");
+		return 1;
+	}
+	cpu_feature_set_clear(&needed_set);
+	for (i = 0; i < num_needed; i++)
+		cpu_feature_set_add(&needed_set, needed[i]);
+	printf("%d CPU types\n%-24s %12s %12s\n", num_ids, "operation", "bytes (ns)", "set (ns)");
+
+	/* All of the needed features */
+	start = now_ms();
+	for (run = 0; run < runs; run++)
+		for (i = 0; i < num_ids; i++)
+			sink += flags_have_all(ids[i].flags, needed, num_needed);
+	bytes_ms = now_ms() - start;
+	start = now_ms();
+	for (run = 0; run < runs; run++)
+		for (i = 0; i < num_ids; i++)
+			sink += cpu_feature_set_is_subset(&needed_set, &ids[i].feature_set);
+	set_ms = now_ms() - start;
+	for (i = 0; i < num_ids; i++)
+		errors += flags_have_all(ids[i].flags, needed, num_needed) != cpu_feature_set_is_subset(&needed_set, &ids[i].feature_set);
+	printf("%-24s %12.2f %12.2f\n", "subset (30 features)", bytes_ms * 1e6 / runs / num_ids, set_ms * 1e6 / runs / num_ids);
+
+	/* Features common to all CPU types */
+	start = now_ms();
+	for (run = 0; run < runs; run++) {
+		memcpy(flags, ids[0].flags, sizeof(flags));
+		for (i = 1; i < num_ids; i++)
+			for (j = 0; j < CPU_FLAGS_MAX; j++)
+				flags[j] &= ids[i].flags[j];
+		sink += flags[run % CPU_FLAGS_MAX];
+	}
+	bytes_ms = now_ms() - start;
+	start = now_ms();
+	for (run = 0; run < runs; run++) {
+		set = ids[0].feature_set;
+		for (i = 1; i < num_ids; i++)
+			cpu_feature_set_intersection(&set, &set, &ids[i].feature_set);
+		sink += (long) set.bits[run % CPU_FEATURE_SET_WORDS];
+	}
+	set_ms = now_ms() - start;
+	errors += !same_features(flags, &set);
+	printf("%-24s %12.2f %12.2f\n", "intersection", bytes_ms * 1e6 / runs / num_ids, set_ms * 1e6 / runs / num_ids);
+
+	/* Features of any CPU type */
+	start = now_ms();
+	for (run = 0; run < runs; run++) {
+		memcpy(flags, ids[0].flags, sizeof(flags));
+		for (i = 1; i < num_ids; i++)
+			for (j = 0; j < CPU_FLAGS_MAX; j++)
+				flags[j] |= ids[i].flags[j];
+		sink += flags[run % CPU_FLAGS_MAX];
+	}
+	bytes_ms = now_ms() - start;
+	start = now_ms();
+	for (run = 0; run < runs; run++) {
+		set = ids[0].feature_set;
+		for (i = 1; i < num_ids; i++)
+			cpu_feature_set_union(&set, &set, &ids[i].feature_set);
+		sink += (long) set.bits[run % CPU_FEATURE_SET_WORDS];
+	}
+	set_ms = now_ms() - start;
+	errors += !same_features(flags, &set);
+	printf("%-24s %12.2f %12.2f\n", "union", bytes_ms * 1e6 / runs / num_ids, set_ms * 1e6 / runs / num_ids);
+
+	/* Features of each CPU type missing on the first one */
+	start = now_ms();
+	for (run = 0; run < runs; run++)
+		for (i = 0; i < num_ids; i++) {
+			for (j = 0; j < CPU_FLAGS_MAX; j++)
+				flags[j] = (ids[i].flags[j] != 0) & (ids[0].flags[j] == 0);
+			sink += flags[run % CPU_FLAGS_MAX];
+		}
+	bytes_ms = now_ms() - start;
+	start = now_ms();
+	for (run = 0; run < runs; run++)
+		for (i = 0; i < num_ids; i++) {
+			cpu_feature_set_difference(&set, &ids[i].feature_set, &ids[0].feature_set);
+			sink += (long) set.bits[run % CPU_FEATURE_SET_WORDS];
+		}
+	set_ms = now_ms() - start;
+	errors += !same_features(flags, &set);
+	printf("%-24s %12.2f %12.2f\n", "difference", bytes_ms * 1e6 / runs / num_ids, set_ms * 1e6 / runs / num_ids);
+
+	/* Number of features */
+	start = now_ms();
+	for (run = 0; run < runs; run++)
+		for (i = 0; i < num_ids; i++)
+			sink += flags_count(ids[i].flags);
+	bytes_ms = now_ms() - start;
+	start = now_ms();
+	for (run = 0; run < runs; run++)
+		for (i = 0; i < num_ids; i++)
+			sink += cpu_feature_set_count(&ids[i].feature_set);
+	set_ms = now_ms() - start;
+	for (i = 0; i < num_ids; i++)
+		errors += flags_count(ids[i].flags) != cpu_feature_set_count(&ids[i].feature_set);
+	printf("%-24s %12.2f %12.2f\n", "count", bytes_ms * 1e6 / runs / num_ids, set_ms * 1e6 / runs / num_ids);
+
+	/* Iteration over the features */
+	start = now_ms();
+	for (run = 0; run < runs; run++)
+		for (i = 0; i < num_ids; i++)
+			for (j = 0; j < CPU_FLAGS_MAX; j++)
+				if (ids[i].flags[j])
+					sink += j;
+	bytes_ms = now_ms() - start;
+	start = now_ms();
+	for (run = 0; run < runs; run++)
+		for (i = 0; i < num_ids; i++)
+			for (feature = cpu_feature_set_next(&ids[i].feature_set, -1); feature >= 0; feature = cpu_feature_set_next(&ids[i].feature_set, feature))
+				sink += feature;
+	set_ms = now_ms() - start;
+	for (i = 0; i < num_ids; i++) {
+		for (j = 0, feature = cpu_feature_set_next(&ids[i].feature_set, -1); j < CPU_FLAGS_MAX; j++)
+			if (ids[i].flags[j]) {
+				errors += feature != j;
+				feature = cpu_feature_set_next(&ids[i].feature_set, feature);
+			}
+		errors += feature != -1;
+	}
+	printf("%-24s %12.2f %12.2f\n", "iteration", bytes_ms * 1e6 / runs / num_ids, set_ms * 1e6 / runs / num_ids);
+
+	printf("%s (%ld)\n", (errors == 0) ? "Same results" : "DIFFERENT RESULTS", sink);
+	free(ids);
+	return (errors == 0) ? 0 : 1;
+}
+
+static const struct {
+	const char* name;
+	const char* args;
+	int (*run)(int argc, char** argv);
+} benchmarks[] = {
+	{ "collect", "[max_threads]", bench_collect },
+	{ "layout",  "<raw dumps...>", bench_layout },
+	{ "compact", "<raw dumps...>", bench_compact },
+	{ "cache",   "<cache directory> [runs]", bench_cache },
+	{ "snapshot", "[shared memory name]", bench_snapshot },
+	{ "alloc",   "[synthetic CPUs]", bench_alloc },
+	{ "binary",  "<raw dumps...>", bench_binary },
+	{ "parse",   "<raw dumps...>", bench_parse },
+	{ "memory",  "<raw dumps...>", bench_memory },
+	{ "delta",   "<raw dumps...>", bench_delta },
+	{ "archive", "<raw dumps...>", bench_archive },
+	{ "json",    "<raw dumps...>", bench_json },
+	{ "compressed", "<raw dumps (plain, xz, gzip or zstd)...>", bench_compressed },
+	{ "deserialize", "[synthetic CPUs] [max_threads]", bench_deserialize },
+	{ "serialize", "[synthetic CPUs]", bench_serialize },
+	{ "identify", "<raw dumps...>", bench_identify },
+	{ "identify_all", "[max synthetic CPUs] [packages]", bench_identify_all },
+	{ "feature_set", "<raw dumps...>", bench_feature_set },
+};
+
+int main(int argc, char** argv)
+{
+	unsigned i;
+
+	if (argc >= 2)
+		for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+			if (!strcmp(argv[1], benchmarks[i].name))
+				return benchmarks[i].run(argc - 2, argv + 2);
+
+	printf("Usage: %s <benchmark> [arguments...]\n\nAvailable benchmarks:\n", argv[0]);
+	for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+		printf("  %s %s\n", benchmarks[i].name, benchmarks[i].args);
+	return 1;
+}